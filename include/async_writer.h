@@ -0,0 +1,81 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+extern "C" {
+#include <libavformat/avio.h>
+}
+
+// 异步输出写入参数
+struct AsyncWriterParams {
+    size_t buffer_size = 1 << 20;   // 每块大小（向上对齐到4KB），顺序写满一块才提交一次
+    int buffer_count = 8;           // 缓冲块数：全部在途时封装线程才会等待磁盘
+    bool direct_io = false;         // 整块对齐写入走O_DIRECT（不支持的文件系统自动回退）
+    int64_t preallocate_bytes = 0;  // 预分配的预计文件大小（fallocate），0表示不预分配
+};
+
+// 异步文件输出：自定义AVIOContext把数据攒成大块对齐缓冲，交给独立写线程pwrite
+// - 每块携带文件偏移，avio回写（MP4回填moov等）无需等待在途数据落盘，写线程按提交顺序执行保证覆盖正确
+// - 预分配不改变文件大小（FALLOC_FL_KEEP_SIZE），关闭时截断到实际长度，多估的空间会被释放
+// - close()之前已写数据不保证在文件中：写尾时需要重新打开文件读回内容的用法（MP4 +faststart）不能使用
+class AsyncFileWriter {
+public:
+    AsyncFileWriter() = default;
+    ~AsyncFileWriter();
+
+    AsyncFileWriter(const AsyncFileWriter&) = delete;
+    AsyncFileWriter& operator=(const AsyncFileWriter&) = delete;
+
+    // 创建/覆盖输出文件并启动写线程
+    bool open(const char* filename, const AsyncWriterParams& params);
+
+    // 交给avformat使用的IO上下文（可寻址），由本对象负责释放
+    AVIOContext* avio_context() const { return avio_; }
+
+    // 刷出剩余数据、等待写线程结束并关闭文件；返回false表示有写入失败。析构时自动调用
+    bool close();
+
+    int64_t bytes_written() const { return file_size_; }
+
+private:
+    struct Block {
+        uint8_t* data = nullptr;
+        int64_t offset = 0;  // 该块在文件中的起始偏移
+        size_t size = 0;
+    };
+
+    static int write_packet(void* opaque, uint8_t* data, int size);
+    static int64_t seek(void* opaque, int64_t offset, int whence);
+
+    int write(const uint8_t* data, int size);
+    bool acquire_block();   // 取一个空闲块作为当前块（全部在途时等待）
+    void submit_block();    // 提交当前块（非空）给写线程
+    void writer_loop();
+    bool write_fully(int fd, const uint8_t* data, size_t size, int64_t offset);
+
+    AVIOContext* avio_ = nullptr;
+    int fd_ = -1;
+    int direct_fd_ = -1;
+    size_t block_size_ = 0;
+
+    // 以下仅由封装线程访问
+    Block current_;
+    int64_t position_ = 0;   // avio的逻辑写位置
+    int64_t file_size_ = 0;  // 已写出的最大偏移（逻辑文件长度）
+
+    // 封装线程与写线程共享
+    std::vector<uint8_t*> buffers_;
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    std::vector<uint8_t*> free_blocks_;
+    std::deque<Block> pending_;
+    bool stopping_ = false;
+    bool failed_ = false;
+    std::thread writer_thread_;
+};
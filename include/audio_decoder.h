@@ -1,5 +1,6 @@
 #pragma once
 #include "queue.h"
+#include "pipeline_metrics.h"
 
 extern "C" {
 #include <libavcodec/avcodec.h>
@@ -13,4 +14,5 @@ void audio_decode_thread_func(AudioPacketQueue* audio_packet_queue,
 // 新的解码到Frame队列函数（用于完整转码流程）
 void audio_decode_to_frames_thread_func(AudioPacketQueue* audio_packet_queue,
                                         AudioFrameQueue* audio_frame_queue,
-                                        AVCodecParameters* codec_params);
\ No newline at end of file
+                                        AVCodecParameters* codec_params,
+                                        StageMetrics* metrics = nullptr);
\ No newline at end of file
@@ -1,6 +1,8 @@
 #pragma once
 
 #include "queue.h"
+#include "pipeline_metrics.h"
+#include "audio_resampler.h"
 #include <memory>
 
 extern "C" {
@@ -24,6 +26,12 @@ struct AudioEncoderParams {
     AVCodecID codec_id = AV_CODEC_ID_AC3;  // 默认AC3
     AVSampleFormat sample_format = AV_SAMPLE_FMT_FLTP;
     uint64_t channel_layout = AV_CH_LAYOUT_STEREO;
+    
+    // 容器要求全局头时置位；parameters_out非空时编码器打开后向封装器发布流参数
+    bool global_header = false;
+    CodecParametersSlot* parameters_out = nullptr;
+    
+    StageMetrics* metrics = nullptr;  // 可选的阶段指标
 };
 
 // 音频编码器抽象基类接口（编码规则强制要求）
@@ -34,7 +42,7 @@ public:
     // 初始化编码器
     virtual bool initialize(const AudioEncoderParams& params) = 0;
     
-    // 编码单个音频帧
+    // 编码单个音频帧；出错或输出队列已结束（封装线程已退出）时返回false
     virtual bool encode_frame(AVFrame* frame, EncodedAudioPacketQueue* output_queue) = 0;
     
     // 刷新编码器（获取延迟的包）
@@ -44,6 +52,9 @@ public:
     virtual const char* get_encoder_name() const = 0;
     virtual AVCodecID get_codec_id() const = 0;
     
+    // 已打开的编码器上下文（透传模式为nullptr）
+    const AVCodecContext* get_codec_context() const { return codec_context_; }
+    
 protected:
     AudioEncoderParams params_;
     AVCodecContext* codec_context_ = nullptr;
@@ -105,6 +116,13 @@ public:
 // 音频编码器工厂函数（编码规则强制要求）
 std::unique_ptr<IAudioEncoder> create_audio_encoder(TargetAudioFormat format);
 
+// 查询编码器原生输入格式：优先FLTP，采样率取最接近的受支持值，声道数不超过编码器上限
+// frame_size返回编码器要求的每帧样本数（0表示不限制）
+bool query_audio_encoder_native_format(TargetAudioFormat format,
+                                       const AudioFormatSpec& preferred,
+                                       AudioFormatSpec& native,
+                                       int& frame_size);
+
 // 新的基于工厂模式的音频编码线程函数
 void audio_encode_thread_func_factory(AudioFrameQueue* audio_frame_queue, 
                                       EncodedAudioPacketQueue* encoded_audio_queue,
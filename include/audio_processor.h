@@ -1,6 +1,8 @@
 #pragma once
 
 #include "queue.h"
+#include "pipeline_metrics.h"
+#include "audio_resampler.h"
 #include <memory>
 #include <vector>
 #include <mutex>
@@ -48,6 +50,11 @@ struct AudioProcessParams {
     // 音频变速参数（新增）
     bool enable_speed_change = false;
     double speed_factor = 1.0;    // 变速倍数，1.0表示正常速度，2.0表示2倍速，0.5表示半速
+    
+    // 输出帧样本数，需与编码器frame_size一致（AC3=1536, AAC=1024, MP3=1152）
+    int output_frame_size = 1536;
+    
+    StageMetrics* metrics = nullptr;  // 可选的阶段指标
 };
 
 // 环形缓冲区类（用于处理音频数据流和固定frame_size需求）
@@ -102,7 +109,7 @@ public:
                    int input_channels,
                    AVSampleFormat input_format);
     
-    // 处理音频帧
+    // 处理音频帧；失败或输出队列已结束（下游退出，未送出的帧已释放）时返回false
     bool process_frame(AVFrame* input_frame, AudioFrameQueue* output_queue);
     
     // 刷新处理器
@@ -125,6 +132,15 @@ private:
     int input_channels_;
     AVSampleFormat input_format_;
     
+    // 处理阶段的采样率/声道（启用重采样时为目标值）及输出帧大小
+    int process_sample_rate_;
+    int process_channels_;
+    int output_frame_size_;
+    
+    // 输入格式转换：任意解码格式 → 交错float
+    std::unique_ptr<AudioResampler> input_converter_;
+    std::vector<float> float_samples_;
+    
     // 音频变速相关（新增）
     std::unique_ptr<soundtouch::SoundTouch> sound_touch_;
     std::unique_ptr<AudioRingBuffer> ring_buffer_;
@@ -135,6 +151,7 @@ private:
     int64_t last_input_pts_;
     int64_t processed_samples_count_;
     int64_t first_input_pts_;  // 第一个输入帧的时间戳，作为时间基准
+    int64_t scratch_bytes_ = 0;  // 已计入阶段指标的缓冲字节数
     
     // 内部函数
     bool setup_filter_graph();
@@ -145,7 +162,9 @@ private:
     bool process_frame_with_speed(AVFrame* input_frame, AudioFrameQueue* output_queue);
     bool process_samples_through_soundtouch(const float* input_samples, int num_samples, AudioFrameQueue* output_queue);
     bool process_samples_through_soundtouch_with_frame_pts(const float* input_samples, int num_samples, int64_t input_pts, AudioFrameQueue* output_queue);
+    bool drain_soundtouch(AudioFrameQueue* output_queue);
     AVFrame* create_output_frame(const float* samples, int num_samples, int64_t pts);
+    void update_scratch();  // 按当前缓冲用量更新阶段指标的临时缓冲计量
     
     // 时间戳计算（严格遵循 new_pts = original_pts / speed_factor）
     int64_t calculate_new_pts(int64_t original_pts) const;
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavutil/channel_layout.h>
+#include <libswresample/swresample.h>
+}
+
+// 音频格式描述：采样率 + 声道数 + 采样格式
+struct AudioFormatSpec {
+    int sample_rate = 48000;
+    int channels = 2;
+    AVSampleFormat sample_format = AV_SAMPLE_FMT_FLTP;
+};
+
+// 常用采样格式转换内核（SSE2加速，其他平台回退到标量实现）
+namespace audio_convert {
+
+// 交错float → 平面float（LRLR... → LLLL.../RRRR...）
+void deinterleave_float(const float* src, float* const* dst, int channels, int num_samples);
+
+// 平面float → 交错float
+void interleave_float(const float* const* src, float* dst, int channels, int num_samples);
+
+// 整型 → float，count为样本总数（所有声道）
+void s16_to_float(const int16_t* src, float* dst, int count);
+void s32_to_float(const int32_t* src, float* dst, int count);
+
+// 是否存在快速路径（采样率、声道不变，仅格式转换）
+bool has_fast_path(AVSampleFormat input, AVSampleFormat output);
+
+// 将S16/S16P/S32/S32P/FLT/FLTP帧转换为交错float，scratch用于平面整型的中间结果
+bool frame_to_interleaved_float(const AVFrame* frame, float* dst, std::vector<float>& scratch);
+
+// 将交错float写入FLT或FLTP格式的帧
+bool interleaved_float_to_frame(const float* src, AVFrame* frame);
+
+} // namespace audio_convert
+
+// 音频格式转换/重采样器
+// 仅格式变化时走SIMD快速路径，采样率或声道布局变化时使用swr
+class AudioResampler {
+public:
+    AudioResampler();
+    ~AudioResampler();
+
+    AudioResampler(const AudioResampler&) = delete;
+    AudioResampler& operator=(const AudioResampler&) = delete;
+
+    // 初始化转换器；input_layout为输入声道布局（nullptr按声道数取默认布局）
+    bool initialize(const AudioFormatSpec& input, const AudioFormatSpec& output,
+                    const AVChannelLayout* input_layout = nullptr);
+
+    // 转换单帧，返回新分配的帧（调用者负责释放），失败返回nullptr
+    AVFrame* convert(const AVFrame* input_frame);
+
+    // 转换为交错float（供SoundTouch使用），num_samples返回每声道样本数
+    bool convert_to_interleaved_float(const AVFrame* input_frame,
+                                      std::vector<float>& output, int& num_samples);
+
+    // 刷出swr内部缓存的样本为一个输出格式的帧（调用者负责释放），无剩余样本或无swr时返回nullptr
+    // 包含输入格式变化时从旧重采样器排空、尚未随convert输出的样本
+    AVFrame* flush();
+
+    // 刷出swr内部缓存的样本（交错float），无剩余样本时num_samples为0
+    bool flush_interleaved_float(std::vector<float>& output, int& num_samples);
+
+    // 输入输出格式完全一致，无需任何转换
+    bool is_passthrough() const { return passthrough_; }
+
+    // 采样率或声道数发生变化
+    bool needs_resample() const { return swr_ctx_ != nullptr; }
+
+    const AudioFormatSpec& input_spec() const { return input_; }
+    const AudioFormatSpec& output_spec() const { return output_; }
+
+    void cleanup();
+
+private:
+    // 输入帧参数（含声道布局）与初始化时不一致时重新配置（解码器中途变更格式），
+    // 旧重采样器中缓存的样本先排空到pending_，随下一次输出一起送出，不产生空缺
+    bool ensure_input_matches(const AVFrame* input_frame);
+    bool setup_swr();
+    int64_t next_output_pts(const AVFrame* input_frame, int output_samples);
+    AVFrame* drain_swr();                      // 排空swr为一个输出格式的帧，无样本返回nullptr
+    AVFrame* prepend_pending(AVFrame* frame);  // 把pending_拼在frame之前（frame为nullptr时单独返回）
+    void prepend_pending_float(std::vector<float>& output, int& num_samples);  // 同上，交错float输出
+
+    AudioFormatSpec input_;
+    AudioFormatSpec output_;
+    AVChannelLayout input_layout_;
+    SwrContext* swr_ctx_;
+    AVFrame* pending_;                 // 格式变化时从旧重采样器排空的样本（输出格式）
+    bool passthrough_;
+    bool initialized_;
+
+    std::vector<float> scratch_;       // 平面整型转换的中间缓冲区
+    std::vector<float> interleaved_;   // 快速路径的交错float缓冲区
+    int64_t next_pts_;                 // 重采样路径下的输出时间戳（输出采样率为单位）
+};
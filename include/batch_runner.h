@@ -0,0 +1,73 @@
+#pragma once
+
+#include "metrics_exporter.h"
+#include "transcode_job.h"
+#include <atomic>
+#include <condition_variable>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+/**
+ * 批处理全局预算：同一进程内的所有任务共享
+ * - 核心按任务均分（每个任务的TranscodeOptions::total_cores），并发数受核心与内存预算共同限制
+ * - 单个任务的估算内存超过预算时，只在没有其他任务运行时才放行（避免永远排不上）
+ */
+struct BatchParams {
+    int total_cores = 0;             // 0表示全部核心
+    int64_t memory_budget_bytes = 0; // 0表示不限制
+    int max_concurrent_jobs = 0;     // 0表示按核心数自动（每个任务至少2个核心）
+    int poll_interval_ms = 1000;     // 监视目录的轮询间隔
+    MetricsParams metrics;           // 全部任务共用一个指标导出（端口/文件均未设置时不导出）
+    CommandLine defaults;            // 每个任务行的默认开关（任务行中的同名开关优先）
+};
+
+/**
+ * 常驻批处理：一个进程内并发执行多个TranscodeJob，替代每个文件启动一个进程
+ * 任务行格式与命令行一致：<输入> <输出> [位置参数...] [--选项...]，支持双引号，空行与#开头的行忽略
+ */
+class BatchRunner {
+public:
+    explicit BatchRunner(const BatchParams& params);
+    ~BatchRunner();  // 等待所有已启动的任务结束
+
+    BatchRunner(const BatchRunner&) = delete;
+    BatchRunner& operator=(const BatchRunner&) = delete;
+
+    // 执行任务列表文件中的全部任务，返回失败的任务数（无法读取列表时返回-1）
+    int run_job_list(const std::string& list_filename);
+
+    /**
+     * 监视目录：每个*.job文件是一个任务行
+     * 认领时改名为*.job.running，结束后改名为*.job.done或*.job.failed；直到stop()后返回失败的任务数
+     */
+    int watch_spool(const std::string& directory);
+
+    // 停止接收新任务，已启动的任务照常完成；只写原子变量，可在信号处理函数中调用
+    void stop() { stopping_ = true; }
+
+private:
+    struct ActiveJob;
+
+    // 解析、探测并等待预算放行后启动一个任务；失败时返回false（已计入失败数并处理监视文件）
+    bool launch(const std::string& name, const std::string& line, const std::string& spool_filename);
+    void finish_spool_file(const std::string& spool_filename, bool succeeded);
+    void reap_finished_jobs();   // 调用方持有mutex_
+    void wait_all();
+
+    BatchParams params_;
+    int total_cores_ = 1;
+    int max_jobs_ = 1;
+    int cores_per_job_ = 1;
+
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    std::list<std::unique_ptr<ActiveJob>> active_;
+    int used_cores_ = 0;
+    int64_t used_memory_ = 0;
+    int failed_jobs_ = 0;
+    std::atomic<bool> stopping_{false};
+    MetricsExporter metrics_;    // 最后析构：停止前写出包含全部已结束任务的最终指标
+};
@@ -0,0 +1,15 @@
+#pragma once
+
+// 全局CPU核心预算：在解码、处理、编码阶段之间分配线程数
+// 解封装/封装为I/O线程不计入预算；音频链路整体按一个核心预留
+struct CoreBudget {
+    int total_cores = 1;          // 参与分配的核心总数
+    int decode_threads = 1;       // 视频解码器thread_count
+    int process_threads = 1;      // 视频处理阶段（OpenGL/CPU滤镜）预留
+    int audio_threads = 0;        // 音频解码+处理+编码链路预留
+    int encode_threads = 1;       // 视频编码器thread_count
+    int lookahead_threads = 0;    // 编码器前瞻线程（0表示由编码器决定）
+};
+
+// 按核心总数规划预算，total_cores为0时使用std::thread::hardware_concurrency()
+CoreBudget plan_core_budget(int total_cores, bool run_video, bool run_audio);
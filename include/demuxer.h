@@ -1,5 +1,8 @@
 #pragma once
 #include "queue.h"
+#include "media_io.h"
+#include "pipeline_metrics.h"
+#include <atomic>
 
 extern "C" {
 #include <libavformat/avformat.h>
@@ -8,10 +11,21 @@ extern "C" {
 // 解封装器配置参数
 struct DemuxerParams {
     const char* input_filename = nullptr;
+    MediaReader* input_reader = nullptr;  // 非空时通过回调读取（内存输入），input_filename仅用于日志
     int max_frames = 0;  // 0表示处理所有帧，>0表示限制处理的帧数
     bool enable_audio = true;// 是否启用音频解封装
     // 是否启用视频解封装
     bool enable_video = true;
+    
+    // 分段范围（视频流时间基下的关键帧dts，AV_NOPTS_VALUE表示文件开头/结尾）
+    // 从segment_start关键帧开始，到segment_end关键帧之前结束；用于分段并行转码
+    int64_t segment_start = AV_NOPTS_VALUE;
+    int64_t segment_end = AV_NOPTS_VALUE;
+    
+    // 取消标志：置位后停止读取并结束输出队列，下游按正常结束流程排空（输出为截断但完整的文件）
+    const std::atomic<bool>* cancel_flag = nullptr;
+    
+    StageMetrics* metrics = nullptr;  // 可选的阶段指标（读出的包数/字节数）
 };
 
 // 解封装线程函数
@@ -40,6 +54,8 @@ struct StreamInfo {
     AVCodecParameters* video_codec_params = nullptr;// 视频编解码器参数
     // 注意：音频编解码器参数可能为nullptr，表示没有音频
     AVCodecParameters* audio_codec_params = nullptr;
+    int64_t duration = 0;  // 文件时长（AV_TIME_BASE单位），未知时为0
 };
 
 bool get_stream_info(const char* input_filename, StreamInfo& info);
+bool get_stream_info(MediaReader* input_reader, StreamInfo& info);
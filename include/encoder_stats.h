@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+// 单个编码输出包（一帧）的统计
+struct EncodedFrameStats {
+    int64_t frame_index = 0;        // 输出顺序的序号
+    int64_t pts = 0;                // 编码器时间基（1/fps）
+    int64_t dts = 0;
+    char frame_type = '?';          // I/P/B，编码器未提供时按关键帧标志推断
+    bool keyframe = false;
+    int32_t size = 0;               // 压缩后字节数
+    float average_qp = -1.0f;       // 来自AV_PKT_DATA_QUALITY_STATS，编码器未提供时为-1
+    float encode_latency_ms = -1.0f; // 从送入编码器到取回对应包的时间
+    float queue_wait_ms = 0.0f;     // 编码线程等待该帧入队的时间（>0说明上游是瓶颈）
+};
+
+// 逐帧统计输出格式
+enum class EncoderStatsFormat {
+    CSV,    // 带表头的文本，便于表格/pandas直接分析
+    BINARY  // 定长小端记录，文件头见encoder_stats.cpp，长时间生产任务开销最小
+};
+
+// 逐帧编码统计写入器：只在编码线程中使用，不加锁；64KB全缓冲，每帧只写入缓冲区，不产生系统调用
+class EncoderStatsWriter {
+public:
+    EncoderStatsWriter() = default;
+    ~EncoderStatsWriter();
+
+    EncoderStatsWriter(const EncoderStatsWriter&) = delete;
+    EncoderStatsWriter& operator=(const EncoderStatsWriter&) = delete;
+
+    // 打开输出文件（覆盖），格式由文件扩展名决定：.bin为二进制，其余为CSV
+    bool open(const std::string& path);
+    bool open(const std::string& path, EncoderStatsFormat format);
+
+    void write(const EncodedFrameStats& stats);
+
+    // 刷新缓冲并关闭文件，析构时自动调用
+    void close();
+
+    bool is_open() const { return file_ != nullptr; }
+    int64_t records_written() const { return records_; }
+
+private:
+    FILE* file_ = nullptr;
+    EncoderStatsFormat format_ = EncoderStatsFormat::CSV;
+    int64_t records_ = 0;
+};
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+extern "C" {
+#include <libavutil/frame.h>
+}
+
+// 每帧的内容复杂度统计（由视频处理阶段计算，经frame->opaque_ref传递给编码器）
+struct FrameAnalysis {
+    float spatial_activity = 0.0f;   // 亮度平均梯度（水平+垂直），反映纹理细节
+    float temporal_activity = 0.0f;  // 与上一帧的亮度平均绝对差，反映运动强度
+    float complexity = 0.0f;         // 综合复杂度：空间 + 2×时间（运动对码率的影响更大）
+    float scene_score = 0.0f;        // 与上一帧亮度直方图的差异（0-1）
+    bool scene_cut = false;          // 镜头切换：编码器在此处插入IDR帧
+};
+
+// 亮度平面复杂度分析器（SSE2 SAD，其他平台回退到标量实现）
+// 按row_step隔行采样整行像素，只保留上一帧的采样行与直方图用于时间差分和镜头切换检测
+class FrameAnalyzer {
+public:
+    static constexpr int kHistogramBins = 64;
+    
+    // min_scene_frames: 两次镜头切换之间的最少帧数，抑制闪光/快速剪辑造成的连续关键帧
+    explicit FrameAnalyzer(int row_step = 4, int min_scene_frames = 5);
+
+    // 分析YUV帧的亮度平面，分辨率变化时自动重置时间参考
+    FrameAnalysis analyze(const AVFrame* frame);
+
+    void reset();
+
+private:
+    int row_step_;
+    int width_;
+    int height_;
+    bool has_previous_;
+    std::vector<uint8_t> previous_rows_;  // 上一帧的采样行（紧密排列）
+    
+    // 镜头切换检测状态
+    int min_scene_frames_;
+    int frames_since_cut_;
+    double motion_average_;               // 非切换帧时间活动度的滑动平均（自适应阈值）
+    std::array<uint32_t, kHistogramBins> previous_histogram_;
+};
+
+// 将分析结果附加到帧的opaque_ref（只替换本模块附加的结果），av_frame_ref会随帧一起复制
+// opaque_ref已被其他用途占用时不覆盖，返回false
+bool attach_frame_analysis(AVFrame* frame, const FrameAnalysis& analysis);
+
+// 读取帧上的分析结果（按缓冲标记识别），没有时返回nullptr
+const FrameAnalysis* get_frame_analysis(const AVFrame* frame);
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+extern "C" {
+#include <libavformat/avio.h>
+}
+
+/**
+ * 回调式输入输出：嵌入方已持有内存中的媒体数据时，不需要落地成临时文件
+ * - seek的whence与stdio一致（SEEK_SET/SEEK_CUR/SEEK_END），另外AVSEEK_SIZE返回总长度（未知返回-1）
+ * - 同一个读取器会被get_stream_info和解封装线程先后打开，每次打开前都会seek到开头，因此必须可寻址
+ *   （seekable()为false的读取器在打开时即被拒绝，TranscodeJob::configure报错）
+ */
+class MediaReader {
+public:
+    virtual ~MediaReader() = default;
+
+    // 读取最多size字节，返回实际字节数，0表示结束，<0表示错误
+    virtual int read(uint8_t* data, int size) = 0;
+
+    // 返回新的读取位置，不支持寻址时返回-1
+    virtual int64_t seek(int64_t offset, int whence) { (void)offset; (void)whence; return -1; }
+
+    virtual bool seekable() const { return false; }
+};
+
+class MediaWriter {
+public:
+    virtual ~MediaWriter() = default;
+
+    // 写入size字节，返回写入的字节数，<0表示错误
+    virtual int write(const uint8_t* data, int size) = 0;
+
+    // 不可寻址的写入器只能配合分片MP4/MPEG-TS等不需要回写文件头的容器（MP4自动改为分片写出，MKV不预留索引）
+    virtual int64_t seek(int64_t offset, int whence) { (void)offset; (void)whence; return -1; }
+
+    virtual bool seekable() const { return false; }
+};
+
+// 读取调用方持有的内存缓冲区（不拷贝，缓冲区需在转码结束前保持有效）
+class MemoryReader : public MediaReader {
+public:
+    MemoryReader(const uint8_t* data, size_t size) : data_(data), size_(size) {}
+
+    int read(uint8_t* data, int size) override;
+    int64_t seek(int64_t offset, int whence) override;
+    bool seekable() const override { return true; }
+
+private:
+    const uint8_t* data_;
+    size_t size_;
+    size_t position_ = 0;
+};
+
+// 写入可增长的内存缓冲区，支持回写（MP4的moov回填等）
+class MemoryWriter : public MediaWriter {
+public:
+    int write(const uint8_t* data, int size) override;
+    int64_t seek(int64_t offset, int whence) override;
+    bool seekable() const override { return true; }
+
+    const std::vector<uint8_t>& data() const { return data_; }
+    std::vector<uint8_t>& data() { return data_; }
+
+private:
+    std::vector<uint8_t> data_;
+    size_t position_ = 0;
+};
+
+// 为读取器/写入器创建AVIOContext（64KB缓冲），失败返回nullptr；用free_media_avio释放
+AVIOContext* create_reader_avio(MediaReader* reader);
+AVIOContext* create_writer_avio(MediaWriter* writer);
+void free_media_avio(AVIOContext** context);
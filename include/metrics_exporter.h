@@ -0,0 +1,71 @@
+#pragma once
+
+#include "pipeline_metrics.h"
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class TranscodeJob;
+
+// 指标导出配置：HTTP与文件可以同时启用
+struct MetricsParams {
+    int port = 0;              // >0时在127.0.0.1:port提供Prometheus文本格式（任意路径均返回指标）
+    std::string filename;      // 非空时定期整体替换写出（写临时文件后rename），供sidecar/textfile采集器读取
+    int interval_ms = 5000;    // 文件写出间隔
+};
+
+/**
+ * Prometheus指标导出
+ * - 按任务：运行中任务的阶段计数器/耗时直方图与队列深度，标签{host, job, stage}
+ * - 按主机：已结束任务的累计值 + 运行中任务的当前值（transcoder_host_*），任务结束后计数器依然单调
+ * 导出线程只读取阶段线程的原子计数，不影响转码热路径
+ */
+class MetricsExporter {
+public:
+    MetricsExporter();
+    ~MetricsExporter();
+
+    MetricsExporter(const MetricsExporter&) = delete;
+    MetricsExporter& operator=(const MetricsExporter&) = delete;
+
+    bool start(const MetricsParams& params);
+    void stop();  // 停止前写出最后一次指标文件
+
+    // 任务start()之后登记；结束后（销毁之前）注销，注销时其计数并入主机累计值
+    void add_job(const std::string& label, const TranscodeJob* job);
+    void remove_job(const TranscodeJob* job);
+
+    // 当前全部指标的Prometheus文本
+    std::string render();
+
+private:
+    struct JobEntry {
+        std::string label;
+        const TranscodeJob* job;
+    };
+
+    void http_loop();
+    void file_loop();
+    bool write_file();
+
+    MetricsParams params_;
+    std::string host_;
+
+    std::mutex mutex_;  // 保护以下任务表与主机累计值
+    std::vector<JobEntry> jobs_;
+    StageSnapshot finished_stages_[kPipelineStageCount];
+    uint64_t jobs_started_ = 0;
+    uint64_t jobs_succeeded_ = 0;
+    uint64_t jobs_failed_ = 0;
+    uint64_t finished_output_bytes_ = 0;
+
+    int listen_fd_ = -1;
+    std::atomic<bool> stopping_{false};
+    std::thread http_thread_;
+    std::thread file_thread_;
+    std::mutex file_mutex_;
+    std::condition_variable file_cond_;
+};
@@ -1,16 +1,57 @@
 #pragma once
 
 #include "queue.h"
+#include "pipeline_metrics.h"
+#include "async_writer.h"
+#include "media_io.h"
+#include <atomic>
+#include <string>
+#include <vector>
 
 extern "C" {
 #include <libavformat/avformat.h>
 #include <libavcodec/avcodec.h>
 }
 
+// 输出容器格式
+enum class OutputContainer {
+    AVI,    // 兼容旧流程（不适合B帧时间戳）
+    MP4,    // moov前置（faststart），可直接用于渐进式下载
+    MKV,    // Matroska，索引(Cues)尽量预留在文件头部
+    FMP4,   // 分片MP4（empty_moov + moof/mdat分片），适合直播/边写边读
+    MPEGTS, // MPEG-TS，适合广播与流式传输
+    
+    // 分段打包：输出文件为播放列表/清单，分段文件写在同一目录，编码过程中逐段发布
+    HLS,       // HLS + TS分段（.m3u8）
+    HLS_FMP4,  // HLS + CMAF(fMP4)分段
+    DASH       // DASH + CMAF分段（.mpd），同时生成HLS播放列表
+};
+
+// 封装进度统计：封装线程写入，其他线程可随时读取
+struct MuxerStats {
+    std::atomic<int64_t> video_packets{0};
+    std::atomic<int64_t> audio_packets{0};
+    std::atomic<int64_t> output_time_us{0};  // 最近写出的包的时间戳（AV_TIME_BASE单位）
+    std::atomic<int64_t> bytes_written{0};   // 已交给输出IO的字节数（HLS/DASH由分段文件各自写出，为0）
+    std::atomic<bool> completed{false};      // 文件尾写入成功
+};
+
 // 封装器配置参数
 struct MuxerParams {
     const char* output_filename = nullptr;
-    const char* format_name = "avi";  // 默认输出AVI格式
+    // 非空时通过回调写出（内存输出），output_filename仅用于日志；不支持HLS/DASH
+    // MP4：已知时长时预留moov空间（写尾时回写文件头，写入器需可寻址）；时长未知时不能用+faststart（需重新打开文件读回），
+    //      与写入器不可寻址时一样改为分片MP4（empty_moov + 按关键帧/fragment_duration分片）
+    // MKV：写入器不可寻址时不预留Cues空间
+    MediaWriter* custom_output = nullptr;
+    OutputContainer container = OutputContainer::AVI;  // 默认输出AVI格式
+    int fragment_duration_ms = 2000;  // 分片MP4的分片时长（同时在每个关键帧处切分）
+    int segment_duration_ms = 4000;   // HLS/DASH目标分段时长（在达到时长后的第一个关键帧处切分）
+    int64_t expected_duration = 0;    // 预计输出时长（AV_TIME_BASE单位），用于为MP4/MKV索引预留头部空间，0表示未知
+    
+    // 编码器发布的流参数（含extradata），为nullptr或编码器不可用时使用下面手工设置的参数
+    CodecParametersSlot* video_parameters = nullptr;
+    CodecParametersSlot* audio_parameters = nullptr;
     
     // 视频参数
     int video_width = 0;
@@ -22,6 +63,29 @@ struct MuxerParams {
     int audio_sample_rate = 48000;
     int audio_channels = 2;
     AVCodecID audio_codec_id = AV_CODEC_ID_AC3;  // 默认使用AC3
+    
+    // 交织缓冲：每个流最多缓存的包数。另一路流迟迟没有数据时，缓存满后按时间戳强制写出，
+    // 保证内存有界（此时的交织由av_interleaved_write_frame继续兜底）
+    int max_buffered_packets = 64;
+    
+    // 输出写入：默认由独立写线程异步写出大块缓冲，封装线程不直接阻塞在磁盘上（分段打包输出不适用）
+    bool async_output = true;
+    AsyncWriterParams output_writer;
+    
+    MuxerStats* stats = nullptr;  // 可选的进度统计输出
+    StageMetrics* metrics = nullptr;  // 可选的阶段指标（写出的包数/字节数与写入耗时）
+};
+
+// 多路输出（tee）：同一份编码结果分发给多个封装线程，每个目标一对独立队列
+struct TeeOutput {
+    EncodedVideoPacketQueue* video_packet_queue = nullptr;  // 为nullptr表示该目标不写视频
+    EncodedAudioPacketQueue* audio_packet_queue = nullptr;
+};
+
+struct TeeParams {
+    std::vector<TeeOutput> outputs;
+    // 每个目标队列最多积压的包数：慢目标积压到上限后分发线程才会等待，其余目标在此之前不受影响
+    int max_buffered_packets = 256;
 };
 
 // 视频封装器配置参数
@@ -45,11 +109,37 @@ struct AudioMuxerParams {
     int bitrate = 128000;
 };
 
-// 主要Mux线程函数（音视频合并）
+// 容器名称解析（avi/mp4/mkv/fmp4/ts/hls/hls-fmp4/dash）与按输出文件扩展名推断（未知扩展名返回AVI）
+bool parse_output_container(const std::string& name, OutputContainer& container);
+OutputContainer output_container_from_filename(const char* filename);
+
+// 容器对应的libavformat封装器名称
+const char* output_container_format_name(OutputContainer container);
+
+// 是否为HLS/DASH分段打包输出
+bool output_container_is_segmented(OutputContainer container);
+
+// 容器是否要求编码器输出全局头（AV_CODEC_FLAG_GLOBAL_HEADER，参数集放在extradata中）
+bool output_container_needs_global_header(OutputContainer container);
+
+// 容器能否封装该编码（avformat_query_codec明确不支持时返回false，无法判断时视为支持）
+bool output_container_supports_codec(OutputContainer container, AVCodecID codec_id);
+
+// 主要Mux线程函数（音视频合并）；退出（含失败提前退出）时结束并清空输入队列，上游编码线程随即停止
 void mux_thread_func(EncodedVideoPacketQueue* video_packet_queue,
                      EncodedAudioPacketQueue* audio_packet_queue,
                      const MuxerParams& params);
 
+// 分发线程：从编码队列取包，按引用计数复制（av_packet_clone共享数据）推送到每个目标的队列
+void tee_thread_func(EncodedVideoPacketQueue* video_packet_queue,
+                     EncodedAudioPacketQueue* audio_packet_queue,
+                     const TeeParams& params);
+
+// tee目标的封装线程：同mux_thread_func，退出时结束并清空自己的队列，分发线程随即跳过该目标
+void tee_mux_thread_func(EncodedVideoPacketQueue* video_packet_queue,
+                         EncodedAudioPacketQueue* audio_packet_queue,
+                         const MuxerParams& params);
+
 // 视频专用Mux线程函数
 void video_mux_thread_func(EncodedVideoPacketQueue* video_packet_queue,
                           const VideoMuxerParams& params);
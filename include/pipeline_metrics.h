@@ -0,0 +1,248 @@
+#pragma once
+
+#include "trace.h"
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <time.h>
+
+// 流水线阶段（指标、导出标签按此顺序）
+enum class PipelineStage {
+    DEMUX,
+    VIDEO_DECODE,
+    VIDEO_PROCESS,
+    VIDEO_ENCODE,
+    AUDIO_DECODE,
+    AUDIO_PROCESS,
+    AUDIO_ENCODE,
+    MUX,
+    COUNT
+};
+
+constexpr int kPipelineStageCount = static_cast<int>(PipelineStage::COUNT);
+
+const char* pipeline_stage_name(PipelineStage stage);
+
+// 处理耗时直方图的桶上界（纳秒），最后一个桶之后为+Inf
+constexpr int kLatencyBucketCount = 14;
+extern const int64_t kLatencyBucketBoundsNs[kLatencyBucketCount];
+
+// 内存计量：当前值与峰值，多个线程可同时增减（任务内全部队列共用一个，或一个阶段的全部临时缓冲共用一个）
+// 可指定上级计量：增减同时计入上级（分段流水线的队列单独计量，同时计入任务的队列总量）
+class MemoryGauge {
+public:
+    explicit MemoryGauge(MemoryGauge* parent = nullptr) : parent_(parent) {}
+
+    void add(int64_t delta) {
+        int64_t now = current_.fetch_add(delta, std::memory_order_relaxed) + delta;
+        int64_t peak = peak_.load(std::memory_order_relaxed);
+        while (now > peak && !peak_.compare_exchange_weak(peak, now, std::memory_order_relaxed)) {
+        }
+        if (parent_) {
+            parent_->add(delta);
+        }
+    }
+
+    int64_t current() const { return current_.load(std::memory_order_relaxed); }
+    int64_t peak() const { return peak_.load(std::memory_order_relaxed); }
+
+private:
+    MemoryGauge* parent_;
+    std::atomic<int64_t> current_{0};
+    std::atomic<int64_t> peak_{0};
+};
+
+/**
+ * 一个阶段的指标：由该阶段的线程写入，导出/进度线程随时读取
+ * 所有累加都是relaxed原子加（fetch_add），多个写线程同时写入也不会丢失计数：
+ * 单流水线时每个阶段只有一个写线程；分段并行时解封装/解码阶段的指标由各分段线程同时写入，
+ * 只多了缓存行争用（每个输入几次原子加，相对解码耗时可以忽略）
+ */
+struct StageMetrics {
+    std::atomic<uint64_t> frames_in{0};      // 取到的输入（包或帧）
+    std::atomic<uint64_t> frames_out{0};     // 产出的包或帧
+    std::atomic<uint64_t> drops{0};          // 丢弃的输入（变速丢帧、解码失败、尺寸不符等）
+    std::atomic<uint64_t> bytes_in{0};       // 压缩数据字节数（解码/封装阶段的输入）
+    std::atomic<uint64_t> bytes_out{0};      // 压缩数据字节数（解封装阶段的输出）
+    std::atomic<int64_t> queue_wait_ns{0};   // 等待输入的累计时间（阻塞在输入）
+    std::atomic<int64_t> process_ns{0};      // 处理输入的累计时间（忙碌，不含阻塞在输出）
+    std::atomic<int64_t> output_wait_ns{0};  // 阻塞在输出的累计时间（下游有界队列满、写缓冲耗尽）
+    std::atomic<int64_t> cpu_ns{0};          // 阶段线程的CPU时间（CLOCK_THREAD_CPUTIME_ID）
+    std::atomic<int64_t> wall_ns{0};         // 阶段线程的存活时间之和
+    std::atomic<int> threads{0};             // 记录过的线程数
+    MemoryGauge scratch;                     // 阶段持有的临时/池化缓冲（格式转换缓冲、SoundTouch与环形缓冲等）
+    std::atomic<uint64_t> process_buckets[kLatencyBucketCount + 1] = {};  // 单个输入的处理耗时分布
+
+    const char* name = "";          // 阶段名称（时间段名与线程名）
+    TraceSession* trace = nullptr;  // 非空时每个输入的处理过程记为一个时间段（线程启动前设置）
+
+    void observe_process(int64_t ns);
+};
+
+// 阶段指标的普通值拷贝：用于导出与累计已结束任务
+struct StageSnapshot {
+    uint64_t frames_in = 0;
+    uint64_t frames_out = 0;
+    uint64_t drops = 0;
+    uint64_t bytes_in = 0;
+    uint64_t bytes_out = 0;
+    int64_t queue_wait_ns = 0;
+    int64_t process_ns = 0;
+    int64_t output_wait_ns = 0;
+    int64_t cpu_ns = 0;
+    int64_t wall_ns = 0;
+    int threads = 0;
+    int64_t scratch_bytes = 0;
+    int64_t scratch_peak_bytes = 0;  // 多个任务/阶段相加时为各自峰值之和（上界）
+    uint64_t process_buckets[kLatencyBucketCount + 1] = {};
+
+    void add(const StageSnapshot& other);
+};
+
+// 一个任务的全部阶段指标
+struct PipelineMetrics {
+    StageMetrics stages[kPipelineStageCount];
+
+    PipelineMetrics();
+
+    StageMetrics* stage(PipelineStage which) { return &stages[static_cast<int>(which)]; }
+    StageSnapshot snapshot(PipelineStage which) const;
+    void enable_trace(TraceSession* session);
+};
+
+/**
+ * 瓶颈报告：各阶段的忙碌/阻塞在输入/阻塞在输出/CPU时间占线程墙钟时间的比例，
+ * 以利用率（忙碌/墙钟）最高的阶段为限制阶段，并按CPU时间/忙碌时间判断它是受CPU限制还是在等待GPU/I/O，给出调整建议
+ */
+std::string format_bottleneck_report(const PipelineMetrics& metrics);
+
+// 当前线程阻塞在输出上的累计时间：阻塞点（有界队列等待空间、写缓冲等待空闲块）用OutputBlockTimer累加，
+// StageRecorder按差值从忙碌/等待输入时间中扣除并计入output_wait_ns，调用点不需要知道所属阶段
+inline int64_t& thread_output_blocked_ns() {
+    static thread_local int64_t blocked_ns = 0;
+    return blocked_ns;
+}
+
+class OutputBlockTimer {
+public:
+    OutputBlockTimer() : begin_ns_(trace_now_ns()) {}
+    ~OutputBlockTimer() { thread_output_blocked_ns() += trace_now_ns() - begin_ns_; }
+
+    OutputBlockTimer(const OutputBlockTimer&) = delete;
+    OutputBlockTimer& operator=(const OutputBlockTimer&) = delete;
+
+private:
+    int64_t begin_ns_;
+};
+
+inline int64_t thread_cpu_now_ns() {
+    timespec now;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    return static_cast<int64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+}
+
+/**
+ * 阶段线程内的记录器：metrics为nullptr时所有调用都是空操作，线程函数不需要分支
+ * 用法：取到输入后begin()，处理完end()；两次之间产出output()/丢弃drop()
+ * 上一次end()（或构造）到begin()之间计为等待输入的时间
+ * 启用时间线时构造即登记本线程的缓冲，begin()到end()记为一个带帧标识（见trace.h）的时间段
+ * 构造到析构为线程的墙钟时间：忙碌 + 阻塞在输入 + 阻塞在输出；CPU时间在每次end()时采样
+ */
+class StageRecorder {
+public:
+    explicit StageRecorder(StageMetrics* metrics)
+        : metrics_(metrics),
+          trace_(metrics && metrics->trace ? metrics->trace->register_thread(metrics->name) : nullptr),
+          created_(trace_now_ns()),
+          idle_since_(created_),
+          blocked_seen_(thread_output_blocked_ns()),
+          cpu_seen_(metrics ? thread_cpu_now_ns() : 0) {
+        if (metrics_) {
+            metrics_->threads.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    ~StageRecorder() {
+        if (!metrics_) {
+            return;
+        }
+        int64_t now = trace_now_ns();
+        metrics_->queue_wait_ns.fetch_add(now - idle_since_ - take_output_blocked(), std::memory_order_relaxed);
+        metrics_->wall_ns.fetch_add(now - created_, std::memory_order_relaxed);
+        sample_cpu();
+    }
+
+    StageRecorder(const StageRecorder&) = delete;
+    StageRecorder& operator=(const StageRecorder&) = delete;
+
+    void begin(uint64_t input_bytes = 0, int64_t frame_id = kNoTraceFrameId) {
+        if (!metrics_) {
+            return;
+        }
+        work_start_ = trace_now_ns();
+        frame_id_ = frame_id;
+        metrics_->queue_wait_ns.fetch_add(work_start_ - idle_since_ - take_output_blocked(), std::memory_order_relaxed);
+        metrics_->frames_in.fetch_add(1, std::memory_order_relaxed);
+        if (input_bytes) {
+            metrics_->bytes_in.fetch_add(input_bytes, std::memory_order_relaxed);
+        }
+    }
+
+    void end() {
+        if (!metrics_) {
+            return;
+        }
+        idle_since_ = trace_now_ns();
+        metrics_->observe_process(idle_since_ - work_start_ - take_output_blocked());
+        sample_cpu();
+        if (trace_) {
+            trace_->add(metrics_->name, work_start_, idle_since_, frame_id_);
+        }
+    }
+
+    void output(uint64_t frames = 1, uint64_t bytes = 0) {
+        if (!metrics_) {
+            return;
+        }
+        metrics_->frames_out.fetch_add(frames, std::memory_order_relaxed);
+        if (bytes) {
+            metrics_->bytes_out.fetch_add(bytes, std::memory_order_relaxed);
+        }
+    }
+
+    void drop(uint64_t count = 1) {
+        if (metrics_) {
+            metrics_->drops.fetch_add(count, std::memory_order_relaxed);
+        }
+    }
+
+    // 供处理过程中记录子步骤（TraceScope）
+    TraceBuffer* trace_buffer() const { return trace_; }
+    int64_t frame_id() const { return frame_id_; }
+
+private:
+    // 自上次采样以来阻塞在输出的时间，计入output_wait_ns并返回
+    int64_t take_output_blocked() {
+        int64_t blocked = thread_output_blocked_ns() - blocked_seen_;
+        blocked_seen_ += blocked;
+        if (blocked) {
+            metrics_->output_wait_ns.fetch_add(blocked, std::memory_order_relaxed);
+        }
+        return blocked;
+    }
+
+    void sample_cpu() {
+        int64_t cpu_now = thread_cpu_now_ns();
+        metrics_->cpu_ns.fetch_add(cpu_now - cpu_seen_, std::memory_order_relaxed);
+        cpu_seen_ = cpu_now;
+    }
+
+    StageMetrics* metrics_;
+    TraceBuffer* trace_;
+    int64_t created_;
+    int64_t idle_since_;
+    int64_t blocked_seen_;
+    int64_t cpu_seen_;
+    int64_t work_start_ = 0;
+    int64_t frame_id_ = kNoTraceFrameId;
+};
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "pipeline_metrics.h"
+#include "queue.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// 自动调优配置
+struct TunerParams {
+    int interval_ms = 500;            // 控制周期：容量按倍数调整，几个周期（数秒）内收敛
+    int64_t memory_budget_bytes = 0;  // 调优控制的队列内存上限（登记的帧队列+分段流水线的队列，不含解封装/封装两端的包队列），0表示不限制
+    int total_cores = 1;              // 任务的核心预算：分段并行度只在CPU未用满时增加
+};
+
+/**
+ * 流水线自动调优线程：按固定周期读取阶段指标的增量与调优控制的队列内存，调整
+ * - 有界帧队列的容量：生产者阻塞在输出、消费者又在等待输入，说明缓冲不足以吸收两端的抖动，容量加倍；
+ *   生产者持续阻塞而消费者从不等待，说明消费者是瓶颈，多余的深度只占内存，连续几个周期后逐步缩小
+ *   （不低于上次出现交替阻塞时的容量，避免来回振荡）；队列内存超预算时把占用最多的队列减半
+ * - 分段并行的活跃流水线数：CPU未用满且内存有余量时增加，内存超预算、或CPU饱和且超过初始并行度时减少
+ * 编解码器线程数在打开编解码器时固定（FFmpeg不支持运行中修改thread_count），处理阶段受OpenGL上下文限制为单线程，
+ * 这两者不在调整范围内；分段并行时每条流水线都是一组完整的解码/处理/编码线程，活跃流水线数即可调的工作线程数
+ */
+class PipelineTuner {
+public:
+    PipelineTuner() = default;
+    ~PipelineTuner();
+
+    PipelineTuner(const PipelineTuner&) = delete;
+    PipelineTuner& operator=(const PipelineTuner&) = delete;
+
+    // 以下登记在start()之前调用；producer/consumer为队列两端阶段的指标（只读取），队列立即设为initial容量
+    void add_queue(const char* name, ThreadSafeQueue<AVFrame*>* queue,
+                   const StageMetrics* producer, const StageMetrics* consumer,
+                   size_t initial, size_t maximum);
+
+    // 分段并行：limit为分段工作线程读取的并行度，修改后通过changed唤醒工作线程；segment_memory为分段流水线全部队列的计量；
+    // initial为核心预算给出的并行度，maximum为工作线程数
+    void set_segment_limit(std::atomic<int>* limit, QueueNotifier* changed, const MemoryGauge* segment_memory,
+                           int initial, int maximum);
+
+    // 流水线线程启动之后调用；登记的队列与计量需在stop()之前保持有效
+    bool start(const TunerParams& params);
+
+    // 停止调优并打印最终配置（任务全部线程结束后调用）
+    void stop();
+
+private:
+    struct TunedQueue {
+        const char* name = "";
+        ThreadSafeQueue<AVFrame*>* queue = nullptr;
+        const StageMetrics* producer = nullptr;
+        const StageMetrics* consumer = nullptr;
+        size_t capacity = 0;
+        size_t floor = 2;              // 缩小的下限：上次交替阻塞时的容量+1
+        size_t maximum = 0;
+        int64_t item_bytes = 0;        // 最近一次观察到的平均元素大小
+        int64_t last_producer_blocked_ns = 0;
+        int64_t last_consumer_waited_ns = 0;
+        int saturated_ticks = 0;       // 连续"生产者阻塞、消费者不等待"的周期数
+    };
+
+    void run();
+    void tick(int64_t interval_ns);
+    void resize(TunedQueue& tuned, size_t capacity, const char* reason);
+    void tune_segments(int64_t interval_ns, int64_t memory, bool over_budget);
+
+    std::vector<TunedQueue> queues_;
+    std::atomic<int>* segment_limit_ = nullptr;
+    QueueNotifier* segment_changed_ = nullptr;
+    const MemoryGauge* segment_memory_ = nullptr;
+    int segment_initial_ = 1;
+    int segment_maximum_ = 1;
+    int segment_cooldown_ = 0;         // 调整并行度后等待新流水线进入稳态的周期数
+    int64_t last_cpu_ns_ = 0;
+    int adjustments_ = 0;
+
+    TunerParams params_;
+    std::thread thread_;
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    bool stopping_ = false;
+};
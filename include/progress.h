@@ -0,0 +1,65 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+
+class TranscodeJob;
+
+// 进度报告配置
+struct ProgressParams {
+    int interval_ms = 1000;    // 采样间隔
+    std::string json_filename; // 非空时追加JSON行（"-"为标准输出，调用方需把std::cout日志改到标准错误），否则在标准输出打印文本行
+    std::string label;         // 任务标识（批处理时区分不同任务），为空时使用输出文件名
+};
+
+// 一次采样的派生指标（相邻两次采样之间的瞬时值 + 从启动起的累计值）
+struct ProgressSample {
+    double elapsed_seconds = 0.0;
+    double percent = -1.0;       // 输入时长未知时为-1
+    int64_t video_frames = 0;    // 主输出已写出的视频帧
+    double fps = 0.0;            // 最近一个间隔的输出帧率
+    double speed = 0.0;          // 最近一个间隔的输出时长/墙钟时长（×实时）
+    double eta_seconds = -1.0;   // 按启动以来的平均速度估算，未知为-1
+    int64_t output_time_us = 0;
+    int64_t bytes_written = 0;
+};
+
+/**
+ * 进度报告线程：按固定间隔采样TranscodeJob::stats()（各队列累计入队数/深度、封装统计）
+ * 只读取原子计数与队列长度，不参与流水线同步，对转码线程没有额外开销
+ */
+class ProgressReporter {
+public:
+    ProgressReporter() = default;
+    ~ProgressReporter();
+
+    ProgressReporter(const ProgressReporter&) = delete;
+    ProgressReporter& operator=(const ProgressReporter&) = delete;
+
+    // 任务start()之后调用；job需在stop()之前保持有效
+    bool start(const TranscodeJob& job, const ProgressParams& params);
+
+    // 停止采样并输出最后一次报告（任务全部线程结束后调用）
+    void stop();
+
+private:
+    void run();
+    void report(bool final_report);
+
+    const TranscodeJob* job_ = nullptr;
+    ProgressParams params_;
+    FILE* json_file_ = nullptr;
+    std::thread thread_;
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    bool stopping_ = false;
+
+    // 上一次采样，用于计算瞬时帧率/速度
+    double last_elapsed_ = 0.0;
+    int64_t last_video_frames_ = 0;
+    int64_t last_output_time_us_ = 0;
+};
@@ -1,15 +1,123 @@
 #pragma once
 
+#include <algorithm>
 #include <queue>
 #include <mutex>
 #include <condition_variable>
 #include <atomic>
+#include <chrono>
+#include <cstdint>
+#include "pipeline_metrics.h"
 
 extern "C" {
 #include <libavcodec/avcodec.h>
 #include <libavformat/avformat.h>
 }
 
+// 多队列等待通知器：消费者需要同时等待多个队列（任一队列有新数据或结束即被唤醒）
+// 使用方法：先读取version()，再非阻塞地检查各队列，没有可处理的数据时调用wait(version)
+class QueueNotifier {
+public:
+    void notify() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            ++version_;
+        }
+        cond_.notify_all();
+    }
+
+    uint64_t version() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return version_;
+    }
+
+    // 阻塞直到version与seen不同（期间有队列发生变化则立即返回）
+    void wait(uint64_t seen) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cond_.wait(lock, [this, seen] { return version_ != seen; });
+    }
+
+    // 同wait，最多等待timeout（等待的条件中有不发通知的标志时使用）；超时返回false
+    bool wait_for(uint64_t seen, std::chrono::milliseconds timeout) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        return cond_.wait_for(lock, timeout, [this, seen] { return version_ != seen; });
+    }
+
+private:
+    mutable std::mutex mutex_;
+    std::condition_variable cond_;
+    uint64_t version_ = 0;
+};
+
+// 编码器→封装器的流参数交接：编码器打开后发布codecpar（含全局头extradata），
+// 封装器在写文件头前等待。只有第一次发布生效（分段并行时多个编码器参数相同）
+class CodecParametersSlot {
+public:
+    CodecParametersSlot() = default;
+    ~CodecParametersSlot() {
+        avcodec_parameters_free(&parameters_);
+    }
+
+    CodecParametersSlot(const CodecParametersSlot&) = delete;
+    CodecParametersSlot& operator=(const CodecParametersSlot&) = delete;
+
+    // 发布编码器参数；context为nullptr表示编码器不可用（封装器回退到手工设置的流参数）
+    void publish(const AVCodecContext* context) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (ready_) {
+            return;
+        }
+        if (context) {
+            parameters_ = avcodec_parameters_alloc();
+            if (parameters_ && avcodec_parameters_from_context(parameters_, context) < 0) {
+                avcodec_parameters_free(&parameters_);
+            }
+        }
+        ready_ = true;
+        cond_.notify_all();
+    }
+
+    // 阻塞直到发布，成功时复制到output并返回true
+    bool wait_and_copy(AVCodecParameters* output) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cond_.wait(lock, [this] { return ready_; });
+        return parameters_ && avcodec_parameters_copy(output, parameters_) >= 0;
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    bool ready_ = false;
+    AVCodecParameters* parameters_ = nullptr;
+};
+
+// 队列元素引用的缓冲字节数：帧/包按其引用的AVBufferRef计（av_frame_ref共享的缓冲在每个引用处各计一次）
+inline int64_t queued_item_bytes(AVFrame* frame) {
+    if (!frame) {
+        return 0;
+    }
+    int64_t bytes = 0;
+    for (int i = 0; i < AV_NUM_DATA_POINTERS && frame->buf[i]; ++i) {
+        bytes += frame->buf[i]->size;
+    }
+    for (int i = 0; i < frame->nb_extended_buf; ++i) {
+        bytes += frame->extended_buf[i]->size;
+    }
+    return bytes;
+}
+
+inline int64_t queued_item_bytes(AVPacket* packet) {
+    if (!packet) {
+        return 0;
+    }
+    return packet->buf ? packet->buf->size : packet->size;
+}
+
+template <typename T>
+int64_t queued_item_bytes(const T&) {
+    return 0;
+}
+
 // 基础线程安全队列模板
 template <typename T>
 class ThreadSafeQueue {
@@ -25,13 +133,25 @@ public:
     // 赋值运算符也被删除，确保队列实例不能被复制或赋值。
     ThreadSafeQueue& operator=(const ThreadSafeQueue&) = delete;
 
-    // 向队列中推送一个元素
-    void push(T value) {
-        std::lock_guard<std::mutex> lock(mutex_);
-        if (!finished_) {
-            queue_.push(std::move(value));
-            cond_.notify_one();
+    // 向队列中推送一个元素；队列已结束时丢弃并返回false（指针元素的所有权仍归调用方）
+    // 设置了容量时先阻塞到队列长度小于容量（计为生产者阶段阻塞在输出）
+    bool push(T value) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (capacity_ > 0 && queue_.size() >= capacity_ && !finished_) {
+            OutputBlockTimer blocked;
+            space_cond_.wait(lock, [this] { return capacity_ == 0 || queue_.size() < capacity_ || finished_; });
         }
+        if (finished_) {
+            return false;
+        }
+        account_bytes(queued_item_bytes(value));
+        queue_.push(std::move(value));
+        pushed_count_++;
+        cond_.notify_one();
+        if (notifier_) {
+            notifier_->notify();
+        }
+        return true;
     }
 
     // 从队列中弹出一个元素，如果队列为空且未结束则阻塞等待
@@ -45,14 +165,48 @@ public:
         
         value = std::move(queue_.front());
         queue_.pop();
+        account_bytes(-queued_item_bytes(value));
+        space_cond_.notify_all();
+        return true;
+    }
+
+    // 非阻塞弹出：队列为空时立即返回false（结束与否用is_finished()区分）
+    bool try_pop(T& value) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (queue_.empty()) {
+            return false;
+        }
+        value = std::move(queue_.front());
+        queue_.pop();
+        account_bytes(-queued_item_bytes(value));
+        space_cond_.notify_all();
         return true;
     }
 
+    // 生产者限流：阻塞直到队列长度小于capacity，或队列已结束（消费者退出）
+    void wait_for_space(size_t capacity) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        space_cond_.wait(lock, [this, capacity] { return queue_.size() < capacity || finished_; });
+    }
+
     // 标记队列结束，唤醒所有等待的线程
     void finish() {
         std::lock_guard<std::mutex> lock(mutex_);
         finished_ = true;
         cond_.notify_all();
+        space_cond_.notify_all();
+        if (notifier_) {
+            notifier_->notify();
+        }
+    }
+
+    // 关联多队列通知器（nullptr取消关联）；在队列锁内通知，取消关联返回后不会再访问通知器
+    void set_notifier(QueueNotifier* notifier) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        notifier_ = notifier;
+        if (notifier_) {
+            notifier_->notify();
+        }
     }
 
     // 检查队列是否为空
@@ -67,6 +221,45 @@ public:
         return queue_.size();
     }
 
+    // 队列中元素引用的缓冲字节数及其峰值
+    int64_t bytes() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return bytes_;
+    }
+
+    int64_t peak_bytes() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return peak_bytes_;
+    }
+
+    /**
+     * 运行时容量（0表示无界，默认）：push在队列满时阻塞，可在运行中随时调整，缩小时不丢弃已有元素
+     * 只能用于消费者退出前一定会结束该队列、且消费者不会反过来等待生产者其他输出的队列
+     * （即单链路的帧队列；解封装/封装两端的包队列保持无界，避免音视频交错导致死锁）
+     */
+    void set_capacity(size_t capacity) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        capacity_ = capacity;
+        space_cond_.notify_all();
+    }
+
+    size_t capacity() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return capacity_;
+    }
+
+    // 关联任务级内存计量（nullptr取消关联）：必须在生产者开始推送之前设置
+    void set_memory_gauge(MemoryGauge* gauge) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        gauge_ = gauge;
+    }
+
+    // 累计入队元素数（进度统计：上游阶段的产出）
+    uint64_t pushed_count() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return pushed_count_;
+    }
+
     // 检查是否已完成
     bool is_finished() const {
         std::lock_guard<std::mutex> lock(mutex_);
@@ -77,7 +270,26 @@ protected:
     mutable std::mutex mutex_;
     std::queue<T> queue_;
     std::condition_variable cond_;
+    std::condition_variable space_cond_;  // 出队或结束时通知，供wait_for_space使用
     std::atomic<bool> finished_;
+    QueueNotifier* notifier_ = nullptr;
+    uint64_t pushed_count_ = 0;
+    int64_t bytes_ = 0;
+    int64_t peak_bytes_ = 0;
+    size_t capacity_ = 0;
+    MemoryGauge* gauge_ = nullptr;
+
+    // 调用方持有mutex_；子类clear()释放全部元素后以-bytes_调用
+    void account_bytes(int64_t delta) {
+        if (delta == 0) {
+            return;
+        }
+        bytes_ += delta;
+        peak_bytes_ = std::max(peak_bytes_, bytes_);
+        if (gauge_) {
+            gauge_->add(delta);
+        }
+    }
 };
 
 // 专用的视频包队列
@@ -99,6 +311,7 @@ public:
                 av_packet_free(&packet);
             }
         }
+        account_bytes(-bytes_);
     }
 };
 
@@ -120,6 +333,7 @@ public:
                 av_packet_free(&packet);
             }
         }
+        account_bytes(-bytes_);
     }
 };
 
@@ -141,6 +355,7 @@ public:
                 av_frame_free(&frame);
             }
         }
+        account_bytes(-bytes_);
     }
 };
 
@@ -162,6 +377,7 @@ public:
                 av_frame_free(&frame);
             }
         }
+        account_bytes(-bytes_);
     }
 };
 
@@ -182,6 +398,7 @@ public:
                 av_packet_free(&packet);
             }
         }
+        account_bytes(-bytes_);
     }
 };
 
@@ -202,5 +419,6 @@ public:
                 av_packet_free(&packet);
             }
         }
+        account_bytes(-bytes_);
     }
 };
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "demuxer.h"
+#include "video_processor.h"
+#include "video_encoder.h"
+#include <string>
+
+// 首遍分析参数：与最终遍使用相同的解码、处理与编码配置
+struct FirstPassParams {
+    const char* input_filename = nullptr;
+    VideoProcessParams process_params;
+    TargetVideoFormat target_format = TargetVideoFormat::MPEG4;
+    VideoEncoderParams encode_params;
+    int decode_threads = 1;
+    std::string cache_dir;        // 为空时使用默认缓存目录
+};
+
+// 默认缓存目录：$XDG_CACHE_HOME/video_transcoder/2pass，其次~/.cache/...，最后/tmp/...
+std::string default_two_pass_cache_dir();
+
+/**
+ * 首遍统计的缓存键：素材身份（绝对路径、大小、修改时间）+ 影响帧序列与分析结果的参数
+ * 不包含目标码率，同一素材不同码率的多个版本共享一次首遍分析
+ */
+std::string first_pass_cache_key(const FirstPassParams& params);
+
+/**
+ * 准备首遍统计：缓存命中时直接返回，否则运行一遍 解封装→解码→处理→编码(pass=1) 分析
+ * stats_file返回可供第二遍使用的统计文件路径
+ */
+bool prepare_first_pass_stats(const FirstPassParams& params, const StreamInfo& stream_info,
+                              std::string& stats_file);
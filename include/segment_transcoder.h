@@ -0,0 +1,58 @@
+#pragma once
+
+#include "queue.h"
+#include "demuxer.h"
+#include "video_processor.h"
+#include "video_encoder.h"
+#include <atomic>
+#include <vector>
+
+extern "C" {
+#include <libavformat/avformat.h>
+}
+
+// 一个GOP对齐的视频分段（视频流时间基下的关键帧dts）
+struct VideoSegment {
+    int index = 0;
+    int64_t start = AV_NOPTS_VALUE;  // AV_NOPTS_VALUE表示文件开头
+    int64_t end = AV_NOPTS_VALUE;    // AV_NOPTS_VALUE表示文件结尾
+};
+
+// 分段并行转码参数
+struct SegmentTranscodeParams {
+    const char* input_filename = nullptr;
+    int parallel_segments = 2;      // 分段工作线程数（同时运行的分段流水线数上限）
+    const std::atomic<int>* active_limit = nullptr;  // 可选：运行时调整的并行度（自动调优），序号不小于它的工作线程暂停领取新分段
+    QueueNotifier* limit_changed = nullptr;          // 与active_limit一起设置：修改并行度后通知，唤醒暂停的工作线程
+    double segment_seconds = 0.0;   // 目标分段时长，0表示按并行度自动计算
+    int decode_threads = 1;         // 每个分段的解码线程数
+    
+    VideoProcessParams process_params;
+    TargetVideoFormat target_format = TargetVideoFormat::MPEG4;
+    VideoEncoderParams encode_params;  // thread_count为每个分段编码器的线程数
+    
+    const std::atomic<bool>* cancel_flag = nullptr;  // 置位后正在运行的分段停止读取，未开始的分段跳过
+    
+    // 可选的阶段指标，所有分段累加到同一组计数（处理/编码阶段的指标在process_params/encode_params中）
+    StageMetrics* demux_metrics = nullptr;
+    StageMetrics* decode_metrics = nullptr;
+    MemoryGauge* queue_memory = nullptr;  // 可选：分段内部队列与分段输出队列计入任务级队列内存
+};
+
+// 扫描视频流关键帧的dts（优先使用容器索引，不完整时逐包扫描）
+bool scan_video_keyframes(const char* input_filename, int video_stream_index,
+                          std::vector<int64_t>& keyframes, AVRational& time_base);
+
+// 按目标时长将关键帧合并为分段，每段至少包含一个关键帧
+std::vector<VideoSegment> plan_video_segments(const std::vector<int64_t>& keyframes,
+                                              AVRational time_base,
+                                              double segment_seconds);
+
+/**
+ * 分段并行视频转码线程函数
+ * 每个分段运行独立的 解封装→解码→处理→编码 流水线，最多parallel_segments个同时运行；
+ * 编码结果按分段顺序拼接，时间戳按已输出帧数累加，保证输出时间轴连续
+ */
+void segment_video_transcode_thread_func(const SegmentTranscodeParams& params,
+                                         const StreamInfo& stream_info,
+                                         EncodedVideoPacketQueue* encoded_video_queue);
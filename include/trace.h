@@ -0,0 +1,126 @@
+#pragma once
+
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// 单调时钟（纳秒）：阶段指标与时间线共用
+inline int64_t trace_now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+constexpr int64_t kNoTraceFrameId = INT64_MIN;
+
+/**
+ * 帧标识：解封装时取包的源流时间戳（换算为微秒），经AVPacket/AVFrame的opaque字段随数据传递
+ * （编解码器打开时设置AV_CODEC_FLAG_COPY_OPAQUE，由FFmpeg从包带到帧、从帧带到包，B帧重排序后依然对应），
+ * 同一帧在解封装、解码、处理、编码、封装各阶段的时间段带相同的标识；变速复制的帧沿用源帧的标识
+ * opaque中存为 (id << 1) | 1，保证非空，nullptr表示没有标识
+ */
+inline void* trace_frame_id_to_opaque(int64_t frame_id) {
+    if (frame_id == kNoTraceFrameId) {
+        return nullptr;
+    }
+    return reinterpret_cast<void*>(static_cast<uintptr_t>((static_cast<uint64_t>(frame_id) << 1) | 1));
+}
+
+inline int64_t trace_frame_id_from_opaque(const void* opaque) {
+    if (!opaque) {
+        return kNoTraceFrameId;
+    }
+    return static_cast<int64_t>(reinterpret_cast<uintptr_t>(opaque)) >> 1;
+}
+
+// 一个时间段：name指向静态字符串（阶段名或子步骤名）
+struct TraceEvent {
+    const char* name;
+    int64_t begin_ns;
+    int64_t end_ns;
+    int64_t frame_id;  // 帧标识（源流时间戳，微秒），kNoTraceFrameId表示未知
+};
+
+/**
+ * 单个线程的时间段缓冲：只有所属线程追加，写出在线程结束后进行，因此无锁
+ * 达到上限后丢弃新的时间段（长任务不会无限占用内存），写出时报告丢弃数
+ */
+class TraceBuffer {
+public:
+    static constexpr size_t kMaxEvents = 1 << 20;
+
+    TraceBuffer(const std::string& thread_name, int thread_id) : thread_name_(thread_name), thread_id_(thread_id) {
+        events_.reserve(4096);
+    }
+
+    void add(const char* name, int64_t begin_ns, int64_t end_ns, int64_t frame_id) {
+        if (events_.size() < kMaxEvents) {
+            events_.push_back({name, begin_ns, end_ns, frame_id});
+        } else {
+            ++dropped_;
+        }
+    }
+
+    const std::string& thread_name() const { return thread_name_; }
+    int thread_id() const { return thread_id_; }
+    const std::vector<TraceEvent>& events() const { return events_; }
+    uint64_t dropped() const { return dropped_; }
+
+private:
+    std::string thread_name_;
+    int thread_id_;
+    std::vector<TraceEvent> events_;
+    uint64_t dropped_ = 0;
+};
+
+/**
+ * 一个任务的时间线：每个阶段线程启动时登记一个缓冲（仅此处加锁），
+ * 所有线程结束后写出Chrome trace-event JSON，可直接用Perfetto/chrome://tracing打开
+ */
+class TraceSession {
+public:
+    TraceSession() : start_ns_(trace_now_ns()) {}
+
+    TraceSession(const TraceSession&) = delete;
+    TraceSession& operator=(const TraceSession&) = delete;
+
+    TraceBuffer* register_thread(const char* thread_name);
+
+    // 必须在全部登记线程结束后调用
+    bool write(const std::string& filename) const;
+
+private:
+    int64_t start_ns_;
+    std::mutex mutex_;
+    std::list<TraceBuffer> buffers_;  // list保证登记后地址不变
+};
+
+/**
+ * 子步骤时间段（如GL上传/绘制/回读）：构造时开始，end()或析构时结束
+ * buffer为nullptr时为空操作
+ */
+class TraceScope {
+public:
+    TraceScope(TraceBuffer* buffer, const char* name, int64_t frame_id)
+        : buffer_(buffer), name_(name), frame_id_(frame_id), begin_ns_(buffer ? trace_now_ns() : 0) {}
+    ~TraceScope() { end(); }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+    void end() {
+        if (buffer_) {
+            buffer_->add(name_, begin_ns_, trace_now_ns(), frame_id_);
+            buffer_ = nullptr;
+        }
+    }
+
+private:
+    TraceBuffer* buffer_;
+    const char* name_;
+    int64_t frame_id_;
+    int64_t begin_ns_;
+};
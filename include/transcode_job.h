@@ -0,0 +1,203 @@
+#pragma once
+
+#include "demuxer.h"
+#include "muxer.h"
+#include "media_io.h"
+#include "progress.h"
+#include "video_encoder.h"
+#include <atomic>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * 任务模式：只构建需要的那一半流水线
+ * - AUDIO_ONLY：播客/音轨提取，不创建视频队列与线程，不初始化GLFW/OpenGL
+ * - VIDEO_ONLY：静音视频，不创建音频队列与线程
+ */
+enum class TranscodeMode {
+    AUDIO_VIDEO,
+    AUDIO_ONLY,
+    VIDEO_ONLY
+};
+
+// 一个转码任务的完整配置（命令行的每个参数/开关都对应这里的一个字段）
+struct TranscodeOptions {
+    // 输入输出：reader/writer非空时走回调IO，文件名仅用于日志
+    std::string input_filename;
+    MediaReader* input_reader = nullptr;
+    std::string output_filename;
+    MediaWriter* custom_output = nullptr;
+    TranscodeMode mode = TranscodeMode::AUDIO_VIDEO;  // 输入缺少某一路流时自动退化为单流任务
+
+    // 处理参数
+    double speed_factor = 1.0;   // 0.1x-5x
+    float rotation_angle = 0.0f;
+    bool enable_blur = false;
+    bool enable_sharpen = true;
+    bool enable_grayscale = false;
+    float brightness = 1.1f;     // 0.0-2.0
+    float contrast = 1.2f;       // 0.0-2.0
+
+    // 视频编码
+    TargetVideoFormat video_format = TargetVideoFormat::MPEG4;
+    VideoEncoderPreset video_preset = VideoEncoderPreset::MEDIUM;
+    int crf = -1;                // >=0时使用恒定质量模式
+    int video_bitrate = 800000;
+    bool two_pass = false;
+    std::string pass_cache_dir;  // 为空时使用默认缓存目录
+    bool adaptive = false;
+    bool scene_cut = false;
+    int max_gop = -1;            // --scene-cut时的最大关键帧间隔，<0表示默认（分段输出为一个分段时长，否则10秒）
+    std::string frame_stats_file;
+
+    // 线程与分段并行
+    int total_cores = 0;         // 0表示全部核心
+    VideoThreadType thread_type = VideoThreadType::AUTO;
+    bool segmented = false;
+    int parallel_segments = 0;   // 0表示按核心数自动
+    double segment_seconds = 0.0;
+
+    // 输出容器与写入
+    OutputContainer container = OutputContainer::AVI;
+    int fragment_duration_ms = 2000;
+    int segment_duration_ms = 4000;
+    std::vector<std::string> tee_outputs;  // 额外输出文件，容器按扩展名推断
+    bool sync_output = false;
+    bool direct_io = false;
+    bool preallocate = false;
+
+    // 进度报告：每隔progress_interval_ms采样一次帧率/速度/队列深度/剩余时间
+    bool progress = false;
+    int progress_interval_ms = 1000;
+    std::string progress_json_file;  // 非空时写JSON行（"-"为标准输出），否则打印文本行
+
+    // 任务结束时打印各阶段忙碌/等待输入/等待输出/CPU时间占比、限制阶段与调整建议
+    bool stage_report = false;
+
+    // 自动调优：运行中按阶段阻塞占比调整帧队列容量与分段并行度（否则帧队列无界、并行度固定）
+    bool auto_tune = false;
+    int64_t tune_memory_bytes = 0;  // 调优控制的队列内存上限（不含解封装/封装两端的包队列），0表示按帧大小自动（64帧解码后视频+64MB）
+
+    // 时间线：非空时记录各阶段每个输入的处理时间段（含OpenGL子步骤），任务结束后写出Chrome trace JSON
+    std::string trace_file;
+};
+
+/**
+ * 命令行解析结果：位置参数保持原有顺序与含义，"--"开头的为可选开关
+ * 开关格式：--name 或 --name=value
+ */
+struct CommandLine {
+    std::vector<std::string> positional;
+    std::map<std::string, std::string> options;
+
+    bool has(const std::string& name) const { return options.count(name) > 0; }
+
+    std::string get(const std::string& name, const std::string& default_value) const {
+        auto it = options.find(name);
+        return it != options.end() ? it->second : default_value;
+    }
+};
+
+// 解析命令行参数（不含程序名）
+CommandLine parse_command_line(const std::vector<std::string>& arguments);
+
+// 命令行 → 任务配置（命令行与批处理任务列表共用），参数无法解析时返回false（原因输出到stderr）
+bool transcode_options_from_command_line(const CommandLine& cmd, TranscodeOptions& options);
+
+enum class TranscodeJobState {
+    CREATED,
+    CONFIGURED,
+    RUNNING,
+    FINISHED,
+    FAILED,
+    CANCELLED
+};
+
+// 队列快照：depth为当前排队数，pushed为累计入队数（即上游阶段的累计产出）
+struct QueueStats {
+    const char* name = "";
+    size_t depth = 0;
+    uint64_t pushed = 0;
+    int64_t bytes = 0;       // 队列中帧/包引用的缓冲字节数
+    int64_t peak_bytes = 0;
+    size_t capacity = 0;     // 0表示无界（自动调优时为当前容量）
+};
+
+// 任务统计：运行中可随时读取
+struct TranscodeStats {
+    TranscodeJobState state = TranscodeJobState::CREATED;
+    double elapsed_seconds = 0.0;   // 从start()开始计时
+    int64_t input_duration = 0;     // 输入时长（AV_TIME_BASE单位），未知为0
+    int64_t output_time_us = 0;     // 主输出已写到的时间点
+    int64_t video_packets = 0;      // 主输出已写出的包数
+    int64_t audio_packets = 0;
+    int64_t bytes_written = 0;      // 主输出已写出的字节数
+    std::vector<QueueStats> queues; // 按流水线顺序，未创建的队列不出现（分段并行时视频前三级在各分段内部）
+
+    // 内存：用于按实测数据设置容器内存上限
+    int64_t queued_bytes = 0;            // 全部队列（含分段内部与tee队列）中帧/包引用的字节数
+    int64_t peak_queued_bytes = 0;
+    int64_t scratch_bytes = 0;           // 各阶段的临时/池化缓冲（格式转换、旋转回读、滤镜副本、SoundTouch与环形缓冲）
+    int64_t peak_scratch_bytes = 0;      // 各阶段峰值之和（上界）
+    int64_t process_rss_bytes = 0;       // 进程常驻内存（批处理时包含同进程的其他任务）
+    int64_t process_peak_rss_bytes = 0;
+};
+
+// 进程级一次性初始化（FFmpeg日志/网络模块），多次调用只生效一次；TranscodeJob::configure会自动调用
+void transcoder_global_init();
+
+// 进程退出前调用：释放所有任务共享的GLFW状态，必须在全部任务结束之后
+void transcoder_global_shutdown();
+
+/**
+ * 转码任务：configure → start → wait/cancel → stats
+ * 每个任务拥有自己的队列与线程，同一进程中可以同时运行多个任务；
+ * FFmpeg与GLFW的进程级状态只初始化一次，由所有任务共享
+ */
+class TranscodeJob {
+public:
+    TranscodeJob();
+    ~TranscodeJob();  // 仍在运行时取消并等待
+
+    TranscodeJob(const TranscodeJob&) = delete;
+    TranscodeJob& operator=(const TranscodeJob&) = delete;
+
+    // 校验参数并探测输入，失败时返回false（原因输出到stderr）
+    bool configure(const TranscodeOptions& options);
+
+    // 构建流水线并启动全部线程（两遍编码的首遍在此同步执行）
+    bool start();
+
+    // 等待全部线程结束，主输出完整写出时返回true
+    bool wait();
+
+    // 请求取消：停止读取输入，流水线排空后结束（输出为截断但可播放的文件），需随后调用wait()
+    void cancel();
+
+    TranscodeStats stats() const;
+    TranscodeJobState state() const { return state_.load(); }
+    const StreamInfo& stream_info() const { return stream_info_; }
+    const TranscodeOptions& options() const { return options_; }
+
+    // 各阶段指标，start()之前为nullptr；任务对象销毁前有效
+    const PipelineMetrics* metrics() const;
+
+private:
+    struct Pipeline;
+
+    TranscodeOptions options_;
+    StreamInfo stream_info_;
+    bool run_video_ = false;
+    bool run_audio_ = false;
+
+    std::unique_ptr<Pipeline> pipeline_;
+    std::vector<std::thread> threads_;
+    ProgressReporter progress_;
+    std::atomic<bool> cancel_requested_{false};
+    std::atomic<TranscodeJobState> state_{TranscodeJobState::CREATED};
+    int64_t start_time_us_ = 0;
+    std::atomic<int64_t> end_time_us_{0};
+};
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "queue.h"
+#include "pipeline_metrics.h"
 
 extern "C" {
 #include <libavcodec/avcodec.h>
@@ -12,6 +13,10 @@ void video_decode_thread_func(VideoPacketQueue* video_packet_queue,
                               const char* output_filename);
 
 // 新的解码到Frame队列函数（用于完整转码流程）
+// thread_count: 解码线程数，0表示自动（帧级+条带并行），1表示单线程
+// metrics: 可选的阶段指标，解码失败的包计入drops
 void video_decode_to_frames_thread_func(VideoPacketQueue* video_packet_queue,
                                         VideoFrameQueue* video_frame_queue,
-                                        AVCodecParameters* codec_params);
+                                        AVCodecParameters* codec_params,
+                                        int thread_count = 1,
+                                        StageMetrics* metrics = nullptr);
@@ -1,12 +1,55 @@
 #pragma once
 
 #include "queue.h"
+#include "pipeline_metrics.h"
+#include "encoder_stats.h"
+#include <chrono>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
 
 extern "C" {
 #include <libavcodec/avcodec.h>
 #include <libavformat/avformat.h>
 }
 
+// 目标视频格式枚举
+enum class TargetVideoFormat {
+    MPEG4,  // MPEG-4 Part 2（默认，兼容性最好）
+    H264,   // libx264
+    HEVC,   // libx265
+    VP9,    // libvpx-vp9
+    AV1     // libsvtav1，不可用时回退到libaom-av1
+};
+
+// 速度/质量预设（沿用x264命名，各后端映射到自己的参数）
+enum class VideoEncoderPreset {
+    ULTRAFAST,
+    SUPERFAST,
+    VERYFAST,
+    FASTER,
+    FAST,
+    MEDIUM,
+    SLOW,
+    SLOWER,
+    VERYSLOW
+};
+
+// 码率控制模式
+enum class VideoRateControl {
+    BITRATE,  // 平均码率（使用bitrate）
+    CRF,      // 恒定质量（使用crf，MPEG4映射为固定量化qscale）
+    TWO_PASS  // 两遍平均码率：首遍分析生成统计，第二遍按统计分配码率（见rate_control.h）
+};
+
+// 编码器线程模型
+enum class VideoThreadType {
+    AUTO,   // 优先帧级并行，编码器不支持时回退到条带并行（低延迟模式只用条带并行）
+    FRAME,  // 帧级并行：吞吐量高，增加thread_count帧的延迟
+    SLICE   // 条带并行：无额外延迟，每帧被切分为多个条带
+};
+
 // 视频编码器配置参数
 struct VideoEncoderParams {
     int width = 0;
@@ -17,9 +60,205 @@ struct VideoEncoderParams {
     AVPixelFormat pixel_format = AV_PIX_FMT_YUV420P;
     int gop_size = 12;      // 关键帧间隔
     int max_b_frames = 2;   // B帧数量
+    
+    // 预设与码率控制
+    VideoEncoderPreset preset = VideoEncoderPreset::MEDIUM;
+    VideoRateControl rate_control = VideoRateControl::BITRATE;
+    int crf = 23;              // 0-51，数值越小质量越高（VP9/AV1按0-63比例换算）
+    bool low_latency = false;  // 低延迟调优（x264/x265 zerolatency，VP9 realtime）
+    
+    // 线程配置（默认值由全局核心预算给出，见core_budget.h）
+    int thread_count = 0;                           // 0表示由编码器自动决定
+    VideoThreadType thread_type = VideoThreadType::AUTO;
+    int lookahead_threads = 0;                      // x264/x265前瞻线程，0表示由编码器决定
+    
+    // 两遍编码（仅TWO_PASS模式）：pass=1为分析遍，写出stats_file；pass=2读取stats_file
+    int pass = 0;
+    std::string stats_file;
+    
+    // 内容自适应码率：根据帧附带的FrameAnalysis（见frame_analysis.h）在基准码率/CRF附近浮动
+    bool adaptive_rate = false;
+    double complexity_reference = 12.0;  // 对应基准码率的平均复杂度，高于此值提高码率
+    
+    // 镜头切换关键帧：在FrameAnalysis::scene_cut标记的帧插入IDR，切换之间的GOP放宽到max_gop_size
+    bool scene_cut_keyframes = false;
+    int max_gop_size = 0;  // 0表示10秒（fps×10）
+    
+    // 逐帧统计输出文件（见encoder_stats.h），为空表示不输出；.bin扩展名为二进制格式
+    std::string frame_stats_file;
+    
+    // 容器要求全局头时置位（参数集放入extradata）；parameters_out非空时编码器打开后向封装器发布流参数
+    bool global_header = false;
+    CodecParametersSlot* parameters_out = nullptr;
+    
+    StageMetrics* metrics = nullptr;  // 可选的阶段指标
+};
+
+// 视频编码器抽象基类接口（与IAudioEncoder对应）
+class IVideoEncoder {
+public:
+    virtual ~IVideoEncoder() = default;
+    
+    // 初始化编码器
+    virtual bool initialize(const VideoEncoderParams& params) = 0;
+    
+    // 编码单个视频帧（不释放frame）；出错或输出队列已结束（封装线程已退出）时返回false
+    virtual bool encode_frame(AVFrame* frame, EncodedVideoPacketQueue* output_queue) = 0;
+    
+    // 刷新编码器（获取延迟的包）
+    virtual bool flush(EncodedVideoPacketQueue* output_queue) = 0;
+    
+    // 获取编码器信息
+    virtual const char* get_encoder_name() const = 0;
+    virtual AVCodecID get_codec_id() const = 0;
+    
+    // 记录下一帧在输入队列上的等待时间（写入逐帧统计），在encode_frame之前调用
+    virtual void record_queue_wait(double milliseconds) { (void)milliseconds; }
+    
+protected:
+    VideoEncoderParams params_;
+    AVCodecContext* codec_context_ = nullptr;
+    const AVCodec* codec_ = nullptr;
+};
+
+// 基于libavcodec的通用实现：公共参数设置与send/receive循环，后端只负责私有选项
+class FFmpegVideoEncoder : public IVideoEncoder {
+public:
+    ~FFmpegVideoEncoder() override;
+    
+    bool initialize(const VideoEncoderParams& params) override;
+    bool encode_frame(AVFrame* frame, EncodedVideoPacketQueue* output_queue) override;
+    bool flush(EncodedVideoPacketQueue* output_queue) override;
+    const char* get_encoder_name() const override;
+    void record_queue_wait(double milliseconds) override { queue_wait_ms_ = milliseconds; }
+    
+protected:
+    // 按优先级排列的libavcodec编码器名称，第一个可用的被选中
+    virtual std::vector<const char*> candidate_encoders() const = 0;
+    
+    // 设置后端私有选项（预设、码率控制等），在avcodec_open2之前调用
+    virtual bool configure_codec(AVDictionary** options) = 0;
+    
+    // 送入编码器前的逐帧处理（例如固定量化模式下设置frame->quality）
+    virtual void prepare_frame(AVFrame* frame) { (void)frame; }
+    
+    // 两遍编码统计的传递方式
+    enum class StatsTransport {
+        ENCODER_FILE,          // 编码器自行读写统计文件（x264/x265，通过私有选项传入路径）
+        STATS_OUT_PER_PACKET,  // 每输出一个包追加一次stats_out（MPEG4）
+        STATS_OUT_AT_FLUSH     // 刷新后stats_out包含完整统计（libvpx/libaom）
+    };
+    virtual StatsTransport stats_transport() const { return StatsTransport::STATS_OUT_PER_PACKET; }
+    
+    // 按比例调整码率（scale>1提高码率/质量），编码过程中随时可能调用；不支持运行时调整的后端返回false
+    virtual bool apply_rate_scale(double scale) { (void)scale; return false; }
+    
+private:
+    bool receive_packets(EncodedVideoPacketQueue* output_queue);
+    bool load_stats_in();
+    bool write_stats_out();
+    void update_rate_from_analysis(const AVFrame* frame);
+    void apply_scene_cut(AVFrame* frame);
+    void write_frame_stats(const AVPacket* packet);
+    
+    AVPacket* packet_ = nullptr;
+    std::string stats_in_;    // 第二遍输入统计（stats_in指向此缓冲区，生命周期长于编码器上下文）
+    std::string stats_out_;   // 首遍累计的统计
+    
+    // 自适应码率状态：复杂度的指数滑动平均与当前生效的比例
+    double complexity_average_ = 0.0;
+    double applied_rate_scale_ = 1.0;
+    bool has_complexity_ = false;
+    bool adaptive_rate_active_ = false;
+    
+    int forced_keyframes_ = 0;  // 镜头切换强制的关键帧数
+    
+    // 逐帧统计：按pts记录送入时间，取回包时计算编码延迟
+    struct PendingFrame {
+        std::chrono::steady_clock::time_point send_time;
+        double queue_wait_ms;
+    };
+    EncoderStatsWriter frame_stats_;
+    std::map<int64_t, PendingFrame> pending_frames_;
+    double queue_wait_ms_ = 0.0;
+    int64_t output_frames_ = 0;
+};
+
+// MPEG4编码器实现（默认）
+class MPEG4VideoEncoder : public FFmpegVideoEncoder {
+public:
+    AVCodecID get_codec_id() const override { return AV_CODEC_ID_MPEG4; }
+protected:
+    std::vector<const char*> candidate_encoders() const override { return {"mpeg4"}; }
+    bool configure_codec(AVDictionary** options) override;
+    void prepare_frame(AVFrame* frame) override;
+    bool apply_rate_scale(double scale) override;
+private:
+    int base_quality_ = 0;  // 固定量化模式下的基准lambda
 };
 
-// 视频编码线程函数
+// H.264编码器实现（libx264）
+class H264VideoEncoder : public FFmpegVideoEncoder {
+public:
+    AVCodecID get_codec_id() const override { return AV_CODEC_ID_H264; }
+protected:
+    std::vector<const char*> candidate_encoders() const override { return {"libx264"}; }
+    bool configure_codec(AVDictionary** options) override;
+    StatsTransport stats_transport() const override { return StatsTransport::ENCODER_FILE; }
+    bool apply_rate_scale(double scale) override;
+};
+
+// HEVC编码器实现（libx265）
+class HEVCVideoEncoder : public FFmpegVideoEncoder {
+public:
+    AVCodecID get_codec_id() const override { return AV_CODEC_ID_HEVC; }
+protected:
+    std::vector<const char*> candidate_encoders() const override { return {"libx265"}; }
+    bool configure_codec(AVDictionary** options) override;
+    StatsTransport stats_transport() const override { return StatsTransport::ENCODER_FILE; }
+};
+
+// VP9编码器实现（libvpx-vp9）
+class VP9VideoEncoder : public FFmpegVideoEncoder {
+public:
+    AVCodecID get_codec_id() const override { return AV_CODEC_ID_VP9; }
+protected:
+    std::vector<const char*> candidate_encoders() const override { return {"libvpx-vp9"}; }
+    bool configure_codec(AVDictionary** options) override;
+    StatsTransport stats_transport() const override { return StatsTransport::STATS_OUT_AT_FLUSH; }
+};
+
+// AV1编码器实现（优先SVT-AV1，回退libaom；两遍编码只能使用libaom）
+class AV1VideoEncoder : public FFmpegVideoEncoder {
+public:
+    AVCodecID get_codec_id() const override { return AV_CODEC_ID_AV1; }
+protected:
+    std::vector<const char*> candidate_encoders() const override;
+    bool configure_codec(AVDictionary** options) override;
+    StatsTransport stats_transport() const override { return StatsTransport::STATS_OUT_AT_FLUSH; }
+};
+
+// 视频编码器工厂函数
+std::unique_ptr<IVideoEncoder> create_video_encoder(TargetVideoFormat format);
+
+// 目标格式与编码ID的相互映射
+AVCodecID video_format_codec_id(TargetVideoFormat format);
+bool video_format_from_codec_id(AVCodecID codec_id, TargetVideoFormat& format);
+
+// 命令行字符串解析（mpeg4/h264/hevc/vp9/av1，ultrafast...veryslow）
+bool parse_video_format(const std::string& name, TargetVideoFormat& format);
+bool parse_video_preset(const std::string& name, VideoEncoderPreset& preset);
+
+// 当前FFmpeg构建中该格式实际选用的编码器是否支持两遍编码（SVT-AV1封装不支持）
+bool video_format_supports_two_pass(TargetVideoFormat format);
+
+// 基于工厂模式的视频编码线程函数
+void video_encode_thread_func_factory(VideoFrameQueue* video_frame_queue, 
+                                      EncodedVideoPacketQueue* encoded_video_queue,
+                                      TargetVideoFormat target_format,
+                                      const VideoEncoderParams& params);
+
+// 视频编码线程函数（按params.codec_id选择后端，保持向后兼容）
 void video_encode_thread_func(VideoFrameQueue* video_frame_queue, 
                               EncodedVideoPacketQueue* encoded_video_queue,
                               const VideoEncoderParams& params);
@@ -27,4 +266,4 @@ void video_encode_thread_func(VideoFrameQueue* video_frame_queue,
 // 便利函数：使用默认参数编码
 void video_encode_thread_func_simple(VideoFrameQueue* video_frame_queue, 
                                      EncodedVideoPacketQueue* encoded_video_queue,
-                                     int width, int height, int fps = 25);
\ No newline at end of file
+                                     int width, int height, int fps = 25);
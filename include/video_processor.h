@@ -1,6 +1,7 @@
 #pragma once
 
 #include "queue.h"
+#include "pipeline_metrics.h"
 
 extern "C" {
 #include <libavcodec/avcodec.h>
@@ -33,8 +34,33 @@ struct VideoProcessParams {
     // 视频变速参数（新增）
     bool enable_speed_change = false;  // 是否启用视频变速
     double speed_factor = 1.0;         // 变速倍数，1.0表示正常速度，>1为加速，<1为减速
+    
+    // 内容复杂度分析：为输出帧附加FrameAnalysis，供编码器自适应码率
+    bool enable_analysis = false;
+    
+    // 镜头切换检测：在分析结果中标记scene_cut，编码器据此强制关键帧
+    bool enable_scene_detection = false;
+    
+    StageMetrics* metrics = nullptr;  // 可选的阶段指标，变速丢弃的帧计入drops
 };
 
+// CPU滤镜内核（仅处理YUV420P，其他格式原样返回true）：不依赖OpenGL，可单独调用与基准测试
+namespace video_filters {
+
+// U/V平面置为128
+bool grayscale(AVFrame* frame);
+
+// Y平面：(y - 128) * contrast + 128，再乘以brightness
+bool brightness_contrast(AVFrame* frame, float brightness, float contrast);
+
+// Y平面3x3均值模糊，边缘一像素不变
+bool blur(AVFrame* frame);
+
+// Y平面拉普拉斯锐化 [0,-1,0; -1,5,-1; 0,-1,0]，边缘一像素不变
+bool sharpen(AVFrame* frame);
+
+} // namespace video_filters
+
 class VideoProcessor {
 public:
     VideoProcessor();
@@ -55,6 +81,9 @@ public:
     bool should_duplicate_frame(int64_t frame_pts); // 判断是否需要复制帧
     int64_t calculate_new_pts(int64_t original_pts) const; // 计算新的时间戳
     int64_t get_next_frame_pts(); // 获取下一帧的线性PTS（用于复制帧）
+    
+    // 时间线：OpenGL上传/绘制/回读作为所属阶段时间段的子步骤记录
+    void set_recorder(const StageRecorder* recorder) { recorder_ = recorder; }
 
 private:
     // OpenGL上下文相关
@@ -74,6 +103,7 @@ private:
     
     // 辅助函数
     bool allocate_output_frame(AVFrame* frame, int width, int height, AVPixelFormat format);
+    void track_scratch(int64_t delta);  // 计入阶段指标的临时缓冲用量
     
 private:
     VideoProcessParams params_;
@@ -114,6 +144,9 @@ private:
     int temp_buffer_size_;
     uint8_t* rgb_buffer_;
     int rgb_buffer_size_;
+    
+    const StageRecorder* recorder_ = nullptr;
+    int64_t scratch_bytes_ = 0;  // 已计入阶段指标的常驻缓冲字节数
 };
 
 // 视频处理线程函数
@@ -122,3 +155,6 @@ void video_process_thread_func(VideoFrameQueue* input_queue,
                               const VideoProcessParams& params,
                               int input_width, int input_height,
                               AVPixelFormat input_format);
+
+// 释放进程级GLFW状态：必须在所有视频处理线程结束后调用（通常在进程退出前）
+void video_processor_shutdown_gl();
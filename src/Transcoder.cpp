@@ -9,9 +9,9 @@
  * 但这里是多线程任务的调度中心。
  * 
  * 架构定位：
- * - 系统入口层：解析命令行参数，验证输入
- * - 线程协调层：创建并管理6个工作线程的生命周期
- * - 资源管理层：统一管理FFmpeg资源的分配与释放
+ * - 系统入口层：解析命令行参数，转换为TranscodeOptions
+ * - 线程协调层：由libtranscoder中的TranscodeJob创建并管理工作线程的生命周期
+ * - 资源管理层：进程级FFmpeg/GLFW状态由transcoder_global_init/shutdown统一管理
  * 
  * 交互模块：
  * - 与所有处理模块交互：demuxer, decoder, processor, encoder, muxer
@@ -72,305 +72,182 @@
  */
 
 #include <iostream>
-#include <thread>
+#include <string>
+#include <cstring>
+#include <cstdlib>
 #include <vector>
-#include "demuxer.h"
-#include "video_decoder.h"
-#include "audio_decoder.h"
-#include "video_processor.h"
-#include "audio_processor.h"
-#include "video_encoder.h"
-#include "audio_encoder.h"
-#include "muxer.h"
-#include "queue.h"
+#include "transcode_job.h"
+#include "batch_runner.h"
+#include "metrics_exporter.h"
+#include <csignal>
 
-extern "C" {
-#include <libavformat/avformat.h>
-#include <libavcodec/avcodec.h>
+// 批处理模式下SIGINT/SIGTERM只停止接收新任务，已启动的任务照常完成
+BatchRunner* g_batch_runner = nullptr;
+
+void handle_stop_signal(int) {
+    if (g_batch_runner) {
+        g_batch_runner->stop();
+    }
 }
 
-#include <GLFW/glfw3.h>
+// --metrics-port=N / --metrics-file=FILE / --metrics-interval=MS
+MetricsParams metrics_params_from_command_line(const CommandLine& cmd) {
+    MetricsParams params;
+    params.port = std::atoi(cmd.get("metrics-port", "0").c_str());
+    params.filename = cmd.get("metrics-file", "");
+    params.interval_ms = std::atoi(cmd.get("metrics-interval", "5000").c_str());
+    return params;
+}
+
+/**
+ * 批处理模式：--batch=FILE 或 --spool=DIR
+ * --threads为所有任务共享的核心预算，其余开关作为每个任务行的默认值
+ */
+int run_batch(const CommandLine& cmd) {
+    BatchParams params;
+    params.total_cores = std::atoi(cmd.get("threads", "0").c_str());
+    params.memory_budget_bytes = std::atoll(cmd.get("memory-budget", "0").c_str()) * 1024 * 1024;
+    params.max_concurrent_jobs = std::atoi(cmd.get("max-jobs", "0").c_str());
+    params.metrics = metrics_params_from_command_line(cmd);
+    params.defaults = cmd;
+    params.defaults.positional.clear();
+    for (const char* name : {"batch", "spool", "threads", "memory-budget", "max-jobs",
+                             "metrics-port", "metrics-file", "metrics-interval"}) {
+        params.defaults.options.erase(name);
+    }
+
+    int failed_jobs = 0;
+    {
+        BatchRunner runner(params);
+        g_batch_runner = &runner;
+        std::signal(SIGINT, handle_stop_signal);
+        std::signal(SIGTERM, handle_stop_signal);
+        failed_jobs = cmd.has("batch") ? runner.run_job_list(cmd.get("batch", ""))
+                                       : runner.watch_spool(cmd.get("spool", "."));
+        g_batch_runner = nullptr;
+    }
+    transcoder_global_shutdown();
+
+    if (failed_jobs != 0) {
+        std::cerr << "批处理结束: " << (failed_jobs < 0 ? "任务列表无法读取" : std::to_string(failed_jobs) + "个任务失败") << std::endl;
+        return -1;
+    }
+    std::cout << "批处理结束: 全部任务完成" << std::endl;
+    return 0;
+}
 
 /**
  * [代码逻辑详述]
  * 
  * 主函数执行流程：
- * 第一阶段：参数解析与验证 (行25-60)
- * 第二阶段：媒体文件信息获取 (行61-75) 
- * 第三阶段：数据流水线构建 (行76-85)
- * 第四阶段：6线程启动与配置 (行86-190)
- * 第五阶段：线程同步等待 (行191-200)
- * 第六阶段：资源清理 (行201-223)
+ * 第一阶段：命令行解析为TranscodeOptions（格式/编码器/线程模型等名称在此解析）
+ * 第二阶段：TranscodeJob::configure 参数校验与输入探测
+ * 第三阶段：TranscodeJob::start 构建流水线并启动全部线程
+ * 第四阶段：TranscodeJob::wait 等待完成
+ * 第五阶段：释放进程级资源（GLFW）
  */
 int main(int argc, char* argv[]) {
-    // ==================== 第一阶段：参数解析与健壮性检查 ====================
+    // ==================== 第一阶段：参数解析 ====================
     
     /**
      * 命令行接口设计：支持9个可选参数，向后兼容
      * 设计考量：参数过多时UX复杂，但提供了最大灵活性
      * 答辩要点：解释为什么不用配置文件而用命令行参数
      */
-    if (argc < 3) {
-        std::cerr << "用法: " << argv[0] << " <输入视频文件> <输出视频文件> [变速倍数] [旋转角度] [模糊:0/1] [锐化:0/1] [灰度:0/1] [亮度:0.0-2.0] [对比度:0.0-2.0]" << std::endl;
-        std::cerr << "例如: " << argv[0] << " input.mp4 output.avi 1.5 90 0 1 0 1.2 1.3" << std::endl;
-        return -1;
-    }
-
-    // 核心参数提取
-    const char* input_filename = argv[1];
-    const char* output_filename = argv[2];
+    CommandLine cmd = parse_command_line(std::vector<std::string>(argv + 1, argv + argc));
     
-    /**
-     * 变速倍数解析：支持0.1x到5x倍速
-     * 技术细节：double类型保证精度，std::atof提供容错性
-     * 风险点：用户输入非数字时std::atof返回0.0，需要范围检查兜底
-     */
-    double speed_factor = (argc > 3) ? std::atof(argv[3]) : 1.0;
-    float rotation_angle = (argc > 4) ? std::atof(argv[4]) : 0.0;
-    
-    // 滤镜参数：布尔值通过整数0/1表示，提供默认值策略
-    bool enable_blur = (argc > 5) ? (std::atoi(argv[5]) != 0) : false;
-    bool enable_sharpen = (argc > 6) ? (std::atoi(argv[6]) != 0) : true;  // 默认启用锐化
-    bool enable_grayscale = (argc > 7) ? (std::atoi(argv[7]) != 0) : false;
-    float brightness = (argc > 8) ? std::atof(argv[8]) : 1.1f;
-    float contrast = (argc > 9) ? std::atof(argv[9]) : 1.2f;
-
-    /**
-     * 参数边界检查：防御性编程实践
-     * 答辩要点：为什么选择这些边界值？
-     * - 0.1x-5x：基于人类感知极限和技术可行性
-     * - 亮度/对比度0-2倍：超出此范围图像质量严重劣化
-     */
-
-    if (speed_factor <= 0.1 || speed_factor > 5.0) {
-        std::cerr << "错误: 变速倍数必须在0.1到5.0之间" << std::endl;
-        return -1;
+    // 进度JSON写到标准输出时，日志与文本进度改走标准错误，保证标准输出只有JSON行
+    if (cmd.get("progress-json", "") == "-") {
+        std::cout.rdbuf(std::cerr.rdbuf());
     }
-
-    // 参数验证
-    if (brightness < 0.0f || brightness > 2.0f) {
-        std::cerr << "错误: 亮度值必须在0.0到2.0之间" << std::endl;
-        return -1;
+    
+    if (cmd.has("batch") || cmd.has("spool")) {
+        return run_batch(cmd);
     }
     
-    if (contrast < 0.0f || contrast > 2.0f) {
-        std::cerr << "错误: 对比度值必须在0.0到2.0之间" << std::endl;
+    if (cmd.positional.size() < 2) {
+        std::cerr << "用法: " << argv[0] << " [选项] <输入视频文件> <输出视频文件> [变速倍数] [旋转角度] [模糊:0/1] [锐化:0/1] [灰度:0/1] [亮度:0.0-2.0] [对比度:0.0-2.0]" << std::endl;
+        std::cerr << "选项: --audio-only  只处理音频（不启动视频线程与OpenGL）" << std::endl;
+        std::cerr << "      --video-only  只处理视频（丢弃音频流）" << std::endl;
+        std::cerr << "      --vcodec=mpeg4|h264|hevc|vp9|av1  视频编码器（默认mpeg4）" << std::endl;
+        std::cerr << "      --preset=ultrafast...veryslow     速度/质量预设（默认medium）" << std::endl;
+        std::cerr << "      --crf=N       恒定质量模式（0-51，越小质量越高）" << std::endl;
+        std::cerr << "      --vbitrate=N  平均码率模式，单位bps（默认800000）" << std::endl;
+        std::cerr << "      --two-pass    两遍平均码率（首遍统计按素材与参数缓存，不同码率复用）" << std::endl;
+        std::cerr << "      --pass-cache=DIR  首遍统计缓存目录" << std::endl;
+        std::cerr << "      --adaptive    按画面复杂度自适应调整码率（h264码率/CRF，mpeg4 CRF）" << std::endl;
+        std::cerr << "      --scene-cut   在镜头切换处插入关键帧，切换之间放宽GOP" << std::endl;
+        std::cerr << "      --max-gop=N   --scene-cut时的最大关键帧间隔（默认10秒）" << std::endl;
+        std::cerr << "      --frame-stats=FILE  输出逐帧编码统计（帧类型/大小/QP/编码延迟/队列等待），.bin为二进制，其余为CSV" << std::endl;
+        std::cerr << "      --threads=N   参与分配的CPU核心数（默认全部核心）" << std::endl;
+        std::cerr << "      --thread-type=auto|frame|slice  编码器线程模型（默认auto）" << std::endl;
+        std::cerr << "      --segments=N  分段并行转码：按GOP切分，N条视频流水线同时运行（0表示按核心数自动）" << std::endl;
+        std::cerr << "      --segment-seconds=S  目标分段时长（默认按并行度自动计算）" << std::endl;
+        std::cerr << "      --container=avi|mp4|mkv|fmp4|ts|hls|hls-fmp4|dash  输出容器（默认按输出文件扩展名推断，未知时为avi）" << std::endl;
+        std::cerr << "      --frag-duration=MS  fmp4分片时长（默认2000毫秒）" << std::endl;
+        std::cerr << "      --seg-duration=MS   hls/dash目标分段时长（默认4000毫秒，在其后的第一个关键帧处切分）" << std::endl;
+        std::cerr << "      --tee=FILE[,FILE...]  同一份编码结果额外写出到这些文件（容器按各自扩展名推断）" << std::endl;
+        std::cerr << "      --sync-output  封装线程直接同步写文件（默认由独立写线程异步写出1MB大块）" << std::endl;
+        std::cerr << "      --direct-io    异步写入的对齐整块使用O_DIRECT，绕过页缓存" << std::endl;
+        std::cerr << "      --preallocate  按目标码率与时长预分配输出文件空间，减少碎片" << std::endl;
+        std::cerr << "      --progress     定期打印进度（帧率、×实时速度、已写字节、队列深度、剩余时间）" << std::endl;
+        std::cerr << "      --progress-interval=MS  进度采样间隔（默认1000毫秒）" << std::endl;
+        std::cerr << "      --progress-json=FILE    进度以JSON行追加写入文件（-为标准输出，此时日志改写到标准错误）" << std::endl;
+        std::cerr << "      --stage-report 结束时打印各阶段忙碌/等待输入/等待输出/CPU时间占比、限制阶段与调整建议" << std::endl;
+        std::cerr << "      --auto-tune    运行中按各阶段阻塞占比自动调整帧队列容量与分段并行度（不设此项时帧队列无界）" << std::endl;
+        std::cerr << "      --tune-memory=MB  自动调优控制的帧队列/分段队列内存上限（默认64帧解码后视频+64MB）" << std::endl;
+        std::cerr << "      --trace=FILE   记录各阶段每帧的处理时间段（含OpenGL上传/绘制/回读），结束后写出Chrome trace JSON（Perfetto可打开）" << std::endl;
+        std::cerr << "      --metrics-port=N        在127.0.0.1:N提供Prometheus指标（阶段帧数/字节/丢弃、等待时间、处理耗时直方图、队列深度）" << std::endl;
+        std::cerr << "      --metrics-file=FILE     定期将Prometheus指标整体替换写入文件（供textfile采集器读取）" << std::endl;
+        std::cerr << "      --metrics-interval=MS   指标文件写出间隔（默认5000毫秒）" << std::endl;
+        std::cerr << "批处理: " << argv[0] << " --batch=FILE|--spool=DIR [--threads=N] [--memory-budget=MB] [--max-jobs=N] [任务默认选项]" << std::endl;
+        std::cerr << "      --batch=FILE   常驻进程并发执行任务列表（每行一个任务，格式同命令行）" << std::endl;
+        std::cerr << "      --spool=DIR    监视目录中的*.job任务文件，结束后改名为.done/.failed（Ctrl+C停止接收新任务）" << std::endl;
+        std::cerr << "      --memory-budget=MB  所有并发任务的估算内存上限（默认不限制）" << std::endl;
+        std::cerr << "      --max-jobs=N   最大并发任务数（默认每个任务2个核心）" << std::endl;
+        std::cerr << "例如: " << argv[0] << " input.mp4 output.avi 1.5 90 0 1 0 1.2 1.3" << std::endl;
         return -1;
     }
 
-    std::cout << "开始增强转码流程（音视频处理）" << std::endl;
-    std::cout << "输入文件: " << input_filename << std::endl;
-    std::cout << "输出文件: " << output_filename << std::endl;
-    std::cout << "变速倍数: " << speed_factor << "x" << std::endl;
-    std::cout << "旋转角度: " << rotation_angle << "度" << std::endl;
-    std::cout << "滤镜设置: 模糊=" << (enable_blur ? "开" : "关") 
-              << " 锐化=" << (enable_sharpen ? "开" : "关")
-              << " 灰度=" << (enable_grayscale ? "开" : "关") << std::endl;
-    std::cout << "图像调整: 亮度=" << brightness << " 对比度=" << contrast << std::endl;
-
-    // ==================== 第二阶段：媒体文件分析 ====================
-    
-    /**
-     * 流信息获取：FFmpeg探测阶段
-     * 技术要点：avformat_find_stream_info()是耗时操作，但对后续处理至关重要
-     * 包含内容：编解码器参数、分辨率、帧率、采样率等元数据
-     */
-    //get_stream_info 是一个函数，接受一个指向输入文件名的常量字符指针 input_filename 和一个 StreamInfo 类型的引用 info 作为参数。
-    //该函数返回一个布尔值，用于指示是否成功获取流信息并填充到 info 中。
-    StreamInfo stream_info;
-    if (!get_stream_info(input_filename, stream_info)) {
-        std::cerr << "错误: 无法获取输入文件信息" << std::endl;
+    TranscodeOptions options;
+    if (!transcode_options_from_command_line(cmd, options)) {
         return -1;
     }
 
-    std::cout << "视频信息: " << stream_info.video_width << "x" << stream_info.video_height 
-              << " @ " << stream_info.video_fps << "fps" << std::endl;
-    std::cout << "音频信息: " << stream_info.audio_sample_rate << "Hz, " 
-              << stream_info.audio_channels << " 声道" << std::endl;
-
-    // ==================== 第三阶段：流水线数据队列构建 ====================
-    
-    /**
-     * 8个线程安全队列：系统的"血管网络"
-     * 设计模式：类型安全的模板队列，避免void*的类型风险
-     * 内存管理：队列持有智能指针，自动释放AVPacket/AVFrame
-     */
-    VideoPacketQueue raw_video_packets;        // 解封装→视频解码
-    AudioPacketQueue raw_audio_packets;        // 解封装→音频解码
-    VideoFrameQueue decoded_video_frames;      // 视频解码→视频处理
-    AudioFrameQueue decoded_audio_frames;      // 音频解码→音频处理
-    VideoFrameQueue processed_video_frames;    // 视频处理→视频编码
-    AudioFrameQueue processed_audio_frames;    // 音频处理→音频编码
-    EncodedVideoPacketQueue encoded_video_packets;  // 视频编码→封装
-    EncodedAudioPacketQueue encoded_audio_packets;  // 音频编码→封装
-
-    /**
-     * 线程容器：std::vector<std::thread>管理线程生命周期
-     * 选择vector而非原始数组：动态大小、RAII自动析构
-     */
-    std::vector<std::thread> threads;
-
-    // ==================== 第四阶段：6线程启动序列 ====================
-
-    /**
-     * 线程1：解封装线程 (I/O密集型)
-     * 职责：读取输入文件，将音视频包分发到不同队列
-     * 技术细节：使用av_read_frame()循环读取，根据stream_index分发
-     * 性能考量：文件I/O可能成为瓶颈，特别是网络文件
-     */
-    DemuxerParams demux_params;
-    demux_params.input_filename = input_filename;
-    demux_params.max_frames = 0;  // 0表示处理整个文件
-    //emplace_back 是一个成员函数，用于在 vector 的末尾添加一个新元素，并返回对该元素的引用。放回
-    // 参数对象传引用避免拷贝，提升性能
-    //此函数接受多个参数，包括一个函数引用、std::reference_wrapper 类型的参数以及指针类型参数，用于以完美转发的方式构造 std::thread 对象。
-    threads.emplace_back(demux_thread_func_with_params, 
-                        std::ref(demux_params),     // 参数对象传引用避免拷贝
-                        &raw_video_packets,
-                        &raw_audio_packets);
-
-    /**
-     * 线程2：视频解码线程 (CPU密集型)
-     * 职责：H.264/MPEG4等压缩视频→YUV原始帧
-     * 技术细节：avcodec_send_packet() + avcodec_receive_frame()异步API
-     * 内存管理：codec_params通过拷贝传递，避免主线程提前释放的竞态条件
-     */
-    threads.emplace_back(video_decode_to_frames_thread_func,
-                        &raw_video_packets,
-                        &decoded_video_frames,
-                        stream_info.video_codec_params);  // 编解码器参数
-
-    /**
-     * 线程3：音频解码线程 (CPU密集型)
-     * 职责：AC3/AAC等压缩音频→PCM原始音频
-     * 并行设计：与视频解码完全独立，充分利用多核CPU
-     */
-    threads.emplace_back(audio_decode_to_frames_thread_func,
-                        &raw_audio_packets,
-                        &decoded_audio_frames,
-                        stream_info.audio_codec_params);
 
-    /**
-     * 线程4：视频处理线程 (GPU+CPU混合)
-     * 职责：OpenGL滤镜处理、旋转、变速处理
-     * 技术栈：OpenGL 4.3 + GLSL着色器 + 帧缓冲对象(FBO)
-     * 性能瓶颈：GPU纹理上传/下载、CPU-GPU数据传输
-     */
-    VideoProcessParams process_params;
-    
-    process_params.rotation_angle = rotation_angle;
-    
-    // 滤镜效果配置：支持多种图像处理算法
-    process_params.enable_blur = enable_blur;          // 高斯模糊卷积
-    process_params.enable_sharpen = enable_sharpen;    // 拉普拉斯锐化
-    process_params.enable_grayscale = enable_grayscale; // RGB→灰度转换
-    process_params.brightness = brightness;
-    process_params.contrast = contrast;
-    
-    /**
-     * 统一变速因子：确保音视频同步
-     * 关键设计：所有处理模块使用相同的speed_factor，避免音画不同步
-     */
-    const double UNIFIED_SPEED_FACTOR = speed_factor;
-    
-    // 视频变速：通过帧丢弃/复制实现
-    process_params.enable_speed_change = true;
-    process_params.speed_factor = UNIFIED_SPEED_FACTOR;
-    
-    threads.emplace_back(video_process_thread_func,
-                        &decoded_video_frames,
-                        &processed_video_frames,
-                        std::ref(process_params),       // 引用传递避免大对象拷贝
-                        stream_info.video_width,
-                        stream_info.video_height,
-                        stream_info.video_pixel_format);
-
-    /**
-     * 线程5：音频处理线程 (CPU密集型)
-     * 职责：SoundTouch变速不变调处理
-     * 技术细节：WSOLA(Waveform Similarity Overlap-Add)算法
-     * 内存管理：环形缓冲区避免大量内存分配
-     */
-    AudioProcessParams audio_process_params;
-    audio_process_params.enable_speed_change = true;
-    audio_process_params.speed_factor = UNIFIED_SPEED_FACTOR;  // 与视频同步
-    audio_process_params.volume_gain = 1.0;  // 音量保持不变
-    
-    threads.emplace_back(audio_process_thread_func,
-                        &decoded_audio_frames,
-                        &processed_audio_frames,
-                        std::ref(audio_process_params),
-                        stream_info.audio_sample_rate,
-                        stream_info.audio_channels,
-                        AV_SAMPLE_FMT_FLTP);
-
-    // 视频编码线程
-    VideoEncoderParams video_encode_params;
-    video_encode_params.width = stream_info.video_width;
-    video_encode_params.height = stream_info.video_height;
-    video_encode_params.fps = stream_info.video_fps;
-    video_encode_params.codec_id = AV_CODEC_ID_MPEG4;
-    video_encode_params.bitrate = 800000;
-    
-    threads.emplace_back(video_encode_thread_func,
-                        &processed_video_frames,
-                        &encoded_video_packets,
-                        std::ref(video_encode_params));
-
-    // 音频编码线程
-    AudioEncoderParams audio_encode_params;
-    audio_encode_params.sample_rate = stream_info.audio_sample_rate;
-    audio_encode_params.channels = stream_info.audio_channels;
-    audio_encode_params.codec_id = AV_CODEC_ID_AC3;
-    audio_encode_params.bitrate = 128000;
-    
-    TargetAudioFormat target_audio_format = TargetAudioFormat::AC3;
-    
-    threads.emplace_back(audio_encode_thread_func_factory,
-                        &processed_audio_frames,
-                        &encoded_audio_packets,
-                        target_audio_format,
-                        std::ref(audio_encode_params));
-
-    // 封装线程
-    MuxerParams mux_params;
-    mux_params.output_filename = output_filename;
-    mux_params.format_name = "avi";
-    mux_params.video_width = video_encode_params.width;
-    mux_params.video_height = video_encode_params.height;
-    mux_params.video_fps = video_encode_params.fps;
-    mux_params.video_codec_id = AV_CODEC_ID_MPEG4;
-    mux_params.audio_sample_rate = audio_encode_params.sample_rate;
-    mux_params.audio_channels = audio_encode_params.channels;
-    mux_params.audio_codec_id = AV_CODEC_ID_AC3;
-    
-    threads.emplace_back(mux_thread_func,
-                        &encoded_video_packets,
-                        &encoded_audio_packets,
-                        std::ref(mux_params));
-
-    std::cout << "所有线程已启动，等待完成..." << std::endl;
-    std::cout << "输出文件: " << output_filename << " (AVI格式，AC3音轨)" << std::endl;
-    std::cout << "变速倍数: " << UNIFIED_SPEED_FACTOR << "x" << std::endl;
-
-    // 等待所有线程完成
-    for (auto& thread : threads) {
-        thread.join();
+    // ==================== 第二~四阶段：配置、启动并等待转码任务 ====================
+    // 指标导出器先于任务创建、后于任务销毁：停止时写出的最终指标包含本任务
+    MetricsParams metrics_params = metrics_params_from_command_line(cmd);
+    MetricsExporter metrics;
+    if ((metrics_params.port > 0 || !metrics_params.filename.empty()) && !metrics.start(metrics_params)) {
+        return -1;
     }
 
-    // 清理流信息
-    if (stream_info.video_codec_params) {
-        avcodec_parameters_free(&stream_info.video_codec_params);
+    int exit_code = 0;
+    {
+        TranscodeJob job;
+        if (!job.configure(options) || !job.start()) {
+            exit_code = -1;
+        } else {
+            metrics.add_job(options.output_filename, &job);
+            bool succeeded = job.wait();
+            metrics.remove_job(&job);
+            if (!succeeded) {
+                std::cerr << "错误: 转码失败" << std::endl;
+                exit_code = -1;
+            } else {
+                TranscodeStats stats = job.stats();
+                std::cout << "视频转码完成！耗时 " << stats.elapsed_seconds << " 秒" << std::endl;
+                std::cout << "输出文件: " << options.output_filename << std::endl;
+                std::cout << "内存峰值: 队列 " << stats.peak_queued_bytes / (1024 * 1024) << "MB，临时缓冲 "
+                          << stats.peak_scratch_bytes / (1024 * 1024) << "MB，进程常驻 "
+                          << stats.process_peak_rss_bytes / (1024 * 1024) << "MB" << std::endl;
+            }
+        }
     }
-    if (stream_info.audio_codec_params) {
-        avcodec_parameters_free(&stream_info.audio_codec_params);
-    }
-
-    std::cout << "视频转码完成！" << std::endl;
-    std::cout << "输出文件: " << output_filename << std::endl;
+    metrics.stop();
     
-    // 清理GLFW资源
-    glfwTerminate();
-    
-    return 0;
+    // ==================== 第五阶段：释放进程级资源 ====================
+    transcoder_global_shutdown();
+    return exit_code;
 }
@@ -0,0 +1,290 @@
+/**
+ * 异步大块输出写入 (async_writer.cpp)
+ *
+ * 封装线程 → avio(64KB) → write_packet：拷入当前块，写满一块（默认1MB）提交一次
+ * 写线程：按提交顺序pwrite到块偏移处；偏移与长度都按4KB对齐的整块在启用时走O_DIRECT，
+ *         其余（尾块、回写的文件头）走普通文件描述符
+ * 封装线程只在全部缓冲块都在途（磁盘持续慢于编码）时才会等待
+ */
+
+#include "async_writer.h"
+#include "pipeline_metrics.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+extern "C" {
+#include <libavutil/error.h>
+#include <libavutil/mem.h>
+}
+
+namespace {
+
+constexpr size_t kAlignment = 4096;         // O_DIRECT要求的偏移/长度/地址对齐
+constexpr int kAvioBufferSize = 64 * 1024;  // avio内部缓冲，攒满后回调write_packet
+
+} // namespace
+
+AsyncFileWriter::~AsyncFileWriter() {
+    close();
+}
+
+bool AsyncFileWriter::open(const char* filename, const AsyncWriterParams& params) {
+    close();
+
+    fd_ = ::open(filename, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd_ < 0) {
+        std::cerr << "错误: 无法打开输出文件 " << filename << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    if (params.direct_io) {
+#ifdef O_DIRECT
+        direct_fd_ = ::open(filename, O_WRONLY | O_DIRECT | O_CLOEXEC);
+#endif
+        if (direct_fd_ < 0) {
+            std::cerr << "警告: 输出文件不支持O_DIRECT，使用普通写入" << std::endl;
+        }
+    }
+
+#ifdef FALLOC_FL_KEEP_SIZE
+    if (params.preallocate_bytes > 0 &&
+        fallocate(fd_, FALLOC_FL_KEEP_SIZE, 0, params.preallocate_bytes) != 0) {
+        std::cerr << "警告: 输出文件预分配失败: " << strerror(errno) << std::endl;
+    }
+#endif
+
+    block_size_ = std::max(kAlignment, (params.buffer_size + kAlignment - 1) / kAlignment * kAlignment);
+    const int block_count = std::max(2, params.buffer_count);
+    for (int i = 0; i < block_count; ++i) {
+        void* memory = nullptr;
+        if (posix_memalign(&memory, kAlignment, block_size_) != 0) {
+            std::cerr << "错误: 无法分配输出缓冲区" << std::endl;
+            close();
+            return false;
+        }
+        buffers_.push_back(static_cast<uint8_t*>(memory));
+    }
+    free_blocks_ = buffers_;
+
+    uint8_t* avio_buffer = static_cast<uint8_t*>(av_malloc(kAvioBufferSize));
+    avio_ = avio_buffer ? avio_alloc_context(avio_buffer, kAvioBufferSize, 1, this,
+                                             nullptr, &AsyncFileWriter::write_packet, &AsyncFileWriter::seek)
+                        : nullptr;
+    if (!avio_) {
+        av_free(avio_buffer);
+        std::cerr << "错误: 无法创建输出IO上下文" << std::endl;
+        close();
+        return false;
+    }
+
+    current_ = Block();
+    position_ = 0;
+    file_size_ = 0;
+    stopping_ = false;
+    failed_ = false;
+    writer_thread_ = std::thread(&AsyncFileWriter::writer_loop, this);
+    return true;
+}
+
+bool AsyncFileWriter::close() {
+    bool ok = true;
+    if (avio_) {
+        avio_flush(avio_);
+        av_freep(&avio_->buffer);
+        avio_context_free(&avio_);
+    }
+    if (writer_thread_.joinable()) {
+        submit_block();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        cond_.notify_all();
+        writer_thread_.join();
+        ok = !failed_;
+    }
+
+    if (fd_ >= 0) {
+        // 截断到逻辑长度，释放预分配多估的空间
+        if (ftruncate(fd_, file_size_) != 0) {
+            ok = false;
+        }
+        if (::close(fd_) != 0) {
+            ok = false;
+        }
+        fd_ = -1;
+    }
+    if (direct_fd_ >= 0) {
+        ::close(direct_fd_);
+        direct_fd_ = -1;
+    }
+
+    for (uint8_t* buffer : buffers_) {
+        free(buffer);
+    }
+    buffers_.clear();
+    free_blocks_.clear();
+    pending_.clear();
+    current_ = Block();
+
+    if (!ok) {
+        std::cerr << "错误: 输出文件写入失败" << std::endl;
+    }
+    return ok;
+}
+
+int AsyncFileWriter::write_packet(void* opaque, uint8_t* data, int size) {
+    return static_cast<AsyncFileWriter*>(opaque)->write(data, size);
+}
+
+int64_t AsyncFileWriter::seek(void* opaque, int64_t offset, int whence) {
+    AsyncFileWriter* writer = static_cast<AsyncFileWriter*>(opaque);
+    int64_t target;
+    switch (whence & ~AVSEEK_FORCE) {
+        case AVSEEK_SIZE:
+            return writer->file_size_;
+        case SEEK_SET:
+            target = offset;
+            break;
+        case SEEK_CUR:
+            target = writer->position_ + offset;
+            break;
+        case SEEK_END:
+            target = writer->file_size_ + offset;
+            break;
+        default:
+            return AVERROR(EINVAL);
+    }
+    if (target < 0) {
+        return AVERROR(EINVAL);
+    }
+    writer->position_ = target;
+    return target;
+}
+
+int AsyncFileWriter::write(const uint8_t* data, int size) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (failed_) {
+            return AVERROR(EIO);
+        }
+    }
+
+    // 寻址后写位置不再紧接当前块：提交当前块，从新位置开始新块
+    if (current_.data && position_ != current_.offset + static_cast<int64_t>(current_.size)) {
+        submit_block();
+    }
+
+    const int total = size;
+    while (size > 0) {
+        if (!current_.data) {
+            if (!acquire_block()) {
+                return AVERROR(EIO);
+            }
+            current_.offset = position_;
+            current_.size = 0;
+        }
+        size_t count = std::min(static_cast<size_t>(size), block_size_ - current_.size);
+        memcpy(current_.data + current_.size, data, count);
+        current_.size += count;
+        position_ += count;
+        data += count;
+        size -= static_cast<int>(count);
+        if (current_.size == block_size_) {
+            submit_block();
+        }
+    }
+    file_size_ = std::max(file_size_, position_);
+    return total;
+}
+
+bool AsyncFileWriter::acquire_block() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (free_blocks_.empty() && !failed_) {
+        OutputBlockTimer blocked;  // 写线程落后：封装线程阻塞在输出上
+        cond_.wait(lock, [this] { return !free_blocks_.empty() || failed_; });
+    }
+    if (failed_) {
+        return false;
+    }
+    current_.data = free_blocks_.back();
+    free_blocks_.pop_back();
+    return true;
+}
+
+void AsyncFileWriter::submit_block() {
+    if (!current_.data) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (current_.size > 0) {
+            pending_.push_back(current_);
+        } else {
+            free_blocks_.push_back(current_.data);
+        }
+    }
+    cond_.notify_all();
+    current_ = Block();
+}
+
+void AsyncFileWriter::writer_loop() {
+    while (true) {
+        Block block;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cond_.wait(lock, [this] { return !pending_.empty() || stopping_; });
+            if (pending_.empty()) {
+                return;
+            }
+            block = pending_.front();
+            pending_.pop_front();
+        }
+
+        bool ok = false;
+        const bool aligned = block.offset % kAlignment == 0 && block.size % kAlignment == 0;
+        if (direct_fd_ >= 0 && aligned) {
+            ok = write_fully(direct_fd_, block.data, block.size, block.offset);
+            if (!ok) {
+                // 部分文件系统打开时接受O_DIRECT但写入时报EINVAL，之后全部走普通写入
+                std::cerr << "警告: O_DIRECT写入失败，回退到普通写入" << std::endl;
+                ::close(direct_fd_);
+                direct_fd_ = -1;
+            }
+        }
+        if (!ok) {
+            ok = write_fully(fd_, block.data, block.size, block.offset);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!ok) {
+                failed_ = true;
+            }
+            free_blocks_.push_back(block.data);
+        }
+        cond_.notify_all();
+    }
+}
+
+bool AsyncFileWriter::write_fully(int fd, const uint8_t* data, size_t size, int64_t offset) {
+    while (size > 0) {
+        ssize_t written = pwrite(fd, data, size, offset);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        size -= static_cast<size_t>(written);
+        offset += written;
+    }
+    return true;
+}
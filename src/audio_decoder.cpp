@@ -264,7 +264,8 @@ void audio_decode_thread_func(AudioPacketQueue* audio_packet_queue,
 // 新的解码到Frame队列函数（用于完整转码流程）
 void audio_decode_to_frames_thread_func(AudioPacketQueue* audio_packet_queue,
                                         AudioFrameQueue* audio_frame_queue,
-                                        AVCodecParameters* codec_params) {
+                                        AVCodecParameters* codec_params,
+                                        StageMetrics* metrics) {
     std::cout << "音频解码线程（输出到Frame队列）已启动。" << std::endl;
     
     /**
@@ -310,6 +311,9 @@ void audio_decode_to_frames_thread_func(AudioPacketQueue* audio_packet_queue,
      * 可能失败的原因：不支持的参数组合、硬件资源不足等
      * 性能影响：某些解码器可能需要较长的初始化时间
      */
+#ifdef AV_CODEC_FLAG_COPY_OPAQUE
+    codec_context->flags |= AV_CODEC_FLAG_COPY_OPAQUE;  // 包的帧标识（时间线）带到对应的输出帧
+#endif
     if (avcodec_open2(codec_context, codec, nullptr) < 0) {
         std::cerr << "无法打开音频解码器。" << std::endl;
         avcodec_free_context(&codec_context);
@@ -332,6 +336,7 @@ void audio_decode_to_frames_thread_func(AudioPacketQueue* audio_packet_queue,
 
     int frame_count = 0;
     bool done = false;
+    StageRecorder recorder(metrics);
     
     /**
      * 第二步：主解码循环
@@ -353,6 +358,10 @@ void audio_decode_to_frames_thread_func(AudioPacketQueue* audio_packet_queue,
         if (!audio_packet_queue->pop(packet)) {
             packet = nullptr; // 队列结束
         }
+        const bool has_packet = (packet != nullptr);
+        if (has_packet) {
+            recorder.begin(packet->size, trace_frame_id_from_opaque(packet->opaque));
+        }
 
         /**
          * 包发送：将压缩包发送给解码器
@@ -362,6 +371,7 @@ void audio_decode_to_frames_thread_func(AudioPacketQueue* audio_packet_queue,
         int ret = avcodec_send_packet(codec_context, packet);
         if (ret < 0) {
             std::cerr << "向音频解码器发送 AVPacket 时出错" << std::endl;
+            recorder.drop();
             done = true;
         }
 
@@ -420,9 +430,19 @@ void audio_decode_to_frames_thread_func(AudioPacketQueue* audio_packet_queue,
              * 队列推送：将复制的帧发送给下游处理线程
              * 线程安全：队列内部处理并发访问保护
              * 内存转移：帧的所有权转移给队列和下游线程
+             * 下游退出：队列已结束时帧仍归本线程，释放后结束输入队列并停止解码
              */
-            audio_frame_queue->push(output_frame);
+            if (!audio_frame_queue->push(output_frame)) {
+                av_frame_free(&output_frame);
+                audio_packet_queue->finish();
+                done = true;
+                break;
+            }
             frame_count++;
+            recorder.output();
+        }
+        if (has_packet) {
+            recorder.end();
         }
     }
     
@@ -1,12 +1,33 @@
 #include "audio_encoder.h"
+#include <algorithm>
 #include <iostream>
+#include <cstdlib>
 
 extern "C" {
 #include <libavcodec/avcodec.h>
 #include <libavutil/opt.h>
 #include <libavutil/channel_layout.h>
+#include <libavutil/audio_fifo.h>
 }
 
+namespace {
+
+// 复制编码包送入输出队列：复制失败只丢弃这一个包；队列已结束（封装线程已退出）时释放副本并返回false
+bool push_packet_copy(EncodedAudioPacketQueue* queue, AVPacket* packet) {
+    AVPacket* output_packet = av_packet_alloc();
+    if (!output_packet || av_packet_ref(output_packet, packet) < 0) {
+        av_packet_free(&output_packet);
+        return true;
+    }
+    if (!queue->push(output_packet)) {
+        av_packet_free(&output_packet);
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
 // =============== AC3编码器实现 ===============
 AC3Encoder::~AC3Encoder() {
     if (codec_context_) {
@@ -40,6 +61,11 @@ bool AC3Encoder::initialize(const AudioEncoderParams& params) {
     codec_context_->frame_size = 1536;
 
     // 打开编码器
+    // AC3每个同步帧自带完整头部，不产生extradata；容器要求全局头时照常置位，保持与容器约定一致
+    if (params.global_header) {
+        codec_context_->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+    }
+    
     if (avcodec_open2(codec_context_, codec_, nullptr) < 0) {
         std::cerr << "无法打开AC3编码器" << std::endl;
         avcodec_free_context(&codec_context_);
@@ -88,14 +114,12 @@ bool AC3Encoder::encode_frame(AVFrame* frame, EncodedAudioPacketQueue* output_qu
         }
 
         // 复制包并添加到输出队列，保持时间戳
-        AVPacket* output_packet = av_packet_alloc();
-        if (output_packet && av_packet_ref(output_packet, packet) >= 0) {
-            // 确保时间戳信息正确传递
-            // FFmpeg编码器应该已经根据输入帧的PTS设置了输出包的PTS/DTS
-            output_queue->push(output_packet);
-        }
-        
+        bool pushed = push_packet_copy(output_queue, packet);
         av_packet_unref(packet);
+        if (!pushed) {
+            success = false;  // 下游已退出
+            break;
+        }
     }
 
     av_packet_free(&packet);
@@ -120,12 +144,12 @@ bool AC3Encoder::flush(EncodedAudioPacketQueue* output_queue) {
             break;
         }
 
-        AVPacket* output_packet = av_packet_alloc();
-        if (output_packet && av_packet_ref(output_packet, packet) >= 0) {
-            output_queue->push(output_packet);
-        }
-        
+        bool pushed = push_packet_copy(output_queue, packet);
         av_packet_unref(packet);
+        if (!pushed) {
+            av_packet_free(&packet);
+            return false;  // 下游已退出
+        }
     }
 
     av_packet_free(&packet);
@@ -162,6 +186,11 @@ bool AACEncoder::initialize(const AudioEncoderParams& params) {
     av_channel_layout_default(&codec_context_->ch_layout, params.channels);
     codec_context_->sample_fmt = AV_SAMPLE_FMT_FLTP;
 
+    // 容器要求全局头时（MP4/MKV），AudioSpecificConfig放入extradata
+    if (params.global_header) {
+        codec_context_->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+    }
+    
     if (avcodec_open2(codec_context_, codec_, nullptr) < 0) {
         std::cerr << "无法打开AAC编码器" << std::endl;
         avcodec_free_context(&codec_context_);
@@ -200,13 +229,13 @@ bool AACEncoder::encode_frame(AVFrame* frame, EncodedAudioPacketQueue* output_qu
             break;
         }
 
-        // 复制包并添加到输出队列
-        AVPacket* output_packet = av_packet_alloc();
-        if (output_packet && av_packet_ref(output_packet, packet) >= 0) {
-            output_queue->push(output_packet);
-        }
-        
+        // 复制包并添加到输出队列，保持时间戳
+        bool pushed = push_packet_copy(output_queue, packet);
         av_packet_unref(packet);
+        if (!pushed) {
+            success = false;  // 下游已退出
+            break;
+        }
     }
 
     av_packet_free(&packet);
@@ -231,12 +260,12 @@ bool AACEncoder::flush(EncodedAudioPacketQueue* output_queue) {
             break;
         }
 
-        AVPacket* output_packet = av_packet_alloc();
-        if (output_packet && av_packet_ref(output_packet, packet) >= 0) {
-            output_queue->push(output_packet);
-        }
-        
+        bool pushed = push_packet_copy(output_queue, packet);
         av_packet_unref(packet);
+        if (!pushed) {
+            av_packet_free(&packet);
+            return false;  // 下游已退出
+        }
     }
 
     av_packet_free(&packet);
@@ -273,6 +302,11 @@ bool MP3Encoder::initialize(const AudioEncoderParams& params) {
     av_channel_layout_default(&codec_context_->ch_layout, params.channels);
     codec_context_->sample_fmt = AV_SAMPLE_FMT_FLTP;
 
+    // MP3帧头自描述，没有extradata；标志只是让编码器与容器的全局头约定保持一致
+    if (params.global_header) {
+        codec_context_->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+    }
+    
     if (avcodec_open2(codec_context_, codec_, nullptr) < 0) {
         std::cerr << "无法打开MP3编码器" << std::endl;
         avcodec_free_context(&codec_context_);
@@ -311,13 +345,13 @@ bool MP3Encoder::encode_frame(AVFrame* frame, EncodedAudioPacketQueue* output_qu
             break;
         }
 
-        // 复制包并添加到输出队列
-        AVPacket* output_packet = av_packet_alloc();
-        if (output_packet && av_packet_ref(output_packet, packet) >= 0) {
-            output_queue->push(output_packet);
-        }
-        
+        // 复制包并添加到输出队列，保持时间戳
+        bool pushed = push_packet_copy(output_queue, packet);
         av_packet_unref(packet);
+        if (!pushed) {
+            success = false;  // 下游已退出
+            break;
+        }
     }
 
     av_packet_free(&packet);
@@ -342,12 +376,12 @@ bool MP3Encoder::flush(EncodedAudioPacketQueue* output_queue) {
             break;
         }
 
-        AVPacket* output_packet = av_packet_alloc();
-        if (output_packet && av_packet_ref(output_packet, packet) >= 0) {
-            output_queue->push(output_packet);
-        }
-        
+        bool pushed = push_packet_copy(output_queue, packet);
         av_packet_unref(packet);
+        if (!pushed) {
+            av_packet_free(&packet);
+            return false;  // 下游已退出
+        }
     }
 
     av_packet_free(&packet);
@@ -389,6 +423,181 @@ std::unique_ptr<IAudioEncoder> create_audio_encoder(TargetAudioFormat format) {
     }
 }
 
+// 目标格式对应的编码器ID（COPY无编码器）
+static AVCodecID target_format_codec_id(TargetAudioFormat format) {
+    switch (format) {
+        case TargetAudioFormat::AC3: return AV_CODEC_ID_AC3;
+        case TargetAudioFormat::AAC: return AV_CODEC_ID_AAC;
+        case TargetAudioFormat::MP3: return AV_CODEC_ID_MP3;
+        default: return AV_CODEC_ID_NONE;
+    }
+}
+
+bool query_audio_encoder_native_format(TargetAudioFormat format,
+                                       const AudioFormatSpec& preferred,
+                                       AudioFormatSpec& native,
+                                       int& frame_size) {
+    native = preferred;
+    frame_size = 0;
+
+    AVCodecID codec_id = target_format_codec_id(format);
+    if (codec_id == AV_CODEC_ID_NONE) {
+        return true;  // 透传模式不需要协商
+    }
+
+    const AVCodec* codec = avcodec_find_encoder(codec_id);
+    if (!codec) {
+        std::cerr << "未找到音频编码器: " << avcodec_get_name(codec_id) << std::endl;
+        return false;
+    }
+
+    // 采样格式：所有变速处理输出均为FLTP，编码器支持时优先选择以避免二次转换
+    if (codec->sample_fmts) {
+        native.sample_format = codec->sample_fmts[0];
+        for (const AVSampleFormat* fmt = codec->sample_fmts; *fmt != AV_SAMPLE_FMT_NONE; ++fmt) {
+            if (*fmt == AV_SAMPLE_FMT_FLTP) {
+                native.sample_format = AV_SAMPLE_FMT_FLTP;
+                break;
+            }
+        }
+    }
+
+    // 采样率：取最接近输入的受支持值（如AC3只支持32/44.1/48kHz）
+    if (codec->supported_samplerates) {
+        int best_rate = codec->supported_samplerates[0];
+        for (const int* rate = codec->supported_samplerates; *rate != 0; ++rate) {
+            if (std::abs(*rate - preferred.sample_rate) < std::abs(best_rate - preferred.sample_rate)) {
+                best_rate = *rate;
+            }
+        }
+        native.sample_rate = best_rate;
+    }
+
+    // 声道：输入声道数受支持则保持，否则取不超过输入的最大受支持声道数
+    if (codec->ch_layouts) {
+        int best_channels = 0;
+        for (const AVChannelLayout* layout = codec->ch_layouts; layout->nb_channels != 0; ++layout) {
+            if (layout->nb_channels <= preferred.channels && layout->nb_channels > best_channels) {
+                best_channels = layout->nb_channels;
+            }
+        }
+        if (best_channels > 0) {
+            native.channels = best_channels;
+        }
+    }
+
+    // 打开一个临时上下文获取编码器的frame_size
+    AVCodecContext* probe_context = avcodec_alloc_context3(codec);
+    if (!probe_context) {
+        return false;
+    }
+    probe_context->sample_rate = native.sample_rate;
+    probe_context->sample_fmt = native.sample_format;
+    probe_context->bit_rate = 128000;
+    av_channel_layout_default(&probe_context->ch_layout, native.channels);
+
+    bool ok = avcodec_open2(probe_context, codec, nullptr) >= 0;
+    if (ok) {
+        frame_size = probe_context->frame_size;
+    } else {
+        std::cerr << "无法以协商参数打开音频编码器: " << avcodec_get_name(codec_id) << std::endl;
+    }
+    avcodec_free_context(&probe_context);
+
+    std::cout << "音频编码器原生格式: " << avcodec_get_name(codec_id) << " "
+              << av_get_sample_fmt_name(native.sample_format) << " "
+              << native.sample_rate << "Hz " << native.channels << "声道, 帧大小: "
+              << frame_size << std::endl;
+    return ok;
+}
+
+namespace {
+
+/**
+ * 按编码器frame_size重新分帧：兜底转换后的帧（尤其是重采样后）样本数不固定，
+ * AAC/AC3/MP2等固定帧长的编码器会拒绝。样本格式为编码器格式，时间戳以输出采样率为单位连续生成
+ */
+class AudioFrameChunker {
+public:
+    ~AudioFrameChunker() {
+        if (fifo_) {
+            av_audio_fifo_free(fifo_);
+        }
+    }
+
+    // 编码器不要求固定帧长时返回false，调用方直接送帧
+    bool initialize(const AVCodecContext* context) {
+        if (!context || context->frame_size <= 0 ||
+            (context->codec && (context->codec->capabilities & AV_CODEC_CAP_VARIABLE_FRAME_SIZE))) {
+            return false;
+        }
+        frame_size_ = context->frame_size;
+        sample_format_ = context->sample_fmt;
+        sample_rate_ = context->sample_rate;
+        channels_ = context->ch_layout.nb_channels;
+        pad_last_ = !(context->codec && (context->codec->capabilities & AV_CODEC_CAP_SMALL_LAST_FRAME));
+        fifo_ = av_audio_fifo_alloc(sample_format_, channels_, frame_size_);
+        return fifo_ != nullptr;
+    }
+
+    bool active() const { return fifo_ != nullptr; }
+
+    // 帧长已符合且没有暂存样本时可以直接编码，保持原时间戳
+    bool passthrough(const AVFrame* frame) const {
+        return !fifo_ || (av_audio_fifo_size(fifo_) == 0 && frame->nb_samples == frame_size_);
+    }
+
+    bool write(const AVFrame* frame) {
+        if (av_audio_fifo_size(fifo_) == 0) {
+            next_pts_ = frame->pts;
+        }
+        return av_audio_fifo_write(fifo_, reinterpret_cast<void**>(frame->extended_data), frame->nb_samples) ==
+               frame->nb_samples;
+    }
+
+    // 取出一个完整的帧；final为true时取出剩余样本（编码器不接受短帧时补静音），无可取样本时返回nullptr
+    AVFrame* read(bool final) {
+        int available = av_audio_fifo_size(fifo_);
+        if (available <= 0 || (!final && available < frame_size_)) {
+            return nullptr;
+        }
+        int samples = std::min(available, frame_size_);
+        AVFrame* frame = av_frame_alloc();
+        if (!frame) {
+            return nullptr;
+        }
+        frame->format = sample_format_;
+        av_channel_layout_default(&frame->ch_layout, channels_);
+        frame->sample_rate = sample_rate_;
+        frame->nb_samples = (samples < frame_size_ && pad_last_) ? frame_size_ : samples;
+        if (av_frame_get_buffer(frame, 0) < 0) {
+            av_frame_free(&frame);
+            return nullptr;
+        }
+        if (frame->nb_samples > samples) {
+            av_samples_set_silence(frame->extended_data, samples, frame->nb_samples - samples,
+                                   channels_, sample_format_);
+        }
+        av_audio_fifo_read(fifo_, reinterpret_cast<void**>(frame->extended_data), samples);
+        frame->pts = next_pts_;
+        if (next_pts_ != AV_NOPTS_VALUE) {
+            next_pts_ += samples;
+        }
+        return frame;
+    }
+
+private:
+    AVAudioFifo* fifo_ = nullptr;
+    int frame_size_ = 0;
+    AVSampleFormat sample_format_ = AV_SAMPLE_FMT_NONE;
+    int sample_rate_ = 0;
+    int channels_ = 0;
+    bool pad_last_ = true;
+    int64_t next_pts_ = AV_NOPTS_VALUE;
+};
+
+} // namespace
+
 // 音频编码线程函数
 void audio_encode_thread_func_factory(AudioFrameQueue* audio_frame_queue, 
                                       EncodedAudioPacketQueue* encoded_audio_queue,
@@ -399,38 +608,131 @@ void audio_encode_thread_func_factory(AudioFrameQueue* audio_frame_queue,
     auto encoder = create_audio_encoder(target_format);
     if (!encoder) {
         std::cerr << "错误: 无法创建音频编码器" << std::endl;
+        if (params.parameters_out) {
+            params.parameters_out->publish(nullptr);
+        }
+        audio_frame_queue->finish();
+        encoded_audio_queue->finish();
         return;
     }
     
-    // 初始化编码器
+    // 初始化编码器；失败时同样结束输出队列并发布空参数，避免封装线程永久等待（输入队列可能有界，一并结束）
     if (!encoder->initialize(params)) {
         std::cerr << "错误: 音频编码器初始化失败" << std::endl;
+        if (params.parameters_out) {
+            params.parameters_out->publish(nullptr);
+        }
+        audio_frame_queue->finish();
+        encoded_audio_queue->finish();
         return;
     }
+    if (params.parameters_out) {
+        params.parameters_out->publish(encoder->get_codec_context());
+    }
     
     std::cout << "使用编码器: " << encoder->get_encoder_name() << std::endl;
     
     int frame_count = 0;
     int encoded_frames = 0;
     AVFrame* frame = nullptr;
+    
+    // 兜底格式转换：上游已按编码器原生格式输出时不会触发；初始化失败只报告一次，之后的不匹配帧直接丢弃
+    AudioResampler output_converter;
+    bool converter_ready = false;
+    bool converter_failed = false;
+    AudioFrameChunker chunker;
+    chunker.initialize(encoder->get_codec_context());
+    StageRecorder recorder(params.metrics);
+
+    // 送入编码器；需要重新分帧时先进入FIFO，再按frame_size取出完整的帧
+    auto encode = [&](AVFrame* input, bool final) {
+        if (input && chunker.passthrough(input)) {
+            if (encoder->encode_frame(input, encoded_audio_queue)) {
+                encoded_frames++;
+            }
+            return;
+        }
+        if (input && !chunker.write(input)) {
+            std::cerr << "音频重新分帧失败，丢弃 " << input->nb_samples << " 个样本" << std::endl;
+        }
+        while (AVFrame* chunk = chunker.read(final)) {
+            if (encoder->encode_frame(chunk, encoded_audio_queue)) {
+                encoded_frames++;
+            }
+            av_frame_free(&chunk);
+        }
+    };
 
     // 主编码循环
     while (audio_frame_queue->pop(frame)) {
         if (!frame) {
             break;
         }
+        recorder.begin(0, trace_frame_id_from_opaque(frame->opaque));
+
+        AVFrame* converted = nullptr;
+        bool needs_conversion = frame->format != params.sample_format ||
+                                frame->sample_rate != params.sample_rate ||
+                                frame->ch_layout.nb_channels != params.channels;
+        if (needs_conversion && !converter_ready && !converter_failed) {
+            AudioFormatSpec input_spec;
+            input_spec.sample_rate = frame->sample_rate;
+            input_spec.channels = frame->ch_layout.nb_channels;
+            input_spec.sample_format = static_cast<AVSampleFormat>(frame->format);
+            
+            AudioFormatSpec output_spec;
+            output_spec.sample_rate = params.sample_rate;
+            output_spec.channels = params.channels;
+            output_spec.sample_format = params.sample_format;
+            converter_ready = output_converter.initialize(input_spec, output_spec, &frame->ch_layout);
+            if (!converter_ready) {
+                converter_failed = true;
+                std::cerr << "错误: 无法初始化音频输出格式转换，格式不匹配的帧将被丢弃" << std::endl;
+            }
+        }
 
-        if (encoder->encode_frame(frame, encoded_audio_queue)) {
-            encoded_frames++;
+        uint64_t pushed_before = encoded_audio_queue->pushed_count();
+        if (!needs_conversion) {
+            encode(frame, false);
+        } else if (converter_ready) {
+            // 转换失败或样本暂存在重采样器中时没有输出
+            converted = output_converter.convert(frame);
+            if (converted) {
+                encode(converted, false);
+            }
+        } else {
+            recorder.drop();
         }
+        recorder.output(encoded_audio_queue->pushed_count() - pushed_before);
         
+        av_frame_free(&converted);
         av_frame_free(&frame);
         frame_count++;
+        recorder.end();
+        if (encoded_audio_queue->is_finished()) {
+            break;  // 封装线程已退出，编码器已释放未送出的包
+        }
     }
 
-    // 刷新编码器
-    std::cout << "刷新音频编码器 (" << encoder->get_encoder_name() << ")..." << std::endl;
-    encoder->flush(encoded_audio_queue);
+    audio_frame_queue->finish();  // 提前退出循环时上游不会阻塞在有界队列上
+
+    // 刷新：先排空重采样器缓存的尾部样本与重新分帧FIFO，再刷新编码器（下游已退出时跳过）
+    if (!encoded_audio_queue->is_finished()) {
+        std::cout << "刷新音频编码器 (" << encoder->get_encoder_name() << ")..." << std::endl;
+        uint64_t pushed_before_flush = encoded_audio_queue->pushed_count();
+        if (converter_ready) {
+            AVFrame* tail = output_converter.flush();
+            if (tail) {
+                encode(tail, false);
+                av_frame_free(&tail);
+            }
+        }
+        if (chunker.active()) {
+            encode(nullptr, true);
+        }
+        encoder->flush(encoded_audio_queue);
+        recorder.output(encoded_audio_queue->pushed_count() - pushed_before_flush);
+    }
 
     // 标记编码完成
     encoded_audio_queue->finish();
@@ -506,18 +808,22 @@ void audio_encode_thread_func(AudioFrameQueue* audio_frame_queue,
                 break;
             }
 
-            AVPacket* output_packet = av_packet_alloc();
-            if (output_packet && av_packet_ref(output_packet, packet) >= 0) {
-                encoded_audio_queue->push(output_packet);
-                encoded_frames++;
-            }
-            
+            bool pushed = push_packet_copy(encoded_audio_queue, packet);
             av_packet_unref(packet);
+            if (!pushed) {
+                break;
+            }
+            encoded_frames++;
         }
         
         frame_count++;
+        if (encoded_audio_queue->is_finished()) {
+            break;  // 封装线程已退出
+        }
     }
 
+    audio_frame_queue->finish();  // 提前退出循环时上游不会阻塞在有界队列上
+
     // 刷新编码器
     std::cout << "刷新音频编码器..." << std::endl;
     avcodec_send_frame(codec_context, nullptr);
@@ -531,13 +837,12 @@ void audio_encode_thread_func(AudioFrameQueue* audio_frame_queue,
             break;
         }
 
-        AVPacket* output_packet = av_packet_alloc();
-        if (output_packet && av_packet_ref(output_packet, packet) >= 0) {
-            encoded_audio_queue->push(output_packet);
-            encoded_frames++;
-        }
-        
+        bool pushed = push_packet_copy(encoded_audio_queue, packet);
         av_packet_unref(packet);
+        if (!pushed) {
+            break;
+        }
+        encoded_frames++;
     }
 
     // 标记编码完成
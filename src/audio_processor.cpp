@@ -267,6 +267,9 @@ AudioProcessor::AudioProcessor()
     , input_sample_rate_(0)
     , input_channels_(0)
     , input_format_(AV_SAMPLE_FMT_NONE)
+    , process_sample_rate_(0)
+    , process_channels_(0)
+    , output_frame_size_(1536)
     , speed_processing_enabled_(false)
     , last_input_pts_(AV_NOPTS_VALUE)
     , processed_samples_count_(0)
@@ -286,6 +289,11 @@ bool AudioProcessor::initialize(const AudioProcessParams& params,
     input_channels_ = input_channels;
     input_format_ = input_format;
     
+    // 处理阶段格式：启用重采样时直接以编码器所需的采样率/声道进行变速处理
+    process_sample_rate_ = params_.enable_resample ? params_.target_sample_rate : input_sample_rate_;
+    process_channels_ = params_.enable_resample ? params_.target_channels : input_channels_;
+    output_frame_size_ = params_.output_frame_size > 0 ? params_.output_frame_size : 1536;
+    
     // 分配滤波器帧
     filter_frame_ = av_frame_alloc();
     if (!filter_frame_) {
@@ -294,8 +302,25 @@ bool AudioProcessor::initialize(const AudioProcessParams& params,
     }
     
     // 无论速度因子是多少，都需要初始化SoundTouch和环形缓冲区
-    // 这是为了确保输出帧大小为1536样本，满足AC3编码器要求
+    // 这是为了确保输出帧大小与编码器frame_size一致（如AC3的1536样本）
     if (params_.enable_speed_change) {
+        // 解码输出（S16/S32/FLT/FLTP...）统一转换为交错float，采样率/声道变化时同时重采样
+        AudioFormatSpec input_spec;
+        input_spec.sample_rate = input_sample_rate_;
+        input_spec.channels = input_channels_;
+        input_spec.sample_format = input_format_;
+        
+        AudioFormatSpec process_spec;
+        process_spec.sample_rate = process_sample_rate_;
+        process_spec.channels = process_channels_;
+        process_spec.sample_format = AV_SAMPLE_FMT_FLT;
+        
+        input_converter_ = std::make_unique<AudioResampler>();
+        if (!input_converter_->initialize(input_spec, process_spec)) {
+            std::cerr << "音频输入格式转换器初始化失败" << std::endl;
+            return false;
+        }
+        
         if (!initialize_speed_processing()) {
             std::cerr << "音频变速处理初始化失败" << std::endl;
             return false;
@@ -471,18 +496,18 @@ bool AudioProcessor::initialize_speed_processing() {
     try {
         // 初始化SoundTouch
         sound_touch_ = std::make_unique<SoundTouch>();
-        sound_touch_->setSampleRate(input_sample_rate_);
-        sound_touch_->setChannels(input_channels_);
+        sound_touch_->setSampleRate(process_sample_rate_);
+        sound_touch_->setChannels(process_channels_);
         
         // 设置速度，但不改变音调
         sound_touch_->setTempo(params_.speed_factor);
         sound_touch_->setPitch(1.0);
         
-        // 初始化环形缓冲区，frame_size=1536适配AC3编码器
-        ring_buffer_ = std::make_unique<AudioRingBuffer>(1536, input_channels_, input_sample_rate_);
+        // 初始化环形缓冲区，frame_size与编码器一致
+        ring_buffer_ = std::make_unique<AudioRingBuffer>(output_frame_size_, process_channels_, process_sample_rate_);
         
-        // 初始化临时缓冲区
-        temp_buffer_.resize(8192 * input_channels_);
+        // 初始化临时缓冲区：每次最多取2帧，保证写入后不超过环形缓冲区的4帧容量
+        temp_buffer_.resize(output_frame_size_ * 2 * process_channels_);
         
         std::cout << "音频变速处理器初始化成功，速度倍数: " << params_.speed_factor << std::endl;
         return true;
@@ -507,8 +532,8 @@ AVFrame* AudioProcessor::create_output_frame(const float* samples, int num_sampl
     
     frame->nb_samples = num_samples;
     frame->format = AV_SAMPLE_FMT_FLTP;
-    av_channel_layout_default(&frame->ch_layout, input_channels_);
-    frame->sample_rate = input_sample_rate_;
+    av_channel_layout_default(&frame->ch_layout, process_channels_);
+    frame->sample_rate = process_sample_rate_;
     frame->pts = pts;
     
     if (av_frame_get_buffer(frame, 0) < 0) {
@@ -516,30 +541,16 @@ AVFrame* AudioProcessor::create_output_frame(const float* samples, int num_sampl
         return nullptr;
     }
     
-    // 转换平面格式
-    if (input_channels_ == 1) {
-        float* output = reinterpret_cast<float*>(frame->data[0]);
-        memcpy(output, samples, num_samples * sizeof(float));
-    } else if (input_channels_ == 2) {
-        float* left = reinterpret_cast<float*>(frame->data[0]);
-        float* right = reinterpret_cast<float*>(frame->data[1]);
-        
-        for (int i = 0; i < num_samples; ++i) {
-            left[i] = samples[i * 2];
-            right[i] = samples[i * 2 + 1];
-        }
-    }
+    // 交错 → 平面格式（SIMD内核，支持任意声道数）
+    audio_convert::deinterleave_float(samples, reinterpret_cast<float* const*>(frame->extended_data),
+                                      process_channels_, num_samples);
     
     return frame;
 }
 
-bool AudioProcessor::process_samples_through_soundtouch(const float* input_samples, int num_samples, AudioFrameQueue* output_queue) {
-    // 输入样本到SoundTouch
-    sound_touch_->putSamples(input_samples, num_samples);
-    
-    // 从SoundTouch获取处理后的样本
+bool AudioProcessor::drain_soundtouch(AudioFrameQueue* output_queue) {
     int received_samples;
-    while ((received_samples = sound_touch_->receiveSamples(temp_buffer_.data(), temp_buffer_.size() / input_channels_)) > 0) {
+    while ((received_samples = sound_touch_->receiveSamples(temp_buffer_.data(), temp_buffer_.size() / process_channels_)) > 0) {
         // 将样本写入环形缓冲区
         if (!ring_buffer_->write_samples(temp_buffer_.data(), received_samples)) {
             std::cerr << "环形缓冲区写入失败" << std::endl;
@@ -547,7 +558,7 @@ bool AudioProcessor::process_samples_through_soundtouch(const float* input_sampl
         }
         
         // 从环形缓冲区读取固定大小的帧
-        std::vector<float> frame_buffer(1536 * input_channels_);
+        std::vector<float> frame_buffer(output_frame_size_ * process_channels_);
         int actual_samples;
         
         while (ring_buffer_->read_frame(frame_buffer.data(), actual_samples)) {
@@ -558,49 +569,32 @@ bool AudioProcessor::process_samples_through_soundtouch(const float* input_sampl
             // 创建输出帧
             AVFrame* output_frame = create_output_frame(frame_buffer.data(), actual_samples, output_pts);
             if (output_frame) {
-                output_queue->push(output_frame);
+                if (!output_queue->push(output_frame)) {
+                    av_frame_free(&output_frame);  // 下游已退出
+                    return false;
+                }
                 // 递增已处理的样本数计数器，为下一帧准备
                 processed_samples_count_ += actual_samples;
             }
         }
     }
-    
     return true;
 }
 
-bool AudioProcessor::process_samples_through_soundtouch_with_frame_pts(const float* input_samples, int num_samples, int64_t input_pts, AudioFrameQueue* output_queue) {
+bool AudioProcessor::process_samples_through_soundtouch(const float* input_samples, int num_samples, AudioFrameQueue* output_queue) {
     // 输入样本到SoundTouch
     sound_touch_->putSamples(input_samples, num_samples);
     
     // 从SoundTouch获取处理后的样本
-    int received_samples;
-    while ((received_samples = sound_touch_->receiveSamples(temp_buffer_.data(), temp_buffer_.size() / input_channels_)) > 0) {
-        // 将样本写入环形缓冲区
-        if (!ring_buffer_->write_samples(temp_buffer_.data(), received_samples)) {
-            std::cerr << "环形缓冲区写入失败" << std::endl;
-            continue;
-        }
-        
-        // 从环形缓冲区读取固定大小的帧
-        std::vector<float> frame_buffer(1536 * input_channels_);
-        int actual_samples;
-        
-        while (ring_buffer_->read_frame(frame_buffer.data(), actual_samples)) {
-            // 为输出帧生成基于采样数的线性时间戳，完全不依赖输入帧PTS
-            // 音频的PTS单位就是"采样数"，从0开始连续递增
-            int64_t output_pts = processed_samples_count_;
-            
-            // 创建输出帧
-            AVFrame* output_frame = create_output_frame(frame_buffer.data(), actual_samples, output_pts);
-            if (output_frame) {
-                output_queue->push(output_frame);
-                // 递增已处理的样本数计数器，为下一帧准备
-                processed_samples_count_ += actual_samples;
-            }
-        }
-    }
+    return drain_soundtouch(output_queue);
+}
+
+bool AudioProcessor::process_samples_through_soundtouch_with_frame_pts(const float* input_samples, int num_samples, int64_t input_pts, AudioFrameQueue* output_queue) {
+    // 输入样本到SoundTouch
+    sound_touch_->putSamples(input_samples, num_samples);
     
-    return true;
+    // 从SoundTouch获取处理后的样本
+    return drain_soundtouch(output_queue);
 }
 
 bool AudioProcessor::process_frame_with_speed(AVFrame* input_frame, AudioFrameQueue* output_queue) {
@@ -613,33 +607,35 @@ bool AudioProcessor::process_frame_with_speed(AVFrame* input_frame, AudioFrameQu
         }
     }
     
-    // 转换为float格式进行处理
-    int num_samples = input_frame->nb_samples;
-    std::vector<float> float_samples(num_samples * input_channels_);
-    
-    // 根据输入格式转换
-    if (input_format_ == AV_SAMPLE_FMT_FLTP) {
-        // 平面浮点格式
-        if (input_channels_ == 1) {
-            float* src = reinterpret_cast<float*>(input_frame->data[0]);
-            memcpy(float_samples.data(), src, num_samples * sizeof(float));
-        } else if (input_channels_ == 2) {
-            float* left = reinterpret_cast<float*>(input_frame->data[0]);
-            float* right = reinterpret_cast<float*>(input_frame->data[1]);
-            
-            for (int i = 0; i < num_samples; ++i) {
-                float_samples[i * 2] = left[i];
-                float_samples[i * 2 + 1] = right[i];
-            }
-        }
-    } else {
-        // 其他格式需要转换（这里简化处理）
-        std::cerr << "不支持的音频格式，需要先转换为FLTP" << std::endl;
+    // 转换为交错float格式进行处理（S16/S32/FLT/FLTP走SIMD快速路径，采样率/声道变化走swr）
+    int num_samples = 0;
+    if (!input_converter_->convert_to_interleaved_float(input_frame, float_samples_, num_samples)) {
         return false;
     }
+    if (num_samples == 0) {
+        return true;  // 样本暂存在重采样器内部
+    }
     
     // 通过SoundTouch处理，使用统一的时间戳计算
-    return process_samples_through_soundtouch_with_frame_pts(float_samples.data(), num_samples, input_frame->pts, output_queue);
+    bool ok = process_samples_through_soundtouch_with_frame_pts(float_samples_.data(), num_samples, input_frame->pts, output_queue);
+    update_scratch();
+    return ok;
+}
+
+void AudioProcessor::update_scratch() {
+    // 变速路径持有的缓冲：SoundTouch中待处理/待取出的样本、环形缓冲、交错float与取样缓冲
+    int64_t bytes = static_cast<int64_t>(temp_buffer_.capacity() + float_samples_.capacity()) * sizeof(float);
+    if (sound_touch_) {
+        bytes += static_cast<int64_t>(sound_touch_->numSamples() + sound_touch_->numUnprocessedSamples()) *
+                 process_channels_ * sizeof(float);
+    }
+    if (ring_buffer_) {
+        bytes += static_cast<int64_t>(ring_buffer_->get_buffer().capacity()) * sizeof(float);
+    }
+    if (params_.metrics && bytes != scratch_bytes_) {
+        params_.metrics->scratch.add(bytes - scratch_bytes_);
+    }
+    scratch_bytes_ = bytes;
 }
 
 bool AudioProcessor::process_frame(AVFrame* input_frame, AudioFrameQueue* output_queue) {
@@ -681,8 +677,11 @@ bool AudioProcessor::process_frame(AVFrame* input_frame, AudioFrameQueue* output
             continue;
         }
         
-        output_queue->push(output_frame);
         av_frame_unref(filter_frame_);
+        if (!output_queue->push(output_frame)) {
+            av_frame_free(&output_frame);  // 下游已退出
+            return false;
+        }
     }
     
     return true;
@@ -695,44 +694,30 @@ bool AudioProcessor::flush(AudioFrameQueue* output_queue) {
     
     // 如果启用了变速处理，需要刷新SoundTouch和环形缓冲区
     if (speed_processing_enabled_ && sound_touch_) {
+        // 先刷出重采样器内部缓存的样本
+        int num_samples = 0;
+        if (input_converter_ && input_converter_->flush_interleaved_float(float_samples_, num_samples) && num_samples > 0) {
+            sound_touch_->putSamples(float_samples_.data(), num_samples);
+        }
+        
         // 刷新SoundTouch中剩余的样本
         sound_touch_->flush();
-        
-        int received_samples;
-        while ((received_samples = sound_touch_->receiveSamples(temp_buffer_.data(), temp_buffer_.size() / input_channels_)) > 0) {
-            // 将样本写入环形缓冲区
-            ring_buffer_->write_samples(temp_buffer_.data(), received_samples);
-            
-            // 从环形缓冲区读取固定大小的帧
-            std::vector<float> frame_buffer(1536 * input_channels_);
-            int actual_samples;
-            
-            while (ring_buffer_->read_frame(frame_buffer.data(), actual_samples)) {
-                // 为输出帧生成基于采样数的线性时间戳，完全不依赖输入帧PTS
-                // 音频的PTS单位就是"采样数"，从0开始连续递增
-                int64_t output_pts = processed_samples_count_;
-                
-                AVFrame* output_frame = create_output_frame(frame_buffer.data(), actual_samples, output_pts);
-                if (output_frame) {
-                    output_queue->push(output_frame);
-                    // 递增已处理的样本数计数器，为下一帧准备
-                    processed_samples_count_ += actual_samples;
-                }
-            }
+        if (!drain_soundtouch(output_queue)) {
+            return false;
         }
         
         // 处理环形缓冲区中剩余的不完整帧
         int remaining_samples = ring_buffer_->available_samples();
-        if (remaining_samples > 0 && remaining_samples < 1536) {
-            // 对于不足1536样本的剩余数据，填充到1536再输出
-            std::vector<float> padded_buffer(1536 * input_channels_, 0.0f);
+        if (remaining_samples > 0 && remaining_samples < output_frame_size_) {
+            // 对于不足一帧的剩余数据，填充到完整帧再输出
+            std::vector<float> padded_buffer(output_frame_size_ * process_channels_, 0.0f);
             
             // 从环形缓冲区读取所有剩余样本
             const auto& buffer = ring_buffer_->get_buffer();
             int buffer_size = static_cast<int>(buffer.size());
             int read_pos = ring_buffer_->get_read_pos();
             
-            for (int i = 0; i < remaining_samples * input_channels_; ++i) {
+            for (int i = 0; i < remaining_samples * process_channels_; ++i) {
                 padded_buffer[i] = buffer[(read_pos + i) % buffer_size];
             }
             
@@ -743,11 +728,14 @@ bool AudioProcessor::flush(AudioFrameQueue* output_queue) {
             // 音频的PTS单位就是"采样数"，从0开始连续递增
             int64_t output_pts = processed_samples_count_;
             
-            AVFrame* output_frame = create_output_frame(padded_buffer.data(), 1536, output_pts);
+            AVFrame* output_frame = create_output_frame(padded_buffer.data(), output_frame_size_, output_pts);
             if (output_frame) {
-                output_queue->push(output_frame);
+                if (!output_queue->push(output_frame)) {
+                    av_frame_free(&output_frame);
+                    return false;
+                }
                 // 递增已处理的样本数计数器
-                processed_samples_count_ += 1536;
+                processed_samples_count_ += output_frame_size_;
             }
         }
         
@@ -781,8 +769,11 @@ bool AudioProcessor::flush(AudioFrameQueue* output_queue) {
             continue;
         }
         
-        output_queue->push(output_frame);
         av_frame_unref(filter_frame_);
+        if (!output_queue->push(output_frame)) {
+            av_frame_free(&output_frame);  // 下游已退出
+            return false;
+        }
     }
     
     return true;
@@ -798,9 +789,15 @@ void AudioProcessor::cleanup() {
     }
     
     // 清理变速处理相关资源
+    if (params_.metrics && scratch_bytes_ != 0) {
+        params_.metrics->scratch.add(-scratch_bytes_);
+    }
+    scratch_bytes_ = 0;
     sound_touch_.reset();
     ring_buffer_.reset();
     temp_buffer_.clear();
+    input_converter_.reset();
+    float_samples_.clear();
     
     speed_processing_enabled_ = false;
     last_input_pts_ = AV_NOPTS_VALUE;
@@ -818,29 +815,48 @@ void audio_process_thread_func(AudioFrameQueue* input_frame_queue,
     AudioProcessor processor;
     if (!processor.initialize(params, sample_rate, channels, format)) {
         std::cerr << "音频处理器初始化失败" << std::endl;
+        input_frame_queue->finish();
+        output_frame_queue->finish();
         return;
     }
     
     int frame_count = 0;
     AVFrame* frame = nullptr;
+    StageRecorder recorder(params.metrics);
     
-    // 主处理循环
+    // 主处理循环（重新分帧后输入输出帧数不一一对应，产出按输出队列的入队数统计）
     while (input_frame_queue->pop(frame)) {
         if (!frame) {
             break;
         }
+        recorder.begin(0, trace_frame_id_from_opaque(frame->opaque));
         
-        if (!processor.process_frame(frame, output_frame_queue)) {
+        uint64_t pushed_before = output_frame_queue->pushed_count();
+        bool ok = processor.process_frame(frame, output_frame_queue);
+        recorder.output(output_frame_queue->pushed_count() - pushed_before);
+        av_frame_free(&frame);
+        if (!ok && output_frame_queue->is_finished()) {
+            recorder.end();
+            break;  // 下游已退出（推送失败的帧已释放）
+        }
+        if (!ok) {
             std::cerr << "音频帧处理失败" << std::endl;
+            recorder.drop();
         }
         
-        av_frame_free(&frame);
         frame_count++;
+        recorder.end();
     }
     
-    // 刷新处理器
-    std::cout << "刷新音频处理器..." << std::endl;
-    processor.flush(output_frame_queue);
+    input_frame_queue->finish();  // 提前退出循环时上游不会阻塞在有界队列上
+
+    // 刷新处理器（下游已退出时跳过）
+    if (!output_frame_queue->is_finished()) {
+        std::cout << "刷新音频处理器..." << std::endl;
+        uint64_t pushed_before_flush = output_frame_queue->pushed_count();
+        processor.flush(output_frame_queue);
+        recorder.output(output_frame_queue->pushed_count() - pushed_before_flush);
+    }
     
     // 标记输出队列结束
     output_frame_queue->finish();
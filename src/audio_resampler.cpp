@@ -0,0 +1,563 @@
+/**
+ * =====================================================================================
+ * 音频格式转换/重采样模块 (audio_resampler.cpp)
+ * =====================================================================================
+ *
+ * [整体概述]
+ * 位于解码与处理之间（以及处理与编码之间）的格式适配层。
+ * 解码器可能输出S16/S32/FLT/FLTP等任意格式，而SoundTouch需要交错float，
+ * 编码器又各自要求自己的原生格式与采样率。
+ *
+ * 两条路径：
+ * - 快速路径：采样率、声道不变，仅采样格式变化 → SSE2内核（交错/解交错、整型转float）
+ * - 通用路径：采样率或声道布局变化、或不常见格式 → libswresample
+ *
+ * 输入输出格式一致时直接透传，保证每个样本最多只被转换一次。
+ */
+
+#include "audio_resampler.h"
+#include <iostream>
+#include <cstring>
+
+extern "C" {
+#include <libavutil/channel_layout.h>
+#include <libavutil/opt.h>
+}
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace audio_convert {
+
+void deinterleave_float(const float* src, float* const* dst, int channels, int num_samples) {
+    if (channels == 1) {
+        memcpy(dst[0], src, num_samples * sizeof(float));
+        return;
+    }
+
+    int i = 0;
+    if (channels == 2) {
+        float* left = dst[0];
+        float* right = dst[1];
+#if defined(__SSE2__)
+        // 每次处理4个立体声样本：L0R0L1R1 L2R2L3R3 → L0L1L2L3 / R0R1R2R3
+        for (; i + 4 <= num_samples; i += 4) {
+            __m128 a = _mm_loadu_ps(src + i * 2);
+            __m128 b = _mm_loadu_ps(src + i * 2 + 4);
+            _mm_storeu_ps(left + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+            _mm_storeu_ps(right + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+        }
+#endif
+        for (; i < num_samples; ++i) {
+            left[i] = src[i * 2];
+            right[i] = src[i * 2 + 1];
+        }
+        return;
+    }
+
+    for (; i < num_samples; ++i) {
+        for (int ch = 0; ch < channels; ++ch) {
+            dst[ch][i] = src[i * channels + ch];
+        }
+    }
+}
+
+void interleave_float(const float* const* src, float* dst, int channels, int num_samples) {
+    if (channels == 1) {
+        memcpy(dst, src[0], num_samples * sizeof(float));
+        return;
+    }
+
+    int i = 0;
+    if (channels == 2) {
+        const float* left = src[0];
+        const float* right = src[1];
+#if defined(__SSE2__)
+        for (; i + 4 <= num_samples; i += 4) {
+            __m128 l = _mm_loadu_ps(left + i);
+            __m128 r = _mm_loadu_ps(right + i);
+            _mm_storeu_ps(dst + i * 2, _mm_unpacklo_ps(l, r));
+            _mm_storeu_ps(dst + i * 2 + 4, _mm_unpackhi_ps(l, r));
+        }
+#endif
+        for (; i < num_samples; ++i) {
+            dst[i * 2] = left[i];
+            dst[i * 2 + 1] = right[i];
+        }
+        return;
+    }
+
+    for (; i < num_samples; ++i) {
+        for (int ch = 0; ch < channels; ++ch) {
+            dst[i * channels + ch] = src[ch][i];
+        }
+    }
+}
+
+void s16_to_float(const int16_t* src, float* dst, int count) {
+    const float scale = 1.0f / 32768.0f;
+    int i = 0;
+#if defined(__SSE2__)
+    const __m128 vscale = _mm_set1_ps(scale);
+    for (; i + 8 <= count; i += 8) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        // 与自身交错后算术右移16位，完成有符号16→32位扩展
+        __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+        __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+        _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), vscale));
+        _mm_storeu_ps(dst + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), vscale));
+    }
+#endif
+    for (; i < count; ++i) {
+        dst[i] = src[i] * scale;
+    }
+}
+
+void s32_to_float(const int32_t* src, float* dst, int count) {
+    const float scale = 1.0f / 2147483648.0f;
+    int i = 0;
+#if defined(__SSE2__)
+    const __m128 vscale = _mm_set1_ps(scale);
+    for (; i + 4 <= count; i += 4) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(v), vscale));
+    }
+#endif
+    for (; i < count; ++i) {
+        dst[i] = src[i] * scale;
+    }
+}
+
+static bool is_fast_input_format(AVSampleFormat format) {
+    switch (format) {
+        case AV_SAMPLE_FMT_S16:
+        case AV_SAMPLE_FMT_S16P:
+        case AV_SAMPLE_FMT_S32:
+        case AV_SAMPLE_FMT_S32P:
+        case AV_SAMPLE_FMT_FLT:
+        case AV_SAMPLE_FMT_FLTP:
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool has_fast_path(AVSampleFormat input, AVSampleFormat output) {
+    return is_fast_input_format(input) &&
+           (output == AV_SAMPLE_FMT_FLT || output == AV_SAMPLE_FMT_FLTP);
+}
+
+bool frame_to_interleaved_float(const AVFrame* frame, float* dst, std::vector<float>& scratch) {
+    const int channels = frame->ch_layout.nb_channels;
+    const int num_samples = frame->nb_samples;
+    const AVSampleFormat format = static_cast<AVSampleFormat>(frame->format);
+
+    switch (format) {
+        case AV_SAMPLE_FMT_FLT:
+            memcpy(dst, frame->extended_data[0], num_samples * channels * sizeof(float));
+            return true;
+        case AV_SAMPLE_FMT_FLTP:
+            interleave_float(reinterpret_cast<const float* const*>(frame->extended_data),
+                             dst, channels, num_samples);
+            return true;
+        case AV_SAMPLE_FMT_S16:
+            s16_to_float(reinterpret_cast<const int16_t*>(frame->extended_data[0]),
+                         dst, num_samples * channels);
+            return true;
+        case AV_SAMPLE_FMT_S32:
+            s32_to_float(reinterpret_cast<const int32_t*>(frame->extended_data[0]),
+                         dst, num_samples * channels);
+            return true;
+        case AV_SAMPLE_FMT_S16P:
+        case AV_SAMPLE_FMT_S32P: {
+            // 平面整型：先逐声道转换为平面float，再交错
+            scratch.resize(static_cast<size_t>(num_samples) * channels);
+            std::vector<const float*> planes(channels);
+            for (int ch = 0; ch < channels; ++ch) {
+                float* plane = scratch.data() + static_cast<size_t>(ch) * num_samples;
+                if (format == AV_SAMPLE_FMT_S16P) {
+                    s16_to_float(reinterpret_cast<const int16_t*>(frame->extended_data[ch]),
+                                 plane, num_samples);
+                } else {
+                    s32_to_float(reinterpret_cast<const int32_t*>(frame->extended_data[ch]),
+                                 plane, num_samples);
+                }
+                planes[ch] = plane;
+            }
+            interleave_float(planes.data(), dst, channels, num_samples);
+            return true;
+        }
+        default:
+            return false;
+    }
+}
+
+bool interleaved_float_to_frame(const float* src, AVFrame* frame) {
+    const int channels = frame->ch_layout.nb_channels;
+    if (frame->format == AV_SAMPLE_FMT_FLT) {
+        memcpy(frame->extended_data[0], src, frame->nb_samples * channels * sizeof(float));
+        return true;
+    }
+    if (frame->format == AV_SAMPLE_FMT_FLTP) {
+        deinterleave_float(src, reinterpret_cast<float* const*>(frame->extended_data),
+                           channels, frame->nb_samples);
+        return true;
+    }
+    return false;
+}
+
+} // namespace audio_convert
+
+AudioResampler::AudioResampler()
+    : input_layout_()
+    , swr_ctx_(nullptr)
+    , pending_(nullptr)
+    , passthrough_(false)
+    , initialized_(false)
+    , next_pts_(AV_NOPTS_VALUE) {
+}
+
+AudioResampler::~AudioResampler() {
+    cleanup();
+    av_frame_free(&pending_);
+    av_channel_layout_uninit(&input_layout_);
+}
+
+bool AudioResampler::initialize(const AudioFormatSpec& input, const AudioFormatSpec& output,
+                                const AVChannelLayout* input_layout) {
+    cleanup();
+
+    input_ = input;
+    output_ = output;
+    av_channel_layout_uninit(&input_layout_);
+    if (!input_layout || input_layout->nb_channels != input_.channels ||
+        av_channel_layout_copy(&input_layout_, input_layout) < 0) {
+        av_channel_layout_default(&input_layout_, input_.channels);
+    }
+
+    const bool same_layout = input_.sample_rate == output_.sample_rate &&
+                             input_.channels == output_.channels;
+    passthrough_ = same_layout && input_.sample_format == output_.sample_format;
+
+    // 采样率/声道变化或格式没有快速路径时才创建swr上下文
+    if (!passthrough_ &&
+        (!same_layout || !audio_convert::has_fast_path(input_.sample_format, output_.sample_format))) {
+        if (!setup_swr()) {
+            return false;
+        }
+    }
+
+    initialized_ = true;
+
+    std::cout << "音频格式转换器: "
+              << av_get_sample_fmt_name(input_.sample_format) << " " << input_.sample_rate << "Hz "
+              << input_.channels << "声道 -> "
+              << av_get_sample_fmt_name(output_.sample_format) << " " << output_.sample_rate << "Hz "
+              << output_.channels << "声道 ("
+              << (passthrough_ ? "透传" : (swr_ctx_ ? "swr重采样" : "SIMD快速路径")) << ")" << std::endl;
+    return true;
+}
+
+bool AudioResampler::setup_swr() {
+    AVChannelLayout out_layout;
+    av_channel_layout_default(&out_layout, output_.channels);
+
+    int ret = swr_alloc_set_opts2(&swr_ctx_,
+                                  &out_layout, output_.sample_format, output_.sample_rate,
+                                  &input_layout_, input_.sample_format, input_.sample_rate,
+                                  0, nullptr);
+    av_channel_layout_uninit(&out_layout);
+
+    if (ret < 0 || !swr_ctx_) {
+        std::cerr << "无法分配音频重采样上下文" << std::endl;
+        return false;
+    }
+
+    if (swr_init(swr_ctx_) < 0) {
+        std::cerr << "无法初始化音频重采样上下文" << std::endl;
+        swr_free(&swr_ctx_);
+        return false;
+    }
+    return true;
+}
+
+bool AudioResampler::ensure_input_matches(const AVFrame* input_frame) {
+    if (!initialized_) {
+        std::cerr << "音频格式转换器未初始化" << std::endl;
+        return false;
+    }
+
+    AudioFormatSpec actual;
+    actual.sample_format = static_cast<AVSampleFormat>(input_frame->format);
+    actual.sample_rate = input_frame->sample_rate > 0 ? input_frame->sample_rate : input_.sample_rate;
+    actual.channels = input_frame->ch_layout.nb_channels > 0 ? input_frame->ch_layout.nb_channels
+                                                            : input_.channels;
+
+    const bool has_layout = input_frame->ch_layout.nb_channels > 0;
+    if (actual.sample_format == input_.sample_format &&
+        actual.sample_rate == input_.sample_rate &&
+        actual.channels == input_.channels &&
+        (!has_layout || av_channel_layout_compare(&input_frame->ch_layout, &input_layout_) == 0)) {
+        return true;
+    }
+
+    std::cout << "检测到音频输入格式变化，重新配置格式转换器" << std::endl;
+    // 旧重采样器缓存的样本（滤波器延迟）属于变化之前的输入，先排空，随下一次输出送出
+    if (swr_ctx_) {
+        pending_ = prepend_pending(drain_swr());
+    }
+    int64_t next_pts = next_pts_;
+    AudioFormatSpec output = output_;
+    if (!initialize(actual, output, has_layout ? &input_frame->ch_layout : nullptr)) {
+        return false;
+    }
+    next_pts_ = next_pts;
+    return true;
+}
+
+int64_t AudioResampler::next_output_pts(const AVFrame* input_frame, int output_samples) {
+    // 重采样后样本数与输入不再一一对应，按输出样本数生成连续时间戳
+    if (next_pts_ == AV_NOPTS_VALUE) {
+        next_pts_ = (input_frame->pts != AV_NOPTS_VALUE)
+                        ? av_rescale(input_frame->pts, output_.sample_rate, input_.sample_rate)
+                        : 0;
+    }
+    int64_t pts = next_pts_;
+    next_pts_ += output_samples;
+    return pts;
+}
+
+AVFrame* AudioResampler::convert(const AVFrame* input_frame) {
+    if (!input_frame || !ensure_input_matches(input_frame)) {
+        return nullptr;
+    }
+
+    if (passthrough_) {
+        return prepend_pending(av_frame_clone(input_frame));
+    }
+
+    AVFrame* output_frame = av_frame_alloc();
+    if (!output_frame) {
+        return nullptr;
+    }
+
+    output_frame->format = output_.sample_format;
+    av_channel_layout_default(&output_frame->ch_layout, output_.channels);
+    output_frame->sample_rate = output_.sample_rate;
+    output_frame->nb_samples = swr_ctx_ ? swr_get_out_samples(swr_ctx_, input_frame->nb_samples)
+                                        : input_frame->nb_samples;
+
+    if (output_frame->nb_samples <= 0 || av_frame_get_buffer(output_frame, 0) < 0) {
+        av_frame_free(&output_frame);
+        return nullptr;
+    }
+
+    if (swr_ctx_) {
+        int converted = swr_convert(swr_ctx_, output_frame->extended_data, output_frame->nb_samples,
+                                    const_cast<const uint8_t**>(input_frame->extended_data),
+                                    input_frame->nb_samples);
+        if (converted <= 0) {
+            // 样本全部缓存在重采样器内部，或转换失败
+            if (converted < 0) {
+                std::cerr << "音频重采样失败" << std::endl;
+            }
+            av_frame_free(&output_frame);
+            return prepend_pending(nullptr);
+        }
+        output_frame->nb_samples = converted;
+        output_frame->pts = next_output_pts(input_frame, converted);
+        return prepend_pending(output_frame);
+    }
+
+    // 快速路径：尽量直接写入目标帧，避免中间拷贝
+    bool ok;
+    if (output_.sample_format == AV_SAMPLE_FMT_FLT) {
+        ok = audio_convert::frame_to_interleaved_float(
+            input_frame, reinterpret_cast<float*>(output_frame->extended_data[0]), scratch_);
+    } else if (input_frame->format == AV_SAMPLE_FMT_FLT) {
+        audio_convert::deinterleave_float(reinterpret_cast<const float*>(input_frame->extended_data[0]),
+                                          reinterpret_cast<float* const*>(output_frame->extended_data),
+                                          output_.channels, input_frame->nb_samples);
+        ok = true;
+    } else {
+        interleaved_.resize(static_cast<size_t>(input_frame->nb_samples) * output_.channels);
+        ok = audio_convert::frame_to_interleaved_float(input_frame, interleaved_.data(), scratch_) &&
+             audio_convert::interleaved_float_to_frame(interleaved_.data(), output_frame);
+    }
+
+    if (!ok) {
+        std::cerr << "音频格式转换失败: " << av_get_sample_fmt_name(input_.sample_format) << std::endl;
+        av_frame_free(&output_frame);
+        return prepend_pending(nullptr);
+    }
+
+    av_frame_copy_props(output_frame, input_frame);
+    return prepend_pending(output_frame);
+}
+
+bool AudioResampler::convert_to_interleaved_float(const AVFrame* input_frame,
+                                                  std::vector<float>& output, int& num_samples) {
+    num_samples = 0;
+    if (!input_frame || !ensure_input_matches(input_frame)) {
+        return false;
+    }
+
+    if (!swr_ctx_) {
+        num_samples = input_frame->nb_samples;
+        output.resize(static_cast<size_t>(num_samples) * output_.channels);
+        if (!audio_convert::frame_to_interleaved_float(input_frame, output.data(), scratch_)) {
+            std::cerr << "音频格式转换失败: " << av_get_sample_fmt_name(input_.sample_format) << std::endl;
+            num_samples = 0;
+            return false;
+        }
+        prepend_pending_float(output, num_samples);
+        return true;
+    }
+
+    if (output_.sample_format != AV_SAMPLE_FMT_FLT) {
+        std::cerr << "交错float输出要求转换器目标格式为FLT" << std::endl;
+        return false;
+    }
+
+    int max_samples = swr_get_out_samples(swr_ctx_, input_frame->nb_samples);
+    if (max_samples <= 0) {
+        prepend_pending_float(output, num_samples);
+        return true;
+    }
+    output.resize(static_cast<size_t>(max_samples) * output_.channels);
+
+    uint8_t* out_ptr = reinterpret_cast<uint8_t*>(output.data());
+    int converted = swr_convert(swr_ctx_, &out_ptr, max_samples,
+                                const_cast<const uint8_t**>(input_frame->extended_data),
+                                input_frame->nb_samples);
+    if (converted < 0) {
+        std::cerr << "音频重采样失败" << std::endl;
+        return false;
+    }
+    num_samples = converted;
+    prepend_pending_float(output, num_samples);
+    return true;
+}
+
+AVFrame* AudioResampler::prepend_pending(AVFrame* frame) {
+    if (!pending_) {
+        return frame;
+    }
+    AVFrame* head = pending_;
+    pending_ = nullptr;
+    if (!frame) {
+        return head;
+    }
+
+    AVFrame* joined = av_frame_alloc();
+    if (joined) {
+        joined->format = frame->format;
+        av_channel_layout_copy(&joined->ch_layout, &frame->ch_layout);
+        joined->sample_rate = frame->sample_rate;
+        joined->nb_samples = head->nb_samples + frame->nb_samples;
+    }
+    if (!joined || av_frame_get_buffer(joined, 0) < 0) {
+        std::cerr << "音频格式变化前的剩余样本无法拼接，丢弃 " << head->nb_samples << " 个样本" << std::endl;
+        av_frame_free(&joined);
+        av_frame_free(&head);
+        return frame;
+    }
+    const int channels = frame->ch_layout.nb_channels;
+    const AVSampleFormat format = static_cast<AVSampleFormat>(frame->format);
+    av_samples_copy(joined->extended_data, head->extended_data, 0, 0, head->nb_samples, channels, format);
+    av_samples_copy(joined->extended_data, frame->extended_data, head->nb_samples, 0, frame->nb_samples,
+                    channels, format);
+    av_frame_copy_props(joined, frame);
+    joined->pts = head->pts;
+    av_frame_free(&head);
+    av_frame_free(&frame);
+    return joined;
+}
+
+void AudioResampler::prepend_pending_float(std::vector<float>& output, int& num_samples) {
+    if (!pending_) {
+        return;
+    }
+    std::vector<float> head(static_cast<size_t>(pending_->nb_samples) * output_.channels);
+    if (audio_convert::frame_to_interleaved_float(pending_, head.data(), scratch_)) {
+        output.resize(static_cast<size_t>(num_samples) * output_.channels);
+        output.insert(output.begin(), head.begin(), head.end());
+        num_samples += pending_->nb_samples;
+    }
+    av_frame_free(&pending_);
+}
+
+AVFrame* AudioResampler::flush() {
+    return prepend_pending(drain_swr());
+}
+
+AVFrame* AudioResampler::drain_swr() {
+    if (!swr_ctx_) {
+        return nullptr;
+    }
+    int max_samples = swr_get_out_samples(swr_ctx_, 0);
+    if (max_samples <= 0) {
+        return nullptr;
+    }
+
+    AVFrame* output_frame = av_frame_alloc();
+    if (!output_frame) {
+        return nullptr;
+    }
+    output_frame->format = output_.sample_format;
+    av_channel_layout_default(&output_frame->ch_layout, output_.channels);
+    output_frame->sample_rate = output_.sample_rate;
+    output_frame->nb_samples = max_samples;
+    if (av_frame_get_buffer(output_frame, 0) < 0) {
+        av_frame_free(&output_frame);
+        return nullptr;
+    }
+
+    int converted = swr_convert(swr_ctx_, output_frame->extended_data, max_samples, nullptr, 0);
+    if (converted <= 0) {
+        if (converted < 0) {
+            std::cerr << "音频重采样器刷新失败" << std::endl;
+        }
+        av_frame_free(&output_frame);
+        return nullptr;
+    }
+    output_frame->nb_samples = converted;
+    output_frame->pts = (next_pts_ != AV_NOPTS_VALUE) ? next_pts_ : 0;
+    next_pts_ = output_frame->pts + converted;
+    return output_frame;
+}
+
+bool AudioResampler::flush_interleaved_float(std::vector<float>& output, int& num_samples) {
+    num_samples = 0;
+    if (!swr_ctx_) {
+        prepend_pending_float(output, num_samples);
+        return true;
+    }
+
+    int max_samples = swr_get_out_samples(swr_ctx_, 0);
+    if (max_samples <= 0) {
+        prepend_pending_float(output, num_samples);
+        return true;
+    }
+    output.resize(static_cast<size_t>(max_samples) * output_.channels);
+
+    uint8_t* out_ptr = reinterpret_cast<uint8_t*>(output.data());
+    int converted = swr_convert(swr_ctx_, &out_ptr, max_samples, nullptr, 0);
+    if (converted < 0) {
+        std::cerr << "音频重采样器刷新失败" << std::endl;
+        return false;
+    }
+    num_samples = converted;
+    prepend_pending_float(output, num_samples);
+    return true;
+}
+
+void AudioResampler::cleanup() {
+    if (swr_ctx_) {
+        swr_free(&swr_ctx_);
+    }
+    passthrough_ = false;
+    initialized_ = false;
+    next_pts_ = AV_NOPTS_VALUE;
+}
@@ -0,0 +1,333 @@
+/**
+ * 常驻批处理 (batch_runner.cpp)
+ *
+ * 调度线程（调用run_job_list/watch_spool的线程）：
+ *   任务行 → 解析参数 → configure探测输入并估算内存 → 等待核心/内存预算放行 → start
+ * 每个运行中的任务配一个等待线程：wait()返回后标记完成并唤醒调度线程，
+ * 由调度线程回收（归还预算、改名监视文件），因此预算只在一个线程里增减
+ *
+ * 进程级状态（FFmpeg初始化、GLFW）由transcoder_global_init与视频处理模块保证只初始化一次，所有任务共享
+ */
+
+#include "batch_runner.h"
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#include <dirent.h>
+#include <stdio.h>
+
+namespace {
+
+constexpr int64_t kJobBaseMemory = 64LL * 1024 * 1024;  // 编解码器上下文、音频链路、输出缓冲
+constexpr int kFramesInFlight = 32;                       // 各级队列与编码器前瞻中同时存在的视频帧估计
+
+/**
+ * 任务行拆分为参数：空白分隔，双引号包住的部分可以含空格
+ * 引号未闭合时返回false
+ */
+bool split_job_line(const std::string& line, std::vector<std::string>& arguments) {
+    std::string current;
+    bool in_token = false;
+    bool quoted = false;
+    for (char c : line) {
+        if (quoted) {
+            if (c == '"') {
+                quoted = false;
+            } else {
+                current += c;
+            }
+        } else if (c == '"') {
+            quoted = true;
+            in_token = true;
+        } else if (std::isspace(static_cast<unsigned char>(c))) {
+            if (in_token) {
+                arguments.push_back(current);
+                current.clear();
+                in_token = false;
+            }
+        } else {
+            current += c;
+            in_token = true;
+        }
+    }
+    if (quoted) {
+        return false;
+    }
+    if (in_token) {
+        arguments.push_back(current);
+    }
+    return true;
+}
+
+// 空行与#注释行不是任务
+bool is_job_line(const std::string& line) {
+    size_t first = line.find_first_not_of(" \t\r\n");
+    return first != std::string::npos && line[first] != '#';
+}
+
+bool has_suffix(const std::string& name, const std::string& suffix) {
+    return name.size() > suffix.size() &&
+           name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// *.job.running → *.job
+std::string strip_running_suffix(const std::string& spool_filename) {
+    return spool_filename.substr(0, spool_filename.size() - std::string(".running").size());
+}
+
+// 按视频分辨率估算一个任务的峰值内存，纯音频任务只计固定部分
+int64_t estimate_job_memory(const TranscodeJob& job) {
+    const StreamInfo& info = job.stream_info();
+    int64_t memory = kJobBaseMemory;
+    if (job.options().mode != TranscodeMode::AUDIO_ONLY && info.video_width > 0 && info.video_height > 0) {
+        int64_t frame_bytes = static_cast<int64_t>(info.video_width) * info.video_height * 3 / 2;
+        memory += frame_bytes * kFramesInFlight;
+    }
+    return memory;
+}
+
+} // namespace
+
+struct BatchRunner::ActiveJob {
+    std::string name;
+    std::string spool_filename;  // 监视目录模式下的*.job.running，任务列表模式为空
+    int cores = 0;
+    int64_t memory_bytes = 0;
+    std::unique_ptr<TranscodeJob> job;
+    std::thread waiter;
+    bool done = false;           // 由等待线程在mutex_下设置
+    bool succeeded = false;
+};
+
+BatchRunner::BatchRunner(const BatchParams& params) : params_(params) {
+    total_cores_ = params_.total_cores > 0 ? params_.total_cores
+                                           : static_cast<int>(std::thread::hardware_concurrency());
+    total_cores_ = std::max(1, total_cores_);
+    max_jobs_ = params_.max_concurrent_jobs > 0 ? params_.max_concurrent_jobs : std::max(1, total_cores_ / 2);
+    cores_per_job_ = std::max(1, total_cores_ / max_jobs_);
+
+    std::cout << "批处理: " << total_cores_ << "个核心，最多" << max_jobs_ << "个任务并发，每个任务"
+              << cores_per_job_ << "个核心";
+    if (params_.memory_budget_bytes > 0) {
+        std::cout << "，内存预算" << params_.memory_budget_bytes / (1024 * 1024) << "MB";
+    }
+    std::cout << std::endl;
+
+    if (params_.metrics.port > 0 || !params_.metrics.filename.empty()) {
+        metrics_.start(params_.metrics);
+    }
+}
+
+BatchRunner::~BatchRunner() {
+    wait_all();
+}
+
+int BatchRunner::run_job_list(const std::string& list_filename) {
+    std::ifstream list(list_filename);
+    if (!list) {
+        std::cerr << "错误: 无法读取任务列表 " << list_filename << std::endl;
+        return -1;
+    }
+
+    std::string line;
+    int line_number = 0;
+    while (!stopping_ && std::getline(list, line)) {
+        ++line_number;
+        if (is_job_line(line)) {
+            launch(list_filename + ":" + std::to_string(line_number), line, "");
+        }
+    }
+    if (stopping_) {
+        std::cout << "批处理: 已停止，任务列表中剩余的任务未执行" << std::endl;
+    }
+
+    wait_all();
+    std::lock_guard<std::mutex> lock(mutex_);
+    return failed_jobs_;
+}
+
+int BatchRunner::watch_spool(const std::string& directory) {
+    std::cout << "批处理: 监视目录 " << directory << std::endl;
+    while (!stopping_) {
+        DIR* dir = opendir(directory.c_str());
+        if (!dir) {
+            std::cerr << "错误: 无法打开监视目录 " << directory << std::endl;
+            break;
+        }
+        std::vector<std::string> names;
+        while (dirent* entry = readdir(dir)) {
+            std::string name = entry->d_name;
+            if (has_suffix(name, ".job")) {
+                names.push_back(name);
+            }
+        }
+        closedir(dir);
+        std::sort(names.begin(), names.end());  // 按文件名顺序执行，便于提交方控制先后
+
+        for (const std::string& name : names) {
+            if (stopping_) {
+                break;
+            }
+            // 改名即认领：多个批处理进程监视同一目录时，只有一个能改名成功
+            std::string job_filename = directory + "/" + name;
+            std::string running_filename = job_filename + ".running";
+            if (rename(job_filename.c_str(), running_filename.c_str()) != 0) {
+                continue;
+            }
+            std::ifstream job_file(running_filename);
+            std::string line;
+            while (std::getline(job_file, line) && !is_job_line(line)) {
+            }
+            if (!is_job_line(line)) {
+                std::cerr << "错误: 任务文件为空 " << name << std::endl;
+                finish_spool_file(running_filename, false);
+                std::lock_guard<std::mutex> lock(mutex_);
+                ++failed_jobs_;
+                continue;
+            }
+            launch(name, line, running_filename);
+        }
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        reap_finished_jobs();
+        cond_.wait_for(lock, std::chrono::milliseconds(params_.poll_interval_ms));
+    }
+
+    wait_all();
+    std::lock_guard<std::mutex> lock(mutex_);
+    return failed_jobs_;
+}
+
+bool BatchRunner::launch(const std::string& name, const std::string& line, const std::string& spool_filename) {
+    // 任务行参数覆盖批处理的默认开关
+    std::vector<std::string> arguments;
+    CommandLine cmd;
+    TranscodeOptions options;
+    bool parsed = split_job_line(line, arguments);
+    if (parsed) {
+        cmd = parse_command_line(arguments);
+        for (const auto& option : params_.defaults.options) {
+            cmd.options.insert(option);
+        }
+        parsed = transcode_options_from_command_line(cmd, options);
+    }
+    if (!parsed) {
+        std::cerr << "错误: 任务参数无效 " << name << std::endl;
+        finish_spool_file(spool_filename, false);
+        std::lock_guard<std::mutex> lock(mutex_);
+        ++failed_jobs_;
+        return false;
+    }
+    options.total_cores = cores_per_job_;
+
+    std::unique_ptr<ActiveJob> active(new ActiveJob());
+    active->name = name;
+    active->spool_filename = spool_filename;
+    active->cores = cores_per_job_;
+    active->job.reset(new TranscodeJob());
+    if (!active->job->configure(options)) {
+        std::cerr << "错误: 任务配置失败 " << name << std::endl;
+        finish_spool_file(spool_filename, false);
+        std::lock_guard<std::mutex> lock(mutex_);
+        ++failed_jobs_;
+        return false;
+    }
+    active->memory_bytes = estimate_job_memory(*active->job);
+
+    // 准入控制：核心与内存都放得下才启动；没有任务在运行时无条件放行
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        reap_finished_jobs();
+        if (stopping_) {
+            // 尚未开始的监视任务退回目录，由下次启动的批处理重新认领
+            if (!spool_filename.empty()) {
+                rename(spool_filename.c_str(), strip_running_suffix(spool_filename).c_str());
+            }
+            return false;
+        }
+        bool fits = static_cast<int>(active_.size()) < max_jobs_ &&
+                    used_cores_ + active->cores <= total_cores_ &&
+                    (params_.memory_budget_bytes <= 0 ||
+                     used_memory_ + active->memory_bytes <= params_.memory_budget_bytes);
+        if (active_.empty() || fits) {
+            break;
+        }
+        cond_.wait_for(lock, std::chrono::milliseconds(params_.poll_interval_ms));
+    }
+
+    std::cout << "批处理: 启动 " << name << " (" << active->cores << "个核心，估算内存"
+              << active->memory_bytes / (1024 * 1024) << "MB，运行中" << active_.size() + 1 << "个)" << std::endl;
+    if (!active->job->start()) {
+        std::cerr << "错误: 任务启动失败 " << name << std::endl;
+        lock.unlock();
+        active->job.reset();
+        finish_spool_file(spool_filename, false);
+        lock.lock();
+        ++failed_jobs_;
+        return false;
+    }
+
+    used_cores_ += active->cores;
+    used_memory_ += active->memory_bytes;
+    metrics_.add_job(name, active->job.get());
+    ActiveJob* raw = active.get();
+    active_.push_back(std::move(active));
+    raw->waiter = std::thread([this, raw]() {
+        bool succeeded = raw->job->wait();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            raw->succeeded = succeeded;
+            raw->done = true;
+        }
+        cond_.notify_all();
+    });
+    return true;
+}
+
+void BatchRunner::finish_spool_file(const std::string& spool_filename, bool succeeded) {
+    if (spool_filename.empty()) {
+        return;
+    }
+    std::string final_filename = strip_running_suffix(spool_filename) + (succeeded ? ".done" : ".failed");
+    if (rename(spool_filename.c_str(), final_filename.c_str()) != 0) {
+        std::cerr << "警告: 无法标记任务文件 " << final_filename << std::endl;
+    }
+}
+
+void BatchRunner::reap_finished_jobs() {
+    for (auto it = active_.begin(); it != active_.end();) {
+        ActiveJob& active = **it;
+        if (!active.done) {
+            ++it;
+            continue;
+        }
+        // 等待线程设置done之后不再访问mutex_，持锁join不会死锁
+        active.waiter.join();
+        TranscodeStats stats = active.job->stats();
+        std::cout << "批处理: " << active.name << (active.succeeded ? " 完成" : " 失败")
+                  << "，耗时 " << stats.elapsed_seconds << " 秒" << std::endl;
+        if (!active.succeeded) {
+            ++failed_jobs_;
+        }
+        used_cores_ -= active.cores;
+        used_memory_ -= active.memory_bytes;
+        finish_spool_file(active.spool_filename, active.succeeded);
+        metrics_.remove_job(active.job.get());
+        it = active_.erase(it);
+    }
+}
+
+void BatchRunner::wait_all() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        reap_finished_jobs();
+        if (active_.empty()) {
+            return;
+        }
+        cond_.wait_for(lock, std::chrono::milliseconds(params_.poll_interval_ms));
+    }
+}
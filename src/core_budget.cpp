@@ -0,0 +1,42 @@
+#include "core_budget.h"
+#include <algorithm>
+#include <iostream>
+#include <thread>
+
+CoreBudget plan_core_budget(int total_cores, bool run_video, bool run_audio) {
+    CoreBudget budget;
+    
+    if (total_cores <= 0) {
+        total_cores = static_cast<int>(std::thread::hardware_concurrency());
+    }
+    budget.total_cores = std::max(1, total_cores);
+    
+    budget.audio_threads = run_audio ? 1 : 0;
+    if (!run_video) {
+        budget.decode_threads = 0;
+        budget.process_threads = 0;
+        budget.encode_threads = 0;
+        return budget;
+    }
+    
+    // 处理阶段是单线程的GL/滤镜循环，固定预留一个核心
+    budget.process_threads = 1;
+    
+    /**
+     * 剩余核心在解码与编码之间按约1:3分配
+     * 编码通常比解码贵3-10倍；解码超过8线程后帧线程延迟增加而收益很小
+     */
+    int remaining = budget.total_cores - budget.process_threads - budget.audio_threads;
+    remaining = std::max(2, remaining);
+    
+    budget.decode_threads = std::max(1, std::min(8, remaining / 4));
+    budget.encode_threads = std::max(1, remaining - budget.decode_threads);
+    
+    // 前瞻线程约为编码线程的1/6（与x264默认策略一致），核心较少时交给编码器决定
+    budget.lookahead_threads = (budget.encode_threads >= 6) ? budget.encode_threads / 6 : 0;
+    
+    std::cout << "核心预算: 共" << budget.total_cores << "核 → 解码" << budget.decode_threads
+              << " 处理" << budget.process_threads << " 音频" << budget.audio_threads
+              << " 编码" << budget.encode_threads << "(前瞻" << budget.lookahead_threads << ")" << std::endl;
+    return budget;
+}
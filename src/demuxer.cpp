@@ -6,17 +6,58 @@ extern "C" {
 #include <libavcodec/avcodec.h>
 }
 
-bool get_stream_info(const char* input_filename, StreamInfo& info) {
+namespace {
+
+const char* input_display_name(const char* input_filename, MediaReader* input_reader) {
+    return input_filename ? input_filename : (input_reader ? "(回调输入)" : "(未指定)");
+}
+
+// 打开输入：input_reader非空时通过自定义AVIOContext读取（每次打开都seek到开头，不可寻址的读取器拒绝），否则按文件名打开
+bool open_input(const char* input_filename, MediaReader* input_reader,
+                AVFormatContext** format_context, AVIOContext** avio) {
+    *avio = nullptr;
+    if (input_reader) {
+        if (!input_reader->seekable() || input_reader->seek(0, SEEK_SET) < 0) {
+            std::cerr << "错误: 回调输入不可寻址（探测与解封装需要分别从头读取）" << std::endl;
+            return false;
+        }
+        *format_context = avformat_alloc_context();
+        *avio = create_reader_avio(input_reader);
+        if (!*format_context || !*avio) {
+            avformat_free_context(*format_context);
+            *format_context = nullptr;
+            free_media_avio(avio);
+            return false;
+        }
+        (*format_context)->pb = *avio;
+        (*format_context)->flags |= AVFMT_FLAG_CUSTOM_IO;
+        // 打开失败时avformat_open_input会释放format_context，但不会释放自定义IO
+        if (avformat_open_input(format_context, input_filename ? input_filename : "", nullptr, nullptr) != 0) {
+            free_media_avio(avio);
+            return false;
+        }
+        return true;
+    }
+    return avformat_open_input(format_context, input_filename, nullptr, nullptr) == 0;
+}
+
+void close_input(AVFormatContext** format_context, AVIOContext** avio) {
+    avformat_close_input(format_context);
+    free_media_avio(avio);
+}
+
+bool read_stream_info(const char* input_filename, MediaReader* input_reader, StreamInfo& info) {
     AVFormatContext* format_context = nullptr;
+    AVIOContext* avio = nullptr;
     
-    if (avformat_open_input(&format_context, input_filename, nullptr, nullptr) != 0) {
-        std::cerr << "错误：无法打开输入文件 " << input_filename << std::endl;
+    if (!open_input(input_filename, input_reader, &format_context, &avio)) {
+        std::cerr << "错误：无法打开输入文件 " << input_display_name(input_filename, input_reader) << std::endl;
         return false;
     }
     
     if (avformat_find_stream_info(format_context, nullptr) < 0) {
         std::cerr << "错误：无法查找流信息。" << std::endl;
-        avformat_close_input(&format_context);
+        close_input(&format_context, &avio);
         return false;
     }
     
@@ -50,7 +91,11 @@ bool get_stream_info(const char* input_filename, StreamInfo& info) {
         }
     }
     
-    avformat_close_input(&format_context);
+    if (format_context->duration > 0) {
+        info.duration = format_context->duration;
+    }
+    
+    close_input(&format_context, &avio);
     
     std::cout << "流信息获取成功:" << std::endl;
     std::cout << "  视频: " << info.video_width << "x" << info.video_height 
@@ -61,6 +106,16 @@ bool get_stream_info(const char* input_filename, StreamInfo& info) {
     return (info.video_stream_index >= 0 || info.audio_stream_index >= 0);
 }
 
+} // namespace
+
+bool get_stream_info(const char* input_filename, StreamInfo& info) {
+    return read_stream_info(input_filename, nullptr, info);
+}
+
+bool get_stream_info(MediaReader* input_reader, StreamInfo& info) {
+    return read_stream_info(nullptr, input_reader, info);
+}
+
 void demux_thread_func(const char* input_filename,
                        VideoPacketQueue* video_packet_queue,
                        AudioPacketQueue* audio_packet_queue) {
@@ -72,80 +127,189 @@ void demux_thread_func(const char* input_filename,
 void demux_thread_func_with_params(const DemuxerParams& params,
                                   VideoPacketQueue* video_packet_queue,
                                   AudioPacketQueue* audio_packet_queue) {
-    std::cout << "解封装线程已启动，文件: " << params.input_filename << std::endl;
+    const char* input_name = input_display_name(params.input_filename, params.input_reader);
+    std::cout << "解封装线程已启动，文件: " << input_name << std::endl;
     
     AVFormatContext* format_context = nullptr;
+    AVIOContext* avio = nullptr;
     int video_stream_index = -1;
     int audio_stream_index = -1;
     
+    // 失败时同样结束输出队列，避免下游线程永久等待
+    auto finish_queues = [&]() {
+        if (video_packet_queue) {
+            video_packet_queue->finish();
+        }
+        if (audio_packet_queue) {
+            audio_packet_queue->finish();
+        }
+    };
+    
     // 打开输入文件并分配上下文
-    if (avformat_open_input(&format_context, params.input_filename, nullptr, nullptr) != 0) {
-        std::cerr << "错误：无法打开输入文件 " << params.input_filename << std::endl;
+    if (!open_input(params.input_filename, params.input_reader, &format_context, &avio)) {
+        std::cerr << "错误：无法打开输入文件 " << input_name << std::endl;
+        finish_queues();
         return;
     }
     
     //  查找流信息
     if (avformat_find_stream_info(format_context, nullptr) < 0) {
         std::cerr << "错误：无法查找流信息。" << std::endl;
-        avformat_close_input(&format_context);
+        close_input(&format_context, &avio);
+        finish_queues();
         return;
     }
     
-    //  找到视频和音频流的索引
+    //  找到视频和音频流的索引（与get_stream_info一致，取第一个匹配的流）
+    //  未启用或未选中的流设置为AVDISCARD_ALL，解封装器直接跳过这些包
     for (unsigned int i = 0; i < format_context->nb_streams; ++i) {
-        if (format_context->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO && params.enable_video) {
+        AVStream* stream = format_context->streams[i];
+        bool selected = false;
+        if (stream->codecpar->codec_type == AVMEDIA_TYPE_VIDEO && params.enable_video && video_packet_queue &&
+            video_stream_index == -1) {
             video_stream_index = i;
-        } else if (format_context->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_AUDIO && params.enable_audio) {
+            selected = true;
+        } else if (stream->codecpar->codec_type == AVMEDIA_TYPE_AUDIO && params.enable_audio && audio_packet_queue &&
+                   audio_stream_index == -1) {
             audio_stream_index = i;
+            selected = true;
+        }
+        if (!selected) {
+            stream->discard = AVDISCARD_ALL;
         }
     }
     
     if (video_stream_index == -1 && audio_stream_index == -1) {
         std::cerr << "错误：未找到有效的视频流或音频流。" << std::endl;
-        avformat_close_input(&format_context);
+        close_input(&format_context, &avio);
+        finish_queues();
         return;
     }
     
     std::cout << "视频流索引: " << video_stream_index << std::endl;
     std::cout << "音频流索引: " << audio_stream_index << std::endl;
     
+    /**
+     * 分段范围：按解码顺序截取[segment_start关键帧, segment_end关键帧)
+     * - 起点之前：seek到起点关键帧之前，丢弃直到遇到起点关键帧
+     * - 范围内：显示时间早于起点关键帧的前导帧（open GOP）标记DISCARD，只参与解码不输出
+     * - 终点：终点关键帧以DISCARD送入，供本段末尾引用它的前导帧解码，随后遇到显示时间
+     *   不早于终点关键帧的包即结束
+     */
+    enum class SegmentState { WAIT_START, IN_RANGE, TAIL, DONE };
+    const bool segmented = (video_stream_index >= 0) &&
+                           (params.segment_start != AV_NOPTS_VALUE || params.segment_end != AV_NOPTS_VALUE);
+    SegmentState segment_state = SegmentState::IN_RANGE;
+    int64_t start_key_pts = AV_NOPTS_VALUE;
+    int64_t end_key_pts = AV_NOPTS_VALUE;
+    
+    if (segmented && params.segment_start != AV_NOPTS_VALUE) {
+        segment_state = SegmentState::WAIT_START;
+        if (av_seek_frame(format_context, video_stream_index, params.segment_start, AVSEEK_FLAG_BACKWARD) < 0) {
+            std::cerr << "警告：分段seek失败，从文件开头扫描到起点" << std::endl;
+        }
+    }
+    
     //  循环读取数据包
     AVPacket* packet = av_packet_alloc();
     int video_frame_count = 0;
     int audio_frame_count = 0;
+    StageRecorder recorder(params.metrics);  // 等待时间即读取输入（I/O）的时间
     
     while (av_read_frame(format_context, packet) >= 0) {
+        // 帧标识：源流时间戳换算为微秒，经opaque随包/帧传到后续阶段（时间线用）
+        int64_t frame_ts = (packet->pts != AV_NOPTS_VALUE) ? packet->pts : packet->dts;
+        int64_t frame_id = kNoTraceFrameId;
+        if (frame_ts != AV_NOPTS_VALUE && packet->stream_index < static_cast<int>(format_context->nb_streams)) {
+            frame_id = av_rescale_q(frame_ts, format_context->streams[packet->stream_index]->time_base, AV_TIME_BASE_Q);
+        }
+        packet->opaque = trace_frame_id_to_opaque(frame_id);
+        recorder.begin(packet->size, frame_id);
+        if (params.cancel_flag && params.cancel_flag->load()) {
+            av_packet_unref(packet);
+            recorder.drop();
+            recorder.end();
+            std::cout << "解封装已取消" << std::endl;
+            break;
+        }
         if (packet->stream_index == video_stream_index && video_packet_queue) {
+            if (segmented) {
+                int64_t decode_ts = (packet->dts != AV_NOPTS_VALUE) ? packet->dts : packet->pts;
+                int64_t display_ts = (packet->pts != AV_NOPTS_VALUE) ? packet->pts : packet->dts;
+                bool keyframe = (packet->flags & AV_PKT_FLAG_KEY) != 0;
+                
+                if (segment_state == SegmentState::WAIT_START) {
+                    if (!keyframe || decode_ts < params.segment_start) {
+                        av_packet_unref(packet);
+                        recorder.drop();
+                        recorder.end();
+                        continue;
+                    }
+                    segment_state = SegmentState::IN_RANGE;
+                    start_key_pts = display_ts;
+                } else if (segment_state == SegmentState::IN_RANGE) {
+                    if (keyframe && params.segment_end != AV_NOPTS_VALUE && decode_ts >= params.segment_end) {
+                        segment_state = SegmentState::TAIL;
+                        end_key_pts = display_ts;
+                        packet->flags |= AV_PKT_FLAG_DISCARD;
+                    } else if (start_key_pts != AV_NOPTS_VALUE && display_ts < start_key_pts) {
+                        packet->flags |= AV_PKT_FLAG_DISCARD;
+                    }
+                } else if (segment_state == SegmentState::TAIL) {
+                    if (display_ts >= end_key_pts) {
+                        segment_state = SegmentState::DONE;
+                        av_packet_unref(packet);
+                        recorder.drop();
+                        recorder.end();
+                        break;
+                    }
+                }
+            }
+            
             AVPacket* video_packet = av_packet_alloc();
             av_packet_ref(video_packet, packet);
-            video_packet_queue->push(video_packet);
-            video_frame_count++;
+            if (video_packet_queue->push(video_packet)) {
+                video_frame_count++;
+                recorder.output(1, packet->size);
+            } else {
+                av_packet_free(&video_packet);  // 解码线程已退出
+                recorder.drop();
+            }
         } else if (packet->stream_index == audio_stream_index && audio_packet_queue) {
             AVPacket* audio_packet = av_packet_alloc();
             av_packet_ref(audio_packet, packet);
-            audio_packet_queue->push(audio_packet);
-            audio_frame_count++;
+            if (audio_packet_queue->push(audio_packet)) {
+                audio_frame_count++;
+                recorder.output(1, packet->size);
+            } else {
+                av_packet_free(&audio_packet);
+                recorder.drop();
+            }
         }
         
         av_packet_unref(packet);
+        recorder.end();
         
-        // 检查是否达到最大视频帧数限制（以视频帧为准进行同步限制）
-        if (params.max_frames > 0 && video_frame_count >= params.max_frames) {
+        // 所有选中流的下游都已退出（队列已结束）时停止读取
+        if ((video_stream_index < 0 || video_packet_queue->is_finished()) &&
+            (audio_stream_index < 0 || audio_packet_queue->is_finished())) {
+            std::cout << "下游已全部退出，停止解封装" << std::endl;
+            break;
+        }
+        
+        // 检查是否达到最大帧数限制（以视频帧为准进行同步限制，纯音频任务以音频帧计数）
+        int limited_count = (video_stream_index >= 0) ? video_frame_count : audio_frame_count;
+        if (params.max_frames > 0 && limited_count >= params.max_frames) {
             std::cout << "达到最大帧数限制: " << params.max_frames << " (视频帧)" << std::endl;
             break;
         }
     }
     
     // 标记队列完成
-    if (video_packet_queue) {
-        video_packet_queue->finish();
-    }
-    if (audio_packet_queue) {
-        audio_packet_queue->finish();
-    }
+    finish_queues();
     
     av_packet_free(&packet);
-    avformat_close_input(&format_context);
+    close_input(&format_context, &avio);
     
     std::cout << "解封装完成，处理了 " << video_frame_count << " 个视频帧，" 
               << audio_frame_count << " 个音频帧" << std::endl;
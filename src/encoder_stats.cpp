@@ -0,0 +1,112 @@
+/**
+ * 逐帧编码统计写入 (encoder_stats.cpp)
+ *
+ * CSV格式：
+ *   frame,pts,dts,type,key,size,qp,encode_ms,queue_wait_ms
+ *
+ * 二进制格式（小端）：
+ *   文件头 8字节: "VTFS" | uint16 版本(1) | uint16 记录长度(48)
+ *   记录  48字节: int64 frame | int64 pts | int64 dts | int32 size |
+ *                 float qp | float encode_ms | float queue_wait_ms |
+ *                 uint8 type | uint8 key | 6字节填充
+ */
+
+#include "encoder_stats.h"
+#include <cstring>
+#include <iostream>
+
+namespace {
+
+constexpr size_t kWriteBufferSize = 64 * 1024;
+constexpr uint16_t kBinaryVersion = 1;
+constexpr uint16_t kBinaryRecordSize = 48;
+
+// 按小端序写入整数/浮点到缓冲区，返回写入后的位置
+template <typename T>
+uint8_t* put_le(uint8_t* out, T value) {
+    uint8_t bytes[sizeof(T)];
+    memcpy(bytes, &value, sizeof(T));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    for (size_t i = 0; i < sizeof(T); ++i) {
+        out[i] = bytes[sizeof(T) - 1 - i];
+    }
+#else
+    memcpy(out, bytes, sizeof(T));
+#endif
+    return out + sizeof(T);
+}
+
+bool has_suffix(const std::string& value, const char* suffix) {
+    size_t length = strlen(suffix);
+    return value.size() >= length && value.compare(value.size() - length, length, suffix) == 0;
+}
+
+} // namespace
+
+EncoderStatsWriter::~EncoderStatsWriter() {
+    close();
+}
+
+bool EncoderStatsWriter::open(const std::string& path) {
+    return open(path, has_suffix(path, ".bin") ? EncoderStatsFormat::BINARY : EncoderStatsFormat::CSV);
+}
+
+bool EncoderStatsWriter::open(const std::string& path, EncoderStatsFormat format) {
+    close();
+
+    file_ = fopen(path.c_str(), format == EncoderStatsFormat::BINARY ? "wb" : "w");
+    if (!file_) {
+        std::cerr << "错误: 无法创建逐帧统计文件 " << path << std::endl;
+        return false;
+    }
+    setvbuf(file_, nullptr, _IOFBF, kWriteBufferSize);
+    format_ = format;
+    records_ = 0;
+
+    if (format_ == EncoderStatsFormat::BINARY) {
+        uint8_t header[8];
+        memcpy(header, "VTFS", 4);
+        uint8_t* out = put_le(header + 4, kBinaryVersion);
+        put_le(out, kBinaryRecordSize);
+        fwrite(header, 1, sizeof(header), file_);
+    } else {
+        fputs("frame,pts,dts,type,key,size,qp,encode_ms,queue_wait_ms\n", file_);
+    }
+    return true;
+}
+
+void EncoderStatsWriter::write(const EncodedFrameStats& stats) {
+    if (!file_) {
+        return;
+    }
+
+    if (format_ == EncoderStatsFormat::BINARY) {
+        uint8_t record[kBinaryRecordSize] = {};
+        uint8_t* out = record;
+        out = put_le(out, stats.frame_index);
+        out = put_le(out, stats.pts);
+        out = put_le(out, stats.dts);
+        out = put_le(out, stats.size);
+        out = put_le(out, stats.average_qp);
+        out = put_le(out, stats.encode_latency_ms);
+        out = put_le(out, stats.queue_wait_ms);
+        *out++ = static_cast<uint8_t>(stats.frame_type);
+        *out++ = stats.keyframe ? 1 : 0;
+        fwrite(record, 1, sizeof(record), file_);
+    } else {
+        fprintf(file_, "%lld,%lld,%lld,%c,%d,%d,%.2f,%.3f,%.3f\n",
+                static_cast<long long>(stats.frame_index),
+                static_cast<long long>(stats.pts),
+                static_cast<long long>(stats.dts),
+                stats.frame_type, stats.keyframe ? 1 : 0, stats.size,
+                stats.average_qp, stats.encode_latency_ms, stats.queue_wait_ms);
+    }
+    records_++;
+}
+
+void EncoderStatsWriter::close() {
+    if (file_) {
+        fclose(file_);
+        file_ = nullptr;
+    }
+}
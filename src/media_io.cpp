@@ -0,0 +1,133 @@
+#include "media_io.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+extern "C" {
+#include <libavutil/error.h>
+#include <libavutil/mem.h>
+}
+
+namespace {
+
+constexpr int kAvioBufferSize = 64 * 1024;
+
+// 按whence计算目标位置，越界（负数）返回-1
+int64_t resolve_seek(int64_t offset, int whence, int64_t position, int64_t size) {
+    int64_t target;
+    switch (whence) {
+        case SEEK_SET:
+            target = offset;
+            break;
+        case SEEK_CUR:
+            target = position + offset;
+            break;
+        case SEEK_END:
+            target = size + offset;
+            break;
+        default:
+            return -1;
+    }
+    return target < 0 ? -1 : target;
+}
+
+int read_callback(void* opaque, uint8_t* data, int size) {
+    int result = static_cast<MediaReader*>(opaque)->read(data, size);
+    if (result == 0) {
+        return AVERROR_EOF;
+    }
+    return result < 0 ? AVERROR(EIO) : result;
+}
+
+int write_callback(void* opaque, uint8_t* data, int size) {
+    int result = static_cast<MediaWriter*>(opaque)->write(data, size);
+    return result < 0 ? AVERROR(EIO) : result;
+}
+
+int64_t reader_seek_callback(void* opaque, int64_t offset, int whence) {
+    int64_t result = static_cast<MediaReader*>(opaque)->seek(offset, whence & ~AVSEEK_FORCE);
+    return result < 0 ? AVERROR(EINVAL) : result;
+}
+
+int64_t writer_seek_callback(void* opaque, int64_t offset, int whence) {
+    int64_t result = static_cast<MediaWriter*>(opaque)->seek(offset, whence & ~AVSEEK_FORCE);
+    return result < 0 ? AVERROR(EINVAL) : result;
+}
+
+AVIOContext* alloc_avio(int write_flag, void* opaque,
+                        int (*read)(void*, uint8_t*, int),
+                        int (*write)(void*, uint8_t*, int),
+                        int64_t (*seek)(void*, int64_t, int)) {
+    uint8_t* buffer = static_cast<uint8_t*>(av_malloc(kAvioBufferSize));
+    if (!buffer) {
+        return nullptr;
+    }
+    AVIOContext* context = avio_alloc_context(buffer, kAvioBufferSize, write_flag, opaque, read, write, seek);
+    if (!context) {
+        av_free(buffer);
+    }
+    return context;
+}
+
+} // namespace
+
+int MemoryReader::read(uint8_t* data, int size) {
+    size_t count = std::min(static_cast<size_t>(std::max(size, 0)), size_ - position_);
+    memcpy(data, data_ + position_, count);
+    position_ += count;
+    return static_cast<int>(count);
+}
+
+int64_t MemoryReader::seek(int64_t offset, int whence) {
+    if (whence == AVSEEK_SIZE) {
+        return static_cast<int64_t>(size_);
+    }
+    int64_t target = resolve_seek(offset, whence, position_, size_);
+    if (target < 0 || target > static_cast<int64_t>(size_)) {
+        return -1;
+    }
+    position_ = static_cast<size_t>(target);
+    return target;
+}
+
+int MemoryWriter::write(const uint8_t* data, int size) {
+    if (size <= 0) {
+        return 0;
+    }
+    size_t end = position_ + static_cast<size_t>(size);
+    if (end > data_.size()) {
+        data_.resize(end);
+    }
+    memcpy(data_.data() + position_, data, size);
+    position_ = end;
+    return size;
+}
+
+int64_t MemoryWriter::seek(int64_t offset, int whence) {
+    if (whence == AVSEEK_SIZE) {
+        return static_cast<int64_t>(data_.size());
+    }
+    int64_t target = resolve_seek(offset, whence, position_, data_.size());
+    if (target < 0) {
+        return -1;
+    }
+    position_ = static_cast<size_t>(target);
+    return target;
+}
+
+AVIOContext* create_reader_avio(MediaReader* reader) {
+    return alloc_avio(0, reader, read_callback, nullptr,
+                      reader->seekable() ? reader_seek_callback : nullptr);
+}
+
+AVIOContext* create_writer_avio(MediaWriter* writer) {
+    return alloc_avio(1, writer, nullptr, write_callback,
+                      writer->seekable() ? writer_seek_callback : nullptr);
+}
+
+void free_media_avio(AVIOContext** context) {
+    if (context && *context) {
+        av_freep(&(*context)->buffer);
+        avio_context_free(context);
+    }
+}
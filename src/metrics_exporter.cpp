@@ -0,0 +1,386 @@
+/**
+ * Prometheus指标导出 (metrics_exporter.cpp)
+ *
+ * 阶段指标（按任务：transcoder_stage_*，按主机：transcoder_host_stage_*）：
+ *   frames_in_total / frames_out_total / drops_total / bytes_in_total / bytes_out_total
+ *   queue_wait_seconds_total      阻塞在输入的累计时间
+ *   output_wait_seconds_total     阻塞在输出的累计时间
+ *   cpu_seconds_total / thread_seconds_total  阶段线程的CPU时间与存活时间
+ *   process_seconds               单个输入的处理耗时直方图（忙碌时间）
+ * 任务指标：transcoder_job_queue_depth{queue} / queue_bytes{queue} / queued_bytes / queued_peak_bytes /
+ *           scratch_bytes / scratch_peak_bytes / output_bytes / output_seconds / elapsed_seconds
+ * 主机指标：transcoder_host_jobs_running / jobs_started_total / jobs_finished_total{result} / output_bytes_total /
+ *           resident_bytes / resident_peak_bytes（有运行中任务时）
+ */
+
+#include "metrics_exporter.h"
+#include "transcode_job.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr int kPollIntervalMs = 250;  // HTTP线程检查停止标志的间隔
+
+std::string escape_label(const std::string& value) {
+    std::string escaped;
+    for (char c : value) {
+        if (c == '\\' || c == '"') {
+            escaped += '\\';
+            escaped += c;
+        } else if (c == '\n') {
+            escaped += "\\n";
+        } else {
+            escaped += c;
+        }
+    }
+    return escaped;
+}
+
+void write_header(std::ostringstream& out, const std::string& name, const char* type, const char* help) {
+    out << "# HELP " << name << " " << help << "\n";
+    out << "# TYPE " << name << " " << type << "\n";
+}
+
+// 一个阶段在导出中的一组标签与指标值
+struct StageSeries {
+    std::string labels;  // 不含大括号，如 host="a",job="b",stage="mux"
+    StageSnapshot values;
+};
+
+// 阶段指标的全部指标族；prefix为transcoder_stage或transcoder_host_stage
+void write_stage_families(std::ostringstream& out, const std::string& prefix, const std::vector<StageSeries>& series) {
+    struct Counter {
+        const char* suffix;
+        const char* help;
+        uint64_t StageSnapshot::*field;
+    };
+    static const Counter counters[] = {
+        {"_frames_in_total", "Packets or frames taken from the stage input.", &StageSnapshot::frames_in},
+        {"_frames_out_total", "Packets or frames produced by the stage.", &StageSnapshot::frames_out},
+        {"_drops_total", "Inputs dropped by the stage.", &StageSnapshot::drops},
+        {"_bytes_in_total", "Compressed bytes consumed by the stage.", &StageSnapshot::bytes_in},
+        {"_bytes_out_total", "Compressed bytes produced by the stage.", &StageSnapshot::bytes_out},
+    };
+    for (const Counter& counter : counters) {
+        write_header(out, prefix + counter.suffix, "counter", counter.help);
+        for (const StageSeries& entry : series) {
+            out << prefix << counter.suffix << "{" << entry.labels << "} " << entry.values.*counter.field << "\n";
+        }
+    }
+
+    struct Seconds {
+        const char* suffix;
+        const char* help;
+        int64_t StageSnapshot::*field;
+    };
+    static const Seconds seconds[] = {
+        {"_queue_wait_seconds_total", "Time the stage spent blocked waiting for input.", &StageSnapshot::queue_wait_ns},
+        {"_output_wait_seconds_total", "Time the stage spent blocked on a full downstream queue or writer.",
+         &StageSnapshot::output_wait_ns},
+        {"_cpu_seconds_total", "CPU time of the stage threads.", &StageSnapshot::cpu_ns},
+        {"_thread_seconds_total", "Wall time the stage threads were alive.", &StageSnapshot::wall_ns},
+    };
+    for (const Seconds& counter : seconds) {
+        write_header(out, prefix + counter.suffix, "counter", counter.help);
+        for (const StageSeries& entry : series) {
+            out << prefix << counter.suffix << "{" << entry.labels << "} " << entry.values.*counter.field / 1e9 << "\n";
+        }
+    }
+
+    const std::string histogram = prefix + "_process_seconds";
+    write_header(out, histogram, "histogram", "Time spent processing one input.");
+    for (const StageSeries& entry : series) {
+        uint64_t cumulative = 0;
+        for (int i = 0; i < kLatencyBucketCount; ++i) {
+            cumulative += entry.values.process_buckets[i];
+            out << histogram << "_bucket{" << entry.labels << ",le=\"" << kLatencyBucketBoundsNs[i] / 1e9 << "\"} "
+                << cumulative << "\n";
+        }
+        cumulative += entry.values.process_buckets[kLatencyBucketCount];
+        out << histogram << "_bucket{" << entry.labels << ",le=\"+Inf\"} " << cumulative << "\n";
+        out << histogram << "_sum{" << entry.labels << "} " << entry.values.process_ns / 1e9 << "\n";
+        out << histogram << "_count{" << entry.labels << "} " << cumulative << "\n";
+    }
+}
+
+} // namespace
+
+MetricsExporter::MetricsExporter() {
+    char hostname[256] = {};
+    if (gethostname(hostname, sizeof(hostname) - 1) != 0) {
+        strcpy(hostname, "unknown");
+    }
+    host_ = hostname;
+}
+
+MetricsExporter::~MetricsExporter() {
+    stop();
+}
+
+bool MetricsExporter::start(const MetricsParams& params) {
+    stop();
+    params_ = params;
+    stopping_ = false;
+
+    if (params_.port > 0) {
+        listen_fd_ = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        int reuse = 1;
+        setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(static_cast<uint16_t>(params_.port));
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (listen_fd_ < 0 ||
+            bind(listen_fd_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+            listen(listen_fd_, 8) != 0) {
+            std::cerr << "错误: 无法监听指标端口 " << params_.port << ": " << strerror(errno) << std::endl;
+            if (listen_fd_ >= 0) {
+                close(listen_fd_);
+                listen_fd_ = -1;
+            }
+            return false;
+        }
+        http_thread_ = std::thread(&MetricsExporter::http_loop, this);
+        std::cout << "指标导出: http://127.0.0.1:" << params_.port << "/metrics" << std::endl;
+    }
+
+    if (!params_.filename.empty()) {
+        if (params_.interval_ms <= 0) {
+            params_.interval_ms = 5000;
+        }
+        file_thread_ = std::thread(&MetricsExporter::file_loop, this);
+        std::cout << "指标导出: " << params_.filename << "（每" << params_.interval_ms << "毫秒）" << std::endl;
+    }
+    return true;
+}
+
+void MetricsExporter::stop() {
+    {
+        std::lock_guard<std::mutex> lock(file_mutex_);
+        stopping_ = true;
+    }
+    file_cond_.notify_all();
+    if (http_thread_.joinable()) {
+        http_thread_.join();
+    }
+    if (file_thread_.joinable()) {
+        file_thread_.join();
+        write_file();  // 最终值（包括刚结束的任务）
+    }
+    if (listen_fd_ >= 0) {
+        close(listen_fd_);
+        listen_fd_ = -1;
+    }
+}
+
+void MetricsExporter::add_job(const std::string& label, const TranscodeJob* job) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    jobs_.push_back({label, job});
+    jobs_started_++;
+}
+
+void MetricsExporter::remove_job(const TranscodeJob* job) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto it = jobs_.begin(); it != jobs_.end(); ++it) {
+        if (it->job != job) {
+            continue;
+        }
+        if (const PipelineMetrics* metrics = job->metrics()) {
+            for (int i = 0; i < kPipelineStageCount; ++i) {
+                finished_stages_[i].add(metrics->snapshot(static_cast<PipelineStage>(i)));
+            }
+        }
+        if (job->state() == TranscodeJobState::FINISHED) {
+            jobs_succeeded_++;
+        } else {
+            jobs_failed_++;
+        }
+        finished_output_bytes_ += job->stats().bytes_written;
+        jobs_.erase(it);
+        return;
+    }
+}
+
+std::string MetricsExporter::render() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const std::string host_label = "host=\"" + escape_label(host_) + "\"";
+
+    std::vector<StageSeries> job_series;
+    std::vector<TranscodeStats> job_stats;
+    StageSnapshot host_stages[kPipelineStageCount];
+    uint64_t host_output_bytes = finished_output_bytes_;
+    for (int i = 0; i < kPipelineStageCount; ++i) {
+        host_stages[i] = finished_stages_[i];
+    }
+
+    for (const JobEntry& entry : jobs_) {
+        job_stats.push_back(entry.job->stats());
+        host_output_bytes += job_stats.back().bytes_written;
+        const PipelineMetrics* metrics = entry.job->metrics();
+        if (!metrics) {
+            continue;
+        }
+        for (int i = 0; i < kPipelineStageCount; ++i) {
+            PipelineStage stage = static_cast<PipelineStage>(i);
+            StageSnapshot values = metrics->snapshot(stage);
+            host_stages[i].add(values);
+            if (values.frames_in == 0 && values.frames_out == 0) {
+                continue;  // 任务未使用的阶段（如纯音频任务的视频阶段）
+            }
+            job_series.push_back({host_label + ",job=\"" + escape_label(entry.label) + "\",stage=\"" +
+                                  pipeline_stage_name(stage) + "\"", values});
+        }
+    }
+
+    std::vector<StageSeries> host_series;
+    for (int i = 0; i < kPipelineStageCount; ++i) {
+        host_series.push_back({host_label + ",stage=\"" + pipeline_stage_name(static_cast<PipelineStage>(i)) + "\"",
+                               host_stages[i]});
+    }
+
+    std::ostringstream out;
+    write_stage_families(out, "transcoder_stage", job_series);
+
+    write_header(out, "transcoder_job_queue_depth", "gauge", "Items currently waiting in a pipeline queue.");
+    for (size_t j = 0; j < jobs_.size(); ++j) {
+        for (const QueueStats& queue : job_stats[j].queues) {
+            out << "transcoder_job_queue_depth{" << host_label << ",job=\"" << escape_label(jobs_[j].label)
+                << "\",queue=\"" << queue.name << "\"} " << queue.depth << "\n";
+        }
+    }
+    write_header(out, "transcoder_job_queue_bytes", "gauge", "Buffer bytes referenced by frames or packets in a queue.");
+    for (size_t j = 0; j < jobs_.size(); ++j) {
+        for (const QueueStats& queue : job_stats[j].queues) {
+            out << "transcoder_job_queue_bytes{" << host_label << ",job=\"" << escape_label(jobs_[j].label)
+                << "\",queue=\"" << queue.name << "\"} " << queue.bytes << "\n";
+        }
+    }
+    struct JobGauge {
+        const char* name;
+        const char* help;
+        int64_t TranscodeStats::*field;
+    };
+    static const JobGauge memory_gauges[] = {
+        {"transcoder_job_queued_bytes", "Buffer bytes referenced by all queues of the job.", &TranscodeStats::queued_bytes},
+        {"transcoder_job_queued_peak_bytes", "Peak of transcoder_job_queued_bytes.", &TranscodeStats::peak_queued_bytes},
+        {"transcoder_job_scratch_bytes", "Scratch and pool buffers held by the job's stages.", &TranscodeStats::scratch_bytes},
+        {"transcoder_job_scratch_peak_bytes", "Sum of per-stage scratch peaks.", &TranscodeStats::peak_scratch_bytes},
+    };
+    for (const JobGauge& gauge : memory_gauges) {
+        write_header(out, gauge.name, "gauge", gauge.help);
+        for (size_t j = 0; j < jobs_.size(); ++j) {
+            out << gauge.name << "{" << host_label << ",job=\"" << escape_label(jobs_[j].label) << "\"} "
+                << job_stats[j].*gauge.field << "\n";
+        }
+    }
+    write_header(out, "transcoder_job_output_bytes", "gauge", "Bytes written to the primary output.");
+    for (size_t j = 0; j < jobs_.size(); ++j) {
+        out << "transcoder_job_output_bytes{" << host_label << ",job=\"" << escape_label(jobs_[j].label) << "\"} "
+            << job_stats[j].bytes_written << "\n";
+    }
+    write_header(out, "transcoder_job_output_seconds", "gauge", "Media time written to the primary output.");
+    for (size_t j = 0; j < jobs_.size(); ++j) {
+        out << "transcoder_job_output_seconds{" << host_label << ",job=\"" << escape_label(jobs_[j].label) << "\"} "
+            << job_stats[j].output_time_us / 1e6 << "\n";
+    }
+    write_header(out, "transcoder_job_elapsed_seconds", "gauge", "Wall time since the job started.");
+    for (size_t j = 0; j < jobs_.size(); ++j) {
+        out << "transcoder_job_elapsed_seconds{" << host_label << ",job=\"" << escape_label(jobs_[j].label) << "\"} "
+            << job_stats[j].elapsed_seconds << "\n";
+    }
+
+    write_stage_families(out, "transcoder_host_stage", host_series);
+    write_header(out, "transcoder_host_jobs_running", "gauge", "Jobs currently running in this process.");
+    out << "transcoder_host_jobs_running{" << host_label << "} " << jobs_.size() << "\n";
+    write_header(out, "transcoder_host_jobs_started_total", "counter", "Jobs started in this process.");
+    out << "transcoder_host_jobs_started_total{" << host_label << "} " << jobs_started_ << "\n";
+    write_header(out, "transcoder_host_jobs_finished_total", "counter", "Jobs finished in this process.");
+    out << "transcoder_host_jobs_finished_total{" << host_label << ",result=\"success\"} " << jobs_succeeded_ << "\n";
+    out << "transcoder_host_jobs_finished_total{" << host_label << ",result=\"failure\"} " << jobs_failed_ << "\n";
+    int64_t rss_bytes = 0;
+    int64_t peak_rss_bytes = 0;
+    if (!job_stats.empty()) {
+        rss_bytes = job_stats.front().process_rss_bytes;
+        peak_rss_bytes = job_stats.front().process_peak_rss_bytes;
+    }
+    if (rss_bytes > 0) {
+        write_header(out, "transcoder_host_resident_bytes", "gauge", "Resident set size of the transcoder process.");
+        out << "transcoder_host_resident_bytes{" << host_label << "} " << rss_bytes << "\n";
+        write_header(out, "transcoder_host_resident_peak_bytes", "gauge", "Peak resident set size of the process.");
+        out << "transcoder_host_resident_peak_bytes{" << host_label << "} " << peak_rss_bytes << "\n";
+    }
+    write_header(out, "transcoder_host_output_bytes_total", "counter", "Bytes written to primary outputs.");
+    out << "transcoder_host_output_bytes_total{" << host_label << "} " << host_output_bytes << "\n";
+    return out.str();
+}
+
+void MetricsExporter::http_loop() {
+    while (!stopping_) {
+        pollfd listen_poll = {listen_fd_, POLLIN, 0};
+        if (poll(&listen_poll, 1, kPollIntervalMs) <= 0) {
+            continue;
+        }
+        int client = accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+        if (client < 0) {
+            continue;
+        }
+        // 请求内容不影响响应（只读一次请求头，避免客户端在收到响应前被RST）
+        char request[4096];
+        pollfd client_poll = {client, POLLIN, 0};
+        if (poll(&client_poll, 1, 1000) > 0) {
+            ssize_t ignored = recv(client, request, sizeof(request), 0);
+            (void)ignored;
+        }
+
+        std::string body = render();
+        std::string response = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " +
+                               std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+        size_t sent = 0;
+        while (sent < response.size()) {
+            ssize_t written = send(client, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+            if (written <= 0) {
+                break;
+            }
+            sent += static_cast<size_t>(written);
+        }
+        close(client);
+    }
+}
+
+void MetricsExporter::file_loop() {
+    std::unique_lock<std::mutex> lock(file_mutex_);
+    while (!file_cond_.wait_for(lock, std::chrono::milliseconds(params_.interval_ms), [this] { return stopping_.load(); })) {
+        lock.unlock();
+        write_file();
+        lock.lock();
+    }
+}
+
+bool MetricsExporter::write_file() {
+    // 先写临时文件再rename：采集方不会读到写了一半的内容
+    std::string body = render();
+    std::string temp_filename = params_.filename + ".tmp";
+    FILE* file = fopen(temp_filename.c_str(), "w");
+    if (!file) {
+        std::cerr << "警告: 无法写入指标文件 " << temp_filename << std::endl;
+        return false;
+    }
+    bool ok = fwrite(body.data(), 1, body.size(), file) == body.size();
+    ok = (fclose(file) == 0) && ok;
+    if (!ok || rename(temp_filename.c_str(), params_.filename.c_str()) != 0) {
+        std::cerr << "警告: 无法写入指标文件 " << params_.filename << std::endl;
+        std::remove(temp_filename.c_str());
+        return false;
+    }
+    return true;
+}
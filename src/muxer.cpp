@@ -1,5 +1,11 @@
 #include "muxer.h"
 #include <iostream>
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <queue>
+#include <string>
+#include <vector>
 
 extern "C" {
 #include <libavformat/avformat.h>
@@ -8,25 +14,185 @@ extern "C" {
 #include <libavutil/channel_layout.h>
 }
 
-void mux_thread_func(EncodedVideoPacketQueue* video_packet_queue,
-                     EncodedAudioPacketQueue* audio_packet_queue,
-                     const MuxerParams& params) {
-    std::cout << "Mux线程已启动，输出文件: " << params.output_filename 
-              << " 格式: " << params.format_name << std::endl;
+namespace {
+
+// MP4 moov大小估算：每个样本在stsz/stts/ctts/stss/stco中最多约32字节，再留50%余量与256KB基础空间
+// 预留不足时movenc会在写尾时失败，因此宁可多留（空余部分以free box填充）
+int64_t estimate_moov_size(const MuxerParams& params, bool has_video, bool has_audio) {
+    double seconds = static_cast<double>(params.expected_duration) / AV_TIME_BASE;
+    double samples_per_second = (has_video ? params.video_fps : 0) +
+                                (has_audio ? params.audio_sample_rate / 1024.0 : 0);
+    return 256 * 1024 + static_cast<int64_t>(seconds * samples_per_second * 32 * 1.5);
+}
+
+bool has_suffix(const std::string& value, const char* suffix) {
+    size_t length = strlen(suffix);
+    if (value.size() < length) {
+        return false;
+    }
+    for (size_t i = 0; i < length; ++i) {
+        if (tolower(static_cast<unsigned char>(value[value.size() - length + i])) != suffix[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// 分段文件名前缀：播放列表所在目录 + 播放列表文件名（去掉扩展名）
+void split_output_path(const char* filename, std::string& directory, std::string& stem) {
+    std::string path = filename ? filename : "";
+    size_t slash = path.find_last_of('/');
+    directory = (slash == std::string::npos) ? "" : path.substr(0, slash + 1);
+    std::string name = (slash == std::string::npos) ? path : path.substr(slash + 1);
+    size_t dot = name.find_last_of('.');
+    stem = (dot == std::string::npos || dot == 0) ? name : name.substr(0, dot);
+}
+
+// HLS/DASH封装选项：分段在目标时长后的第一个关键帧处切分，播放列表/清单每完成一段更新一次
+void set_segmented_options(const MuxerParams& params, AVDictionary** options) {
+    std::string directory;
+    std::string stem;
+    split_output_path(params.output_filename, directory, stem);
+    const double seconds = std::max(1, params.segment_duration_ms) / 1000.0;
+    
+    if (params.container == OutputContainer::DASH) {
+        av_dict_set(options, "seg_duration", std::to_string(seconds).c_str(), 0);
+        av_dict_set(options, "use_template", "1", 0);
+        av_dict_set(options, "use_timeline", "1", 0);
+        av_dict_set(options, "dash_segment_type", "mp4", 0);
+        av_dict_set(options, "hls_playlist", "1", 0);
+        av_dict_set(options, "init_seg_name", (stem + "-init-$RepresentationID$.m4s").c_str(), 0);
+        av_dict_set(options, "media_seg_name", (stem + "-$RepresentationID$-$Number%05d$.m4s").c_str(), 0);
+        return;
+    }
+    
+    const bool fmp4 = params.container == OutputContainer::HLS_FMP4;
+    av_dict_set(options, "hls_time", std::to_string(seconds).c_str(), 0);
+    av_dict_set(options, "hls_list_size", "0", 0);            // 保留全部分段（点播）
+    av_dict_set(options, "hls_playlist_type", "event", 0);    // 编码过程中只追加，结束时写入ENDLIST
+    av_dict_set(options, "hls_flags", "independent_segments+temp_file", 0);  // 分段写完整后才改名发布
+    av_dict_set(options, "hls_segment_type", fmp4 ? "fmp4" : "mpegts", 0);
+    av_dict_set(options, "hls_segment_filename", 
+                (directory + stem + (fmp4 ? "_%05d.m4s" : "_%05d.ts")).c_str(), 0);
+    if (fmp4) {
+        av_dict_set(options, "hls_fmp4_init_filename", (stem + "_init.mp4").c_str(), 0);
+    }
+}
+
+} // namespace
+
+bool parse_output_container(const std::string& name, OutputContainer& container) {
+    if (name == "avi") {
+        container = OutputContainer::AVI;
+    } else if (name == "mp4" || name == "mov") {
+        container = OutputContainer::MP4;
+    } else if (name == "mkv" || name == "matroska") {
+        container = OutputContainer::MKV;
+    } else if (name == "fmp4" || name == "cmaf") {
+        container = OutputContainer::FMP4;
+    } else if (name == "ts" || name == "mpegts") {
+        container = OutputContainer::MPEGTS;
+    } else if (name == "hls") {
+        container = OutputContainer::HLS;
+    } else if (name == "hls-fmp4" || name == "hls-cmaf") {
+        container = OutputContainer::HLS_FMP4;
+    } else if (name == "dash") {
+        container = OutputContainer::DASH;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+OutputContainer output_container_from_filename(const char* filename) {
+    std::string name = filename ? filename : "";
+    if (has_suffix(name, ".mp4") || has_suffix(name, ".mov") || has_suffix(name, ".m4v")) {
+        return OutputContainer::MP4;
+    } else if (has_suffix(name, ".mkv")) {
+        return OutputContainer::MKV;
+    } else if (has_suffix(name, ".m4s") || has_suffix(name, ".cmfv")) {
+        return OutputContainer::FMP4;
+    } else if (has_suffix(name, ".ts") || has_suffix(name, ".m2ts")) {
+        return OutputContainer::MPEGTS;
+    } else if (has_suffix(name, ".m3u8")) {
+        return OutputContainer::HLS;
+    } else if (has_suffix(name, ".mpd")) {
+        return OutputContainer::DASH;
+    }
+    return OutputContainer::AVI;
+}
+
+const char* output_container_format_name(OutputContainer container) {
+    switch (container) {
+        case OutputContainer::MP4:
+        case OutputContainer::FMP4:
+            return "mp4";
+        case OutputContainer::MKV:
+            return "matroska";
+        case OutputContainer::MPEGTS:
+            return "mpegts";
+        case OutputContainer::HLS:
+        case OutputContainer::HLS_FMP4:
+            return "hls";
+        case OutputContainer::DASH:
+            return "dash";
+        default:
+            return "avi";
+    }
+}
+
+bool output_container_is_segmented(OutputContainer container) {
+    return container == OutputContainer::HLS || container == OutputContainer::HLS_FMP4 ||
+           container == OutputContainer::DASH;
+}
+
+bool output_container_needs_global_header(OutputContainer container) {
+    const AVOutputFormat* format = av_guess_format(output_container_format_name(container), nullptr, nullptr);
+    return format && (format->flags & AVFMT_GLOBALHEADER);
+}
+
+bool output_container_supports_codec(OutputContainer container, AVCodecID codec_id) {
+    const AVOutputFormat* format = av_guess_format(output_container_format_name(container), nullptr, nullptr);
+    // avformat_query_codec：1支持，0不支持，<0封装器无法判断（HLS/DASH等由分段封装器决定），只有明确不支持才拒绝
+    return !format || avformat_query_codec(format, codec_id, FF_COMPLIANCE_NORMAL) != 0;
+}
+
+// 封装的主体：打开输出、写头、按时间戳交错写包、写尾；各失败路径直接返回，队列由mux_thread_func统一收尾
+static void mux_packets(EncodedVideoPacketQueue* video_packet_queue,
+                        EncodedAudioPacketQueue* audio_packet_queue,
+                        const MuxerParams& params) {
+    const char* format_name = output_container_format_name(params.container);
+    const char* output_name = params.output_filename ? params.output_filename : "(回调输出)";
+    std::cout << "Mux线程已启动，输出文件: " << output_name 
+              << " 格式: " << format_name << std::endl;
 
     AVFormatContext* output_format_context = nullptr;
     
-    // 分配输出格式上下文，指定AVI格式
+    // 分配输出格式上下文
     if (avformat_alloc_output_context2(&output_format_context, nullptr, 
-                                      params.format_name, params.output_filename) < 0) {
+                                      format_name, params.output_filename) < 0) {
         std::cerr << "无法创建输出格式上下文。" << std::endl;
         return;
     }
 
+    // 容器不支持的编码直接报错（例如MPEG-TS中的VP9/AV1），而不是写出无法播放的文件；
+    // TranscodeJob::configure已提前检查，这里兜底直接调用封装线程的用法
+    if ((video_packet_queue && !output_container_supports_codec(params.container, params.video_codec_id)) ||
+        (audio_packet_queue && !output_container_supports_codec(params.container, params.audio_codec_id))) {
+        std::cerr << "错误: 容器 " << format_name << " 不支持 " 
+                  << avcodec_get_name(video_packet_queue ? params.video_codec_id : params.audio_codec_id)
+                  << (video_packet_queue && audio_packet_queue ? std::string(" 或 ") + avcodec_get_name(params.audio_codec_id) : "")
+                  << " 编码" << std::endl;
+        avformat_free_context(output_format_context);
+        return;
+    }
+
     AVStream* video_stream = nullptr;
     AVStream* audio_stream = nullptr;
     int video_stream_index = -1;
     int audio_stream_index = -1;
+    int video_packet_count = 0;
+    int audio_packet_count = 0;
 
     // 创建视频流
     if (video_packet_queue) {
@@ -38,17 +204,23 @@ void mux_thread_func(EncodedVideoPacketQueue* video_packet_queue,
         }
         video_stream_index = video_stream->index;
 
-        // 视频流参数
-        video_stream->codecpar->codec_type = AVMEDIA_TYPE_VIDEO;
-        video_stream->codecpar->codec_id = params.video_codec_id;
-        video_stream->codecpar->width = params.video_width;
-        video_stream->codecpar->height = params.video_height;
-        video_stream->codecpar->format = AV_PIX_FMT_YUV420P;
-        video_stream->codecpar->bit_rate = 800000; // 800kbps
+        // 优先使用编码器发布的参数（含全局头），codec_tag交给容器重新选择
+        if (params.video_parameters && params.video_parameters->wait_and_copy(video_stream->codecpar)) {
+            video_stream->codecpar->codec_tag = 0;
+        } else {
+            video_stream->codecpar->codec_type = AVMEDIA_TYPE_VIDEO;
+            video_stream->codecpar->codec_id = params.video_codec_id;
+            video_stream->codecpar->width = params.video_width;
+            video_stream->codecpar->height = params.video_height;
+            video_stream->codecpar->format = AV_PIX_FMT_YUV420P;
+            video_stream->codecpar->bit_rate = 800000; // 800kbps
+        }
         video_stream->time_base = {1, params.video_fps};
+        video_stream->avg_frame_rate = {params.video_fps, 1};
         
         std::cout << "创建视频流: " << params.video_width << "x" << params.video_height 
-                  << " 编码器: " << avcodec_get_name(params.video_codec_id) << std::endl;
+                  << " 编码器: " << avcodec_get_name(params.video_codec_id) 
+                  << (video_stream->codecpar->extradata_size > 0 ? "（全局头）" : "") << std::endl;
     }
 
     // 创建音频流
@@ -61,13 +233,16 @@ void mux_thread_func(EncodedVideoPacketQueue* video_packet_queue,
         }
         audio_stream_index = audio_stream->index;
 
-        // 音频流参数
-        audio_stream->codecpar->codec_type = AVMEDIA_TYPE_AUDIO;
-        audio_stream->codecpar->codec_id = params.audio_codec_id;
-        audio_stream->codecpar->sample_rate = params.audio_sample_rate;
-        av_channel_layout_default(&audio_stream->codecpar->ch_layout, params.audio_channels);
-        audio_stream->codecpar->format = AV_SAMPLE_FMT_FLTP;
-        audio_stream->codecpar->bit_rate = 128000; // 128kbps
+        if (params.audio_parameters && params.audio_parameters->wait_and_copy(audio_stream->codecpar)) {
+            audio_stream->codecpar->codec_tag = 0;
+        } else {
+            audio_stream->codecpar->codec_type = AVMEDIA_TYPE_AUDIO;
+            audio_stream->codecpar->codec_id = params.audio_codec_id;
+            audio_stream->codecpar->sample_rate = params.audio_sample_rate;
+            av_channel_layout_default(&audio_stream->codecpar->ch_layout, params.audio_channels);
+            audio_stream->codecpar->format = AV_SAMPLE_FMT_FLTP;
+            audio_stream->codecpar->bit_rate = 128000; // 128kbps
+        }
         audio_stream->time_base = {1, params.audio_sample_rate};
         
         std::cout << "创建音频流: " << params.audio_sample_rate << "Hz, " 
@@ -75,124 +250,410 @@ void mux_thread_func(EncodedVideoPacketQueue* video_packet_queue,
                   << avcodec_get_name(params.audio_codec_id) << std::endl;
     }
 
-    // 打开输出文件
-    if (!(output_format_context->oformat->flags & AVFMT_NOFILE)) {
-        if (avio_open(&output_format_context->pb, params.output_filename, AVIO_FLAG_WRITE) < 0) {
-            std::cerr << "无法打开输出文件: " << params.output_filename << std::endl;
+    /**
+     * MP4时长未知时使用+faststart：写尾时movenc按文件名重新打开输出读回mdat再整体后移，
+     * 要求此前写出的数据都已在文件中，而异步写入器的当前块与在途块在close()之前不保证落盘，
+     * 因此这种情况下改用avio_open同步写入
+     */
+    const bool mp4_faststart = params.container == OutputContainer::MP4 && params.expected_duration <= 0 &&
+                               !params.custom_output;
+    // 回调输出没有可重新打开的文件（output_filename仅用于日志），时长未知时只能写为分片MP4；
+    // 写入器不可寻址时moov_size/Cues预留空间都无法在写尾时回填，MP4同样按分片写出，MKV不预留索引
+    const bool unseekable_output = params.custom_output && !params.custom_output->seekable();
+    const bool mp4_fragmented_fallback = params.container == OutputContainer::MP4 && params.custom_output &&
+                                         (params.expected_duration <= 0 || unseekable_output);
+
+    // 打开输出文件：回调输出使用自定义IO；否则优先使用异步写入器（faststart除外），失败时回退到avio_open同步写入
+    AsyncFileWriter async_writer;
+    bool async_output = false;
+    AVIOContext* custom_avio = nullptr;
+    if (params.custom_output) {
+        if (output_format_context->oformat->flags & AVFMT_NOFILE) {
+            std::cerr << "错误: 容器 " << format_name << " 自行创建分段文件，不支持回调输出" << std::endl;
+            avformat_free_context(output_format_context);
+            return;
+        }
+        custom_avio = create_writer_avio(params.custom_output);
+        if (!custom_avio) {
+            std::cerr << "无法创建回调输出IO上下文" << std::endl;
+            avformat_free_context(output_format_context);
+            return;
+        }
+        output_format_context->pb = custom_avio;
+        output_format_context->flags |= AVFMT_FLAG_CUSTOM_IO;
+    } else if (!(output_format_context->oformat->flags & AVFMT_NOFILE)) {
+        if (params.async_output && !mp4_faststart && async_writer.open(params.output_filename, params.output_writer)) {
+            output_format_context->pb = async_writer.avio_context();
+            output_format_context->flags |= AVFMT_FLAG_CUSTOM_IO;
+            async_output = true;
+        } else if (avio_open(&output_format_context->pb, params.output_filename, AVIO_FLAG_WRITE) < 0) {
+            std::cerr << "无法打开输出文件: " << output_name << std::endl;
             avformat_free_context(output_format_context);
             return;
         }
     }
 
+    /**
+     * 容器选项：
+     * - MP4：已知时长时预留moov空间（moov_size），写尾时直接回填文件头部，不需要再读一遍文件；
+     *        时长未知时退回+faststart（写尾时整体后移mdat）
+     * - 分片MP4：empty_moov + 每个关键帧/fragment_duration切分分片
+     * - MKV：已知时长时在文件头预留Cues空间，播放器无需读到文件尾即可寻址（回调输出不可寻址时不预留）
+     * - HLS/DASH：编码输出直接切分为分段文件，每完成一段即更新播放列表，不需要二次读取
+     */
+    AVDictionary* options = nullptr;
+    switch (params.container) {
+        case OutputContainer::MP4:
+            if (mp4_fragmented_fallback) {
+                std::cout << (unseekable_output ? "回调输出不可寻址" : "回调输出的时长未知")
+                          << "，MP4按分片写出（empty_moov），不需要回写输出" << std::endl;
+                av_dict_set(&options, "movflags", "+frag_keyframe+empty_moov+default_base_moof", 0);
+                av_dict_set_int(&options, "frag_duration", static_cast<int64_t>(std::max(1, params.fragment_duration_ms)) * 1000, 0);
+            } else if (!mp4_faststart) {
+                av_dict_set_int(&options, "moov_size", 
+                                estimate_moov_size(params, video_packet_queue != nullptr, audio_packet_queue != nullptr), 0);
+            } else {
+                av_dict_set(&options, "movflags", "+faststart", 0);
+            }
+            break;
+        case OutputContainer::FMP4:
+            av_dict_set(&options, "movflags", "+frag_keyframe+empty_moov+default_base_moof", 0);
+            av_dict_set_int(&options, "frag_duration", static_cast<int64_t>(std::max(1, params.fragment_duration_ms)) * 1000, 0);
+            break;
+        case OutputContainer::MKV:
+            if (params.expected_duration > 0 && !unseekable_output) {
+                int64_t seconds = params.expected_duration / AV_TIME_BASE + 1;
+                av_dict_set_int(&options, "reserve_index_space", 1024 + seconds * 64, 0);
+            }
+            break;
+        case OutputContainer::HLS:
+        case OutputContainer::HLS_FMP4:
+        case OutputContainer::DASH:
+            set_segmented_options(params, &options);
+            break;
+        default:
+            break;
+    }
+
     // 写入文件头
-    if (avformat_write_header(output_format_context, nullptr) < 0) {
+    int header_result = avformat_write_header(output_format_context, &options);
+    av_dict_free(&options);
+    if (header_result < 0) {
         std::cerr << "写入文件头失败。" << std::endl;
-        if (!(output_format_context->oformat->flags & AVFMT_NOFILE)) {
+        if (custom_avio) {
+            free_media_avio(&custom_avio);
+        } else if (async_output) {
+            async_writer.close();
+        } else if (!(output_format_context->oformat->flags & AVFMT_NOFILE)) {
             avio_closep(&output_format_context->pb);
         }
         avformat_free_context(output_format_context);
         return;
     }
 
-    bool video_done = (video_packet_queue == nullptr);
-    bool audio_done = (audio_packet_queue == nullptr);
-    int64_t video_pts = 0;
-    int64_t audio_pts = 0;
-    int video_packet_count = 0;
-    int audio_packet_count = 0;
-
-    // 主循环：从队列中获取包并写入文件
-    while (!video_done || !audio_done) {
-        AVPacket* packet = nullptr;
-        int stream_index = -1;
-        bool is_video = false;
-
-        // 选择下一个要写的包（基于时间戳）
-        if (!video_done && !audio_done) {
-            if (video_pts <= audio_pts) {
-                is_video = true;
-            } else {
-                is_video = false;
-            }
-        } else if (!video_done) {
-            is_video = true;
-        } else {
-            is_video = false;
+    /**
+     * 按时间戳交织写出：
+     * - 非阻塞地从各编码队列取包，取出后立即换算到输出流时间基，并按AV_TIME_BASE比较
+     * - 所有包进入按dts排序的最小堆；只有当每个未结束的流都至少缓存了一个包时，堆顶才一定是全局最早的包
+     * - 某个流缓存满（另一路编码器卡顿）时强制写出堆顶，内存占用有界
+     * - 没有可写的包时在通知器上等待任一队列有新数据，不会阻塞在某一个队列上
+     */
+    struct MuxInput {
+        ThreadSafeQueue<AVPacket*>* queue;
+        int stream_index;
+        AVRational source_time_base;  // 编码器输出的时间基
+        int buffered;
+        bool finished;
+        int packet_count;
+    };
+    struct PendingPacket {
+        int64_t dts_us;
+        uint64_t sequence;  // 时间戳相同时保持到达顺序
+        AVPacket* packet;
+        size_t input;
+    };
+    struct PendingLater {
+        bool operator()(const PendingPacket& a, const PendingPacket& b) const {
+            return a.dts_us != b.dts_us ? a.dts_us > b.dts_us : a.sequence > b.sequence;
         }
-
-        if (is_video && !video_done) {
-            if (video_packet_queue->pop(packet)) {
-                stream_index = video_stream_index;
-                video_packet_count++;
-            } else {
-                video_done = true;
-                continue;
+    };
+    
+    std::vector<MuxInput> inputs;
+    if (video_packet_queue) {
+        inputs.push_back({video_packet_queue, video_stream_index, {1, params.video_fps}, 0, false, 0});
+    }
+    if (audio_packet_queue) {
+        inputs.push_back({audio_packet_queue, audio_stream_index, {1, params.audio_sample_rate}, 0, false, 0});
+    }
+    
+    const int max_buffered = std::max(1, params.max_buffered_packets);
+    std::priority_queue<PendingPacket, std::vector<PendingPacket>, PendingLater> pending;
+    StageRecorder recorder(params.metrics);  // 以写出的包为单位：处理时间为写入耗时，其余计为等待
+    uint64_t sequence = 0;
+    QueueNotifier notifier;
+    for (MuxInput& input : inputs) {
+        input.queue->set_notifier(&notifier);
+    }
+    
+    while (true) {
+        uint64_t seen = notifier.version();
+        bool progress = false;
+        
+        // 1. 把各队列中已有的包取入缓冲（每个流最多max_buffered个）
+        for (size_t i = 0; i < inputs.size(); ++i) {
+            MuxInput& input = inputs[i];
+            AVPacket* packet = nullptr;
+            while (!input.finished && input.buffered < max_buffered && input.queue->try_pop(packet)) {
+                progress = true;
+                if (!packet) {
+                    continue;
+                }
+                input.packet_count++;
+                packet->stream_index = input.stream_index;
+                if (packet->pts == AV_NOPTS_VALUE) {
+                    packet->pts = input.packet_count;
+                    packet->dts = packet->pts;
+                }
+                AVStream* stream = output_format_context->streams[input.stream_index];
+                av_packet_rescale_ts(packet, input.source_time_base, stream->time_base);
+                
+                int64_t ts = (packet->dts != AV_NOPTS_VALUE) ? packet->dts : packet->pts;
+                pending.push({av_rescale_q(ts, stream->time_base, AV_TIME_BASE_Q), sequence++, packet, i});
+                input.buffered++;
             }
-        } else if (!is_video && !audio_done) {
-            if (audio_packet_queue->pop(packet)) {
-                stream_index = audio_stream_index;
-                audio_packet_count++;
-            } else {
-                audio_done = true;
-                continue;
+            // 队列结束后不会再有新包，此时为空即表示该流已完成
+            if (!input.finished && input.buffered < max_buffered &&
+                input.queue->is_finished() && input.queue->empty()) {
+                input.finished = true;
+                progress = true;
             }
         }
-
-        if (packet) {
-            packet->stream_index = stream_index;
-
-            // 时间戳处理
-            AVStream* stream = output_format_context->streams[stream_index];
-            
-            if (packet->pts == AV_NOPTS_VALUE) {
-                if (stream_index == video_stream_index) {
-                    packet->pts = video_packet_count;
-                    packet->dts = packet->pts;
-                } else {
-                    packet->pts = audio_packet_count;
-                    packet->dts = packet->pts;
+        
+        // 2. 写出顺序已确定的包
+        while (!pending.empty()) {
+            bool all_buffered = true;
+            bool any_full = false;
+            for (const MuxInput& input : inputs) {
+                if (!input.finished && input.buffered == 0) {
+                    all_buffered = false;
                 }
+                if (input.buffered >= max_buffered) {
+                    any_full = true;
+                }
+            }
+            if (!all_buffered && !any_full) {
+                break;
             }
             
-            // 时间戳缩放
-            if (stream_index == video_stream_index) {
-                AVRational frame_rate = {params.video_fps, 1};
-                av_packet_rescale_ts(packet, av_inv_q(frame_rate), stream->time_base);
+            PendingPacket next = pending.top();
+            pending.pop();
+            inputs[next.input].buffered--;
+            progress = true;
+            
+            if (next.packet->stream_index == video_stream_index) {
+                video_packet_count++;
             } else {
-                AVRational sample_rate = {1, params.audio_sample_rate};
-                av_packet_rescale_ts(packet, sample_rate, stream->time_base);
+                audio_packet_count++;
             }
-
-            // 更新PTS
-            if (stream_index == video_stream_index) {
-                video_pts = packet->pts;
-            } else {
-                audio_pts = packet->pts;
+            if (params.stats) {
+                (next.packet->stream_index == video_stream_index ? params.stats->video_packets
+                                                                 : params.stats->audio_packets)++;
+                params.stats->output_time_us = next.dts_us;
             }
-
-            // 写入包
-            if (av_interleaved_write_frame(output_format_context, packet) < 0) {
+            const int packet_size = next.packet->size;
+            recorder.begin(packet_size, trace_frame_id_from_opaque(next.packet->opaque));
+            if (av_interleaved_write_frame(output_format_context, next.packet) < 0) {
                 std::cerr << "写入包失败。" << std::endl;
+                recorder.drop();
+            } else {
+                recorder.output(1, packet_size);
             }
-
-            av_packet_free(&packet);
+            recorder.end();
+            if (params.stats && output_format_context->pb) {
+                params.stats->bytes_written = avio_tell(output_format_context->pb);
+            }
+            av_packet_free(&next.packet);
+        }
+        
+        bool all_finished = true;
+        for (const MuxInput& input : inputs) {
+            all_finished = all_finished && input.finished;
+        }
+        if (all_finished && pending.empty()) {
+            break;
+        }
+        
+        // 3. 没有任何进展时等待任一队列变化
+        if (!progress) {
+            notifier.wait(seen);
         }
     }
+    
+    for (MuxInput& input : inputs) {
+        input.queue->set_notifier(nullptr);
+    }
 
-    // 写入文件尾
-    av_write_trailer(output_format_context);
+    // 写入文件尾（MP4在此回填moov）
+    bool trailer_written = av_write_trailer(output_format_context) >= 0;
+    if (!trailer_written) {
+        std::cerr << "错误: 写入文件尾失败" << std::endl;
+    }
 
-    // 清理资源
-    if (!(output_format_context->oformat->flags & AVFMT_NOFILE)) {
+    // 清理资源（异步写入时在此等待剩余数据落盘）
+    if (custom_avio) {
+        avio_flush(custom_avio);
+        trailer_written = trailer_written && custom_avio->error >= 0;
+        free_media_avio(&custom_avio);
+    } else if (async_output) {
+        trailer_written = async_writer.close() && trailer_written;
+    } else if (!(output_format_context->oformat->flags & AVFMT_NOFILE)) {
         avio_closep(&output_format_context->pb);
     }
     avformat_free_context(output_format_context);
+    if (params.stats) {
+        params.stats->completed = trailer_written;
+    }
 
-    std::cout << "Mux线程已结束，输出文件已生成: " << params.output_filename << std::endl;
+    std::cout << "Mux线程已结束，输出文件已生成: " << output_name << std::endl;
     std::cout << "写入了 " << video_packet_count << " 个视频包和 " 
               << audio_packet_count << " 个音频包" << std::endl;
 }
 
+namespace {
+
+// 推送到单个目标：先等待目标队列有空位，目标已退出时释放包
+void push_to_tee_output(ThreadSafeQueue<AVPacket*>* queue, AVPacket* packet, size_t capacity) {
+    {
+        OutputBlockTimer blocked;
+        queue->wait_for_space(capacity);
+    }
+    if (!queue->push(packet)) {
+        av_packet_free(&packet);
+    }
+}
+
+// 分发一个包：前n-1个目标拿到共享数据的引用，最后一个目标直接接收原包
+template <typename Select>
+void fan_out_packet(AVPacket* packet, const TeeParams& params, size_t capacity, Select select) {
+    std::vector<ThreadSafeQueue<AVPacket*>*> targets;
+    for (const TeeOutput& output : params.outputs) {
+        ThreadSafeQueue<AVPacket*>* queue = select(output);
+        if (queue && !queue->is_finished()) {
+            targets.push_back(queue);
+        }
+    }
+    if (targets.empty()) {
+        av_packet_free(&packet);
+        return;
+    }
+    for (size_t i = 0; i + 1 < targets.size(); ++i) {
+        AVPacket* reference = av_packet_clone(packet);
+        if (reference) {
+            push_to_tee_output(targets[i], reference, capacity);
+        }
+    }
+    push_to_tee_output(targets.back(), packet, capacity);
+}
+
+} // namespace
+
+void tee_thread_func(EncodedVideoPacketQueue* video_packet_queue,
+                     EncodedAudioPacketQueue* audio_packet_queue,
+                     const TeeParams& params) {
+    std::cout << "Tee线程已启动，输出目标数: " << params.outputs.size() << std::endl;
+    
+    const size_t capacity = static_cast<size_t>(std::max(1, params.max_buffered_packets));
+    auto select_video = [](const TeeOutput& output) -> ThreadSafeQueue<AVPacket*>* { return output.video_packet_queue; };
+    auto select_audio = [](const TeeOutput& output) -> ThreadSafeQueue<AVPacket*>* { return output.audio_packet_queue; };
+    
+    QueueNotifier notifier;
+    if (video_packet_queue) {
+        video_packet_queue->set_notifier(&notifier);
+    }
+    if (audio_packet_queue) {
+        audio_packet_queue->set_notifier(&notifier);
+    }
+    
+    bool video_finished = (video_packet_queue == nullptr);
+    bool audio_finished = (audio_packet_queue == nullptr);
+    int64_t packet_count = 0;
+    while (!video_finished || !audio_finished) {
+        uint64_t seen = notifier.version();
+        bool progress = false;
+        AVPacket* packet = nullptr;
+        
+        // 两路交替各取一个包，避免某一路长时间占用分发线程
+        if (!video_finished) {
+            if (video_packet_queue->try_pop(packet)) {
+                progress = true;
+                if (packet) {
+                    fan_out_packet(packet, params, capacity, select_video);
+                    packet_count++;
+                }
+            } else if (video_packet_queue->is_finished() && video_packet_queue->empty()) {
+                video_finished = true;
+                progress = true;
+            }
+        }
+        if (!audio_finished) {
+            if (audio_packet_queue->try_pop(packet)) {
+                progress = true;
+                if (packet) {
+                    fan_out_packet(packet, params, capacity, select_audio);
+                    packet_count++;
+                }
+            } else if (audio_packet_queue->is_finished() && audio_packet_queue->empty()) {
+                audio_finished = true;
+                progress = true;
+            }
+        }
+        
+        if (!progress) {
+            notifier.wait(seen);
+        }
+    }
+    
+    if (video_packet_queue) {
+        video_packet_queue->set_notifier(nullptr);
+    }
+    if (audio_packet_queue) {
+        audio_packet_queue->set_notifier(nullptr);
+    }
+    for (const TeeOutput& output : params.outputs) {
+        if (output.video_packet_queue) {
+            output.video_packet_queue->finish();
+        }
+        if (output.audio_packet_queue) {
+            output.audio_packet_queue->finish();
+        }
+    }
+    
+    std::cout << "Tee线程已结束，共分发 " << packet_count << " 个包" << std::endl;
+}
+
+void mux_thread_func(EncodedVideoPacketQueue* video_packet_queue,
+                     EncodedAudioPacketQueue* audio_packet_queue,
+                     const MuxerParams& params) {
+    mux_packets(video_packet_queue, audio_packet_queue, params);
+    
+    // 正常结束时队列已取空；提前退出（创建上下文/流、打开输出、写头失败等）时结束队列并丢弃积压，
+    // 编码线程的push随即失败并停止，不会把整个输入编码进无界队列；tee目标的分发线程也随即跳过该目标
+    if (video_packet_queue) {
+        video_packet_queue->finish();
+        video_packet_queue->clear();
+    }
+    if (audio_packet_queue) {
+        audio_packet_queue->finish();
+        audio_packet_queue->clear();
+    }
+}
+
+void tee_mux_thread_func(EncodedVideoPacketQueue* video_packet_queue,
+                         EncodedAudioPacketQueue* audio_packet_queue,
+                         const MuxerParams& params) {
+    mux_thread_func(video_packet_queue, audio_packet_queue, params);
+}
+
 // 简化封装函数
 void mux_thread_func_simple(EncodedVideoPacketQueue* video_packet_queue,
                            EncodedAudioPacketQueue* audio_packet_queue,
@@ -201,7 +662,7 @@ void mux_thread_func_simple(EncodedVideoPacketQueue* video_packet_queue,
                            int audio_sample_rate, int audio_channels) {
     MuxerParams params;
     params.output_filename = output_filename;
-    params.format_name = "avi";
+    params.container = OutputContainer::AVI;
     params.video_width = video_width;
     params.video_height = video_height;
     params.video_fps = video_fps;
@@ -0,0 +1,179 @@
+#include "pipeline_metrics.h"
+#include <cstdio>
+
+const int64_t kLatencyBucketBoundsNs[kLatencyBucketCount] = {
+    100000, 250000, 500000,                 // 0.1 / 0.25 / 0.5 ms
+    1000000, 2500000, 5000000,              // 1 / 2.5 / 5 ms
+    10000000, 25000000, 50000000,           // 10 / 25 / 50 ms
+    100000000, 250000000, 500000000,        // 100 / 250 / 500 ms
+    1000000000, 2500000000LL                // 1 / 2.5 s
+};
+
+const char* pipeline_stage_name(PipelineStage stage) {
+    switch (stage) {
+        case PipelineStage::DEMUX: return "demux";
+        case PipelineStage::VIDEO_DECODE: return "video_decode";
+        case PipelineStage::VIDEO_PROCESS: return "video_process";
+        case PipelineStage::VIDEO_ENCODE: return "video_encode";
+        case PipelineStage::AUDIO_DECODE: return "audio_decode";
+        case PipelineStage::AUDIO_PROCESS: return "audio_process";
+        case PipelineStage::AUDIO_ENCODE: return "audio_encode";
+        case PipelineStage::MUX: return "mux";
+        case PipelineStage::COUNT: break;
+    }
+    return "unknown";
+}
+
+PipelineMetrics::PipelineMetrics() {
+    for (int i = 0; i < kPipelineStageCount; ++i) {
+        stages[i].name = pipeline_stage_name(static_cast<PipelineStage>(i));
+    }
+}
+
+void PipelineMetrics::enable_trace(TraceSession* session) {
+    for (StageMetrics& metrics : stages) {
+        metrics.trace = session;
+    }
+}
+
+void StageMetrics::observe_process(int64_t ns) {
+    process_ns.fetch_add(ns, std::memory_order_relaxed);
+    int bucket = 0;
+    while (bucket < kLatencyBucketCount && ns > kLatencyBucketBoundsNs[bucket]) {
+        ++bucket;
+    }
+    process_buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+}
+
+void StageSnapshot::add(const StageSnapshot& other) {
+    frames_in += other.frames_in;
+    frames_out += other.frames_out;
+    drops += other.drops;
+    bytes_in += other.bytes_in;
+    bytes_out += other.bytes_out;
+    queue_wait_ns += other.queue_wait_ns;
+    process_ns += other.process_ns;
+    output_wait_ns += other.output_wait_ns;
+    cpu_ns += other.cpu_ns;
+    wall_ns += other.wall_ns;
+    threads += other.threads;
+    scratch_bytes += other.scratch_bytes;
+    scratch_peak_bytes += other.scratch_peak_bytes;
+    for (int i = 0; i <= kLatencyBucketCount; ++i) {
+        process_buckets[i] += other.process_buckets[i];
+    }
+}
+
+StageSnapshot PipelineMetrics::snapshot(PipelineStage which) const {
+    const StageMetrics& metrics = stages[static_cast<int>(which)];
+    StageSnapshot snapshot;
+    snapshot.frames_in = metrics.frames_in.load(std::memory_order_relaxed);
+    snapshot.frames_out = metrics.frames_out.load(std::memory_order_relaxed);
+    snapshot.drops = metrics.drops.load(std::memory_order_relaxed);
+    snapshot.bytes_in = metrics.bytes_in.load(std::memory_order_relaxed);
+    snapshot.bytes_out = metrics.bytes_out.load(std::memory_order_relaxed);
+    snapshot.queue_wait_ns = metrics.queue_wait_ns.load(std::memory_order_relaxed);
+    snapshot.process_ns = metrics.process_ns.load(std::memory_order_relaxed);
+    snapshot.output_wait_ns = metrics.output_wait_ns.load(std::memory_order_relaxed);
+    snapshot.cpu_ns = metrics.cpu_ns.load(std::memory_order_relaxed);
+    snapshot.wall_ns = metrics.wall_ns.load(std::memory_order_relaxed);
+    snapshot.threads = metrics.threads.load(std::memory_order_relaxed);
+    snapshot.scratch_bytes = metrics.scratch.current();
+    snapshot.scratch_peak_bytes = metrics.scratch.peak();
+    for (int i = 0; i <= kLatencyBucketCount; ++i) {
+        snapshot.process_buckets[i] = metrics.process_buckets[i].load(std::memory_order_relaxed);
+    }
+    return snapshot;
+}
+
+namespace {
+
+// 限制阶段受CPU限制时的建议：哪里增加工作线程/并行度有效
+const char* cpu_bound_advice(PipelineStage stage) {
+    switch (stage) {
+        case PipelineStage::DEMUX:
+            return "解封装受CPU限制（通常是大量小包）：解封装为单线程，可用--segments让各分段各自解封装";
+        case PipelineStage::VIDEO_DECODE:
+            return "视频解码受CPU限制：用--segments分段并行（每段独立解码），或提高--threads让解码器多线程";
+        case PipelineStage::VIDEO_PROCESS:
+            return "视频处理（颜色转换/CPU滤镜）受CPU限制：单帧处理是单线程的，用--segments让多条处理流水线并行";
+        case PipelineStage::VIDEO_ENCODE:
+            return "视频编码受CPU限制：提高--threads、使用--thread-type=frame、--segments分段并行编码，或选择更快的--preset";
+        case PipelineStage::AUDIO_DECODE:
+        case PipelineStage::AUDIO_PROCESS:
+        case PipelineStage::AUDIO_ENCODE:
+            return "音频阶段受CPU限制：音频流水线每级只有一个线程，可按时间分块并行变速/编码，或降低音频处理开销";
+        case PipelineStage::MUX:
+            return "封装受CPU限制：封装为单线程，减少--tee输出数量或关闭不需要的容器特性";
+        case PipelineStage::COUNT:
+            break;
+    }
+    return "";
+}
+
+// 限制阶段大部分忙碌时间并未占用CPU（在等待GPU同步或I/O）时的建议
+const char* wait_bound_advice(PipelineStage stage) {
+    switch (stage) {
+        case PipelineStage::DEMUX:
+            return "输入读取受I/O限制：增加工作线程无效，应使用更快的存储或增大读取缓冲";
+        case PipelineStage::VIDEO_PROCESS:
+            return "视频处理主要在等待GPU（纹理上传/像素回读同步）：增加线程帮助有限，应流水化上传与回读（如PBO异步读回）或关闭旋转";
+        case PipelineStage::MUX:
+            return "封装主要在等待写入：检查磁盘吞吐，或使用异步大块写入（不加--sync-output）";
+        default:
+            return "该阶段忙碌时间中CPU占比低（等待锁/内存/外部资源）：增加线程帮助有限，应先定位阶段内部的等待";
+    }
+}
+
+} // namespace
+
+std::string format_bottleneck_report(const PipelineMetrics& metrics) {
+    std::string report = "阶段利用率（占线程墙钟时间）:\n";
+    char line[256];
+    snprintf(line, sizeof(line), "  %-14s %4s %9s %7s %9s %9s %7s\n",
+             "阶段", "线程", "墙钟(s)", "忙碌", "等待输入", "等待输出", "CPU");
+    report += line;
+
+    int limiting = -1;
+    double limiting_utilisation = 0.0;
+    StageSnapshot limiting_snapshot;
+    for (int i = 0; i < kPipelineStageCount; ++i) {
+        PipelineStage stage = static_cast<PipelineStage>(i);
+        StageSnapshot snapshot = metrics.snapshot(stage);
+        if (snapshot.threads == 0 || snapshot.wall_ns <= 0) {
+            continue;
+        }
+        double wall = static_cast<double>(snapshot.wall_ns);
+        double utilisation = snapshot.process_ns / wall;
+        snprintf(line, sizeof(line), "  %-14s %4d %9.2f %6.1f%% %8.1f%% %8.1f%% %6.1f%%\n",
+                 pipeline_stage_name(stage), snapshot.threads, wall / 1e9 / snapshot.threads,
+                 utilisation * 100.0, snapshot.queue_wait_ns * 100.0 / wall,
+                 snapshot.output_wait_ns * 100.0 / wall, snapshot.cpu_ns * 100.0 / wall);
+        report += line;
+        if (utilisation > limiting_utilisation) {
+            limiting = i;
+            limiting_utilisation = utilisation;
+            limiting_snapshot = snapshot;
+        }
+    }
+    if (limiting < 0) {
+        return report + "  （没有阶段记录）\n";
+    }
+
+    PipelineStage stage = static_cast<PipelineStage>(limiting);
+    double cpu_share = limiting_snapshot.process_ns > 0
+                           ? static_cast<double>(limiting_snapshot.cpu_ns) / limiting_snapshot.process_ns
+                           : 0.0;
+    snprintf(line, sizeof(line), "限制阶段: %s（利用率%.1f%%，忙碌时间中CPU占%.0f%%）\n",
+             pipeline_stage_name(stage), limiting_utilisation * 100.0, cpu_share * 100.0);
+    report += line;
+    if (limiting_utilisation < 0.5) {
+        report += "建议: 各阶段利用率都不高，流水线主要在相互等待（输入速度或阶段间依赖受限），增加线程不会提高吞吐\n";
+    } else if (cpu_share >= 0.6 || stage == PipelineStage::VIDEO_DECODE || stage == PipelineStage::VIDEO_ENCODE) {
+        // 编解码器的帧/片线程在FFmpeg内部运行，阶段线程本身的CPU占比低不代表在等待外部资源
+        report += std::string("建议: ") + cpu_bound_advice(stage) + "\n";
+    } else {
+        report += std::string("建议: ") + wait_bound_advice(stage) + "\n";
+    }
+    return report;
+}
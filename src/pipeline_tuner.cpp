@@ -0,0 +1,250 @@
+/**
+ * 流水线自动调优 (pipeline_tuner.cpp)
+ *
+ * 每个周期对每个有界帧队列计算两端在这一周期内的阻塞占比：
+ *   生产者阻塞在输出 = Δproducer.output_wait_ns / 周期
+ *   消费者等待输入   = Δconsumer.queue_wait_ns / 周期
+ * 两者同时超过5% → 交替阻塞，容量加倍（不超过上限与内存余量）
+ * 生产者超过50%且消费者低于1%，连续3个周期 → 缩小约四分之一（不低于floor）
+ * 内存预算只计调优能控制的队列：登记的帧队列与分段流水线的队列；解封装/封装两端的包队列无界，
+ * 缩小帧队列或分段并行度都不能让它们变小，计入预算只会把帧队列错误地压到下限
+ * 分段并行度按进程CPU时间（CLOCK_PROCESS_CPUTIME_ID）判断核心是否用满；
+ * 批处理时同一进程的其他任务也计入，调优因此偏保守
+ */
+
+#include "pipeline_tuner.h"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <time.h>
+
+namespace {
+
+const double kAlternatingShare = 0.05;   // 两端都有超过此比例的时间阻塞时视为交替阻塞
+const double kSaturatedShare = 0.5;      // 生产者阻塞超过此比例...
+const double kIdleShare = 0.01;          // ...且消费者等待低于此比例时视为消费者是瓶颈
+const int kShrinkTicks = 3;              // 连续满足缩小条件的周期数
+const size_t kMinCapacity = 2;
+const double kCpuIdleShare = 0.8;        // 进程CPU低于核心预算的此比例时可以增加分段并行度
+const double kCpuSaturatedShare = 0.98;
+const int kSegmentCooldownTicks = 4;     // 新分段流水线打开编码器、填满队列需要的时间
+
+int64_t process_cpu_now_ns() {
+    timespec now;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now);
+    return static_cast<int64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+}
+
+} // namespace
+
+PipelineTuner::~PipelineTuner() {
+    stop();
+}
+
+void PipelineTuner::add_queue(const char* name, ThreadSafeQueue<AVFrame*>* queue,
+                              const StageMetrics* producer, const StageMetrics* consumer,
+                              size_t initial, size_t maximum) {
+    if (!queue || !producer || !consumer) {
+        return;
+    }
+    TunedQueue tuned;
+    tuned.name = name;
+    tuned.queue = queue;
+    tuned.producer = producer;
+    tuned.consumer = consumer;
+    tuned.maximum = std::max(kMinCapacity, maximum);
+    tuned.capacity = std::min(std::max(kMinCapacity, initial), tuned.maximum);
+    tuned.floor = kMinCapacity;
+    queue->set_capacity(tuned.capacity);
+    queues_.push_back(tuned);
+}
+
+void PipelineTuner::set_segment_limit(std::atomic<int>* limit, QueueNotifier* changed, const MemoryGauge* segment_memory,
+                                      int initial, int maximum) {
+    segment_limit_ = limit;
+    segment_changed_ = changed;
+    segment_memory_ = segment_memory;
+    segment_maximum_ = std::max(1, maximum);
+    segment_initial_ = std::min(std::max(1, initial), segment_maximum_);
+    if (segment_limit_) {
+        segment_limit_->store(segment_initial_);
+        if (segment_changed_) {
+            segment_changed_->notify();
+        }
+    }
+}
+
+bool PipelineTuner::start(const TunerParams& params) {
+    stop();
+    if (queues_.empty() && !segment_limit_) {
+        return false;
+    }
+    params_ = params;
+    if (params_.interval_ms <= 0) {
+        params_.interval_ms = 500;
+    }
+    params_.total_cores = std::max(1, params_.total_cores);
+
+    for (TunedQueue& tuned : queues_) {
+        tuned.last_producer_blocked_ns = tuned.producer->output_wait_ns.load(std::memory_order_relaxed);
+        tuned.last_consumer_waited_ns = tuned.consumer->queue_wait_ns.load(std::memory_order_relaxed);
+    }
+    last_cpu_ns_ = process_cpu_now_ns();
+    segment_cooldown_ = kSegmentCooldownTicks;
+    adjustments_ = 0;
+
+    std::cout << "自动调优: 已启用（周期" << params_.interval_ms << "ms";
+    if (params_.memory_budget_bytes > 0) {
+        std::cout << "，队列内存上限" << params_.memory_budget_bytes / (1024 * 1024) << "MB";
+    }
+    std::cout << "）" << std::endl;
+
+    stopping_ = false;
+    thread_ = std::thread(&PipelineTuner::run, this);
+    return true;
+}
+
+void PipelineTuner::stop() {
+    if (!thread_.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    cond_.notify_all();
+    thread_.join();
+
+    std::cout << "自动调优: 共调整" << adjustments_ << "次，最终";
+    for (const TunedQueue& tuned : queues_) {
+        std::cout << " " << tuned.name << "=" << tuned.capacity;
+    }
+    if (segment_limit_) {
+        std::cout << " 分段并行度=" << segment_limit_->load();
+    }
+    std::cout << std::endl;
+}
+
+void PipelineTuner::run() {
+    auto last = std::chrono::steady_clock::now();
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!cond_.wait_for(lock, std::chrono::milliseconds(params_.interval_ms), [this] { return stopping_; })) {
+        lock.unlock();
+        auto now = std::chrono::steady_clock::now();
+        int64_t interval_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(now - last).count();
+        last = now;
+        if (interval_ns > 0) {
+            tick(interval_ns);
+        }
+        lock.lock();
+    }
+}
+
+void PipelineTuner::tick(int64_t interval_ns) {
+    int64_t memory = segment_memory_ ? segment_memory_->current() : 0;
+    for (const TunedQueue& tuned : queues_) {
+        memory += tuned.queue->bytes();
+    }
+    bool over_budget = params_.memory_budget_bytes > 0 && memory > params_.memory_budget_bytes;
+    TunedQueue* largest = nullptr;
+    int64_t largest_bytes = 0;
+
+    for (TunedQueue& tuned : queues_) {
+        int64_t producer_blocked_ns = tuned.producer->output_wait_ns.load(std::memory_order_relaxed);
+        int64_t consumer_waited_ns = tuned.consumer->queue_wait_ns.load(std::memory_order_relaxed);
+        double producer_blocked = static_cast<double>(producer_blocked_ns - tuned.last_producer_blocked_ns) / interval_ns;
+        double consumer_starved = static_cast<double>(consumer_waited_ns - tuned.last_consumer_waited_ns) / interval_ns;
+        tuned.last_producer_blocked_ns = producer_blocked_ns;
+        tuned.last_consumer_waited_ns = consumer_waited_ns;
+
+        size_t depth = tuned.queue->size();
+        int64_t bytes = tuned.queue->bytes();
+        if (depth > 0) {
+            tuned.item_bytes = bytes / static_cast<int64_t>(depth);
+        }
+        if (bytes > largest_bytes && tuned.capacity > kMinCapacity) {
+            largest = &tuned;
+            largest_bytes = bytes;
+        }
+        if (over_budget) {
+            continue;
+        }
+
+        if (producer_blocked > kAlternatingShare && consumer_starved > kAlternatingShare) {
+            tuned.saturated_ticks = 0;
+            size_t grown = std::min(tuned.maximum, tuned.capacity * 2);
+            int64_t extra = static_cast<int64_t>(grown - tuned.capacity) * tuned.item_bytes;
+            if (grown > tuned.capacity &&
+                (params_.memory_budget_bytes <= 0 || memory + extra <= params_.memory_budget_bytes)) {
+                tuned.floor = tuned.capacity + 1;
+                memory += extra;
+                resize(tuned, grown, "上下游交替阻塞");
+            }
+        } else if (producer_blocked > kSaturatedShare && consumer_starved < kIdleShare) {
+            if (++tuned.saturated_ticks >= kShrinkTicks) {
+                tuned.saturated_ticks = 0;
+                size_t shrunk = std::max(tuned.floor, tuned.capacity - std::max<size_t>(1, tuned.capacity / 4));
+                if (shrunk < tuned.capacity) {
+                    resize(tuned, shrunk, "消费者是瓶颈");
+                }
+            }
+        } else {
+            tuned.saturated_ticks = 0;
+        }
+    }
+
+    // 超预算：每个周期只缩小占用最多的一个队列，下一周期按新的内存占用再判断
+    if (over_budget && largest) {
+        largest->floor = kMinCapacity;
+        resize(*largest, std::max(kMinCapacity, largest->capacity / 2), "队列内存超出预算");
+    }
+
+    if (segment_limit_) {
+        tune_segments(interval_ns, memory, over_budget);
+    }
+}
+
+void PipelineTuner::resize(TunedQueue& tuned, size_t capacity, const char* reason) {
+    std::cout << "自动调优: " << tuned.name << " 容量 " << tuned.capacity << "→" << capacity
+              << "（" << reason << "）" << std::endl;
+    tuned.capacity = capacity;
+    tuned.queue->set_capacity(capacity);
+    adjustments_++;
+}
+
+void PipelineTuner::tune_segments(int64_t interval_ns, int64_t memory, bool over_budget) {
+    int64_t cpu_ns = process_cpu_now_ns();
+    double cores_used = static_cast<double>(cpu_ns - last_cpu_ns_) / interval_ns;
+    last_cpu_ns_ = cpu_ns;
+    if (segment_cooldown_ > 0) {
+        segment_cooldown_--;
+        return;
+    }
+
+    int limit = segment_limit_->load();
+    int target = limit;
+    const char* reason = "";
+    if (over_budget && limit > 1) {
+        target = limit - 1;
+        reason = "队列内存超出预算";
+    } else if (cores_used >= params_.total_cores * kCpuSaturatedShare && limit > segment_initial_) {
+        target = limit - 1;
+        reason = "CPU已饱和";
+    } else if (cores_used < params_.total_cores * kCpuIdleShare && limit < segment_maximum_ &&
+               (params_.memory_budget_bytes <= 0 || memory < params_.memory_budget_bytes / 2)) {
+        target = limit + 1;
+        reason = "CPU未用满";
+    }
+    if (target == limit) {
+        return;
+    }
+
+    std::cout << "自动调优: 分段并行度 " << limit << "→" << target << "（" << reason << "，CPU "
+              << static_cast<int>(cores_used * 100 / params_.total_cores) << "%）" << std::endl;
+    segment_limit_->store(target);
+    if (segment_changed_) {
+        segment_changed_->notify();
+    }
+    segment_cooldown_ = kSegmentCooldownTicks;
+    adjustments_++;
+}
@@ -0,0 +1,199 @@
+/**
+ * 进度报告 (progress.cpp)
+ *
+ * 文本行（标准输出）：
+ *   进度[out.mp4] 45.2% 帧1234 87.3fps 3.49x 时间00:00:42 已写12.3MB 剩余00:01:23 队列内存45.6MB 常驻312.0MB 队列 video_frames=5 ...
+ * JSON行（每次采样一行，便于调度器/脚本增量读取）：
+ *   {"job":"out.mp4","state":"running","elapsed":12.0,"percent":45.2,"frames":1234,"fps":87.3,
+ *    "speed":3.49,"output_time":42.1,"bytes":12897484,"eta":83.1,"queued_bytes":47815680,"peak_queued_bytes":...,
+ *    "scratch_bytes":...,"rss":...,"peak_rss":...,"queues":{"video_frames":{"depth":5,"pushed":1240,"bytes":...,"peak_bytes":...,"capacity":0},...}}
+ */
+
+#include "progress.h"
+#include "transcode_job.h"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+namespace {
+
+const char* state_name(TranscodeJobState state) {
+    switch (state) {
+        case TranscodeJobState::CREATED: return "created";
+        case TranscodeJobState::CONFIGURED: return "configured";
+        case TranscodeJobState::RUNNING: return "running";
+        case TranscodeJobState::FINISHED: return "finished";
+        case TranscodeJobState::FAILED: return "failed";
+        case TranscodeJobState::CANCELLED: return "cancelled";
+    }
+    return "unknown";
+}
+
+// 秒数 → HH:MM:SS，未知时为--:--:--
+std::string format_clock(double seconds) {
+    if (seconds < 0) {
+        return "--:--:--";
+    }
+    int64_t total = static_cast<int64_t>(seconds + 0.5);
+    char text[32];
+    snprintf(text, sizeof(text), "%02lld:%02lld:%02lld",
+             static_cast<long long>(total / 3600), static_cast<long long>(total / 60 % 60),
+             static_cast<long long>(total % 60));
+    return text;
+}
+
+std::string json_escape(const std::string& value) {
+    std::string escaped;
+    for (char c : value) {
+        if (c == '"' || c == '\\') {
+            escaped += '\\';
+            escaped += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char code[8];
+            snprintf(code, sizeof(code), "\\u%04x", c);
+            escaped += code;
+        } else {
+            escaped += c;
+        }
+    }
+    return escaped;
+}
+
+} // namespace
+
+ProgressReporter::~ProgressReporter() {
+    stop();
+}
+
+bool ProgressReporter::start(const TranscodeJob& job, const ProgressParams& params) {
+    stop();
+    job_ = &job;
+    params_ = params;
+    if (params_.interval_ms <= 0) {
+        params_.interval_ms = 1000;
+    }
+    if (params_.label.empty()) {
+        params_.label = job.options().output_filename.empty() ? "(回调输出)" : job.options().output_filename;
+    }
+    if (!params_.json_filename.empty()) {
+        // 追加模式：批处理的多个任务可以写同一个文件，每行一次fwrite
+        json_file_ = params_.json_filename == "-" ? stdout : fopen(params_.json_filename.c_str(), "a");
+        if (!json_file_) {
+            std::cerr << "错误: 无法打开进度文件 " << params_.json_filename << std::endl;
+            return false;
+        }
+    }
+
+    last_elapsed_ = 0.0;
+    last_video_frames_ = 0;
+    last_output_time_us_ = 0;
+    stopping_ = false;
+    thread_ = std::thread(&ProgressReporter::run, this);
+    return true;
+}
+
+void ProgressReporter::stop() {
+    if (!thread_.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    cond_.notify_all();
+    thread_.join();
+    report(true);
+    if (json_file_ && json_file_ != stdout) {
+        fclose(json_file_);
+    }
+    json_file_ = nullptr;
+}
+
+void ProgressReporter::run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!cond_.wait_for(lock, std::chrono::milliseconds(params_.interval_ms), [this] { return stopping_; })) {
+        lock.unlock();
+        report(false);
+        lock.lock();
+    }
+}
+
+void ProgressReporter::report(bool final_report) {
+    TranscodeStats stats = job_->stats();
+    const TranscodeOptions& options = job_->options();
+
+    ProgressSample sample;
+    sample.elapsed_seconds = stats.elapsed_seconds;
+    sample.video_frames = stats.video_packets;
+    sample.output_time_us = stats.output_time_us;
+    sample.bytes_written = stats.bytes_written;
+
+    double interval = sample.elapsed_seconds - last_elapsed_;
+    if (interval > 0) {
+        sample.fps = (sample.video_frames - last_video_frames_) / interval;
+        sample.speed = (sample.output_time_us - last_output_time_us_) / 1e6 / interval;
+    }
+    last_elapsed_ = sample.elapsed_seconds;
+    last_video_frames_ = sample.video_frames;
+    last_output_time_us_ = sample.output_time_us;
+
+    // 输出总时长 = 输入时长/变速倍数；剩余时间按启动以来的平均速度估算，比瞬时速度稳定
+    double expected_seconds = stats.input_duration > 0 ? stats.input_duration / 1e6 / options.speed_factor : 0.0;
+    double output_seconds = sample.output_time_us / 1e6;
+    if (expected_seconds > 0) {
+        sample.percent = std::min(100.0, output_seconds * 100.0 / expected_seconds);
+        if (output_seconds > 0 && sample.elapsed_seconds > 0) {
+            double average_speed = output_seconds / sample.elapsed_seconds;
+            sample.eta_seconds = std::max(0.0, (expected_seconds - output_seconds) / average_speed);
+        }
+    }
+    if (final_report) {
+        sample.eta_seconds = 0.0;
+    }
+
+    char buffer[512];
+    std::string line;
+    if (json_file_) {
+        snprintf(buffer, sizeof(buffer),
+                 "\",\"state\":\"%s\",\"elapsed\":%.3f,\"percent\":%.2f,\"frames\":%lld,"
+                 "\"fps\":%.2f,\"speed\":%.3f,\"output_time\":%.3f,\"bytes\":%lld,\"eta\":%.1f,"
+                 "\"queued_bytes\":%lld,\"peak_queued_bytes\":%lld,\"scratch_bytes\":%lld,\"rss\":%lld,\"peak_rss\":%lld,"
+                 "\"queues\":{",
+                 state_name(stats.state), sample.elapsed_seconds,
+                 sample.percent, static_cast<long long>(sample.video_frames), sample.fps, sample.speed,
+                 output_seconds, static_cast<long long>(sample.bytes_written), sample.eta_seconds,
+                 static_cast<long long>(stats.queued_bytes), static_cast<long long>(stats.peak_queued_bytes),
+                 static_cast<long long>(stats.scratch_bytes), static_cast<long long>(stats.process_rss_bytes),
+                 static_cast<long long>(stats.process_peak_rss_bytes));
+        line = "{\"job\":\"" + json_escape(params_.label) + buffer;
+        for (size_t i = 0; i < stats.queues.size(); ++i) {
+            snprintf(buffer, sizeof(buffer), "%s\"%s\":{\"depth\":%zu,\"pushed\":%llu,\"bytes\":%lld,\"peak_bytes\":%lld,\"capacity\":%zu}",
+                     i > 0 ? "," : "", stats.queues[i].name, stats.queues[i].depth,
+                     static_cast<unsigned long long>(stats.queues[i].pushed),
+                     static_cast<long long>(stats.queues[i].bytes), static_cast<long long>(stats.queues[i].peak_bytes),
+                     stats.queues[i].capacity);
+            line += buffer;
+        }
+        line += "}}\n";
+        fwrite(line.data(), 1, line.size(), json_file_);
+        fflush(json_file_);
+        return;
+    }
+
+    snprintf(buffer, sizeof(buffer), "%s 帧%lld %.1ffps %.2fx 时间%s 已写%.1fMB 剩余%s",
+             sample.percent >= 0 ? (std::to_string(static_cast<int>(sample.percent)) + "%").c_str() : "--%",
+             static_cast<long long>(sample.video_frames), sample.fps, sample.speed,
+             format_clock(output_seconds).c_str(), sample.bytes_written / (1024.0 * 1024.0),
+             format_clock(sample.eta_seconds).c_str());
+    line = "进度[" + params_.label + "] " + buffer;
+    snprintf(buffer, sizeof(buffer), " 队列内存%.1fMB 常驻%.1fMB", stats.queued_bytes / (1024.0 * 1024.0),
+             stats.process_rss_bytes / (1024.0 * 1024.0));
+    line += buffer;
+    if (!final_report && !stats.queues.empty()) {
+        line += " 队列";
+        for (const QueueStats& queue : stats.queues) {
+            line += std::string(" ") + queue.name + "=" + std::to_string(queue.depth);
+        }
+    }
+    std::cout << line << std::endl;
+}
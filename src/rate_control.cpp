@@ -0,0 +1,225 @@
+#include "rate_control.h"
+#include "video_decoder.h"
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <climits>
+#include <cerrno>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <atomic>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+
+// 64位FNV-1a：结果跨进程、跨构建稳定，适合作为缓存文件名
+static uint64_t fnv1a_64(const std::string& data) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (unsigned char c : data) {
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// 逐级创建目录（等价于mkdir -p）
+static bool make_directories(const std::string& path) {
+    std::string current;
+    std::stringstream stream(path);
+    std::string part;
+    if (!path.empty() && path[0] == '/') {
+        current = "/";
+    }
+    while (std::getline(stream, part, '/')) {
+        if (part.empty()) {
+            continue;
+        }
+        current += part + "/";
+        if (mkdir(current.c_str(), 0755) != 0 && errno != EEXIST) {
+            std::cerr << "错误: 无法创建目录 " << current << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool file_exists_non_empty(const std::string& path) {
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0;
+}
+
+std::string default_two_pass_cache_dir() {
+    const char* xdg_cache = std::getenv("XDG_CACHE_HOME");
+    if (xdg_cache && xdg_cache[0]) {
+        return std::string(xdg_cache) + "/video_transcoder/2pass";
+    }
+    const char* home = std::getenv("HOME");
+    if (home && home[0]) {
+        return std::string(home) + "/.cache/video_transcoder/2pass";
+    }
+    return "/tmp/video_transcoder/2pass";
+}
+
+std::string first_pass_cache_key(const FirstPassParams& params) {
+    std::ostringstream key;
+    
+    // 素材身份：文件被替换或修改后缓存自动失效
+    char resolved[PATH_MAX];
+    const char* path = realpath(params.input_filename, resolved) ? resolved : params.input_filename;
+    struct stat st;
+    key << path;
+    if (stat(path, &st) == 0) {
+        key << "|" << static_cast<long long>(st.st_size) << "|" << static_cast<long long>(st.st_mtime);
+    }
+    
+    // 编码参数（不含码率）
+    const VideoEncoderParams& enc = params.encode_params;
+    key << "|fmt=" << static_cast<int>(params.target_format)
+        << "|" << enc.width << "x" << enc.height << "@" << enc.fps
+        << "|pix=" << enc.pixel_format
+        << "|gop=" << enc.gop_size << "|bf=" << enc.max_b_frames
+        << "|preset=" << static_cast<int>(enc.preset)
+        << "|ll=" << enc.low_latency
+        << "|scenecut=" << enc.scene_cut_keyframes << ":" << enc.max_gop_size;
+    
+    // 处理参数：变速会改变帧序列，滤镜会改变画面复杂度
+    const VideoProcessParams& proc = params.process_params;
+    key << "|rot=" << proc.rotation_angle
+        << "|blur=" << proc.enable_blur << "|sharpen=" << proc.enable_sharpen
+        << "|gray=" << proc.enable_grayscale
+        << "|bright=" << proc.brightness << "|contrast=" << proc.contrast
+        << "|size=" << proc.output_width << "x" << proc.output_height
+        << "|speed=" << proc.enable_speed_change << ":" << proc.speed_factor;
+    
+    char hex[17];
+    std::snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(fnv1a_64(key.str())));
+    return std::string(avcodec_get_name(video_format_codec_id(params.target_format))) + "-" + hex;
+}
+
+// 运行首遍分析流水线，编码输出的包直接丢弃
+static bool run_first_pass(const FirstPassParams& params, const StreamInfo& stream_info,
+                           const std::string& stats_file) {
+    auto begin = std::chrono::steady_clock::now();
+    
+    VideoPacketQueue packets;
+    VideoFrameQueue decoded_frames;
+    VideoFrameQueue processed_frames;
+    EncodedVideoPacketQueue encoded_packets;
+    
+    DemuxerParams demux_params;
+    demux_params.input_filename = params.input_filename;
+    demux_params.enable_audio = false;
+    
+    VideoEncoderParams encode_params = params.encode_params;
+    encode_params.rate_control = VideoRateControl::TWO_PASS;
+    encode_params.pass = 1;
+    encode_params.stats_file = stats_file;
+    encode_params.frame_stats_file.clear();  // 逐帧统计只针对最终输出
+    encode_params.parameters_out = nullptr;   // 首遍不向封装器发布参数
+    
+    AVCodecParameters* codec_params = avcodec_parameters_alloc();
+    if (!codec_params || avcodec_parameters_copy(codec_params, stream_info.video_codec_params) < 0) {
+        avcodec_parameters_free(&codec_params);
+        return false;
+    }
+    
+    std::vector<std::thread> threads;
+    threads.emplace_back(demux_thread_func_with_params, std::cref(demux_params), &packets, nullptr);
+    threads.emplace_back(video_decode_to_frames_thread_func,
+                         &packets, &decoded_frames, codec_params, params.decode_threads,
+                         static_cast<StageMetrics*>(nullptr));
+    threads.emplace_back(video_process_thread_func,
+                         &decoded_frames, &processed_frames, std::cref(params.process_params),
+                         stream_info.video_width, stream_info.video_height,
+                         stream_info.video_pixel_format);
+    threads.emplace_back(video_encode_thread_func_factory,
+                         &processed_frames, &encoded_packets, params.target_format,
+                         std::cref(encode_params));
+    
+    // 首遍输出没有用处，边产生边释放，避免整段码流驻留内存
+    AVPacket* packet = nullptr;
+    while (encoded_packets.pop(packet)) {
+        av_packet_free(&packet);
+    }
+    
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - begin).count();
+    std::cout << "首遍分析完成，耗时 " << elapsed << " ms" << std::endl;
+    
+    return file_exists_non_empty(stats_file);
+}
+
+// 编码器在统计文件旁写出的附属文件（x264的宏块树、x265的CU树），随统计文件一起改名/清理
+static const char* const kStatsCompanionSuffixes[] = {".mbtree", ".cutree"};
+
+static void remove_stats_files(const std::string& stats_file) {
+    std::remove(stats_file.c_str());
+    for (const char* suffix : kStatsCompanionSuffixes) {
+        std::remove((stats_file + suffix).c_str());
+    }
+}
+
+// 进程内唯一、跨进程不冲突的临时统计文件名（同一缓存键的并发任务各写各的）
+static std::string temp_stats_file(const std::string& stats_file) {
+    static std::atomic<unsigned> counter(0);
+    return stats_file + "." + std::to_string(getpid()) + "." + std::to_string(counter.fetch_add(1)) + ".tmp";
+}
+
+// 附属文件先就位、统计文件最后改名：缓存命中只检查统计文件，看到它时附属文件一定已完整
+static bool publish_stats_files(const std::string& temp_file, const std::string& stats_file) {
+    for (const char* suffix : kStatsCompanionSuffixes) {
+        std::string temp_companion = temp_file + suffix;
+        if (file_exists_non_empty(temp_companion) &&
+            std::rename(temp_companion.c_str(), (stats_file + suffix).c_str()) != 0) {
+            std::cerr << "错误: 无法重命名首遍附属文件 " << temp_companion << std::endl;
+            return false;
+        }
+    }
+    if (std::rename(temp_file.c_str(), stats_file.c_str()) != 0) {
+        std::cerr << "错误: 无法重命名首遍统计文件 " << stats_file << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool prepare_first_pass_stats(const FirstPassParams& params, const StreamInfo& stream_info,
+                              std::string& stats_file) {
+    std::string cache_dir = params.cache_dir.empty() ? default_two_pass_cache_dir() : params.cache_dir;
+    if (!make_directories(cache_dir)) {
+        return false;
+    }
+    
+    stats_file = cache_dir + "/" + first_pass_cache_key(params) + ".log";
+    
+    if (file_exists_non_empty(stats_file)) {
+        std::cout << "首遍统计缓存命中: " << stats_file << std::endl;
+        return true;
+    }
+    
+    /**
+     * 首遍写入唯一的临时文件，成功后再改名到缓存路径（同一文件系统内rename是原子的）
+     * 被中断的首遍或同一缓存键的并发任务不会留下被当作缓存命中的半截统计文件
+     */
+    std::cout << "首遍统计缓存未命中，开始首遍分析: " << stats_file << std::endl;
+    std::string temp_file = temp_stats_file(stats_file);
+    if (!run_first_pass(params, stream_info, temp_file)) {
+        std::cerr << "错误: 首遍分析失败" << std::endl;
+        remove_stats_files(temp_file);
+        return false;
+    }
+    if (!publish_stats_files(temp_file, stats_file)) {
+        remove_stats_files(temp_file);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,318 @@
+#include "segment_transcoder.h"
+#include "video_decoder.h"
+#include <iostream>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <chrono>
+#include <algorithm>
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+}
+
+// 索引覆盖流时长的比例达到此值时视为完整（MP4/AVI等容器在打开时即建立完整索引）
+static const double kIndexCoverageThreshold = 0.9;
+
+// 自动分段时每段的最小时长，避免编码器启动与前瞻开销占比过高
+static const double kMinSegmentSeconds = 10.0;
+
+bool scan_video_keyframes(const char* input_filename, int video_stream_index,
+                          std::vector<int64_t>& keyframes, AVRational& time_base) {
+    keyframes.clear();
+    
+    AVFormatContext* format_context = nullptr;
+    if (avformat_open_input(&format_context, input_filename, nullptr, nullptr) != 0) {
+        std::cerr << "错误：无法打开输入文件 " << input_filename << std::endl;
+        return false;
+    }
+    if (avformat_find_stream_info(format_context, nullptr) < 0 ||
+        video_stream_index < 0 || video_stream_index >= (int)format_context->nb_streams) {
+        std::cerr << "错误：无法定位视频流" << std::endl;
+        avformat_close_input(&format_context);
+        return false;
+    }
+    
+    AVStream* stream = format_context->streams[video_stream_index];
+    time_base = stream->time_base;
+    
+    // 1. 容器索引
+    int entry_count = avformat_index_get_entries_count(stream);
+    int64_t last_indexed = AV_NOPTS_VALUE;
+    for (int i = 0; i < entry_count; ++i) {
+        const AVIndexEntry* entry = avformat_index_get_entry(stream, i);
+        if (entry && (entry->flags & AVINDEX_KEYFRAME)) {
+            keyframes.push_back(entry->timestamp);
+            last_indexed = entry->timestamp;
+        }
+    }
+    
+    bool index_complete = false;
+    if (!keyframes.empty() && stream->duration > 0 && stream->duration != AV_NOPTS_VALUE) {
+        int64_t first = (stream->start_time != AV_NOPTS_VALUE) ? stream->start_time : 0;
+        index_complete = (last_indexed - first) >= kIndexCoverageThreshold * stream->duration;
+    }
+    
+    // 2. 索引缺失或不完整时逐包扫描（只解封装，其他流直接丢弃）
+    if (!index_complete) {
+        keyframes.clear();
+        for (unsigned int i = 0; i < format_context->nb_streams; ++i) {
+            if ((int)i != video_stream_index) {
+                format_context->streams[i]->discard = AVDISCARD_ALL;
+            }
+        }
+        
+        AVPacket* packet = av_packet_alloc();
+        while (av_read_frame(format_context, packet) >= 0) {
+            if (packet->stream_index == video_stream_index && (packet->flags & AV_PKT_FLAG_KEY)) {
+                int64_t ts = (packet->dts != AV_NOPTS_VALUE) ? packet->dts : packet->pts;
+                if (ts != AV_NOPTS_VALUE) {
+                    keyframes.push_back(ts);
+                }
+            }
+            av_packet_unref(packet);
+        }
+        av_packet_free(&packet);
+    }
+    
+    avformat_close_input(&format_context);
+    
+    std::sort(keyframes.begin(), keyframes.end());
+    keyframes.erase(std::unique(keyframes.begin(), keyframes.end()), keyframes.end());
+    
+    std::cout << "关键帧扫描完成: " << keyframes.size() << " 个关键帧（"
+              << (index_complete ? "容器索引" : "逐包扫描") << "）" << std::endl;
+    return !keyframes.empty();
+}
+
+std::vector<VideoSegment> plan_video_segments(const std::vector<int64_t>& keyframes,
+                                              AVRational time_base,
+                                              double segment_seconds) {
+    std::vector<VideoSegment> segments;
+    
+    VideoSegment current;
+    current.index = 0;
+    int64_t current_start_ts = keyframes.empty() ? 0 : keyframes.front();
+    
+    for (size_t i = 1; i < keyframes.size(); ++i) {
+        double elapsed = (keyframes[i] - current_start_ts) * av_q2d(time_base);
+        if (elapsed >= segment_seconds) {
+            current.end = keyframes[i];
+            segments.push_back(current);
+            
+            current = VideoSegment();
+            current.index = static_cast<int>(segments.size());
+            current.start = keyframes[i];
+            current_start_ts = keyframes[i];
+        }
+    }
+    
+    // 第一段从文件开头、最后一段到文件结尾，保证关键帧之外的包也被覆盖
+    segments.push_back(current);
+    return segments;
+}
+
+// 运行单个分段的 解封装→解码→处理→编码 流水线，编码结果写入output_queue
+static void run_segment_pipeline(const SegmentTranscodeParams& params,
+                                 const StreamInfo& stream_info,
+                                 const VideoSegment& segment,
+                                 EncodedVideoPacketQueue* output_queue) {
+    auto begin = std::chrono::steady_clock::now();
+    
+    VideoPacketQueue packets;
+    VideoFrameQueue decoded_frames;
+    VideoFrameQueue processed_frames;
+    packets.set_memory_gauge(params.queue_memory);
+    decoded_frames.set_memory_gauge(params.queue_memory);
+    processed_frames.set_memory_gauge(params.queue_memory);
+    
+    DemuxerParams demux_params;
+    demux_params.input_filename = params.input_filename;
+    demux_params.enable_audio = false;
+    demux_params.segment_start = segment.start;
+    demux_params.segment_end = segment.end;
+    demux_params.cancel_flag = params.cancel_flag;
+    demux_params.metrics = params.demux_metrics;
+    
+    // 解码线程负责释放参数，每个分段使用独立副本
+    AVCodecParameters* codec_params = avcodec_parameters_alloc();
+    if (!codec_params || avcodec_parameters_copy(codec_params, stream_info.video_codec_params) < 0) {
+        std::cerr << "错误: 分段 " << segment.index << " 无法复制解码参数" << std::endl;
+        avcodec_parameters_free(&codec_params);
+        output_queue->finish();
+        return;
+    }
+    
+    std::vector<std::thread> threads;
+    threads.emplace_back(video_decode_to_frames_thread_func,
+                         &packets, &decoded_frames, codec_params, params.decode_threads,
+                         params.decode_metrics);
+    threads.emplace_back(video_process_thread_func,
+                         &decoded_frames, &processed_frames, std::cref(params.process_params),
+                         stream_info.video_width, stream_info.video_height,
+                         stream_info.video_pixel_format);
+    // 各分段的编码器独立写逐帧统计，文件名追加分段序号
+    VideoEncoderParams encode_params = params.encode_params;
+    if (!encode_params.frame_stats_file.empty()) {
+        encode_params.frame_stats_file += "." + std::to_string(segment.index);
+    }
+    threads.emplace_back(video_encode_thread_func_factory,
+                         &processed_frames, output_queue, params.target_format,
+                         std::cref(encode_params));
+    
+    // 解封装在当前工作线程中执行
+    demux_thread_func_with_params(demux_params, &packets, nullptr);
+    
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - begin).count();
+    std::cout << "分段 " << segment.index << " 完成，耗时 " << elapsed << " ms" << std::endl;
+}
+
+void segment_video_transcode_thread_func(const SegmentTranscodeParams& params,
+                                         const StreamInfo& stream_info,
+                                         EncodedVideoPacketQueue* encoded_video_queue) {
+    std::cout << "分段并行视频转码线程已启动" << std::endl;
+    
+    // 规划分段
+    std::vector<VideoSegment> segments;
+    std::vector<int64_t> keyframes;
+    AVRational time_base = {1, 1};
+    int parallel = std::max(1, params.parallel_segments);
+    
+    if (scan_video_keyframes(params.input_filename, stream_info.video_stream_index, keyframes, time_base)) {
+        double segment_seconds = params.segment_seconds;
+        if (segment_seconds <= 0.0) {
+            // 分段数约为并行度的3倍，使各流水线负载均衡（结尾不会只剩一段在跑）
+            double duration = (keyframes.back() - keyframes.front()) * av_q2d(time_base);
+            segment_seconds = std::max(kMinSegmentSeconds, duration / (parallel * 3));
+        }
+        segments = plan_video_segments(keyframes, time_base, segment_seconds);
+    }
+    if (segments.empty()) {
+        std::cerr << "警告: 无法规划分段，整个文件作为一个分段处理" << std::endl;
+        segments.push_back(VideoSegment());
+    }
+    parallel = std::min(parallel, static_cast<int>(segments.size()));
+    
+    std::cout << "共 " << segments.size() << " 个分段，并行度 " << parallel << std::endl;
+    
+    // 每个分段有独立的编码输出队列，由拼接阶段按顺序消费
+    std::vector<std::unique_ptr<EncodedVideoPacketQueue>> segment_outputs;
+    for (size_t i = 0; i < segments.size(); ++i) {
+        segment_outputs.emplace_back(new EncodedVideoPacketQueue());
+        segment_outputs.back()->set_memory_gauge(params.queue_memory);
+    }
+    
+    /**
+     * 工作线程按分段顺序领取任务，保证正在拼接的分段总是最先开始的
+     * 设置了active_limit时，序号不小于当前并行度的工作线程在领取下一个分段前等待limit_changed的通知：
+     * 并行度调整、最后一个分段被领取、封装线程退出时都会通知；取消标志不发通知，等待带超时兜底。
+     * 已在运行的分段不会被打断，并行度下调在分段边界生效
+     */
+    std::atomic<size_t> next_segment(0);
+    std::atomic<bool> output_closed(false);  // 封装线程已退出：不再启动新分段
+    const bool gated = params.active_limit && params.limit_changed;
+    std::vector<std::thread> workers;
+    for (int i = 0; i < parallel; ++i) {
+        workers.emplace_back([&, i]() {
+            auto may_claim = [&]() {
+                return !gated || i < params.active_limit->load() || next_segment.load() >= segments.size() ||
+                       output_closed.load() || (params.cancel_flag && params.cancel_flag->load());
+            };
+            while (true) {
+                while (true) {
+                    uint64_t seen = gated ? params.limit_changed->version() : 0;
+                    if (may_claim()) {
+                        break;
+                    }
+                    params.limit_changed->wait_for(seen, std::chrono::milliseconds(200));
+                }
+                size_t index = next_segment.fetch_add(1);
+                if (gated && index + 1 >= segments.size()) {
+                    params.limit_changed->notify();  // 分段已领取完，暂停的工作线程不必再等
+                }
+                if (index >= segments.size()) {
+                    break;
+                }
+                // 已取消或下游已退出：不再启动新分段，结束其输出队列让拼接阶段继续
+                if (output_closed.load() || (params.cancel_flag && params.cancel_flag->load())) {
+                    segment_outputs[index]->finish();
+                    continue;
+                }
+                run_segment_pipeline(params, stream_info, segments[index], segment_outputs[index].get());
+            }
+        });
+    }
+    
+    /**
+     * 拼接：分段编码器的时间戳都从0开始（单位为帧），每个分段的pts与dts整体平移同一个偏移，
+     * 分段内部pts-dts的重排序间隔保持不变（dts<=pts始终成立）。偏移通常为前面分段的帧数之和；
+     * 分段的重排序延迟（首包pts-dts）大于前一分段时，按前一分段最后的dts与本分段首包dts加大偏移，
+     * 保证dts跨分段严格递增，此后的分段在加大后的偏移上继续累加
+     */
+    int64_t frame_offset = 0;
+    int64_t last_dts = AV_NOPTS_VALUE;
+    int64_t total_packets = 0;
+    
+    for (size_t i = 0; i < segments.size(); ++i) {
+        int64_t segment_max_pts = -1;
+        int64_t segment_offset = frame_offset;
+        bool offset_fixed = false;
+        AVPacket* packet = nullptr;
+        
+        while (segment_outputs[i]->pop(packet)) {
+            if (!packet) {
+                continue;
+            }
+            if (!offset_fixed && packet->dts != AV_NOPTS_VALUE) {
+                if (last_dts != AV_NOPTS_VALUE && packet->dts + segment_offset <= last_dts) {
+                    segment_offset = last_dts + 1 - packet->dts;
+                }
+                offset_fixed = true;
+            }
+            if (packet->pts != AV_NOPTS_VALUE) {
+                segment_max_pts = std::max(segment_max_pts, packet->pts);
+                packet->pts += segment_offset;
+            }
+            if (packet->dts != AV_NOPTS_VALUE) {
+                packet->dts += segment_offset;
+                last_dts = packet->dts;
+            }
+            if (!encoded_video_queue->push(packet)) {
+                // 封装线程已退出：结束全部分段输出，运行中的分段编码器随即停止，其余分段不再启动
+                av_packet_free(&packet);
+                output_closed = true;
+                for (auto& output : segment_outputs) {
+                    output->finish();
+                }
+                if (gated) {
+                    params.limit_changed->notify();
+                }
+                break;
+            }
+            total_packets++;
+        }
+        
+        frame_offset = segment_offset + segment_max_pts + 1;
+        if (output_closed.load()) {
+            break;
+        }
+    }
+    
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    
+    // 所有分段编码器都未能打开时，确保封装线程不会一直等待流参数
+    if (params.encode_params.parameters_out) {
+        params.encode_params.parameters_out->publish(nullptr);
+    }
+    encoded_video_queue->finish();
+    std::cout << "分段并行视频转码完成，拼接 " << total_packets << " 个包，共 " 
+              << frame_offset << " 帧" << std::endl;
+}
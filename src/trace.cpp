@@ -0,0 +1,63 @@
+/**
+ * 时间线写出 (trace.cpp)
+ *
+ * Chrome trace-event JSON（完整事件ph="X"，时间单位微秒）：
+ *   {"traceEvents":[
+ *     {"name":"thread_name","ph":"M","pid":1,"tid":3,"args":{"name":"video_encode"}},
+ *     {"name":"video_encode","cat":"stage","ph":"X","pid":1,"tid":3,"ts":1234.567,"dur":2.345,"args":{"frame":400000}},
+ *     ...]}
+ * 同一线程内的子步骤（gl_upload/gl_draw/gl_readback）按时间嵌套在阶段时间段之下
+ * args.frame为帧标识（源流时间戳，微秒，见trace.h），未知时args为空
+ */
+
+#include "trace.h"
+#include <cstdio>
+#include <iostream>
+
+TraceBuffer* TraceSession::register_thread(const char* thread_name) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    buffers_.emplace_back(thread_name, static_cast<int>(buffers_.size()) + 1);
+    return &buffers_.back();
+}
+
+bool TraceSession::write(const std::string& filename) const {
+    FILE* file = fopen(filename.c_str(), "w");
+    if (!file) {
+        std::cerr << "错误: 无法写入时间线文件 " << filename << std::endl;
+        return false;
+    }
+
+    size_t event_count = 0;
+    uint64_t dropped = 0;
+    bool first = true;
+    fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", file);
+    for (const TraceBuffer& buffer : buffers_) {
+        fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                first ? "" : ",\n", buffer.thread_id(), buffer.thread_name().c_str());
+        first = false;
+        for (const TraceEvent& event : buffer.events()) {
+            fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"stage\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,"
+                          "\"ts\":%.3f,\"dur\":%.3f,\"args\":{",
+                    event.name, buffer.thread_id(), (event.begin_ns - start_ns_) / 1e3,
+                    (event.end_ns - event.begin_ns) / 1e3);
+            if (event.frame_id != kNoTraceFrameId) {
+                fprintf(file, "\"frame\":%lld", static_cast<long long>(event.frame_id));
+            }
+            fputs("}}", file);
+        }
+        event_count += buffer.events().size();
+        dropped += buffer.dropped();
+    }
+    fputs("\n]}\n", file);
+
+    if (fclose(file) != 0) {
+        std::cerr << "错误: 时间线文件写入失败 " << filename << std::endl;
+        return false;
+    }
+    std::cout << "时间线: " << filename << "（" << buffers_.size() << "个线程，" << event_count << "个时间段";
+    if (dropped > 0) {
+        std::cout << "，超出上限丢弃" << dropped << "个";
+    }
+    std::cout << "）" << std::endl;
+    return true;
+}
@@ -0,0 +1,968 @@
+/**
+ * 转码任务 (transcode_job.cpp)
+ *
+ * 多级流水线：
+ * 输入 → [解封装] → [解码] → [处理] → [编码] → [封装] → 输出
+ *
+ * 任务生命周期：
+ * - configure：参数校验 + 探测输入，确定任务模式（缺少某一路流时退化为单流）
+ * - start：按核心预算构建队列与线程；两遍编码的首遍在此同步执行
+ * - wait：等待所有线程结束，以主输出的文件尾是否写出判断成败
+ * - cancel：只通知解封装停止读取，下游按正常结束流程排空，不需要强行中断任何线程
+ *
+ * 进程级状态（FFmpeg初始化、GLFW）由所有任务共享，只初始化一次
+ */
+
+#include "transcode_job.h"
+#include "video_decoder.h"
+#include "audio_decoder.h"
+#include "video_processor.h"
+#include "audio_processor.h"
+#include "audio_encoder.h"
+#include "core_budget.h"
+#include "segment_transcoder.h"
+#include "rate_control.h"
+#include "pipeline_tuner.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <fstream>
+#include <initializer_list>
+#include <iostream>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <libavutil/mathematics.h>
+}
+
+namespace {
+
+int64_t now_us() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// 进程常驻内存：当前值来自/proc/self/statm，峰值来自getrusage（进程生命周期内的最高值）
+void read_process_memory(int64_t& rss_bytes, int64_t& peak_rss_bytes) {
+    std::ifstream statm("/proc/self/statm");
+    int64_t total_pages = 0;
+    int64_t resident_pages = 0;
+    if (statm >> total_pages >> resident_pages) {
+        rss_bytes = resident_pages * sysconf(_SC_PAGESIZE);
+    }
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+        peak_rss_bytes = static_cast<int64_t>(usage.ru_maxrss) * 1024;  // Linux下单位为KB
+    }
+}
+
+// 解码线程结束时会释放传入的参数，这里为每个解码线程准备独立副本
+AVCodecParameters* copy_codec_params(const AVCodecParameters* source) {
+    AVCodecParameters* copy = avcodec_parameters_alloc();
+    if (copy && avcodec_parameters_copy(copy, source) < 0) {
+        avcodec_parameters_free(&copy);
+    }
+    return copy;
+}
+
+std::once_flag g_global_init_once;
+
+// 输出音频固定编码为AC3
+const TargetAudioFormat kOutputAudioFormat = TargetAudioFormat::AC3;
+const AVCodecID kOutputAudioCodecId = AV_CODEC_ID_AC3;
+
+} // namespace
+
+void transcoder_global_init() {
+    std::call_once(g_global_init_once, []() {
+        avformat_network_init();
+    });
+}
+
+void transcoder_global_shutdown() {
+    video_processor_shutdown_gl();
+    avformat_network_deinit();
+}
+
+/**
+ * 一个任务的全部流水线状态：线程以指针/引用访问这里的队列与参数，
+ * 因此整体分配在堆上，地址在任务生命周期内保持不变
+ */
+struct TranscodeJob::Pipeline {
+    MemoryGauge queue_memory;  // 全部队列（含分段内部与tee队列）中帧/包引用的字节数；先于队列声明，最后析构
+    MemoryGauge segment_memory{&queue_memory};  // 分段流水线内部队列与分段输出队列（同时计入queue_memory），自动调优按它判断分段并行度
+
+    std::unique_ptr<VideoPacketQueue> raw_video_packets;              // 解封装→视频解码
+    std::unique_ptr<VideoFrameQueue> decoded_video_frames;            // 视频解码→视频处理
+    std::unique_ptr<VideoFrameQueue> processed_video_frames;          // 视频处理→视频编码
+    std::unique_ptr<EncodedVideoPacketQueue> encoded_video_packets;   // 视频编码→封装
+    std::unique_ptr<AudioPacketQueue> raw_audio_packets;              // 解封装→音频解码
+    std::unique_ptr<AudioFrameQueue> decoded_audio_frames;            // 音频解码→音频处理
+    std::unique_ptr<AudioFrameQueue> processed_audio_frames;          // 音频处理→音频编码
+    std::unique_ptr<EncodedAudioPacketQueue> encoded_audio_packets;   // 音频编码→封装
+
+    // 编码器打开后向封装线程发布的流参数（MP4/MKV需要的全局头在其中）
+    CodecParametersSlot video_stream_parameters;
+    CodecParametersSlot audio_stream_parameters;
+
+    DemuxerParams demux_params;
+    VideoProcessParams process_params;
+    VideoEncoderParams video_encode_params;
+    SegmentTranscodeParams segment_params;
+    AudioProcessParams audio_process_params;
+    AudioEncoderParams audio_encode_params;
+    MuxerParams mux_params;
+    MuxerStats mux_stats;
+    PipelineMetrics metrics;  // 各阶段线程写入的计数与耗时
+    TraceSession trace;       // 仅在TranscodeOptions::trace_file非空时挂到各阶段
+
+    // tee输出：每个目标一对队列与一个封装线程
+    std::vector<OutputContainer> tee_containers;
+    std::vector<MuxerParams> tee_mux_params;
+    std::vector<std::unique_ptr<EncodedVideoPacketQueue>> tee_video_packets;
+    std::vector<std::unique_ptr<EncodedAudioPacketQueue>> tee_audio_packets;
+    TeeParams tee_params;
+
+    // 自动调优：最后声明，析构时先停止调优线程，再释放它读取的队列与指标
+    std::atomic<int> active_segments{0};
+    QueueNotifier active_segments_changed;
+    PipelineTuner tuner;
+};
+
+CommandLine parse_command_line(const std::vector<std::string>& arguments) {
+    CommandLine cmd;
+    for (const std::string& argument : arguments) {
+        if (argument.compare(0, 2, "--") == 0) {
+            std::string option = argument.substr(2);
+            size_t eq = option.find('=');
+            if (eq == std::string::npos) {
+                cmd.options[option] = "1";
+            } else {
+                cmd.options[option.substr(0, eq)] = option.substr(eq + 1);
+            }
+        } else {
+            cmd.positional.push_back(argument);
+        }
+    }
+    return cmd;
+}
+
+bool transcode_options_from_command_line(const CommandLine& cmd, TranscodeOptions& options) {
+    const std::vector<std::string>& args = cmd.positional;
+    if (args.size() < 2) {
+        std::cerr << "错误: 缺少输入或输出文件" << std::endl;
+        return false;
+    }
+    options.input_filename = args[0];
+    options.output_filename = args[1];
+    
+    /**
+     * 变速倍数解析：支持0.1x到5x倍速（范围检查在TranscodeJob::configure中）
+     * 风险点：用户输入非数字时std::atof返回0.0，由范围检查兜底
+     */
+    if (args.size() > 2) options.speed_factor = std::atof(args[2].c_str());
+    if (args.size() > 3) options.rotation_angle = std::atof(args[3].c_str());
+    
+    // 滤镜参数：布尔值通过整数0/1表示，提供默认值策略
+    if (args.size() > 4) options.enable_blur = (std::atoi(args[4].c_str()) != 0);
+    if (args.size() > 5) options.enable_sharpen = (std::atoi(args[5].c_str()) != 0);  // 默认启用锐化
+    if (args.size() > 6) options.enable_grayscale = (std::atoi(args[6].c_str()) != 0);
+    if (args.size() > 7) options.brightness = std::atof(args[7].c_str());
+    if (args.size() > 8) options.contrast = std::atof(args[8].c_str());
+    
+    if (cmd.has("audio-only") && cmd.has("video-only")) {
+        std::cerr << "错误: --audio-only 与 --video-only 不能同时使用" << std::endl;
+        return false;
+    } else if (cmd.has("audio-only")) {
+        options.mode = TranscodeMode::AUDIO_ONLY;
+    } else if (cmd.has("video-only")) {
+        options.mode = TranscodeMode::VIDEO_ONLY;
+    }
+    
+    // 输出容器：--container优先，否则按输出文件扩展名推断（未知扩展名沿用AVI）
+    options.container = output_container_from_filename(options.output_filename.c_str());
+    if (cmd.has("container") && !parse_output_container(cmd.get("container", ""), options.container)) {
+        std::cerr << "错误: 不支持的容器格式 " << cmd.get("container", "") << std::endl;
+        return false;
+    }
+    options.fragment_duration_ms = std::atoi(cmd.get("frag-duration", "2000").c_str());
+    options.segment_duration_ms = std::atoi(cmd.get("seg-duration", "4000").c_str());
+    
+    // tee输出：主输出之外的目标文件，逗号分隔，容器按各自扩展名推断
+    if (cmd.has("tee")) {
+        std::string list = cmd.get("tee", "");
+        size_t start = 0;
+        while (start <= list.size()) {
+            size_t comma = list.find(',', start);
+            std::string name = list.substr(start, comma == std::string::npos ? std::string::npos : comma - start);
+            if (!name.empty()) {
+                options.tee_outputs.push_back(name);
+            }
+            if (comma == std::string::npos) {
+                break;
+            }
+            start = comma + 1;
+        }
+        if (options.tee_outputs.empty()) {
+            std::cerr << "错误: --tee 需要至少一个输出文件" << std::endl;
+            return false;
+        }
+    }
+    options.progress = cmd.has("progress");
+    options.progress_interval_ms = std::atoi(cmd.get("progress-interval", "1000").c_str());
+    options.progress_json_file = cmd.get("progress-json", "");
+    options.trace_file = cmd.get("trace", "");
+    options.stage_report = cmd.has("stage-report");
+    options.auto_tune = cmd.has("auto-tune");
+    options.tune_memory_bytes = std::atoll(cmd.get("tune-memory", "0").c_str()) * 1024 * 1024;
+    options.sync_output = cmd.has("sync-output");
+    options.direct_io = cmd.has("direct-io");
+    options.preallocate = cmd.has("preallocate");
+    
+    // 视频编码器选择：后端、预设与码率控制模式按任务指定
+    if (!parse_video_format(cmd.get("vcodec", "mpeg4"), options.video_format)) {
+        std::cerr << "错误: 不支持的视频编码器 " << cmd.get("vcodec", "") << std::endl;
+        return false;
+    }
+    if (!parse_video_preset(cmd.get("preset", "medium"), options.video_preset)) {
+        std::cerr << "错误: 不支持的预设 " << cmd.get("preset", "") << std::endl;
+        return false;
+    }
+    if (cmd.has("crf")) {
+        options.crf = std::atoi(cmd.get("crf", "-1").c_str());
+        if (options.crf < 0) {
+            std::cerr << "错误: CRF必须在0到51之间" << std::endl;
+            return false;
+        }
+    }
+    options.video_bitrate = std::atoi(cmd.get("vbitrate", "800000").c_str());
+    options.two_pass = cmd.has("two-pass");
+    options.pass_cache_dir = cmd.get("pass-cache", "");
+    options.adaptive = cmd.has("adaptive");
+    options.scene_cut = cmd.has("scene-cut");
+    if (cmd.has("max-gop")) {
+        options.max_gop = std::atoi(cmd.get("max-gop", "0").c_str());
+    }
+    options.frame_stats_file = cmd.get("frame-stats", "");
+    
+    options.total_cores = std::atoi(cmd.get("threads", "0").c_str());
+    options.segmented = cmd.has("segments");
+    options.parallel_segments = std::atoi(cmd.get("segments", "0").c_str());
+    options.segment_seconds = std::atof(cmd.get("segment-seconds", "0").c_str());
+    std::string thread_type_name = cmd.get("thread-type", "auto");
+    if (thread_type_name == "frame") {
+        options.thread_type = VideoThreadType::FRAME;
+    } else if (thread_type_name == "slice") {
+        options.thread_type = VideoThreadType::SLICE;
+    } else if (thread_type_name != "auto") {
+        std::cerr << "错误: 不支持的线程模型 " << thread_type_name << std::endl;
+        return false;
+    }
+    return true;
+}
+
+TranscodeJob::TranscodeJob() = default;
+
+TranscodeJob::~TranscodeJob() {
+    if (!threads_.empty()) {
+        cancel();
+        wait();
+    }
+    if (stream_info_.video_codec_params) {
+        avcodec_parameters_free(&stream_info_.video_codec_params);
+    }
+    if (stream_info_.audio_codec_params) {
+        avcodec_parameters_free(&stream_info_.audio_codec_params);
+    }
+}
+
+bool TranscodeJob::configure(const TranscodeOptions& options) {
+    if (state_ != TranscodeJobState::CREATED) {
+        std::cerr << "错误: 转码任务只能配置一次" << std::endl;
+        return false;
+    }
+    transcoder_global_init();
+    options_ = options;
+
+    /**
+     * 参数边界检查
+     * - 0.1x-5x：基于人类感知极限和技术可行性
+     * - 亮度/对比度0-2倍：超出此范围图像质量严重劣化
+     */
+    if (options_.speed_factor <= 0.1 || options_.speed_factor > 5.0) {
+        std::cerr << "错误: 变速倍数必须在0.1到5.0之间" << std::endl;
+        return false;
+    }
+    if (options_.brightness < 0.0f || options_.brightness > 2.0f) {
+        std::cerr << "错误: 亮度值必须在0.0到2.0之间" << std::endl;
+        return false;
+    }
+    if (options_.contrast < 0.0f || options_.contrast > 2.0f) {
+        std::cerr << "错误: 对比度值必须在0.0到2.0之间" << std::endl;
+        return false;
+    }
+    if (options_.crf > 51) {
+        std::cerr << "错误: CRF必须在0到51之间" << std::endl;
+        return false;
+    }
+    if (options_.video_bitrate <= 0) {
+        std::cerr << "错误: 视频码率必须大于0" << std::endl;
+        return false;
+    }
+    if (options_.two_pass && options_.crf >= 0) {
+        std::cerr << "错误: --two-pass 与 --crf 不能同时使用" << std::endl;
+        return false;
+    }
+    if (!options_.input_reader && options_.input_filename.empty()) {
+        std::cerr << "错误: 未指定输入" << std::endl;
+        return false;
+    }
+    if (!options_.custom_output && options_.output_filename.empty()) {
+        std::cerr << "错误: 未指定输出" << std::endl;
+        return false;
+    }
+
+    bool any_segmented_output = output_container_is_segmented(options_.container);
+    for (const std::string& name : options_.tee_outputs) {
+        any_segmented_output = any_segmented_output ||
+                               output_container_is_segmented(output_container_from_filename(name.c_str()));
+    }
+    if (any_segmented_output && options_.segment_duration_ms <= 0) {
+        std::cerr << "错误: 分段时长必须大于0" << std::endl;
+        return false;
+    }
+    if (options_.custom_output && !options_.tee_outputs.empty()) {
+        std::cerr << "错误: 回调输出不支持tee" << std::endl;
+        return false;
+    }
+
+    // 探测流信息与解封装线程先后从头打开输入，回调输入必须可寻址（否则解封装会从探测读到的位置之后开始）
+    if (options_.input_reader && !options_.input_reader->seekable()) {
+        std::cerr << "错误: 回调输入必须可寻址" << std::endl;
+        return false;
+    }
+
+    // 分段并行与两遍首遍需要在多个线程中同时打开输入，回调读取器只有一个读取位置
+    if (options_.input_reader && (options_.segmented || options_.two_pass)) {
+        std::cerr << "警告: 回调输入不支持分段并行/两遍编码，按单遍顺序处理" << std::endl;
+        options_.segmented = false;
+        options_.two_pass = false;
+    }
+
+    const char* input_name = options_.input_filename.empty() ? "(回调输入)" : options_.input_filename.c_str();
+    const char* output_name = options_.output_filename.empty() ? "(回调输出)" : options_.output_filename.c_str();
+    std::cout << "开始增强转码流程（音视频处理）" << std::endl;
+    std::cout << "输入文件: " << input_name << std::endl;
+    std::cout << "输出文件: " << output_name << std::endl;
+    std::cout << "变速倍数: " << options_.speed_factor << "x" << std::endl;
+    std::cout << "旋转角度: " << options_.rotation_angle << "度" << std::endl;
+    std::cout << "滤镜设置: 模糊=" << (options_.enable_blur ? "开" : "关")
+              << " 锐化=" << (options_.enable_sharpen ? "开" : "关")
+              << " 灰度=" << (options_.enable_grayscale ? "开" : "关") << std::endl;
+    std::cout << "图像调整: 亮度=" << options_.brightness << " 对比度=" << options_.contrast << std::endl;
+
+    /**
+     * 流信息获取：FFmpeg探测阶段
+     * avformat_find_stream_info()是耗时操作，但编解码器参数、分辨率、帧率、采样率等都依赖它
+     */
+    bool probed = options_.input_reader ? get_stream_info(options_.input_reader, stream_info_)
+                                        : get_stream_info(options_.input_filename.c_str(), stream_info_);
+    if (!probed) {
+        std::cerr << "错误: 无法获取输入文件信息" << std::endl;
+        state_ = TranscodeJobState::FAILED;
+        return false;
+    }
+
+    /**
+     * 任务模式确定：用户显式指定优先，否则按输入文件实际包含的流自动选择
+     * 缺少某一路流时自动退化为单流任务，不再启动空转的线程
+     */
+    bool has_video_stream = (stream_info_.video_stream_index >= 0 && stream_info_.video_codec_params);
+    bool has_audio_stream = (stream_info_.audio_stream_index >= 0 && stream_info_.audio_codec_params);
+
+    if (options_.mode == TranscodeMode::AUDIO_ONLY && !has_audio_stream) {
+        std::cerr << "错误: 输入文件不包含音频流，无法执行 --audio-only" << std::endl;
+        state_ = TranscodeJobState::FAILED;
+        return false;
+    }
+    if (options_.mode == TranscodeMode::VIDEO_ONLY && !has_video_stream) {
+        std::cerr << "错误: 输入文件不包含视频流，无法执行 --video-only" << std::endl;
+        state_ = TranscodeJobState::FAILED;
+        return false;
+    }
+    if (options_.mode == TranscodeMode::AUDIO_VIDEO) {
+        if (!has_video_stream) {
+            options_.mode = TranscodeMode::AUDIO_ONLY;
+        } else if (!has_audio_stream) {
+            options_.mode = TranscodeMode::VIDEO_ONLY;
+        }
+    }
+
+    run_video_ = (options_.mode != TranscodeMode::AUDIO_ONLY);
+    run_audio_ = (options_.mode != TranscodeMode::VIDEO_ONLY);
+
+    if (run_video_) {
+        std::cout << "视频信息: " << stream_info_.video_width << "x" << stream_info_.video_height
+                  << " @ " << stream_info_.video_fps << "fps" << std::endl;
+    }
+    if (run_audio_) {
+        std::cout << "音频信息: " << stream_info_.audio_sample_rate << "Hz, "
+                  << stream_info_.audio_channels << " 声道" << std::endl;
+    }
+    std::cout << "任务模式: " << (run_video_ && run_audio_ ? "音视频" : (run_video_ ? "仅视频" : "仅音频")) << std::endl;
+
+    // 容器与编码的兼容性在启动任何线程之前检查（例如MPEG-TS不支持VP9/AV1），不要等整个输入转码完才在封装阶段失败
+    std::vector<std::pair<const char*, OutputContainer>> outputs;
+    outputs.emplace_back(output_name, options_.container);
+    for (const std::string& name : options_.tee_outputs) {
+        outputs.emplace_back(name.c_str(), output_container_from_filename(name.c_str()));
+    }
+    AVCodecID video_codec_id = video_format_codec_id(options_.video_format);
+    for (const auto& output : outputs) {
+        AVCodecID rejected = AV_CODEC_ID_NONE;
+        if (run_video_ && !output_container_supports_codec(output.second, video_codec_id)) {
+            rejected = video_codec_id;
+        } else if (run_audio_ && !output_container_supports_codec(output.second, kOutputAudioCodecId)) {
+            rejected = kOutputAudioCodecId;
+        }
+        if (rejected != AV_CODEC_ID_NONE) {
+            std::cerr << "错误: 输出 " << output.first << " 的容器 " << output_container_format_name(output.second)
+                      << " 不支持 " << avcodec_get_name(rejected) << " 编码" << std::endl;
+            state_ = TranscodeJobState::FAILED;
+            return false;
+        }
+    }
+
+    state_ = TranscodeJobState::CONFIGURED;
+    return true;
+}
+
+bool TranscodeJob::start() {
+    if (state_ != TranscodeJobState::CONFIGURED) {
+        std::cerr << "错误: 转码任务未配置或已启动" << std::endl;
+        return false;
+    }
+    start_time_us_ = now_us();
+    pipeline_.reset(new Pipeline());
+    Pipeline& p = *pipeline_;
+    const TranscodeOptions& o = options_;
+    const char* input_filename = o.input_filename.empty() ? nullptr : o.input_filename.c_str();
+    const char* output_filename = o.output_filename.empty() ? nullptr : o.output_filename.c_str();
+
+    for (const std::string& name : o.tee_outputs) {
+        p.tee_containers.push_back(output_container_from_filename(name.c_str()));
+    }
+    bool any_segmented_output = output_container_is_segmented(o.container);
+    for (OutputContainer container : p.tee_containers) {
+        any_segmented_output = any_segmented_output || output_container_is_segmented(container);
+    }
+
+    /**
+     * 全局核心预算：解码器、处理阶段与编码器共享同一份核心数
+     * 避免各阶段各自按全部核心开线程导致过度订阅
+     */
+    CoreBudget core_budget = plan_core_budget(o.total_cores, run_video_, run_audio_);
+
+    /**
+     * 分段并行模式：视频由多条独立流水线按GOP分段处理后拼接，音频作为一条并行轨道
+     * 核心预算在分段流水线之间平分，每条流水线的编码器线程数相应减少
+     */
+    const bool run_segmented_video = run_video_ && o.segmented;
+    int parallel_segments = o.parallel_segments;
+    if (run_segmented_video && parallel_segments <= 0) {
+        // 每条分段流水线至少分到约4个核心（解码+处理+编码）
+        parallel_segments = std::max(1, core_budget.total_cores / 4);
+    }
+
+    // 两遍统计按完整帧序列生成，分段编码器无法按段使用；不支持的编码器同样回退到单遍
+    bool two_pass = o.two_pass;
+    if (two_pass && run_video_ && (run_segmented_video || !video_format_supports_two_pass(o.video_format))) {
+        std::cerr << "警告: 当前模式/编码器不支持两遍编码，回退到单遍平均码率" << std::endl;
+        two_pass = false;
+    }
+
+    /**
+     * 只为需要的一半流水线创建队列，未使用的一侧保持nullptr
+     * 解封装线程和封装线程均以nullptr表示跳过对应的流
+     */
+    if (run_video_) {
+        // 分段模式下前三个队列由各分段流水线自行创建
+        if (!run_segmented_video) {
+            p.raw_video_packets.reset(new VideoPacketQueue());
+            p.decoded_video_frames.reset(new VideoFrameQueue());
+            p.processed_video_frames.reset(new VideoFrameQueue());
+        }
+        p.encoded_video_packets.reset(new EncodedVideoPacketQueue());
+    }
+    if (run_audio_) {
+        p.raw_audio_packets.reset(new AudioPacketQueue());
+        p.decoded_audio_frames.reset(new AudioFrameQueue());
+        p.processed_audio_frames.reset(new AudioFrameQueue());
+        p.encoded_audio_packets.reset(new EncodedAudioPacketQueue());
+    }
+    for (auto* queue : std::initializer_list<ThreadSafeQueue<AVPacket*>*>{
+             p.raw_video_packets.get(), p.encoded_video_packets.get(),
+             p.raw_audio_packets.get(), p.encoded_audio_packets.get()}) {
+        if (queue) {
+            queue->set_memory_gauge(&p.queue_memory);
+        }
+    }
+    for (auto* queue : std::initializer_list<ThreadSafeQueue<AVFrame*>*>{
+             p.decoded_video_frames.get(), p.processed_video_frames.get(),
+             p.decoded_audio_frames.get(), p.processed_audio_frames.get()}) {
+        if (queue) {
+            queue->set_memory_gauge(&p.queue_memory);
+        }
+    }
+
+    // 解码线程的参数副本在启动任何线程之前准备好，分配失败时任务直接失败，不留下半启动的流水线
+    AVCodecParameters* video_codec_params = nullptr;
+    AVCodecParameters* audio_codec_params = nullptr;
+    if (run_video_ && !run_segmented_video) {
+        video_codec_params = copy_codec_params(stream_info_.video_codec_params);
+    }
+    if (run_audio_) {
+        audio_codec_params = copy_codec_params(stream_info_.audio_codec_params);
+    }
+    if ((run_video_ && !run_segmented_video && !video_codec_params) || (run_audio_ && !audio_codec_params)) {
+        std::cerr << "错误: 无法复制解码参数" << std::endl;
+        avcodec_parameters_free(&video_codec_params);
+        avcodec_parameters_free(&audio_codec_params);
+        state_ = TranscodeJobState::FAILED;
+        return false;
+    }
+
+    // 编码器只有一个：任一输出目标需要全局头时都打开（不需要的容器会在关键帧前自行补参数集）
+    bool global_header = output_container_needs_global_header(o.container);
+    for (OutputContainer container : p.tee_containers) {
+        global_header = global_header || output_container_needs_global_header(container);
+    }
+
+    // 解封装（I/O密集型）：按stream_index分发到音视频队列，未启用的流在解封装阶段直接丢弃；线程在两遍编码的首遍之后启动
+    p.demux_params.input_filename = input_filename;
+    p.demux_params.input_reader = o.input_reader;
+    p.demux_params.max_frames = 0;  // 0表示处理整个文件
+    p.demux_params.enable_video = run_video_ && !run_segmented_video;
+    p.demux_params.enable_audio = run_audio_;
+    p.demux_params.cancel_flag = &cancel_requested_;
+    if (!o.trace_file.empty()) {
+        p.metrics.enable_trace(&p.trace);  // 必须在任何阶段线程启动之前
+    }
+    p.demux_params.metrics = p.metrics.stage(PipelineStage::DEMUX);
+
+    // 统一变速因子：所有处理模块使用相同的speed_factor，避免音画不同步
+    const double unified_speed_factor = o.speed_factor;
+
+    if (run_video_) {
+        // 视频处理（GPU+CPU混合）：OpenGL滤镜、旋转与变速
+        p.process_params.rotation_angle = o.rotation_angle;
+        p.process_params.enable_blur = o.enable_blur;          // 高斯模糊卷积
+        p.process_params.enable_sharpen = o.enable_sharpen;    // 拉普拉斯锐化
+        p.process_params.enable_grayscale = o.enable_grayscale; // RGB→灰度转换
+        p.process_params.brightness = o.brightness;
+        p.process_params.contrast = o.contrast;
+
+        // 视频变速：通过帧丢弃/复制实现
+        p.process_params.enable_speed_change = true;
+        p.process_params.speed_factor = unified_speed_factor;
+
+        VideoEncoderParams& encode = p.video_encode_params;
+        encode.width = stream_info_.video_width;
+        encode.height = stream_info_.video_height;
+        encode.fps = stream_info_.video_fps;
+        encode.codec_id = video_format_codec_id(o.video_format);
+        encode.bitrate = o.video_bitrate;
+        encode.preset = o.video_preset;
+        encode.thread_count = core_budget.encode_threads;
+        encode.thread_type = o.thread_type;
+        encode.lookahead_threads = core_budget.lookahead_threads;
+        encode.global_header = global_header;
+        encode.parameters_out = &p.video_stream_parameters;
+        if (o.crf >= 0) {
+            encode.rate_control = VideoRateControl::CRF;
+            encode.crf = o.crf;
+        }
+
+        encode.frame_stats_file = o.frame_stats_file;
+
+        // 镜头切换关键帧：需在首遍之前设置，两遍的帧类型决定必须一致
+        if (o.scene_cut) {
+            p.process_params.enable_scene_detection = true;
+            encode.scene_cut_keyframes = true;
+            encode.max_gop_size = std::max(0, o.max_gop);
+            // HLS/DASH只能在关键帧处切分：未指定最大GOP时上限取一个分段时长，避免分段被拉长到10秒
+            if (any_segmented_output && o.max_gop < 0) {
+                encode.max_gop_size = std::max(1,
+                    static_cast<int>(static_cast<int64_t>(o.segment_duration_ms) * encode.fps / 1000));
+            }
+        }
+
+        /**
+         * 两遍编码：首遍在启动编码流水线之前同步执行（命中缓存时跳过）
+         * 首遍失败时回退到单遍平均码率，不中断任务
+         */
+        if (two_pass) {
+            FirstPassParams first_pass;
+            first_pass.input_filename = input_filename;
+            first_pass.process_params = p.process_params;
+            first_pass.target_format = o.video_format;
+            first_pass.encode_params = encode;
+            first_pass.decode_threads = core_budget.decode_threads;
+            first_pass.cache_dir = o.pass_cache_dir;
+
+            std::string stats_file;
+            if (prepare_first_pass_stats(first_pass, stream_info_, stats_file)) {
+                encode.rate_control = VideoRateControl::TWO_PASS;
+                encode.pass = 2;
+                encode.stats_file = stats_file;
+            } else {
+                std::cerr << "警告: 首遍统计不可用，回退到单遍平均码率" << std::endl;
+            }
+        }
+
+        // 内容自适应码率：处理线程分析输出帧复杂度，编码器据此在基准码率附近浮动
+        if (o.adaptive && encode.rate_control != VideoRateControl::TWO_PASS) {
+            p.process_params.enable_analysis = true;
+            encode.adaptive_rate = true;
+        }
+
+        // 阶段指标在首遍之后才挂上，首遍分析不计入本任务的指标
+        p.process_params.metrics = p.metrics.stage(PipelineStage::VIDEO_PROCESS);
+        encode.metrics = p.metrics.stage(PipelineStage::VIDEO_ENCODE);
+    }
+
+    // 解封装线程在首遍之后启动：首遍期间没有解码线程消费，无界的包队列会装下整个输入，且与首遍争抢输入I/O
+    if (p.demux_params.enable_video || p.demux_params.enable_audio) {
+        threads_.emplace_back(demux_thread_func_with_params,
+                              std::cref(p.demux_params),
+                              p.raw_video_packets.get(),
+                              p.raw_audio_packets.get());
+    }
+
+    if (run_segmented_video) {
+        SegmentTranscodeParams& segment = p.segment_params;
+        segment.input_filename = input_filename;
+        segment.parallel_segments = parallel_segments;
+        segment.segment_seconds = o.segment_seconds;
+        segment.decode_threads = std::max(1, core_budget.decode_threads / parallel_segments);
+        segment.process_params = p.process_params;
+        segment.target_format = o.video_format;
+        segment.encode_params = p.video_encode_params;
+        segment.encode_params.thread_count = std::max(1, core_budget.encode_threads / parallel_segments);
+        segment.encode_params.lookahead_threads = 0;
+        segment.cancel_flag = &cancel_requested_;
+        segment.demux_metrics = p.metrics.stage(PipelineStage::DEMUX);
+        segment.decode_metrics = p.metrics.stage(PipelineStage::VIDEO_DECODE);
+        segment.queue_memory = &p.segment_memory;
+        if (o.auto_tune) {
+            // 每条流水线的线程数按初始并行度分配；调优可在CPU空闲时额外启用最多同样多条流水线
+            int maximum = std::min(parallel_segments * 2, std::max(parallel_segments, core_budget.total_cores));
+            segment.parallel_segments = maximum;
+            segment.active_limit = &p.active_segments;
+            segment.limit_changed = &p.active_segments_changed;
+            p.tuner.set_segment_limit(&p.active_segments, &p.active_segments_changed, &p.segment_memory,
+                                      parallel_segments, maximum);
+        }
+
+        threads_.emplace_back(segment_video_transcode_thread_func,
+                              std::cref(segment),
+                              std::cref(stream_info_),
+                              p.encoded_video_packets.get());
+    } else if (run_video_) {
+        // 视频解码（CPU密集型）：codec_params传递独立副本，由解码线程释放
+        threads_.emplace_back(video_decode_to_frames_thread_func,
+                              p.raw_video_packets.get(),
+                              p.decoded_video_frames.get(),
+                              video_codec_params,
+                              core_budget.decode_threads,
+                              p.metrics.stage(PipelineStage::VIDEO_DECODE));
+
+        threads_.emplace_back(video_process_thread_func,
+                              p.decoded_video_frames.get(),
+                              p.processed_video_frames.get(),
+                              std::cref(p.process_params),
+                              stream_info_.video_width,
+                              stream_info_.video_height,
+                              stream_info_.video_pixel_format);
+
+        threads_.emplace_back(video_encode_thread_func_factory,
+                              p.processed_video_frames.get(),
+                              p.encoded_video_packets.get(),
+                              o.video_format,
+                              std::cref(p.video_encode_params));
+    }
+
+    TargetAudioFormat target_audio_format = kOutputAudioFormat;
+    if (run_audio_) {
+        threads_.emplace_back(audio_decode_to_frames_thread_func,
+                              p.raw_audio_packets.get(),
+                              p.decoded_audio_frames.get(),
+                              audio_codec_params,
+                              p.metrics.stage(PipelineStage::AUDIO_DECODE));
+
+        // 音频处理：SoundTouch变速不变调（WSOLA），与视频使用同一变速因子
+        p.audio_process_params.enable_speed_change = true;
+        p.audio_process_params.speed_factor = unified_speed_factor;
+        p.audio_process_params.volume_gain = 1.0;  // 音量保持不变
+        p.audio_process_params.metrics = p.metrics.stage(PipelineStage::AUDIO_PROCESS);
+
+        /**
+         * 格式协商：处理阶段直接输出编码器的原生格式/采样率/帧大小
+         * 解码格式(S16/S32/FLT/FLTP)在处理线程入口统一转换，编码端不再需要二次转换
+         */
+        AudioFormatSpec decoded_audio_spec;
+        decoded_audio_spec.sample_rate = stream_info_.audio_sample_rate;
+        decoded_audio_spec.channels = stream_info_.audio_channels;
+        decoded_audio_spec.sample_format = stream_info_.audio_sample_format;
+
+        AudioFormatSpec encoder_audio_spec = decoded_audio_spec;
+        int encoder_frame_size = 0;
+        if (!query_audio_encoder_native_format(target_audio_format, decoded_audio_spec,
+                                               encoder_audio_spec, encoder_frame_size)) {
+            std::cerr << "警告: 无法查询音频编码器原生格式，沿用输入参数" << std::endl;
+            encoder_audio_spec.sample_format = AV_SAMPLE_FMT_FLTP;
+        }
+
+        if (encoder_audio_spec.sample_rate != decoded_audio_spec.sample_rate ||
+            encoder_audio_spec.channels != decoded_audio_spec.channels) {
+            p.audio_process_params.enable_resample = true;
+            p.audio_process_params.target_sample_rate = encoder_audio_spec.sample_rate;
+            p.audio_process_params.target_channels = encoder_audio_spec.channels;
+        }
+        if (encoder_frame_size > 0) {
+            p.audio_process_params.output_frame_size = encoder_frame_size;
+        }
+
+        threads_.emplace_back(audio_process_thread_func,
+                              p.decoded_audio_frames.get(),
+                              p.processed_audio_frames.get(),
+                              std::cref(p.audio_process_params),
+                              stream_info_.audio_sample_rate,
+                              stream_info_.audio_channels,
+                              stream_info_.audio_sample_format);
+
+        p.audio_encode_params.sample_rate = encoder_audio_spec.sample_rate;
+        p.audio_encode_params.channels = encoder_audio_spec.channels;
+        p.audio_encode_params.sample_format = encoder_audio_spec.sample_format;
+        p.audio_encode_params.codec_id = kOutputAudioCodecId;
+        p.audio_encode_params.bitrate = 128000;
+        p.audio_encode_params.global_header = global_header;
+        p.audio_encode_params.parameters_out = &p.audio_stream_parameters;
+        p.audio_encode_params.metrics = p.metrics.stage(PipelineStage::AUDIO_ENCODE);
+
+        threads_.emplace_back(audio_encode_thread_func_factory,
+                              p.processed_audio_frames.get(),
+                              p.encoded_audio_packets.get(),
+                              target_audio_format,
+                              std::cref(p.audio_encode_params));
+    }
+
+    // 封装线程：队列为nullptr的流不会写入输出文件
+    MuxerParams& mux = p.mux_params;
+    mux.output_filename = output_filename;
+    mux.custom_output = o.custom_output;
+    mux.container = o.container;
+    mux.fragment_duration_ms = o.fragment_duration_ms;
+    mux.segment_duration_ms = o.segment_duration_ms;
+    mux.expected_duration = static_cast<int64_t>(stream_info_.duration / unified_speed_factor);
+    mux.async_output = !o.sync_output;
+    mux.output_writer.direct_io = o.direct_io;
+    if (o.preallocate) {
+        // 预计大小 = (视频+音频码率) × 时长；CRF模式以目标码率作估计，多估的空间在关闭时截断释放
+        int64_t total_bitrate = (run_video_ ? o.video_bitrate : 0) + (run_audio_ ? p.audio_encode_params.bitrate : 0);
+        mux.output_writer.preallocate_bytes = av_rescale(mux.expected_duration, total_bitrate / 8, AV_TIME_BASE);
+    }
+    mux.video_parameters = &p.video_stream_parameters;
+    mux.audio_parameters = &p.audio_stream_parameters;
+    mux.video_width = p.video_encode_params.width;
+    mux.video_height = p.video_encode_params.height;
+    mux.video_fps = p.video_encode_params.fps;
+    mux.video_codec_id = video_format_codec_id(o.video_format);
+    mux.audio_sample_rate = p.audio_encode_params.sample_rate;
+    mux.audio_channels = p.audio_encode_params.channels;
+    mux.audio_codec_id = kOutputAudioCodecId;
+    mux.stats = &p.mux_stats;
+    mux.metrics = p.metrics.stage(PipelineStage::MUX);
+
+    /**
+     * tee模式：分发线程把编码结果按引用计数复制给每个目标，每个目标一个封装线程
+     * 目标队列有界，慢目标只有在积压到上限后才会拖慢其他目标
+     */
+    if (o.tee_outputs.empty()) {
+        threads_.emplace_back(mux_thread_func,
+                              p.encoded_video_packets.get(),
+                              p.encoded_audio_packets.get(),
+                              std::cref(mux));
+    } else {
+        p.tee_mux_params.assign(o.tee_outputs.size() + 1, mux);
+        for (size_t i = 0; i < o.tee_outputs.size(); ++i) {
+            p.tee_mux_params[i + 1].output_filename = o.tee_outputs[i].c_str();
+            p.tee_mux_params[i + 1].container = p.tee_containers[i];
+            p.tee_mux_params[i + 1].stats = nullptr;  // 统计只反映主输出
+            p.tee_mux_params[i + 1].metrics = nullptr;
+        }
+        for (size_t i = 0; i < p.tee_mux_params.size(); ++i) {
+            p.tee_video_packets.emplace_back(run_video_ ? new EncodedVideoPacketQueue() : nullptr);
+            p.tee_audio_packets.emplace_back(run_audio_ ? new EncodedAudioPacketQueue() : nullptr);
+            TeeOutput output;
+            output.video_packet_queue = p.tee_video_packets.back().get();
+            output.audio_packet_queue = p.tee_audio_packets.back().get();
+            for (auto* queue : std::initializer_list<ThreadSafeQueue<AVPacket*>*>{
+                     output.video_packet_queue, output.audio_packet_queue}) {
+                if (queue) {
+                    queue->set_memory_gauge(&p.queue_memory);
+                }
+            }
+            p.tee_params.outputs.push_back(output);
+        }
+        threads_.emplace_back(tee_thread_func,
+                              p.encoded_video_packets.get(),
+                              p.encoded_audio_packets.get(),
+                              std::cref(p.tee_params));
+        for (size_t i = 0; i < p.tee_mux_params.size(); ++i) {
+            threads_.emplace_back(tee_mux_thread_func,
+                                  p.tee_video_packets[i].get(),
+                                  p.tee_audio_packets[i].get(),
+                                  std::cref(p.tee_mux_params[i]));
+        }
+    }
+
+    state_ = TranscodeJobState::RUNNING;
+    std::cout << "所有线程已启动（共" << threads_.size() << "个），等待完成..." << std::endl;
+    std::cout << "输出文件: " << (output_filename ? output_filename : "(回调输出)")
+              << " (" << output_container_format_name(o.container) << "格式"
+              << (run_video_ ? std::string("，") + avcodec_get_name(mux.video_codec_id) + "视频" : "")
+              << (run_audio_ ? "，AC3音轨" : "") << ")" << std::endl;
+    for (size_t i = 0; i < o.tee_outputs.size(); ++i) {
+        std::cout << "附加输出: " << o.tee_outputs[i] << " (" << output_container_format_name(p.tee_containers[i]) << "格式)" << std::endl;
+    }
+    std::cout << "变速倍数: " << unified_speed_factor << "x" << std::endl;
+
+    /**
+     * 自动调优：只调整解码→处理→编码之间的帧队列（解封装/封装两端的包队列保持无界，
+     * 否则封装线程按时间戳交错等待某一路时，另一路的背压会经解封装线程反过来卡住它）
+     * 初始容量约为1/4秒的视频帧或音频帧，上限取4倍
+     */
+    if (o.auto_tune) {
+        p.tuner.add_queue("video_frames", p.decoded_video_frames.get(),
+                          p.metrics.stage(PipelineStage::VIDEO_DECODE), p.metrics.stage(PipelineStage::VIDEO_PROCESS), 8, 64);
+        p.tuner.add_queue("processed_video", p.processed_video_frames.get(),
+                          p.metrics.stage(PipelineStage::VIDEO_PROCESS), p.metrics.stage(PipelineStage::VIDEO_ENCODE), 8, 64);
+        p.tuner.add_queue("audio_frames", p.decoded_audio_frames.get(),
+                          p.metrics.stage(PipelineStage::AUDIO_DECODE), p.metrics.stage(PipelineStage::AUDIO_PROCESS), 16, 128);
+        p.tuner.add_queue("processed_audio", p.processed_audio_frames.get(),
+                          p.metrics.stage(PipelineStage::AUDIO_PROCESS), p.metrics.stage(PipelineStage::AUDIO_ENCODE), 16, 128);
+
+        TunerParams tuner;
+        tuner.total_cores = core_budget.total_cores;
+        tuner.memory_budget_bytes = o.tune_memory_bytes;
+        if (tuner.memory_budget_bytes <= 0) {
+            int64_t frame_bytes = run_video_ ? static_cast<int64_t>(stream_info_.video_width) * stream_info_.video_height * 3 / 2 : 0;
+            tuner.memory_budget_bytes = 64 * frame_bytes + 64 * 1024 * 1024;
+        }
+        p.tuner.start(tuner);
+    }
+
+    if (o.progress || !o.progress_json_file.empty()) {
+        ProgressParams progress;
+        progress.interval_ms = o.progress_interval_ms;
+        progress.json_filename = o.progress_json_file;
+        progress_.start(*this, progress);
+    }
+    return true;
+}
+
+bool TranscodeJob::wait() {
+    for (auto& thread : threads_) {
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+    threads_.clear();
+    if (state_ != TranscodeJobState::RUNNING) {
+        return state_ == TranscodeJobState::FINISHED;
+    }
+    if (pipeline_) {
+        pipeline_->tuner.stop();
+    }
+    if (pipeline_ && !options_.trace_file.empty()) {
+        pipeline_->trace.write(options_.trace_file);  // 所有阶段线程已结束，缓冲不再变化
+    }
+    if (pipeline_ && options_.stage_report) {
+        std::cout << format_bottleneck_report(pipeline_->metrics);
+    }
+
+    end_time_us_ = now_us();
+    bool completed = pipeline_ && pipeline_->mux_stats.completed;
+    if (cancel_requested_) {
+        state_ = TranscodeJobState::CANCELLED;
+    } else {
+        state_ = completed ? TranscodeJobState::FINISHED : TranscodeJobState::FAILED;
+    }
+    progress_.stop();  // 最后一次报告带上最终状态
+    return state_ == TranscodeJobState::FINISHED;
+}
+
+void TranscodeJob::cancel() {
+    cancel_requested_ = true;
+}
+
+const PipelineMetrics* TranscodeJob::metrics() const {
+    return pipeline_ ? &pipeline_->metrics : nullptr;
+}
+
+TranscodeStats TranscodeJob::stats() const {
+    TranscodeStats stats;
+    stats.state = state_;
+    stats.input_duration = stream_info_.duration;
+    if (start_time_us_ > 0) {
+        int64_t end = end_time_us_ > 0 ? end_time_us_.load() : now_us();
+        stats.elapsed_seconds = (end - start_time_us_) / 1e6;
+    }
+    if (pipeline_) {
+        stats.output_time_us = pipeline_->mux_stats.output_time_us;
+        stats.video_packets = pipeline_->mux_stats.video_packets;
+        stats.audio_packets = pipeline_->mux_stats.audio_packets;
+        stats.bytes_written = pipeline_->mux_stats.bytes_written;
+
+        const Pipeline& p = *pipeline_;
+        auto add_queue = [&stats](const char* name, const auto& queue) {
+            if (queue) {
+                QueueStats entry;
+                entry.name = name;
+                entry.depth = queue->size();
+                entry.pushed = queue->pushed_count();
+                entry.bytes = queue->bytes();
+                entry.peak_bytes = queue->peak_bytes();
+                entry.capacity = queue->capacity();
+                stats.queues.push_back(entry);
+            }
+        };
+        add_queue("video_packets", p.raw_video_packets);
+        add_queue("video_frames", p.decoded_video_frames);
+        add_queue("processed_video", p.processed_video_frames);
+        add_queue("encoded_video", p.encoded_video_packets);
+        add_queue("audio_packets", p.raw_audio_packets);
+        add_queue("audio_frames", p.decoded_audio_frames);
+        add_queue("processed_audio", p.processed_audio_frames);
+        add_queue("encoded_audio", p.encoded_audio_packets);
+
+        stats.queued_bytes = p.queue_memory.current();
+        stats.peak_queued_bytes = p.queue_memory.peak();
+        for (int i = 0; i < kPipelineStageCount; ++i) {
+            const StageMetrics& stage = p.metrics.stages[i];
+            stats.scratch_bytes += stage.scratch.current();
+            stats.peak_scratch_bytes += stage.scratch.peak();
+        }
+    }
+    read_process_memory(stats.process_rss_bytes, stats.process_peak_rss_bytes);
+    return stats;
+}
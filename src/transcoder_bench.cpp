@@ -0,0 +1,337 @@
+/**
+ * 热点内核与队列的微基准 (transcoder_bench.cpp)
+ *
+ * 覆盖：
+ * - ThreadSafeQueue 在1/1、4/4生产者/消费者下的push/pop
+ * - AudioRingBuffer 写入一帧再读出一帧
+ * - video_filters::blur/sharpen/brightness_contrast 在720p/1080p/4K
+ * - AudioProcessor::create_output_frame 的交错→平面转换（分配帧 + deinterleave_float）
+ * - VideoProcessor 使用的sws_scale转换（缩放/格式、YUV→RGB、RGB→YUV，以及旋转路径中每帧新建上下文的开销）
+ *
+ * 每个基准先预热一次，然后重复若干轮，每轮循环至少min-time毫秒，报告各轮ns/次的中位数。
+ * 内核优化前后各运行一次并保存--json结果，即可得到可复现的对比数据。
+ *
+ * 用法: transcoder_bench [--filter=子串] [--min-time=毫秒] [--repeats=N] [--json=FILE]
+ */
+
+#include "audio_processor.h"
+#include "audio_resampler.h"
+#include "queue.h"
+#include "transcode_job.h"
+#include "video_processor.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct BenchOptions {
+    std::string filter;     // 只运行名称包含该子串的基准
+    int min_time_ms = 200;  // 每轮最短运行时间
+    int repeats = 5;        // 轮数（取中位数）
+    std::string json_filename;
+};
+
+struct BenchResult {
+    std::string name;
+    int64_t iterations = 0;       // 最后一轮的循环次数
+    double ns_per_item = 0.0;     // 中位数
+    double bytes_per_second = 0.0;
+};
+
+std::vector<BenchResult> g_results;
+volatile uint64_t g_sink = 0;  // 防止读出的结果被优化掉
+
+/**
+ * 运行一个基准：body每次处理items_per_op个条目（帧/样本块/队列元素），每个条目bytes_per_item字节
+ */
+void run_benchmark(const BenchOptions& options, const std::string& name, int64_t items_per_op,
+                   int64_t bytes_per_item, const std::function<void()>& body) {
+    if (!options.filter.empty() && name.find(options.filter) == std::string::npos) {
+        return;
+    }
+
+    body();  // 预热：分配缓冲、填充缓存
+
+    std::vector<double> round_ns;
+    int64_t iterations = 0;
+    for (int round = 0; round < options.repeats; ++round) {
+        iterations = 0;
+        auto start = std::chrono::steady_clock::now();
+        auto elapsed = std::chrono::steady_clock::duration::zero();
+        do {
+            body();
+            ++iterations;
+            elapsed = std::chrono::steady_clock::now() - start;
+        } while (elapsed < std::chrono::milliseconds(options.min_time_ms));
+        double ns = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+        round_ns.push_back(ns / (iterations * items_per_op));
+    }
+    std::sort(round_ns.begin(), round_ns.end());
+
+    BenchResult result;
+    result.name = name;
+    result.iterations = iterations;
+    result.ns_per_item = round_ns[round_ns.size() / 2];
+    result.bytes_per_second = bytes_per_item > 0 ? bytes_per_item * 1e9 / result.ns_per_item : 0.0;
+    g_results.push_back(result);
+
+    char line[256];
+    snprintf(line, sizeof(line), "%-44s %10lld %14.1f", name.c_str(),
+             static_cast<long long>(iterations), result.ns_per_item);
+    std::cout << line;
+    if (result.bytes_per_second > 0) {
+        snprintf(line, sizeof(line), " %10.1f MB/s", result.bytes_per_second / (1024.0 * 1024.0));
+        std::cout << line;
+    }
+    std::cout << std::endl;
+}
+
+// 确定性的伪随机画面：每次运行内容相同，结果可比较
+AVFrame* make_test_frame(int width, int height, AVPixelFormat format) {
+    AVFrame* frame = av_frame_alloc();
+    frame->format = format;
+    frame->width = width;
+    frame->height = height;
+    if (av_frame_get_buffer(frame, 32) < 0) {
+        av_frame_free(&frame);
+        return nullptr;
+    }
+    uint32_t state = 12345;
+    for (int plane = 0; plane < AV_NUM_DATA_POINTERS && frame->data[plane]; ++plane) {
+        int plane_height = (plane == 0 || format != AV_PIX_FMT_YUV420P) ? height : (height + 1) / 2;
+        for (int y = 0; y < plane_height; ++y) {
+            uint8_t* row = frame->data[plane] + y * frame->linesize[plane];
+            for (int x = 0; x < frame->linesize[plane]; ++x) {
+                state = state * 1664525u + 1013904223u;
+                row[x] = static_cast<uint8_t>(state >> 24);
+            }
+        }
+    }
+    return frame;
+}
+
+struct Resolution {
+    const char* name;
+    int width;
+    int height;
+};
+
+const Resolution kResolutions[] = {
+    {"720p", 1280, 720},
+    {"1080p", 1920, 1080},
+    {"4k", 3840, 2160},
+};
+
+void bench_queues(const BenchOptions& options) {
+    struct Contention {
+        const char* name;
+        int producers;
+        int consumers;
+    };
+    const Contention contentions[] = {{"1p1c", 1, 1}, {"4p4c", 4, 4}};
+    const int kItemsPerProducer = 50000;
+
+    for (const Contention& contention : contentions) {
+        int64_t total_items = static_cast<int64_t>(kItemsPerProducer) * contention.producers;
+        run_benchmark(options, std::string("queue/push_pop/") + contention.name, total_items, 0, [&]() {
+            ThreadSafeQueue<int> queue;
+            std::vector<std::thread> consumers;
+            std::vector<std::thread> producers;
+            for (int i = 0; i < contention.consumers; ++i) {
+                consumers.emplace_back([&queue]() {
+                    int value = 0;
+                    uint64_t sum = 0;
+                    while (queue.pop(value)) {
+                        sum += value;
+                    }
+                    g_sink += sum;
+                });
+            }
+            for (int i = 0; i < contention.producers; ++i) {
+                producers.emplace_back([&queue]() {
+                    for (int n = 0; n < kItemsPerProducer; ++n) {
+                        queue.push(n);
+                    }
+                });
+            }
+            for (auto& producer : producers) {
+                producer.join();
+            }
+            queue.finish();
+            for (auto& consumer : consumers) {
+                consumer.join();
+            }
+        });
+    }
+}
+
+void bench_audio(const BenchOptions& options) {
+    const int kFrameSize = 1536;  // AC3帧大小，与音频处理线程一致
+    const int kChannels = 2;
+    std::vector<float> samples(kFrameSize * kChannels);
+    for (size_t i = 0; i < samples.size(); ++i) {
+        samples[i] = static_cast<float>(i % 200) / 100.0f - 1.0f;
+    }
+
+    AudioRingBuffer ring(kFrameSize, kChannels, 48000);
+    std::vector<float> frame_samples(kFrameSize * kChannels);
+    run_benchmark(options, "audio/ring_buffer/write_read_1536x2", 1, samples.size() * sizeof(float), [&]() {
+        int actual_samples = 0;
+        ring.write_samples(samples.data(), kFrameSize);
+        ring.read_frame(frame_samples.data(), actual_samples);
+        g_sink += actual_samples;
+    });
+
+    // 与AudioProcessor::create_output_frame相同的步骤：分配FLTP帧并把交错样本拆成平面
+    run_benchmark(options, "audio/create_output_frame_1536x2", 1, samples.size() * sizeof(float), [&]() {
+        AVFrame* frame = av_frame_alloc();
+        frame->nb_samples = kFrameSize;
+        frame->format = AV_SAMPLE_FMT_FLTP;
+        av_channel_layout_default(&frame->ch_layout, kChannels);
+        frame->sample_rate = 48000;
+        if (av_frame_get_buffer(frame, 0) >= 0) {
+            audio_convert::deinterleave_float(samples.data(), reinterpret_cast<float* const*>(frame->extended_data),
+                                              kChannels, kFrameSize);
+            g_sink += frame->extended_data[1][kFrameSize - 1] > 0.0f;
+        }
+        av_frame_free(&frame);
+    });
+}
+
+void bench_filters(const BenchOptions& options) {
+    for (const Resolution& resolution : kResolutions) {
+        AVFrame* frame = make_test_frame(resolution.width, resolution.height, AV_PIX_FMT_YUV420P);
+        if (!frame) {
+            std::cerr << "错误: 无法分配测试帧 " << resolution.name << std::endl;
+            continue;
+        }
+        int64_t luma_bytes = static_cast<int64_t>(resolution.width) * resolution.height;
+        std::string suffix = std::string("/") + resolution.name;
+        run_benchmark(options, "filter/blur" + suffix, 1, luma_bytes, [&]() {
+            video_filters::blur(frame);
+        });
+        run_benchmark(options, "filter/sharpen" + suffix, 1, luma_bytes, [&]() {
+            video_filters::sharpen(frame);
+        });
+        run_benchmark(options, "filter/brightness_contrast" + suffix, 1, luma_bytes, [&]() {
+            video_filters::brightness_contrast(frame, 1.1f, 1.2f);
+        });
+        av_frame_free(&frame);
+    }
+}
+
+// VideoProcessor中的sws_scale：process_frame的YUV→YUV（同尺寸时即拷贝/缩放），旋转路径的YUV→RGB与RGB→YUV
+void bench_sws(const BenchOptions& options) {
+    for (const Resolution& resolution : kResolutions) {
+        int width = resolution.width;
+        int height = resolution.height;
+        AVFrame* yuv = make_test_frame(width, height, AV_PIX_FMT_YUV420P);
+        AVFrame* yuv_out = make_test_frame(width, height, AV_PIX_FMT_YUV420P);
+        AVFrame* yuv_720p = make_test_frame(1280, 720, AV_PIX_FMT_YUV420P);
+        AVFrame* rgb = make_test_frame(width, height, AV_PIX_FMT_RGB24);
+        if (!yuv || !yuv_out || !yuv_720p || !rgb) {
+            std::cerr << "错误: 无法分配测试帧 " << resolution.name << std::endl;
+            av_frame_free(&yuv);
+            av_frame_free(&yuv_out);
+            av_frame_free(&yuv_720p);
+            av_frame_free(&rgb);
+            continue;
+        }
+        int64_t yuv_bytes = static_cast<int64_t>(width) * height * 3 / 2;
+        std::string suffix = std::string("/") + resolution.name;
+
+        SwsContext* copy_ctx = sws_getContext(width, height, AV_PIX_FMT_YUV420P, width, height, AV_PIX_FMT_YUV420P,
+                                              SWS_BICUBIC, nullptr, nullptr, nullptr);
+        SwsContext* scale_ctx = sws_getContext(width, height, AV_PIX_FMT_YUV420P, 1280, 720, AV_PIX_FMT_YUV420P,
+                                               SWS_BICUBIC, nullptr, nullptr, nullptr);
+        SwsContext* to_rgb_ctx = sws_getContext(width, height, AV_PIX_FMT_YUV420P, width, height, AV_PIX_FMT_RGB24,
+                                                SWS_BICUBIC, nullptr, nullptr, nullptr);
+        SwsContext* to_yuv_ctx = sws_getContext(width, height, AV_PIX_FMT_RGB24, width, height, AV_PIX_FMT_YUV420P,
+                                                SWS_BICUBIC, nullptr, nullptr, nullptr);
+
+        run_benchmark(options, "sws/yuv420p_copy" + suffix, 1, yuv_bytes, [&]() {
+            sws_scale(copy_ctx, yuv->data, yuv->linesize, 0, height, yuv_out->data, yuv_out->linesize);
+        });
+        if (width != 1280) {
+            run_benchmark(options, "sws/yuv420p_scale_to_720p" + suffix, 1, yuv_bytes, [&]() {
+                sws_scale(scale_ctx, yuv->data, yuv->linesize, 0, height, yuv_720p->data, yuv_720p->linesize);
+            });
+        }
+        run_benchmark(options, "sws/yuv420p_to_rgb24" + suffix, 1, yuv_bytes, [&]() {
+            sws_scale(to_rgb_ctx, yuv->data, yuv->linesize, 0, height, rgb->data, rgb->linesize);
+        });
+        run_benchmark(options, "sws/rgb24_to_yuv420p" + suffix, 1, yuv_bytes, [&]() {
+            sws_scale(to_yuv_ctx, rgb->data, rgb->linesize, 0, height, yuv_out->data, yuv_out->linesize);
+        });
+        // 旋转路径当前每帧新建并释放RGB→YUV上下文，单独计量该开销
+        run_benchmark(options, "sws/rgb24_to_yuv420p_new_context" + suffix, 1, yuv_bytes, [&]() {
+            SwsContext* context = sws_getContext(width, height, AV_PIX_FMT_RGB24, width, height, AV_PIX_FMT_YUV420P,
+                                                 SWS_BICUBIC, nullptr, nullptr, nullptr);
+            sws_scale(context, rgb->data, rgb->linesize, 0, height, yuv_out->data, yuv_out->linesize);
+            sws_freeContext(context);
+        });
+
+        sws_freeContext(copy_ctx);
+        sws_freeContext(scale_ctx);
+        sws_freeContext(to_rgb_ctx);
+        sws_freeContext(to_yuv_ctx);
+        av_frame_free(&yuv);
+        av_frame_free(&yuv_out);
+        av_frame_free(&yuv_720p);
+        av_frame_free(&rgb);
+    }
+}
+
+bool write_json(const std::string& filename, const BenchOptions& options) {
+    FILE* file = fopen(filename.c_str(), "w");
+    if (!file) {
+        std::cerr << "错误: 无法写入结果文件 " << filename << std::endl;
+        return false;
+    }
+    fprintf(file, "{\"min_time_ms\":%d,\"repeats\":%d,\"hardware_threads\":%u,\"benchmarks\":[",
+            options.min_time_ms, options.repeats, std::thread::hardware_concurrency());
+    for (size_t i = 0; i < g_results.size(); ++i) {
+        const BenchResult& result = g_results[i];
+        fprintf(file, "%s\n{\"name\":\"%s\",\"iterations\":%lld,\"ns_per_item\":%.3f,\"bytes_per_second\":%.1f}",
+                i > 0 ? "," : "", result.name.c_str(), static_cast<long long>(result.iterations),
+                result.ns_per_item, result.bytes_per_second);
+    }
+    fputs("\n]}\n", file);
+    return fclose(file) == 0;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    CommandLine cmd = parse_command_line(std::vector<std::string>(argv + 1, argv + argc));
+    if (!cmd.positional.empty()) {
+        std::cerr << "用法: " << argv[0] << " [--filter=子串] [--min-time=毫秒] [--repeats=N] [--json=FILE]" << std::endl;
+        return -1;
+    }
+
+    BenchOptions options;
+    options.filter = cmd.get("filter", "");
+    options.min_time_ms = std::max(1, std::atoi(cmd.get("min-time", "200").c_str()));
+    options.repeats = std::max(1, std::atoi(cmd.get("repeats", "5").c_str()));
+    options.json_filename = cmd.get("json", "");
+
+    char header[256];
+    snprintf(header, sizeof(header), "%-44s %10s %14s %13s", "基准", "迭代", "ns/条目", "吞吐");
+    std::cout << header << std::endl;
+
+    bench_queues(options);
+    bench_audio(options);
+    bench_filters(options);
+    bench_sws(options);
+
+    if (!options.json_filename.empty() && !write_json(options.json_filename, options)) {
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,392 @@
+/**
+ * 端到端吞吐基准 (transcoder_e2e_bench.cpp)
+ *
+ * 1. 用FFmpeg的lavfi源（testsrc2 + sine）生成不同分辨率/编码/时长的合成输入，已存在则复用
+ * 2. 对每个输入运行配置矩阵（变速、滤镜、旋转、编码器、分段并行）
+ * 3. 每次运行在独立子进程中执行TranscodeJob：wait4取得该次运行的CPU时间与峰值RSS，互不干扰
+ * 4. 结果写JSON（每次运行一行）；指定--baseline时与基线比较，fps/CPU时间/峰值RSS变差超过阈值即报告回归并返回非0
+ *
+ * 用法: transcoder_e2e_bench [--work-dir=DIR] [--ffmpeg=PATH] [--filter=子串] [--quick]
+ *                            [--json=FILE] [--baseline=FILE] [--threshold=百分比] [--verbose]
+ */
+
+#include "transcode_job.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+
+// 合成输入
+struct InputSpec {
+    const char* name;
+    int width;
+    int height;
+    const char* encoder;   // ffmpeg -c:v
+    int duration_seconds;
+    bool quick;            // --quick时只运行这些输入
+};
+
+const InputSpec kInputs[] = {
+    {"480p_mpeg4_10s", 854, 480, "mpeg4", 10, false},
+    {"720p_h264_10s", 1280, 720, "libx264", 10, true},
+    {"1080p_h264_10s", 1920, 1080, "libx264", 10, false},
+    {"1080p_h264_30s", 1920, 1080, "libx264", 30, false},
+};
+
+// 运行配置：输入/输出之后的命令行参数（与EnhancedTranscoder相同）
+struct RunConfig {
+    const char* name;
+    const char* extension;  // 输出容器
+    const char* arguments;
+};
+
+const RunConfig kConfigs[] = {
+    {"baseline", "avi", "1.0"},
+    {"speed2x", "avi", "2.0"},
+    {"speed0.5x", "avi", "0.5"},
+    {"filters", "avi", "1.0 0 1 1 1 1.2 1.3"},
+    {"rotate90", "avi", "1.0 90"},
+    {"h264", "mp4", "1.0 --vcodec=h264 --preset=veryfast"},
+    {"h264_segments", "mp4", "1.0 --vcodec=h264 --preset=veryfast --segments=0"},
+};
+
+struct RunResult {
+    std::string name;
+    bool succeeded = false;
+    double elapsed_seconds = 0.0;
+    int64_t frames = 0;
+    double fps = 0.0;
+    double realtime = 0.0;        // 输入时长 / 墙钟时间
+    double cpu_user_seconds = 0.0;
+    double cpu_system_seconds = 0.0;
+    double peak_rss_mb = 0.0;
+};
+
+// 子进程通过管道回传的统计
+struct ChildReport {
+    int succeeded;
+    double elapsed_seconds;
+    int64_t frames;
+    int64_t input_duration;
+};
+
+bool file_exists(const std::string& filename) {
+    struct stat info;
+    return stat(filename.c_str(), &info) == 0 && info.st_size > 0;
+}
+
+std::vector<std::string> split_arguments(const std::string& text) {
+    std::vector<std::string> arguments;
+    std::istringstream stream(text);
+    std::string argument;
+    while (stream >> argument) {
+        arguments.push_back(argument);
+    }
+    return arguments;
+}
+
+bool generate_input(const std::string& ffmpeg, const InputSpec& spec, const std::string& filename) {
+    if (file_exists(filename)) {
+        return true;
+    }
+    char command[1024];
+    snprintf(command, sizeof(command),
+             "\"%s\" -hide_banner -loglevel error -y "
+             "-f lavfi -i testsrc2=size=%dx%d:rate=30:duration=%d "
+             "-f lavfi -i sine=frequency=440:sample_rate=48000:duration=%d "
+             "-c:v %s -g 60 -pix_fmt yuv420p %s -c:a aac -b:a 128k -shortest \"%s\"",
+             ffmpeg.c_str(), spec.width, spec.height, spec.duration_seconds, spec.duration_seconds,
+             spec.encoder, strcmp(spec.encoder, "libx264") == 0 ? "-preset veryfast" : "-q:v 3",
+             filename.c_str());
+    std::cout << "生成输入: " << filename << std::endl;
+    if (std::system(command) != 0 || !file_exists(filename)) {
+        std::cerr << "错误: 生成合成输入失败（需要带lavfi与libx264的ffmpeg）: " << filename << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// 子进程：运行一个任务并把统计写入管道
+void run_child(const CommandLine& cmd, int report_fd, bool verbose) {
+    if (!verbose) {
+        int null_fd = open("/dev/null", O_WRONLY);
+        dup2(null_fd, STDOUT_FILENO);
+        dup2(null_fd, STDERR_FILENO);
+        close(null_fd);
+    }
+
+    ChildReport report = {};
+    TranscodeOptions options;
+    if (transcode_options_from_command_line(cmd, options)) {
+        TranscodeJob job;
+        if (job.configure(options) && job.start()) {
+            report.succeeded = job.wait() ? 1 : 0;
+            TranscodeStats stats = job.stats();
+            report.elapsed_seconds = stats.elapsed_seconds;
+            report.frames = stats.video_packets;
+            report.input_duration = stats.input_duration;
+        }
+    }
+    transcoder_global_shutdown();
+    ssize_t written = write(report_fd, &report, sizeof(report));
+    _exit(written == sizeof(report) ? 0 : 1);
+}
+
+RunResult run_config(const std::string& name, const CommandLine& cmd, bool verbose) {
+    RunResult result;
+    result.name = name;
+
+    int pipe_fds[2];
+    if (pipe(pipe_fds) != 0) {
+        std::cerr << "错误: 无法创建管道: " << strerror(errno) << std::endl;
+        return result;
+    }
+    std::cout.flush();
+    pid_t pid = fork();
+    if (pid < 0) {
+        std::cerr << "错误: 无法创建子进程: " << strerror(errno) << std::endl;
+        close(pipe_fds[0]);
+        close(pipe_fds[1]);
+        return result;
+    }
+    if (pid == 0) {
+        close(pipe_fds[0]);
+        run_child(cmd, pipe_fds[1], verbose);
+    }
+    close(pipe_fds[1]);
+
+    ChildReport report = {};
+    size_t received = 0;
+    while (received < sizeof(report)) {
+        ssize_t n = read(pipe_fds[0], reinterpret_cast<char*>(&report) + received, sizeof(report) - received);
+        if (n <= 0) {
+            break;
+        }
+        received += static_cast<size_t>(n);
+    }
+    close(pipe_fds[0]);
+
+    int status = 0;
+    struct rusage usage = {};
+    wait4(pid, &status, 0, &usage);
+    if (received != sizeof(report) || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        return result;  // 子进程崩溃
+    }
+
+    result.succeeded = report.succeeded != 0;
+    result.elapsed_seconds = report.elapsed_seconds;
+    result.frames = report.frames;
+    if (report.elapsed_seconds > 0) {
+        result.fps = report.frames / report.elapsed_seconds;
+        result.realtime = report.input_duration / 1e6 / report.elapsed_seconds;
+    }
+    result.cpu_user_seconds = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6;
+    result.cpu_system_seconds = usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+    result.peak_rss_mb = usage.ru_maxrss / 1024.0;  // Linux下ru_maxrss单位为KB
+    return result;
+}
+
+std::string result_to_json(const RunResult& result) {
+    char line[512];
+    snprintf(line, sizeof(line),
+             "{\"name\":\"%s\",\"ok\":%s,\"elapsed\":%.3f,\"frames\":%lld,\"fps\":%.2f,\"realtime\":%.3f,"
+             "\"cpu_user\":%.3f,\"cpu_system\":%.3f,\"peak_rss_mb\":%.1f}",
+             result.name.c_str(), result.succeeded ? "true" : "false", result.elapsed_seconds,
+             static_cast<long long>(result.frames), result.fps, result.realtime,
+             result.cpu_user_seconds, result.cpu_system_seconds, result.peak_rss_mb);
+    return line;
+}
+
+// 从本程序写出的结果行中取数值字段
+double json_number(const std::string& line, const char* key) {
+    std::string pattern = std::string("\"") + key + "\":";
+    size_t position = line.find(pattern);
+    return position == std::string::npos ? 0.0 : std::atof(line.c_str() + position + pattern.size());
+}
+
+std::string json_string(const std::string& line, const char* key) {
+    std::string pattern = std::string("\"") + key + "\":\"";
+    size_t position = line.find(pattern);
+    if (position == std::string::npos) {
+        return "";
+    }
+    position += pattern.size();
+    return line.substr(position, line.find('"', position) - position);
+}
+
+bool load_baseline(const std::string& filename, std::map<std::string, RunResult>& baseline) {
+    std::ifstream file(filename);
+    if (!file) {
+        std::cerr << "错误: 无法读取基线 " << filename << std::endl;
+        return false;
+    }
+    std::string line;
+    while (std::getline(file, line)) {
+        std::string name = json_string(line, "name");
+        if (name.empty()) {
+            continue;
+        }
+        RunResult result;
+        result.name = name;
+        result.succeeded = line.find("\"ok\":true") != std::string::npos;
+        result.fps = json_number(line, "fps");
+        result.cpu_user_seconds = json_number(line, "cpu_user");
+        result.cpu_system_seconds = json_number(line, "cpu_system");
+        result.peak_rss_mb = json_number(line, "peak_rss_mb");
+        baseline[name] = result;
+    }
+    return true;
+}
+
+// 返回回归项数：fps下降、CPU时间或峰值RSS上升超过threshold_percent
+int compare_with_baseline(const std::vector<RunResult>& results, const std::map<std::string, RunResult>& baseline,
+                          double threshold_percent) {
+    int regressions = 0;
+    auto report = [&](const std::string& name, const char* metric, double before, double after, double change) {
+        char line[256];
+        snprintf(line, sizeof(line), "回归: %-36s %-10s %10.2f -> %10.2f (%+.1f%%)", name.c_str(), metric,
+                 before, after, change);
+        std::cout << line << std::endl;
+        ++regressions;
+    };
+
+    for (const RunResult& result : results) {
+        auto it = baseline.find(result.name);
+        if (it == baseline.end() || !it->second.succeeded) {
+            continue;  // 新增配置或基线中失败的配置不比较
+        }
+        const RunResult& before = it->second;
+        if (!result.succeeded) {
+            std::cout << "回归: " << result.name << " 基线成功，本次失败" << std::endl;
+            ++regressions;
+            continue;
+        }
+        if (before.fps > 0) {
+            double change = (result.fps - before.fps) * 100.0 / before.fps;
+            if (change < -threshold_percent) {
+                report(result.name, "fps", before.fps, result.fps, change);
+            }
+        }
+        double cpu_before = before.cpu_user_seconds + before.cpu_system_seconds;
+        double cpu_after = result.cpu_user_seconds + result.cpu_system_seconds;
+        if (cpu_before > 0) {
+            double change = (cpu_after - cpu_before) * 100.0 / cpu_before;
+            if (change > threshold_percent) {
+                report(result.name, "cpu", cpu_before, cpu_after, change);
+            }
+        }
+        if (before.peak_rss_mb > 0) {
+            double change = (result.peak_rss_mb - before.peak_rss_mb) * 100.0 / before.peak_rss_mb;
+            if (change > threshold_percent) {
+                report(result.name, "rss_mb", before.peak_rss_mb, result.peak_rss_mb, change);
+            }
+        }
+    }
+    return regressions;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    CommandLine cmd = parse_command_line(std::vector<std::string>(argv + 1, argv + argc));
+    if (!cmd.positional.empty()) {
+        std::cerr << "用法: " << argv[0] << " [--work-dir=DIR] [--ffmpeg=PATH] [--filter=子串] [--quick]"
+                  << " [--json=FILE] [--baseline=FILE] [--threshold=百分比] [--verbose]" << std::endl;
+        return -1;
+    }
+    std::string work_dir = cmd.get("work-dir", "bench_work");
+    std::string ffmpeg = cmd.get("ffmpeg", "ffmpeg");
+    std::string filter = cmd.get("filter", "");
+    std::string json_filename = cmd.get("json", "");
+    std::string baseline_filename = cmd.get("baseline", "");
+    double threshold_percent = std::atof(cmd.get("threshold", "10").c_str());
+    bool quick = cmd.has("quick");
+    bool verbose = cmd.has("verbose");
+
+    if (mkdir(work_dir.c_str(), 0755) != 0 && errno != EEXIST) {
+        std::cerr << "错误: 无法创建工作目录 " << work_dir << std::endl;
+        return -1;
+    }
+
+    std::map<std::string, RunResult> baseline;
+    if (!baseline_filename.empty() && !load_baseline(baseline_filename, baseline)) {
+        return -1;
+    }
+
+    char header[256];
+    snprintf(header, sizeof(header), "%-36s %8s %8s %9s %9s %9s", "配置", "fps", "×实时", "CPU(s)", "峰值RSS", "耗时(s)");
+    std::cout << header << std::endl;
+
+    std::vector<RunResult> results;
+    for (const InputSpec& input : kInputs) {
+        if (quick && !input.quick) {
+            continue;
+        }
+        std::string input_filename = work_dir + "/" + input.name + ".mp4";
+        bool input_ready = false;
+        for (const RunConfig& config : kConfigs) {
+            std::string name = std::string(input.name) + "/" + config.name;
+            if (!filter.empty() && name.find(filter) == std::string::npos) {
+                continue;
+            }
+            if (!input_ready && !(input_ready = generate_input(ffmpeg, input, input_filename))) {
+                break;
+            }
+
+            std::vector<std::string> arguments = {input_filename,
+                                                  work_dir + "/" + input.name + "_" + config.name + "." + config.extension};
+            for (const std::string& argument : split_arguments(config.arguments)) {
+                arguments.push_back(argument);
+            }
+            RunResult result = run_config(name, parse_command_line(arguments), verbose);
+            results.push_back(result);
+
+            char line[256];
+            if (result.succeeded) {
+                snprintf(line, sizeof(line), "%-36s %8.1f %8.2f %9.2f %7.1fMB %9.2f", name.c_str(), result.fps,
+                         result.realtime, result.cpu_user_seconds + result.cpu_system_seconds, result.peak_rss_mb,
+                         result.elapsed_seconds);
+            } else {
+                snprintf(line, sizeof(line), "%-36s 失败（--verbose查看转码日志）", name.c_str());
+            }
+            std::cout << line << std::endl;
+        }
+    }
+
+    if (!json_filename.empty()) {
+        std::ofstream file(json_filename);
+        file << "{\"runs\":[\n";
+        for (size_t i = 0; i < results.size(); ++i) {
+            file << result_to_json(results[i]) << (i + 1 < results.size() ? ",\n" : "\n");
+        }
+        file << "]}\n";
+        if (!file) {
+            std::cerr << "错误: 无法写入结果文件 " << json_filename << std::endl;
+            return -1;
+        }
+    }
+
+    int failed = static_cast<int>(std::count_if(results.begin(), results.end(),
+                                                [](const RunResult& result) { return !result.succeeded; }));
+    int regressions = baseline.empty() ? 0 : compare_with_baseline(results, baseline, threshold_percent);
+    if (!baseline.empty()) {
+        std::cout << "与基线比较（阈值" << threshold_percent << "%）: "
+                  << (regressions == 0 ? "无回归" : std::to_string(regressions) + "项回归") << std::endl;
+    }
+    return (failed > 0 || regressions > 0) ? 1 : 0;
+}
@@ -136,13 +136,16 @@ void video_decode_thread_func(VideoPacketQueue* video_packet_queue,
 // 新的解码到Frame队列函数（用于完整转码流程）
 void video_decode_to_frames_thread_func(VideoPacketQueue* video_packet_queue,
                                         VideoFrameQueue* video_frame_queue,
-                                        AVCodecParameters* codec_params) {
+                                        AVCodecParameters* codec_params,
+                                        int thread_count,
+                                        StageMetrics* metrics) {
     std::cout << "视频解码线程（输出到Frame队列）已启动。" << std::endl;
     
     const AVCodec* codec = avcodec_find_decoder(codec_params->codec_id);
     if (!codec) {
         std::cerr << "未找到视频解码器，ID: " << codec_params->codec_id << std::endl;
         avcodec_parameters_free(&codec_params);
+        video_frame_queue->finish();
         return;
     }
 
@@ -150,6 +153,7 @@ void video_decode_to_frames_thread_func(VideoPacketQueue* video_packet_queue,
     if (!codec_context) {
         std::cerr << "无法分配视频解码器上下文。" << std::endl;
         avcodec_parameters_free(&codec_params);
+        video_frame_queue->finish();
         return;
     }
 
@@ -157,13 +161,22 @@ void video_decode_to_frames_thread_func(VideoPacketQueue* video_packet_queue,
         std::cerr << "无法将解码参数复制到视频解码器上下文。" << std::endl;
         avcodec_free_context(&codec_context);
         avcodec_parameters_free(&codec_params);
+        video_frame_queue->finish();
         return;
     }
+    
+    // 多线程解码：帧级并行优先，解码器不支持时由libavcodec回退到条带并行
+    codec_context->thread_count = thread_count;
+    codec_context->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+#ifdef AV_CODEC_FLAG_COPY_OPAQUE
+    codec_context->flags |= AV_CODEC_FLAG_COPY_OPAQUE;  // 包的帧标识（时间线）带到对应的输出帧
+#endif
 
     if (avcodec_open2(codec_context, codec, nullptr) < 0) {
         std::cerr << "无法打开视频解码器。" << std::endl;
         avcodec_free_context(&codec_context);
         avcodec_parameters_free(&codec_params);
+        video_frame_queue->finish();
         return;
     }
 
@@ -172,43 +185,69 @@ void video_decode_to_frames_thread_func(VideoPacketQueue* video_packet_queue,
          std::cerr << "无法分配视频帧。" << std::endl;
          avcodec_free_context(&codec_context);
          avcodec_parameters_free(&codec_params);
+         video_frame_queue->finish();
          return;
     }
 
     int frame_count = 0;
+    StageRecorder recorder(metrics);
+    
+    // 取出解码器中所有可用的帧并转移到输出队列；下游已退出（队列已结束）时返回false
+    auto receive_frames = [&]() {
+        while (true) {
+            int ret = avcodec_receive_frame(codec_context, frame);
+            if (ret < 0) {
+                break;  // EAGAIN/EOF或解码错误
+            }
+            AVFrame* output_frame = av_frame_alloc();
+            if (!output_frame) {
+                av_frame_unref(frame);
+                continue;
+            }
+            av_frame_move_ref(output_frame, frame);
+            
+            if (!video_frame_queue->push(output_frame)) {
+                av_frame_free(&output_frame);
+                return false;
+            }
+            frame_count++;
+            recorder.output();
+        }
+        return true;
+    };
 
+    bool output_closed = false;
     while (true) {
         AVPacket* packet = nullptr;
         if (!video_packet_queue->pop(packet) || packet == nullptr) {
             break;
         }
+        recorder.begin(packet->size, trace_frame_id_from_opaque(packet->opaque));
 
         int ret = avcodec_send_packet(codec_context, packet);
         av_packet_free(&packet);
 
         if (ret < 0) {
+            recorder.drop();
+            recorder.end();
             continue;
         }
 
-        while (ret >= 0) {
-            ret = avcodec_receive_frame(codec_context, frame);
-            if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
-                break;
-            } else if (ret < 0) {
-                break;
-            }
-            AVFrame* output_frame = av_frame_alloc();
-            if (av_frame_ref(output_frame, frame) < 0) {
-                std::cerr << "无法复制视频帧。" << std::endl;
-                av_frame_free(&output_frame);
-                continue;
-            }
-            
-            video_frame_queue->push(output_frame);
-            frame_count++;
+        output_closed = !receive_frames();
+        recorder.end();
+        if (output_closed) {
+            break;
         }
     }
     
+    if (output_closed) {
+        video_packet_queue->finish();  // 下游已退出：结束输入队列，解封装线程不再送包
+    } else {
+        // 刷新解码器：取出B帧重排序与帧级多线程缓存的剩余帧
+        avcodec_send_packet(codec_context, nullptr);
+        receive_frames();
+    }
+    
     // 标记帧队列结束
     video_frame_queue->finish();
 
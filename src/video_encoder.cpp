@@ -1,157 +1,786 @@
 #include "video_encoder.h"
+#include "frame_analysis.h"
 #include <iostream>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <cmath>
 
 extern "C" {
 #include <libavcodec/avcodec.h>
 #include <libavutil/opt.h>
 #include <libavutil/imgutils.h>
+#include <libavutil/intreadwrite.h>
 }
 
-void video_encode_thread_func(VideoFrameQueue* video_frame_queue, 
-                              EncodedVideoPacketQueue* encoded_video_queue,
-                              const VideoEncoderParams& params) {
-    std::cout << "视频编码线程已启动，使用编码器: " << avcodec_get_name(params.codec_id) << std::endl;
+namespace {
+
+// x264/x265共用的预设名称，按VideoEncoderPreset顺序排列
+const char* const kX26xPresetNames[] = {
+    "ultrafast", "superfast", "veryfast", "faster", "fast",
+    "medium", "slow", "slower", "veryslow"
+};
+
+int preset_index(VideoEncoderPreset preset) {
+    return static_cast<int>(preset);
+}
+
+// libvpx/libaom的cpu-used：0最慢质量最高，8最快
+int preset_to_cpu_used(VideoEncoderPreset preset) {
+    static const int cpu_used[] = {8, 7, 6, 5, 4, 3, 2, 1, 0};
+    return cpu_used[preset_index(preset)];
+}
+
+// SVT-AV1的preset：0最慢，13最快
+int preset_to_svt_preset(VideoEncoderPreset preset) {
+    static const int svt_preset[] = {12, 11, 10, 9, 8, 7, 5, 4, 2};
+    return svt_preset[preset_index(preset)];
+}
+
+// 将0-51的CRF换算到VP9/AV1的0-63范围
+int crf_to_range63(int crf) {
+    int clamped = std::max(0, std::min(51, crf));
+    return (clamped * 63 + 25) / 51;
+}
+
+// 将0-51的CRF换算到MPEG4的qscale(2-31)
+int crf_to_qscale(int crf) {
+    int clamped = std::max(0, std::min(51, crf));
+    return 2 + (clamped * 29 + 25) / 51;
+}
+
+void dict_set_int(AVDictionary** options, const char* key, int value) {
+    av_dict_set(options, key, std::to_string(value).c_str(), 0);
+}
+
+// 追加"key=value"到x264-params/x265-params风格的冒号分隔参数串
+void append_codec_param(std::string& param_string, const char* key, int value) {
+    if (!param_string.empty()) {
+        param_string += ":";
+    }
+    param_string += key;
+    param_string += "=";
+    param_string += std::to_string(value);
+}
+
+// libvpx/libaom的tile-columns取log2值，每个tile列至少256像素宽
+int tile_columns_log2(int width, int threads) {
+    int log2 = 0;
+    while ((2 << log2) <= threads && (width >> (log2 + 1)) >= 256 && log2 < 6) {
+        ++log2;
+    }
+    return log2;
+}
+
+// 自适应码率的调整范围与触发阈值（相对当前生效比例变化超过10%才重新配置编码器）
+constexpr double kMinRateScale = 0.6;
+constexpr double kMaxRateScale = 1.4;
+constexpr double kRateScaleHysteresis = 0.1;
+
+} // namespace
+
+// =============== 通用FFmpeg视频编码器实现 ===============
+FFmpegVideoEncoder::~FFmpegVideoEncoder() {
+    if (packet_) {
+        av_packet_free(&packet_);
+    }
+    if (codec_context_) {
+        avcodec_free_context(&codec_context_);
+    }
+}
+
+const char* FFmpegVideoEncoder::get_encoder_name() const {
+    return codec_ ? codec_->name : avcodec_get_name(get_codec_id());
+}
+
+bool FFmpegVideoEncoder::initialize(const VideoEncoderParams& params) {
+    params_ = params;
+    params_.codec_id = get_codec_id();
     
-    // 查找编码器
-    const AVCodec* codec = avcodec_find_encoder(params.codec_id);
-    if (!codec) {
-        std::cerr << "未找到视频编码器，ID: " << params.codec_id << std::endl;
-        return;
+    // 按优先级查找可用的编码器实现
+    for (const char* name : candidate_encoders()) {
+        codec_ = avcodec_find_encoder_by_name(name);
+        if (codec_) {
+            break;
+        }
+    }
+    if (!codec_) {
+        std::cerr << "未找到视频编码器: " << avcodec_get_name(get_codec_id()) 
+                  << "（FFmpeg未编译对应的外部库）" << std::endl;
+        return false;
     }
 
     // 分配编码器上下文
-    AVCodecContext* codec_context = avcodec_alloc_context3(codec);
-    if (!codec_context) {
-        std::cerr << "无法分配视频编码器上下文。" << std::endl;
-        return;
+    codec_context_ = avcodec_alloc_context3(codec_);
+    if (!codec_context_) {
+        std::cerr << "无法分配视频编码器上下文: " << codec_->name << std::endl;
+        return false;
+    }
+
+    // 设置公共编码参数
+    codec_context_->bit_rate = params_.bitrate;
+    codec_context_->width = params_.width;
+    codec_context_->height = params_.height;
+    codec_context_->time_base = {1, params_.fps};
+    codec_context_->framerate = {params_.fps, 1};
+    codec_context_->gop_size = params_.gop_size;
+    if (params_.scene_cut_keyframes) {
+        // 关键帧由镜头切换决定，固定间隔只作为长镜头的上限（保证可寻址性）
+        codec_context_->gop_size = params_.max_gop_size > 0 ? params_.max_gop_size : params_.fps * 10;
+    }
+    codec_context_->max_b_frames = params_.low_latency ? 0 : params_.max_b_frames;
+    codec_context_->pix_fmt = params_.pixel_format;
+    
+    // 线程配置：libavcodec会在编码器不支持时忽略对应的线程类型
+    codec_context_->thread_count = params_.thread_count;
+    switch (params_.thread_type) {
+        case VideoThreadType::FRAME:
+            codec_context_->thread_type = FF_THREAD_FRAME;
+            break;
+        case VideoThreadType::SLICE:
+            codec_context_->thread_type = FF_THREAD_SLICE;
+            break;
+        default:
+            codec_context_->thread_type = params_.low_latency ? FF_THREAD_SLICE 
+                                                              : (FF_THREAD_FRAME | FF_THREAD_SLICE);
+            break;
+    }
+
+    if (params_.global_header) {
+        codec_context_->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+    }
+
+    // 两遍编码：首遍只做分析并写出统计，第二遍读取统计分配码率
+    if (params_.rate_control == VideoRateControl::TWO_PASS && params_.pass == 1) {
+        codec_context_->flags |= AV_CODEC_FLAG_PASS1;
+    } else if (params_.rate_control == VideoRateControl::TWO_PASS && params_.pass == 2) {
+        codec_context_->flags |= AV_CODEC_FLAG_PASS2;
+        if (stats_transport() != StatsTransport::ENCODER_FILE && !load_stats_in()) {
+            avcodec_free_context(&codec_context_);
+            return false;
+        }
     }
 
-    // 设置编码参数
-    codec_context->bit_rate = params.bitrate;
-    codec_context->width = params.width;
-    codec_context->height = params.height;
-    codec_context->time_base = {1, params.fps};
-    codec_context->framerate = {params.fps, 1};
-    codec_context->gop_size = params.gop_size;
-    codec_context->max_b_frames = params.max_b_frames;
-    codec_context->pix_fmt = params.pixel_format;
-
-    // 针对不同编码器的特殊设置
-    if (params.codec_id == AV_CODEC_ID_H264) {
-        av_opt_set(codec_context->priv_data, "preset", "fast", 0);
-        av_opt_set(codec_context->priv_data, "tune", "zerolatency", 0);
-    } else if (params.codec_id == AV_CODEC_ID_MPEG4) {
-        // MPEG4编码器设置
-        codec_context->qmin = 2;
-        codec_context->qmax = 31;
-        codec_context->qcompress = 0.6f;
-        // 设置MPEG4特有的选项
-        av_opt_set_int(codec_context, "mpeg_quant", 1, 0);
+    // 后端私有选项
+    AVDictionary* options = nullptr;
+    if (!configure_codec(&options)) {
+        av_dict_free(&options);
+        avcodec_free_context(&codec_context_);
+        return false;
     }
 
+#ifdef AV_CODEC_FLAG_COPY_OPAQUE
+    codec_context_->flags |= AV_CODEC_FLAG_COPY_OPAQUE;  // 帧标识（时间线）带到对应的输出包，B帧重排序后依然对应
+#endif
+
     // 打开编码器
-    if (avcodec_open2(codec_context, codec, nullptr) < 0) {
-        std::cerr << "无法打开视频编码器。" << std::endl;
-        avcodec_free_context(&codec_context);
-        return;
+    if (avcodec_open2(codec_context_, codec_, &options) < 0) {
+        std::cerr << "无法打开视频编码器: " << codec_->name << std::endl;
+        av_dict_free(&options);
+        avcodec_free_context(&codec_context_);
+        return false;
+    }
+    
+    // 未被编码器识别的选项
+    AVDictionaryEntry* entry = nullptr;
+    while ((entry = av_dict_get(options, "", entry, AV_DICT_IGNORE_SUFFIX))) {
+        std::cerr << "警告: 视频编码器 " << codec_->name << " 忽略选项 " 
+                  << entry->key << "=" << entry->value << std::endl;
     }
+    av_dict_free(&options);
 
-    AVPacket* packet = av_packet_alloc();
-    if (!packet) {
+    packet_ = av_packet_alloc();
+    if (!packet_) {
         std::cerr << "无法分配视频编码包。" << std::endl;
-        avcodec_free_context(&codec_context);
+        avcodec_free_context(&codec_context_);
+        return false;
+    }
+    
+    if (params_.parameters_out) {
+        params_.parameters_out->publish(codec_context_);
+    }
+
+    if (!params_.frame_stats_file.empty() && frame_stats_.open(params_.frame_stats_file)) {
+        std::cout << "逐帧编码统计输出到: " << params_.frame_stats_file << std::endl;
+    }
+
+    // 两遍编码已由首遍统计分配码率，不再叠加自适应调整
+    adaptive_rate_active_ = params_.adaptive_rate && params_.rate_control != VideoRateControl::TWO_PASS;
+    if (params_.adaptive_rate && !adaptive_rate_active_) {
+        std::cout << "两遍编码模式下忽略内容自适应码率" << std::endl;
+    }
+
+    std::cout << "视频编码器初始化成功: " << codec_->name << " " 
+              << params_.width << "x" << params_.height << " @ " << params_.fps << "fps, 预设: "
+              << kX26xPresetNames[preset_index(params_.preset)] << ", 线程: " 
+              << codec_context_->thread_count << ((codec_context_->active_thread_type & FF_THREAD_FRAME) ? "(帧)" : 
+                                                  (codec_context_->active_thread_type & FF_THREAD_SLICE) ? "(条带)" : "")
+              << ", ";
+    if (params_.rate_control == VideoRateControl::CRF) {
+        std::cout << "CRF " << params_.crf << std::endl;
+    } else if (params_.rate_control == VideoRateControl::TWO_PASS) {
+        std::cout << params_.bitrate << "bps, 两遍编码第" << params_.pass << "遍" << std::endl;
+    } else {
+        std::cout << params_.bitrate << "bps" << std::endl;
+    }
+    return true;
+}
+
+bool FFmpegVideoEncoder::encode_frame(AVFrame* frame, EncodedVideoPacketQueue* output_queue) {
+    if (adaptive_rate_active_ && frame) {
+        update_rate_from_analysis(frame);
+    }
+    if (params_.scene_cut_keyframes && frame) {
+        apply_scene_cut(frame);
+    }
+    prepare_frame(frame);
+    
+    if (frame_stats_.is_open() && frame) {
+        pending_frames_[frame->pts] = {std::chrono::steady_clock::now(), queue_wait_ms_};
+        queue_wait_ms_ = 0.0;
+    }
+    
+    // 发送帧给编码器
+    int ret = avcodec_send_frame(codec_context_, frame);
+    if (ret < 0) {
+        std::cerr << "发送帧到编码器时出错。" << std::endl;
+        return false;
+    }
+    
+    return receive_packets(output_queue);
+}
+
+bool FFmpegVideoEncoder::flush(EncodedVideoPacketQueue* output_queue) {
+    avcodec_send_frame(codec_context_, nullptr);
+    bool ok = receive_packets(output_queue);
+    
+    if (params_.scene_cut_keyframes) {
+        std::cout << "镜头切换强制关键帧: " << forced_keyframes_ << " 个" << std::endl;
+    }
+    if (frame_stats_.is_open()) {
+        std::cout << "逐帧编码统计: " << frame_stats_.records_written() << " 条" << std::endl;
+        frame_stats_.close();
+    }
+    
+    // 首遍结束：由本类负责落盘的统计在此写出（x264/x265在关闭编码器时自行写出）
+    if (codec_context_->flags & AV_CODEC_FLAG_PASS1) {
+        if (stats_transport() == StatsTransport::STATS_OUT_AT_FLUSH && codec_context_->stats_out) {
+            stats_out_ = codec_context_->stats_out;
+        }
+        if (stats_transport() != StatsTransport::ENCODER_FILE) {
+            ok = write_stats_out() && ok;
+        }
+    }
+    return ok;
+}
+
+void FFmpegVideoEncoder::update_rate_from_analysis(const AVFrame* frame) {
+    const FrameAnalysis* analysis = get_frame_analysis(frame);
+    if (!analysis) {
+        return;
+    }
+    
+    // 约1秒窗口的指数滑动平均，避免单帧突变引起码率抖动
+    double alpha = 2.0 / (std::max(1, params_.fps) + 1.0);
+    if (!has_complexity_) {
+        complexity_average_ = analysis->complexity;
+        has_complexity_ = true;
+    } else {
+        complexity_average_ += alpha * (analysis->complexity - complexity_average_);
+    }
+    
+    // 码率按复杂度的平方根变化（复杂度翻倍约提高40%码率）
+    double reference = params_.complexity_reference > 0.0 ? params_.complexity_reference : 1.0;
+    double scale = std::sqrt(std::max(0.0, complexity_average_) / reference);
+    scale = std::max(kMinRateScale, std::min(kMaxRateScale, scale));
+    if (std::fabs(scale - applied_rate_scale_) < kRateScaleHysteresis * applied_rate_scale_) {
+        return;
+    }
+    
+    if (!apply_rate_scale(scale)) {
+        std::cerr << "警告: 视频编码器 " << get_encoder_name() 
+                  << " 不支持运行时调整码率，忽略内容自适应码率" << std::endl;
+        adaptive_rate_active_ = false;
+        return;
+    }
+    applied_rate_scale_ = scale;
+}
+
+void FFmpegVideoEncoder::write_frame_stats(const AVPacket* packet) {
+    EncodedFrameStats stats;
+    stats.frame_index = output_frames_++;
+    stats.pts = packet->pts;
+    stats.dts = packet->dts;
+    stats.size = packet->size;
+    stats.keyframe = (packet->flags & AV_PKT_FLAG_KEY) != 0;
+    stats.frame_type = stats.keyframe ? 'I' : '?';
+    
+    // 编码器导出的质量信息：uint32 lambda + uint8 帧类型
+    size_t side_data_size = 0;
+    const uint8_t* quality = av_packet_get_side_data(packet, AV_PKT_DATA_QUALITY_STATS, &side_data_size);
+    if (quality && side_data_size >= 5) {
+        stats.average_qp = static_cast<float>(AV_RL32(quality)) / FF_QP2LAMBDA;
+        if (quality[4] != AV_PICTURE_TYPE_NONE) {
+            stats.frame_type = av_get_picture_type_char(static_cast<AVPictureType>(quality[4]));
+        }
+    }
+    
+    auto pending = pending_frames_.find(packet->pts);
+    if (pending != pending_frames_.end()) {
+        stats.encode_latency_ms = static_cast<float>(std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - pending->second.send_time).count());
+        stats.queue_wait_ms = static_cast<float>(pending->second.queue_wait_ms);
+        pending_frames_.erase(pending);
+    }
+    
+    frame_stats_.write(stats);
+}
+
+void FFmpegVideoEncoder::apply_scene_cut(AVFrame* frame) {
+    // 解码帧可能携带源流的帧类型，只保留镜头切换的决定，其余交给编码器自行安排
+    const FrameAnalysis* analysis = get_frame_analysis(frame);
+    if (analysis && analysis->scene_cut) {
+        frame->pict_type = AV_PICTURE_TYPE_I;
+        forced_keyframes_++;
+    } else {
+        frame->pict_type = AV_PICTURE_TYPE_NONE;
+    }
+}
+
+bool FFmpegVideoEncoder::load_stats_in() {
+    std::ifstream file(params_.stats_file, std::ios::binary);
+    if (!file) {
+        std::cerr << "错误: 无法读取首遍统计文件 " << params_.stats_file << std::endl;
+        return false;
+    }
+    std::ostringstream content;
+    content << file.rdbuf();
+    stats_in_ = content.str();
+    if (stats_in_.empty()) {
+        std::cerr << "错误: 首遍统计文件为空 " << params_.stats_file << std::endl;
+        return false;
+    }
+    codec_context_->stats_in = &stats_in_[0];
+    return true;
+}
+
+bool FFmpegVideoEncoder::write_stats_out() {
+    if (stats_out_.empty()) {
+        std::cerr << "错误: 首遍没有产生统计数据" << std::endl;
+        return false;
+    }
+    
+    // 先写临时文件再重命名，避免并发任务读到不完整的统计
+    std::string temp_file = params_.stats_file + ".temp";
+    {
+        std::ofstream file(temp_file, std::ios::binary | std::ios::trunc);
+        if (!file || !file.write(stats_out_.data(), stats_out_.size())) {
+            std::cerr << "错误: 无法写入首遍统计文件 " << temp_file << std::endl;
+            return false;
+        }
+    }
+    if (std::rename(temp_file.c_str(), params_.stats_file.c_str()) != 0) {
+        std::cerr << "错误: 无法重命名首遍统计文件 " << params_.stats_file << std::endl;
+        std::remove(temp_file.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool FFmpegVideoEncoder::receive_packets(EncodedVideoPacketQueue* output_queue) {
+    while (true) {
+        int ret = avcodec_receive_packet(codec_context_, packet_);
+        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+            return true;
+        } else if (ret < 0) {
+            std::cerr << "编码时出错。" << std::endl;
+            return false;
+        }
+
+        if (frame_stats_.is_open()) {
+            write_frame_stats(packet_);
+        }
+
+        // 转移包的所有权到输出队列
+        AVPacket* output_packet = av_packet_alloc();
+        if (!output_packet) {
+            av_packet_unref(packet_);
+            return false;
+        }
+        av_packet_move_ref(output_packet, packet_);
+        if (!output_queue->push(output_packet)) {
+            av_packet_free(&output_packet);  // 封装线程已退出
+            return false;
+        }
+        
+        if ((codec_context_->flags & AV_CODEC_FLAG_PASS1) && codec_context_->stats_out &&
+            stats_transport() == StatsTransport::STATS_OUT_PER_PACKET) {
+            stats_out_ += codec_context_->stats_out;
+        }
+    }
+}
+
+// =============== MPEG4编码器实现 ===============
+bool MPEG4VideoEncoder::configure_codec(AVDictionary** options) {
+    codec_context_->qmin = 2;
+    codec_context_->qmax = 31;
+    codec_context_->qcompress = 0.6f;
+    // 设置MPEG4特有的选项
+    av_opt_set_int(codec_context_, "mpeg_quant", 1, 0);
+    
+    // MPEG4只支持条带并行，线程数不能超过16且不能超过宏块行数
+    if (codec_context_->thread_count != 1) {
+        int mb_rows = (params_.width > 0) ? (params_.height + 15) / 16 : 1;
+        int threads = codec_context_->thread_count > 0 ? codec_context_->thread_count : 16;
+        codec_context_->thread_count = std::max(1, std::min(std::min(16, mb_rows), threads));
+        codec_context_->thread_type = FF_THREAD_SLICE;
+    }
+    
+    // MPEG4没有预设，慢速档位启用率失真宏块决策与网格量化
+    if (params_.preset >= VideoEncoderPreset::SLOW) {
+        av_dict_set(options, "mbd", "rd", 0);
+        av_dict_set(options, "trellis", "1", 0);
+    }
+    if (params_.preset >= VideoEncoderPreset::SLOWER) {
+        codec_context_->flags |= AV_CODEC_FLAG_4MV;
+    }
+    
+    // 恒定质量：固定量化qscale，需要逐帧设置frame->quality
+    if (params_.rate_control == VideoRateControl::CRF) {
+        codec_context_->flags |= AV_CODEC_FLAG_QSCALE;
+        codec_context_->global_quality = FF_QP2LAMBDA * crf_to_qscale(params_.crf);
+        codec_context_->bit_rate = 0;
+    }
+    base_quality_ = codec_context_->global_quality;
+    return true;
+}
+
+void MPEG4VideoEncoder::prepare_frame(AVFrame* frame) {
+    if (frame && (codec_context_->flags & AV_CODEC_FLAG_QSCALE)) {
+        frame->quality = codec_context_->global_quality;
+    }
+}
+
+bool MPEG4VideoEncoder::apply_rate_scale(double scale) {
+    // 平均码率模式下mpeg4的码率控制在打开后不可调整，只能调整固定量化
+    if (!(codec_context_->flags & AV_CODEC_FLAG_QSCALE) || scale <= 0.0) {
+        return false;
+    }
+    int quality = static_cast<int>(base_quality_ / scale + 0.5);
+    codec_context_->global_quality = std::max(2 * FF_QP2LAMBDA, std::min(31 * FF_QP2LAMBDA, quality));
+    return true;
+}
+
+// =============== H.264编码器实现 ===============
+bool H264VideoEncoder::configure_codec(AVDictionary** options) {
+    av_dict_set(options, "preset", kX26xPresetNames[preset_index(params_.preset)], 0);
+    if (params_.low_latency) {
+        av_dict_set(options, "tune", "zerolatency", 0);
+    }
+    if (params_.rate_control == VideoRateControl::CRF) {
+        dict_set_int(options, "crf", std::max(0, std::min(51, params_.crf)));
+        codec_context_->bit_rate = 0;
+    }
+    
+    // 强制的I帧编码为IDR（默认只是非IDR关键帧，分段器无法在此切分）
+    if (params_.scene_cut_keyframes) {
+        av_dict_set(options, "forced-idr", "1", 0);
+    }
+    
+    // 两遍编码：x264自行读写统计文件（另有.mbtree文件，使用同一路径前缀）
+    if (params_.rate_control == VideoRateControl::TWO_PASS && params_.pass > 0) {
+        av_dict_set(options, "stats", params_.stats_file.c_str(), 0);
+    }
+    
+    // thread_count/条带并行由libx264封装直接映射，前瞻线程需要通过x264-params传递
+    if (params_.lookahead_threads > 0) {
+        std::string x264_params;
+        append_codec_param(x264_params, "lookahead-threads", params_.lookahead_threads);
+        av_dict_set(options, "x264-params", x264_params.c_str(), 0);
+    }
+    return true;
+}
+
+bool H264VideoEncoder::apply_rate_scale(double scale) {
+    // libx264封装在每帧送入前比较bit_rate/crf，发生变化时调用x264_encoder_reconfig
+    if (params_.rate_control == VideoRateControl::CRF) {
+        double offset = std::max(-3.0, std::min(3.0, -3.0 * std::log2(scale)));
+        double crf = std::max(0.0, std::min(51.0, params_.crf + offset));
+        return av_opt_set_double(codec_context_->priv_data, "crf", crf, 0) >= 0;
+    }
+    codec_context_->bit_rate = static_cast<int64_t>(params_.bitrate * scale);
+    return true;
+}
+
+// =============== HEVC编码器实现 ===============
+bool HEVCVideoEncoder::configure_codec(AVDictionary** options) {
+    av_dict_set(options, "preset", kX26xPresetNames[preset_index(params_.preset)], 0);
+    if (params_.low_latency) {
+        av_dict_set(options, "tune", "zerolatency", 0);
+    }
+    if (params_.rate_control == VideoRateControl::CRF) {
+        dict_set_int(options, "crf", std::max(0, std::min(51, params_.crf)));
+        codec_context_->bit_rate = 0;
+    }
+    if (params_.scene_cut_keyframes) {
+        av_dict_set(options, "forced-idr", "1", 0);
+    }
+    
+    // libx265封装不读取thread_count，线程池与帧并行度通过x265-params传递
+    std::string x265_params = "log-level=error";
+    if (params_.thread_count > 0) {
+        append_codec_param(x265_params, "pools", params_.thread_count);
+        if (params_.thread_type == VideoThreadType::SLICE || params_.low_latency) {
+            append_codec_param(x265_params, "frame-threads", 1);
+        }
+    }
+    if (params_.lookahead_threads > 0) {
+        append_codec_param(x265_params, "lookahead-threads", params_.lookahead_threads);
+    }
+    if (params_.rate_control == VideoRateControl::TWO_PASS && params_.pass > 0) {
+        append_codec_param(x265_params, "pass", params_.pass);
+        x265_params += ":stats=" + params_.stats_file;
+    }
+    av_dict_set(options, "x265-params", x265_params.c_str(), 0);
+    return true;
+}
+
+// =============== VP9编码器实现 ===============
+bool VP9VideoEncoder::configure_codec(AVDictionary** options) {
+    av_dict_set(options, "deadline", params_.low_latency ? "realtime" : "good", 0);
+    dict_set_int(options, "cpu-used", preset_to_cpu_used(params_.preset));
+    av_dict_set(options, "row-mt", "1", 0);
+    if (params_.thread_count > 1) {
+        dict_set_int(options, "tile-columns", tile_columns_log2(params_.width, params_.thread_count));
+    }
+    if (params_.low_latency) {
+        av_dict_set(options, "lag-in-frames", "0", 0);
+    }
+    if (params_.rate_control == VideoRateControl::CRF) {
+        // VP9恒定质量模式要求码率为0
+        dict_set_int(options, "crf", crf_to_range63(params_.crf));
+        codec_context_->bit_rate = 0;
+    }
+    return true;
+}
+
+// =============== AV1编码器实现 ===============
+std::vector<const char*> AV1VideoEncoder::candidate_encoders() const {
+    // SVT-AV1的FFmpeg封装不支持两遍统计，两遍模式直接使用libaom
+    if (params_.rate_control == VideoRateControl::TWO_PASS) {
+        return {"libaom-av1"};
+    }
+    return {"libsvtav1", "libaom-av1"};
+}
+
+bool AV1VideoEncoder::configure_codec(AVDictionary** options) {
+    const bool svt = std::string(codec_->name) == "libsvtav1";
+    if (svt) {
+        dict_set_int(options, "preset", preset_to_svt_preset(params_.preset));
+        // SVT-AV1以逻辑处理器数限制线程池
+        if (params_.thread_count > 0) {
+            std::string svt_params;
+            append_codec_param(svt_params, "lp", params_.thread_count);
+            av_dict_set(options, "svtav1-params", svt_params.c_str(), 0);
+        }
+    } else {
+        dict_set_int(options, "cpu-used", preset_to_cpu_used(params_.preset));
+        av_dict_set(options, "row-mt", "1", 0);
+        if (params_.thread_count > 1) {
+            dict_set_int(options, "tile-columns", tile_columns_log2(params_.width, params_.thread_count));
+        }
+        if (params_.low_latency) {
+            av_dict_set(options, "usage", "realtime", 0);
+        }
+    }
+    if (params_.rate_control == VideoRateControl::CRF) {
+        dict_set_int(options, "crf", crf_to_range63(params_.crf));
+        codec_context_->bit_rate = 0;
+    }
+    return true;
+}
+
+// =============== 工厂与辅助函数 ===============
+std::unique_ptr<IVideoEncoder> create_video_encoder(TargetVideoFormat format) {
+    switch (format) {
+        case TargetVideoFormat::MPEG4:
+            return std::make_unique<MPEG4VideoEncoder>();
+        case TargetVideoFormat::H264:
+            return std::make_unique<H264VideoEncoder>();
+        case TargetVideoFormat::HEVC:
+            return std::make_unique<HEVCVideoEncoder>();
+        case TargetVideoFormat::VP9:
+            return std::make_unique<VP9VideoEncoder>();
+        case TargetVideoFormat::AV1:
+            return std::make_unique<AV1VideoEncoder>();
+        default:
+            std::cerr << "错误: 不支持的视频格式" << std::endl;
+            return nullptr;
+    }
+}
+
+AVCodecID video_format_codec_id(TargetVideoFormat format) {
+    switch (format) {
+        case TargetVideoFormat::MPEG4: return AV_CODEC_ID_MPEG4;
+        case TargetVideoFormat::H264:  return AV_CODEC_ID_H264;
+        case TargetVideoFormat::HEVC:  return AV_CODEC_ID_HEVC;
+        case TargetVideoFormat::VP9:   return AV_CODEC_ID_VP9;
+        case TargetVideoFormat::AV1:   return AV_CODEC_ID_AV1;
+        default:                       return AV_CODEC_ID_NONE;
+    }
+}
+
+bool video_format_from_codec_id(AVCodecID codec_id, TargetVideoFormat& format) {
+    switch (codec_id) {
+        case AV_CODEC_ID_MPEG4: format = TargetVideoFormat::MPEG4; return true;
+        case AV_CODEC_ID_H264:  format = TargetVideoFormat::H264;  return true;
+        case AV_CODEC_ID_HEVC:  format = TargetVideoFormat::HEVC;  return true;
+        case AV_CODEC_ID_VP9:   format = TargetVideoFormat::VP9;   return true;
+        case AV_CODEC_ID_AV1:   format = TargetVideoFormat::AV1;   return true;
+        default:                return false;
+    }
+}
+
+bool parse_video_format(const std::string& name, TargetVideoFormat& format) {
+    if (name == "mpeg4") {
+        format = TargetVideoFormat::MPEG4;
+    } else if (name == "h264" || name == "x264" || name == "avc") {
+        format = TargetVideoFormat::H264;
+    } else if (name == "hevc" || name == "h265" || name == "x265") {
+        format = TargetVideoFormat::HEVC;
+    } else if (name == "vp9") {
+        format = TargetVideoFormat::VP9;
+    } else if (name == "av1") {
+        format = TargetVideoFormat::AV1;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool parse_video_preset(const std::string& name, VideoEncoderPreset& preset) {
+    for (int i = 0; i <= preset_index(VideoEncoderPreset::VERYSLOW); ++i) {
+        if (name == kX26xPresetNames[i]) {
+            preset = static_cast<VideoEncoderPreset>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool video_format_supports_two_pass(TargetVideoFormat format) {
+    switch (format) {
+        case TargetVideoFormat::MPEG4: return avcodec_find_encoder_by_name("mpeg4") != nullptr;
+        case TargetVideoFormat::H264:  return avcodec_find_encoder_by_name("libx264") != nullptr;
+        case TargetVideoFormat::HEVC:  return avcodec_find_encoder_by_name("libx265") != nullptr;
+        case TargetVideoFormat::VP9:   return avcodec_find_encoder_by_name("libvpx-vp9") != nullptr;
+        case TargetVideoFormat::AV1:   return avcodec_find_encoder_by_name("libaom-av1") != nullptr;
+        default:                       return false;
+    }
+}
+
+// =============== 编码线程 ===============
+void video_encode_thread_func_factory(VideoFrameQueue* video_frame_queue, 
+                                      EncodedVideoPacketQueue* encoded_video_queue,
+                                      TargetVideoFormat target_format,
+                                      const VideoEncoderParams& params) {
+    std::cout << "视频编码线程（工厂模式）已启动" << std::endl;
+    
+    auto encoder = create_video_encoder(target_format);
+    if (!encoder || !encoder->initialize(params)) {
+        std::cerr << "错误: 视频编码器初始化失败" << std::endl;
+        // 仍然结束输出队列并发布空参数，避免封装线程永久等待；输入队列可能有界，同样结束
+        if (params.parameters_out) {
+            params.parameters_out->publish(nullptr);
+        }
+        video_frame_queue->finish();
+        encoded_video_queue->finish();
         return;
     }
+    
+    std::cout << "使用编码器: " << encoder->get_encoder_name() << std::endl;
 
     int frame_count = 0;
     int encoded_frames = 0;
     AVFrame* frame = nullptr;
 
-    // 主编码循环
+    // 主编码循环（记录每次出队的等待时间，写入逐帧统计）
+    StageRecorder recorder(params.metrics);
+    auto wait_begin = std::chrono::steady_clock::now();
     while (video_frame_queue->pop(frame)) {
         if (!frame) {
             break;
         }
+        recorder.begin(0, trace_frame_id_from_opaque(frame->opaque));
+        auto popped = std::chrono::steady_clock::now();
+        encoder->record_queue_wait(std::chrono::duration<double, std::milli>(popped - wait_begin).count());
 
         // 确保帧格式正确
-        if (frame->format != codec_context->pix_fmt) {
-            std::cerr << "警告: 帧格式不匹配，期望 " << codec_context->pix_fmt 
+        if (frame->format != params.pixel_format) {
+            std::cerr << "警告: 帧格式不匹配，期望 " << params.pixel_format 
                       << "，实际 " << frame->format << std::endl;
         }
 
-        // 设置正确的时间戳
-        frame->pts = frame_count;
-        frame->pkt_dts = AV_NOPTS_VALUE;
-        
         // 确保帧尺寸正确
-        if (frame->width != codec_context->width || frame->height != codec_context->height) {
+        if (frame->width != params.width || frame->height != params.height) {
             std::cerr << "错误: 帧尺寸不匹配" << std::endl;
             av_frame_free(&frame);
+            recorder.drop();
+            recorder.end();
+            wait_begin = std::chrono::steady_clock::now();
             continue;
         }
 
+        // 设置正确的时间戳
+        frame->pts = frame_count;
+        frame->pkt_dts = AV_NOPTS_VALUE;
         frame_count++;
 
-        // 发送帧给编码器
-        int ret = avcodec_send_frame(codec_context, frame);
-        av_frame_free(&frame);
-
-        if (ret < 0) {
-            std::cerr << "发送帧到编码器时出错。" << std::endl;
-            continue;
+        uint64_t pushed_before = encoded_video_queue->pushed_count();
+        if (encoder->encode_frame(frame, encoded_video_queue)) {
+            encoded_frames++;
         }
-
-        // 接收编码后的包
-        while (ret >= 0) {
-            ret = avcodec_receive_packet(codec_context, packet);
-            if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
-                break;
-            } else if (ret < 0) {
-                std::cerr << "编码时出错。" << std::endl;
-                break;
-            }
-
-            // 复制包并添加到输出队列
-            AVPacket* output_packet = av_packet_alloc();
-            if (output_packet && av_packet_ref(output_packet, packet) >= 0) {
-                encoded_video_queue->push(output_packet);
-                encoded_frames++;
-            }
-            
-            av_packet_unref(packet);
+        recorder.output(encoded_video_queue->pushed_count() - pushed_before);
+        av_frame_free(&frame);
+        recorder.end();
+        if (encoded_video_queue->is_finished()) {
+            break;  // 封装线程已退出，编码器已释放未送出的包
         }
+        wait_begin = std::chrono::steady_clock::now();
     }
 
-    // 刷新编码器
-    std::cout << "刷新视频编码器..." << std::endl;
-    avcodec_send_frame(codec_context, nullptr);
-    
-    int ret = 0;
-    while (ret >= 0) {
-        ret = avcodec_receive_packet(codec_context, packet);
-        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
-            break;
-        } else if (ret < 0) {
-            break;
-        }
+    video_frame_queue->finish();  // 提前退出循环时上游不会阻塞在有界队列上
 
-        AVPacket* output_packet = av_packet_alloc();
-        if (output_packet && av_packet_ref(output_packet, packet) >= 0) {
-            encoded_video_queue->push(output_packet);
-            encoded_frames++;
-        }
-        
-        av_packet_unref(packet);
+    // 刷新编码器（下游已退出时跳过）
+    if (!encoded_video_queue->is_finished()) {
+        std::cout << "刷新视频编码器 (" << encoder->get_encoder_name() << ")..." << std::endl;
+        uint64_t pushed_before_flush = encoded_video_queue->pushed_count();
+        encoder->flush(encoded_video_queue);
+        recorder.output(encoded_video_queue->pushed_count() - pushed_before_flush);
     }
 
     // 标记编码完成
     encoded_video_queue->finish();
-
-    // 清理资源
-    av_packet_free(&packet);
-    avcodec_free_context(&codec_context);
     
-    std::cout << "视频编码线程结束，编码了 " << encoded_frames << " 个包" << std::endl;
+    std::cout << "视频编码线程结束，使用 " << encoder->get_encoder_name() 
+              << " 编码了 " << encoded_frames << " 帧" << std::endl;
+}
+
+void video_encode_thread_func(VideoFrameQueue* video_frame_queue, 
+                              EncodedVideoPacketQueue* encoded_video_queue,
+                              const VideoEncoderParams& params) {
+    TargetVideoFormat format;
+    if (!video_format_from_codec_id(params.codec_id, format)) {
+        std::cerr << "未找到视频编码器，ID: " << params.codec_id << std::endl;
+        if (params.parameters_out) {
+            params.parameters_out->publish(nullptr);
+        }
+        video_frame_queue->finish();
+        encoded_video_queue->finish();
+        return;
+    }
+    video_encode_thread_func_factory(video_frame_queue, encoded_video_queue, format, params);
 }
 
 // 简化编码函数
@@ -166,4 +795,4 @@ void video_encode_thread_func_simple(VideoFrameQueue* video_frame_queue,
     params.bitrate = width * height * fps / 10;  // 基于分辨率的比特率估算
     
     video_encode_thread_func(video_frame_queue, encoded_video_queue, params);
-}
\ No newline at end of file
+}
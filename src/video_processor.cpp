@@ -89,10 +89,13 @@
  */
 
 #include "video_processor.h"
+#include "frame_analysis.h"
 #include <iostream>
 #include <cstring>
 #include <algorithm>
 #include <cmath>
+#include <mutex>
+#include <vector>
 
 extern "C" {
 #include <libavutil/imgutils.h>
@@ -105,6 +108,11 @@ extern "C" {
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+// 保护GLFW全局状态（初始化、窗口创建/销毁）
+static std::mutex g_glfw_mutex;
+// GLFW在进程内只初始化一次，由多个任务/处理器共享，进程退出前由video_processor_shutdown_gl释放
+static bool g_glfw_initialized = false;
+
 /**
  * =====================================================================================
  * GLSL着色器源码：GPU并行图像处理的核心算法
@@ -290,6 +298,10 @@ bool VideoProcessor::initialize(int input_width, int input_height,
                   << "，目标帧间隔: " << target_frame_interval_ << "秒" << std::endl;
     }
     
+    // 格式转换与旋转回读的缓冲在处理器存活期间一直持有
+    scratch_bytes_ = temp_buffer_size_ + rgb_buffer_size_;
+    track_scratch(scratch_bytes_);
+    
     initialized_ = true;
     std::cout << "视频处理器初始化成功: " << input_width_ << "x" << input_height_ 
               << " -> " << output_width_ << "x" << output_height_;
@@ -383,19 +395,27 @@ bool VideoProcessor::process_frame(AVFrame* input_frame, AVFrame* output_frame)
 
 // OpenGL上下文初始化
 bool VideoProcessor::init_opengl_context() {
-    // 初始化GLFW
-    if (!glfwInit()) {
-        std::cerr << "错误: 无法初始化GLFW" << std::endl;
-        return false;
+    {
+        // GLFW全局状态不是线程安全的，分段并行时多个处理器会同时创建上下文
+        std::lock_guard<std::mutex> lock(g_glfw_mutex);
+        
+        // 初始化GLFW（进程内首次使用时）
+        if (!g_glfw_initialized) {
+            if (!glfwInit()) {
+                std::cerr << "错误: 无法初始化GLFW" << std::endl;
+                return false;
+            }
+            g_glfw_initialized = true;
+        }
+        
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+        
+        // 创建窗口和OpenGL上下文
+        window_ = glfwCreateWindow(input_width_, input_height_, "Video Processor", nullptr, nullptr);
     }
-    
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
-    
-    // 创建窗口和OpenGL上下文
-    window_ = glfwCreateWindow(input_width_, input_height_, "Video Processor", nullptr, nullptr);
     if (!window_) {
         std::cerr << "错误: 无法创建GLFW窗口" << std::endl;
         return false;
@@ -529,6 +549,8 @@ void VideoProcessor::cleanup_opengl_context() {
     }
     
     if (window_) {
+        glfwMakeContextCurrent(nullptr);
+        std::lock_guard<std::mutex> lock(g_glfw_mutex);
         glfwDestroyWindow(window_);
         window_ = nullptr;
     }
@@ -545,6 +567,10 @@ bool VideoProcessor::rotate_frame_opengl(AVFrame* input_frame, AVFrame* output_f
     // 设置当前OpenGL上下文
     glfwMakeContextCurrent(window_);
     
+    TraceBuffer* trace = recorder_ ? recorder_->trace_buffer() : nullptr;
+    int64_t frame_id = recorder_ ? recorder_->frame_id() : kNoTraceFrameId;
+    TraceScope upload_span(trace, "gl_upload", frame_id);  // YUV→RGB与纹理上传
+    
     // 将YUV帧转换为RGB
     uint8_t* rgb_data[4];
     int rgb_linesize[4];
@@ -610,6 +636,8 @@ bool VideoProcessor::rotate_frame_opengl(AVFrame* input_frame, AVFrame* output_f
         std::cerr << "OpenGL旋转失败: 纹理上传错误 " << error << std::endl;
         return false;
     }
+    upload_span.end();
+    TraceScope draw_span(trace, "gl_draw", frame_id);
     
     // 设置纹理uniform
     GLint texture_location = glGetUniformLocation(shader_program_, "ourTexture");
@@ -641,6 +669,10 @@ bool VideoProcessor::rotate_frame_opengl(AVFrame* input_frame, AVFrame* output_f
     
     // 清理索引缓冲区
     glDeleteBuffers(1, &ebo);
+    draw_span.end();
+    
+    // 回读需要等待GPU完成绘制，RGB→YUV转换也计入回读
+    TraceScope readback_span(trace, "gl_readback", frame_id);
     
     // 读取渲染结果
     glReadPixels(0, 0, input_width_, input_height_, GL_RGB, GL_UNSIGNED_BYTE, rgb_buffer_);
@@ -734,7 +766,9 @@ GLuint VideoProcessor::create_program(const char* vertex_shader, const char* fra
     return program;
 }
 
-bool VideoProcessor::apply_grayscale(AVFrame* frame) {
+namespace video_filters {
+
+bool grayscale(AVFrame* frame) {
     if (frame->format != AV_PIX_FMT_YUV420P) {
         return true; // 只支持YUV420P格式
     }
@@ -747,7 +781,7 @@ bool VideoProcessor::apply_grayscale(AVFrame* frame) {
     return true;
 }
 
-bool VideoProcessor::apply_brightness_contrast(AVFrame* frame) {
+bool brightness_contrast(AVFrame* frame, float brightness, float contrast) {
     if (frame->format != AV_PIX_FMT_YUV420P) {
         return true;
     }
@@ -759,8 +793,8 @@ bool VideoProcessor::apply_brightness_contrast(AVFrame* frame) {
     for (int i = 0; i < y_size; i++) {
         float pixel = y_data[i];
         // 应用对比度和亮度调整
-        pixel = (pixel - 128) * params_.contrast + 128;
-        pixel = pixel * params_.brightness;
+        pixel = (pixel - 128) * contrast + 128;
+        pixel = pixel * brightness;
         
         // 限制在有效范围内
         y_data[i] = std::max(0, std::min(255, (int)pixel));
@@ -769,7 +803,7 @@ bool VideoProcessor::apply_brightness_contrast(AVFrame* frame) {
     return true;
 }
 
-bool VideoProcessor::apply_blur(AVFrame* frame) {
+bool blur(AVFrame* frame) {
     // 简单的3x3均值滤波器模糊效果
     if (frame->format != AV_PIX_FMT_YUV420P) {
         return true;
@@ -806,7 +840,7 @@ bool VideoProcessor::apply_blur(AVFrame* frame) {
     return true;
 }
 
-bool VideoProcessor::apply_sharpen(AVFrame* frame) {
+bool sharpen(AVFrame* frame) {
     // 锐化滤波器（拉普拉斯算子）
     if (frame->format != AV_PIX_FMT_YUV420P) {
         return true;
@@ -841,6 +875,33 @@ bool VideoProcessor::apply_sharpen(AVFrame* frame) {
     return true;
 }
 
+} // namespace video_filters
+
+bool VideoProcessor::apply_grayscale(AVFrame* frame) {
+    return video_filters::grayscale(frame);
+}
+
+bool VideoProcessor::apply_brightness_contrast(AVFrame* frame) {
+    return video_filters::brightness_contrast(frame, params_.brightness, params_.contrast);
+}
+
+// 模糊/锐化内核每帧复制一份Y平面作为输入，计入阶段临时缓冲（峰值可见）
+bool VideoProcessor::apply_blur(AVFrame* frame) {
+    int64_t copy_bytes = static_cast<int64_t>(frame->linesize[0]) * frame->height;
+    track_scratch(copy_bytes);
+    bool ok = video_filters::blur(frame);
+    track_scratch(-copy_bytes);
+    return ok;
+}
+
+bool VideoProcessor::apply_sharpen(AVFrame* frame) {
+    int64_t copy_bytes = static_cast<int64_t>(frame->linesize[0]) * frame->height;
+    track_scratch(copy_bytes);
+    bool ok = video_filters::sharpen(frame);
+    track_scratch(-copy_bytes);
+    return ok;
+}
+
 bool VideoProcessor::allocate_output_frame(AVFrame* frame, int width, int height, AVPixelFormat format) {
     // 安全地释放任何现有的引用，避免内存泄漏和双重释放
     av_frame_unref(frame);
@@ -881,9 +942,17 @@ void VideoProcessor::cleanup() {
         rgb_buffer_ = nullptr;
     }
     
+    track_scratch(-scratch_bytes_);
+    scratch_bytes_ = 0;
     initialized_ = false;
 }
 
+void VideoProcessor::track_scratch(int64_t delta) {
+    if (params_.metrics && delta != 0) {
+        params_.metrics->scratch.add(delta);
+    }
+}
+
 // 视频变速相关私有函数实现
 bool VideoProcessor::should_process_frame(int64_t frame_pts) {
     if (!speed_processing_enabled_) {
@@ -947,29 +1016,44 @@ void video_process_thread_func(VideoFrameQueue* input_queue,
     VideoProcessor processor;
     if (!processor.initialize(input_width, input_height, input_format, params)) {
         std::cerr << "错误: 视频处理器初始化失败" << std::endl;
+        input_queue->finish();  // 输入队列可能有界，结束它让解码线程不再阻塞
+        output_queue->finish();
         return;
     }
     
     AVFrame* input_frame = nullptr;
     int processed_frames = 0;
+    FrameAnalyzer analyzer;
+    StageRecorder recorder(params.metrics);
+    processor.set_recorder(&recorder);
     
     while (input_queue->pop(input_frame)) {
         if (!input_frame) {
             break;
         }
+        recorder.begin(0, trace_frame_id_from_opaque(input_frame->opaque));
         
         AVFrame* output_frame = av_frame_alloc();
         if (!output_frame) {
             av_frame_free(&input_frame);
+            recorder.drop();
+            recorder.end();
             continue;
         }
         
         if (processor.process_frame(input_frame, output_frame)) {
-            // process_frame已经生成了正确的线性PTS，无需重复计算
-            output_queue->push(output_frame);
-            processed_frames++;
+            output_frame->opaque = input_frame->opaque;  // 帧标识随输出帧（及其复制帧）传给编码器
+            // 复杂度分析与镜头切换检测基于最终输出画面（滤镜之后），复制帧随av_frame_ref共享同一结果
+            FrameAnalysis analysis;
+            if (params.enable_analysis || params.enable_scene_detection) {
+                analysis = analyzer.analyze(output_frame);
+                analysis.scene_cut = analysis.scene_cut && params.enable_scene_detection;
+                attach_frame_analysis(output_frame, analysis);
+            }
             
             // 如果启用了变速且需要复制帧（减速时）
+            // 复制帧必须在原帧入队之前创建：入队后原帧可能已被编码线程释放
+            std::vector<AVFrame*> duplicated_frames;
             if (params.enable_speed_change && params.speed_factor < 1.0) {
                 double duplicate_factor = 1.0 / params.speed_factor;
                 int duplicate_count = static_cast<int>(duplicate_factor) - 1;
@@ -982,9 +1066,13 @@ void video_process_thread_func(VideoFrameQueue* input_queue,
                         duplicated_frame->pts = processor.get_next_frame_pts();
                         duplicated_frame->pkt_dts = duplicated_frame->pts;
                         duplicated_frame->duration = 1;
-                        
-                        output_queue->push(duplicated_frame);
-                        processed_frames++;
+                        // 镜头切换只标记在第一帧上，复制帧不再触发关键帧
+                        if (analysis.scene_cut) {
+                            FrameAnalysis duplicated_analysis = analysis;
+                            duplicated_analysis.scene_cut = false;
+                            attach_frame_analysis(duplicated_frame, duplicated_analysis);
+                        }
+                        duplicated_frames.push_back(duplicated_frame);
                     } else {
                         if (duplicated_frame) {
                             av_frame_free(&duplicated_frame);
@@ -993,13 +1081,48 @@ void video_process_thread_func(VideoFrameQueue* input_queue,
                     }
                 }
             }
+            
+            // process_frame已经生成了正确的线性PTS，无需重复计算
+            // 下游已退出（队列已结束）时帧仍归本线程，释放全部未送出的帧后停止处理
+            bool output_closed = !output_queue->push(output_frame);
+            if (output_closed) {
+                av_frame_free(&output_frame);
+            } else {
+                processed_frames++;
+                recorder.output();
+            }
+            for (AVFrame* duplicated_frame : duplicated_frames) {
+                if (!output_closed && output_queue->push(duplicated_frame)) {
+                    processed_frames++;
+                    recorder.output();
+                } else {
+                    output_closed = true;
+                    av_frame_free(&duplicated_frame);
+                }
+            }
+            if (output_closed) {
+                av_frame_free(&input_frame);
+                recorder.end();
+                break;
+            }
         } else {
             av_frame_free(&output_frame);
+            recorder.drop();  // 加速丢帧或处理失败
         }
         
         av_frame_free(&input_frame);
+        recorder.end();
     }
     
+    input_queue->finish();  // 提前退出循环时上游不会阻塞在有界队列上
     output_queue->finish();
     std::cout << "视频处理线程结束, 处理了 " << processed_frames << " 帧" << std::endl;
 }
+
+void video_processor_shutdown_gl() {
+    std::lock_guard<std::mutex> lock(g_glfw_mutex);
+    if (g_glfw_initialized) {
+        glfwTerminate();
+        g_glfw_initialized = false;
+    }
+}